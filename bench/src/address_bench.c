@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "trigram_index.h"
+
+// Measures address substring searches through the trigram index against a scan with strstr().
+// usage: address_bench [EMPLOYEES]
+// build the library with 'make OPT=-O2 build build_bench' for representative numbers
+
+#define BENCH_ROUNDS 20
+
+
+double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t employees_size = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    const char *streets[] = { "Wallaby Way", "Easy St", "Sunny Ln", "Main St", "Harbour Rd", "King William St", "Elm Ave", "Queens Pde" };
+    const char *cities[] = { "Sydney", "New York", "Mobile", "Perth", "Boston", "Adelaide", "Denver", "Leeds" };
+    size_t street_count = sizeof(streets) / sizeof(streets[0]), city_count = sizeof(cities) / sizeof(cities[0]);
+
+    employee *employees = calloc(employees_size, sizeof(employee));
+    if (!employees)
+        return 1;
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        char address[64];
+        snprintf(address, sizeof(address), "%zu %s, %s", (i * 2654435761U) % 5000, streets[i % street_count], cities[(i / street_count) % city_count]);
+        employees[i].address = strdup(address);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    trigram_index idx;
+    if (trigram_index_build(&idx, employees, employees_size) == STATUS_ERROR)
+        return 1;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%zu employees, index built in %.1f ms, %zu trigrams\n", employees_size, elapsed_ms(&start, &end), idx.count);
+
+    const char *queries[] = { "4321 King", "Wallaby Way, Perth", "Leeds", "99 Elm" };
+    printf("%-24s %10s %12s %12s\n", "query", "matches", "index ms", "scan ms");
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++)
+    {
+        uint32_t *slots = NULL;
+        size_t slots_size = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < BENCH_ROUNDS; r++)
+        {
+            free(slots);
+            trigram_index_search(&idx, employees, employees_size, queries[q], &slots, &slots_size);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double index_ms = elapsed_ms(&start, &end) / BENCH_ROUNDS;
+        free(slots);
+
+        size_t matches = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < BENCH_ROUNDS; r++)
+        {
+            matches = 0;
+            for (size_t i = 0; i < employees_size; i++)
+                matches += strstr(employees[i].address, queries[q]) != NULL;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double scan_ms = elapsed_ms(&start, &end) / BENCH_ROUNDS;
+
+        if (matches != slots_size)
+            fprintf(stderr, "'%s': index found %zu matches, scan found %zu\n", queries[q], slots_size, matches);
+        printf("%-24s %10zu %12.3f %12.3f\n", queries[q], matches, index_ms, scan_ms);
+    }
+
+    free_trigram_index(&idx);
+    for (size_t i = 0; i < employees_size; i++)
+        free(employees[i].address);
+    free(employees);
+    return 0;
+}
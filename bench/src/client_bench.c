@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "db_client.h"
+#include "db_async.h"
+
+// Measures updates per second sent by one client process per update against one client process sending them all
+// as a batch over a single connection, and against calls to the client library, blocking and asynchronous, with
+// each protocol version.
+// usage: client_bench [OPS] [PORT]
+// run from the repository root after 'make OPT=-O2 build build_server build_client', the server is started on PORT
+
+#define BENCH_DB_FILE "/tmp/client_bench.db"
+#define BENCH_BATCH_FILE "/tmp/client_bench.batch"
+
+
+double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// runs a program with its output discarded, returns its pid or waits for it to exit when wait is set
+pid_t run(char **args, int wait)
+{
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        fprintf(stderr, "fork() failed: (%d) %s\n", errno, strerror(errno));
+        return -1;
+    }
+    if (pid == 0)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        execv(args[0], args);
+        _exit(127);
+    }
+    if (!wait)
+        return pid;
+
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "%s exited with an error\n", args[0]);
+        return -1;
+    }
+    return pid;
+}
+
+static void count_success(int status, const unsigned char *data, uint32_t data_len, void *arg)
+{
+    (void)data;
+    (void)data_len;
+    if (status == STATUS_SUCCESS)
+        (*(int *)arg)++;
+}
+
+int wait_for_server(int port)
+{
+    struct sockaddr_in addr = { .sin_family=AF_INET, .sin_port=htons(port) };
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    for (int i = 0; i < 100; i++)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int status = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+        close(fd);
+        if (status == 0)
+            return STATUS_SUCCESS;
+        usleep(20000);
+    }
+    return STATUS_ERROR;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t ops = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    char *port = argc > 2 ? argv[2] : "7399";
+
+    unlink(BENCH_DB_FILE);
+    char *server_args[] = { "bin/server", "-n", "-f", BENCH_DB_FILE, "-a", "127.0.0.1", "-p", port, "-v", "2", NULL };
+    pid_t server = run(server_args, 0);
+    if (server == -1 || wait_for_server(atoi(port)) == STATUS_ERROR)
+    {
+        fprintf(stderr, "unable to start bin/server\n");
+        return 1;
+    }
+
+    char *add_args[] = { "bin/client", "-h", "127.0.0.1", "-p", port, "-v", "2", "-a", "Bench Employee,1 Bench st.,0", NULL };
+    if (run(add_args, 1) == -1)
+        return 1;
+
+    FILE *batch = fopen(BENCH_BATCH_FILE, "w");
+    if (!batch)
+        return 1;
+    for (size_t i = 0; i < ops; i++)
+        fprintf(batch, "-u \"Bench Employee\" -n %zu\n", i);
+    fclose(batch);
+
+    printf("%zu updates\n", ops);
+    printf("%-32s %12s %12s\n", "pattern", "ms", "ops/s");
+    const char *versions[] = { "1", "2" };
+    for (size_t v = 0; v < 2; v++)
+    {
+        struct timespec start, end;
+        char hours[32];
+        char *update_args[] = { "bin/client", "-h", "127.0.0.1", "-p", port, "-v", (char *)versions[v], "-u", "Bench Employee", "-n", hours, NULL };
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < ops; i++)
+        {
+            snprintf(hours, sizeof(hours), "%zu", i);
+            if (run(update_args, 1) == -1)
+                return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double ms = elapsed_ms(&start, &end);
+        printf("v%s %-29s %12.1f %12.0f\n", versions[v], "process per update", ms, ops / (ms / 1e3));
+
+        char *batch_args[] = { "bin/client", "-h", "127.0.0.1", "-p", port, "-v", (char *)versions[v], "-b", BENCH_BATCH_FILE, NULL };
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (run(batch_args, 1) == -1)
+            return 1;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ms = elapsed_ms(&start, &end);
+        printf("v%s %-29s %12.1f %12.0f\n", versions[v], "batch over one connection", ms, ops / (ms / 1e3));
+
+        // a library call waits for its response, every update is a round trip on a connection kept open
+        db_client c;
+        if (db_client_connect(&c, "127.0.0.1", port, (uint16_t)atoi(versions[v]), 1) == STATUS_ERROR)
+            return 1;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < ops; i++)
+        {
+            if (db_client_update(&c, "Bench Employee", (uint32_t)i) != STATUS_SUCCESS)
+                return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        free_db_client(&c);
+        ms = elapsed_ms(&start, &end);
+        printf("v%s %-29s %12.1f %12.0f\n", versions[v], "library call per update", ms, ops / (ms / 1e3));
+
+        // one thread submits every update before waiting for any of them
+        db_async_client ac;
+        if (db_async_connect(&ac, "127.0.0.1", port, (uint16_t)atoi(versions[v]), 1) == STATUS_ERROR)
+            return 1;
+        int succeeded = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < ops; i++)
+        {
+            if (db_async_submit(&ac, &(db_client_request) { .option='u', .text="Bench Employee", .hours=(uint32_t)i }, count_success, &succeeded) == STATUS_ERROR)
+                return 1;
+        }
+        if (db_async_wait(&ac) == STATUS_ERROR || (size_t)succeeded != ops)
+            return 1;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        free_db_async_client(&ac);
+        ms = elapsed_ms(&start, &end);
+        printf("v%s %-29s %12.1f %12.0f\n", versions[v], "async, all in flight", ms, ops / (ms / 1e3));
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_BATCH_FILE);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "serialize.h"
+
+// Compares file size, checkpoint time and load time of plain and block compressed database files.
+// usage: compress_bench [EMPLOYEES] [FILE]
+// build the library with 'make OPT=-O2 build build_bench' for representative numbers
+
+
+double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void free_employees(employee *employees, size_t employees_size)
+{
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        free(employees[i].name);
+        free(employees[i].address);
+    }
+    free(employees);
+}
+
+int time_load(char *fname, size_t nthreads, double *ms)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1)
+    {
+        fprintf(stderr, "unable to open file '%s': (%d) %s\n", fname, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    db_header dbhdr;
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    if (read_dbhdr(fd, &dbhdr) == STATUS_ERROR || read_db_sections(fd, &dbhdr, sections, &section_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    employee *employees = malloc(dbhdr.employee_count * sizeof(employee));
+    int status = read_employees_parallel(fd, &dbhdr, sections, section_count, employees, NULL, nthreads);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *ms = elapsed_ms(&start, &end);
+
+    free_employees(employees, dbhdr.employee_count);
+    close(fd);
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t employees_size = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    char *fname = argc > 2 ? argv[2] : "bench/compress_bench.bin";
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = nprocs > 0 ? (size_t)nprocs : 1;
+
+    employee *employees = malloc(employees_size * sizeof(employee));
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        char name[64], address[64];
+        snprintf(name, sizeof(name), "Employee %zu", i);
+        snprintf(address, sizeof(address), "%zu Wallaby Way, Sydney", i % 997);
+        employees[i].name = strdup(name);
+        employees[i].address = strdup(address);
+        employees[i].hours = i % 200;
+    }
+
+    printf("employees: %zu, online cores: %ld\n", employees_size, nprocs);
+    printf("%-12s %12s %16s %-10s %12s %14s\n", "format", "size (MB)", "checkpoint (ms)", "threads", "load (ms)", "read (MB/s)");
+
+    int formats[] = { 0, DB_CHECKPOINT_COMPRESSED, DB_CHECKPOINT_COMPRESSED | DB_CHECKPOINT_ADDRESS_DICTIONARY };
+    const char *names[] = { "plain", "blocks", "blocks+dict" };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+    {
+        int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1)
+        {
+            fprintf(stderr, "unable to open file '%s': (%d) %s\n", fname, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+
+        struct timespec start, end;
+        db_header dbhdr = { .fsize=sizeof(db_header), .employee_count=employees_size };
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (checkpoint_db(fd, &dbhdr, employees, formats[f]) == STATUS_ERROR)
+        {
+            fprintf(stderr, "checkpoint_db() failed\n");
+            return STATUS_ERROR;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double checkpoint_ms = elapsed_ms(&start, &end);
+        close(fd);
+
+        // warm the page cache so every run measures decoding rather than the disk
+        double ms;
+        if (time_load(fname, 1, &ms) == STATUS_ERROR)
+            return STATUS_ERROR;
+
+        // the rate at which file bytes are consumed, to compare against the bandwidth of the disk
+        double size_mb = dbhdr.fsize / 1e6;
+        for (size_t nthreads = 1; nthreads <= max_threads; nthreads *= 2)
+        {
+            if (time_load(fname, nthreads, &ms) == STATUS_ERROR)
+            {
+                fprintf(stderr, "time_load() failed\n");
+                return STATUS_ERROR;
+            }
+            printf("%-12s %12.1f %16.1f %-10zu %12.1f %14.0f\n", names[f], size_mb, checkpoint_ms, nthreads, ms, size_mb / (ms / 1e3));
+        }
+    }
+
+    free_employees(employees, employees_size);
+    unlink(fname);
+    return STATUS_SUCCESS;
+}
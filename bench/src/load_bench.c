@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "serialize.h"
+#include "db.h"
+#include "shard.h"
+
+// Measures startup load time of a database file against the number of loader threads,
+// then the time until a database is ready for requests when loaded in full, lazily or from a snapshot,
+// and the load and checkpoint times of a database partitioned across a number of shards.
+// usage: load_bench [EMPLOYEES] [FILE]
+// build the library with 'make OPT=-O2 build build_bench' for representative numbers
+
+
+double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void free_employees(employee *employees, size_t employees_size)
+{
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        free(employees[i].name);
+        free(employees[i].address);
+    }
+    free(employees);
+}
+
+int create_bench_file(char *fname, size_t employees_size, int checkpoint_flags)
+{
+    int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+    {
+        fprintf(stderr, "unable to open file '%s': (%d) %s\n", fname, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    employee *employees = malloc(employees_size * sizeof(employee));
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        char name[64], address[64];
+        snprintf(name, sizeof(name), "Employee %zu", i);
+        snprintf(address, sizeof(address), "%zu Wallaby Way, Sydney", i % 997);
+        employees[i].name = strdup(name);
+        employees[i].address = strdup(address);
+        employees[i].hours = i % 200;
+    }
+
+    db_header dbhdr = { .fsize=sizeof(db_header), .employee_count=employees_size };
+    int status = checkpoint_db(fd, &dbhdr, employees, checkpoint_flags);
+    free_employees(employees, employees_size);
+    close(fd);
+    return status;
+}
+
+int time_load(char *fname, size_t nthreads, double *ms)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1)
+    {
+        fprintf(stderr, "unable to open file '%s': (%d) %s\n", fname, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    db_header dbhdr;
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    if (read_dbhdr(fd, &dbhdr) == STATUS_ERROR || read_db_sections(fd, &dbhdr, sections, &section_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    employee *employees = malloc(dbhdr.employee_count * sizeof(employee));
+    int status;
+    if (nthreads == 0)
+        status = read_employees(fd, &employees, dbhdr.employee_count);
+    else
+        status = read_employees_parallel(fd, &dbhdr, sections, section_count, employees, NULL, nthreads);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *ms = elapsed_ms(&start, &end);
+
+    free_employees(employees, dbhdr.employee_count);
+    close(fd);
+    return status;
+}
+
+typedef enum {
+    LOAD_EAGER,
+    LOAD_LAZY,
+    LOAD_SNAPSHOT,
+} load_mode;
+
+// time until the database is ready for requests, every record decoded, none, or mapped from a snapshot
+int time_db_load(char *fname, load_mode mode, char *snapshot, double *ms)
+{
+    int fd = open(fname, O_RDWR);
+    if (fd == -1)
+    {
+        fprintf(stderr, "unable to open file '%s': (%d) %s\n", fname, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    database db;
+    int status;
+    if (mode == LOAD_SNAPSHOT)
+        status = db_load_snapshot(&db, fd, 0, snapshot);
+    else if (mode == LOAD_LAZY)
+        status = db_load_lazy(&db, fd, 0, 0);
+    else
+        status = db_load(&db, fd, 0, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *ms = elapsed_ms(&start, &end);
+
+    if (status == STATUS_SUCCESS)
+        free_database(&db);
+    close(fd);
+    return status;
+}
+
+int create_snapshot(char *fname, char *snapshot)
+{
+    int fd = open(fname, O_RDWR);
+    if (fd == -1)
+    {
+        fprintf(stderr, "unable to open file '%s': (%d) %s\n", fname, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    database db;
+    int status = db_load(&db, fd, 0, 0);
+    if (status == STATUS_SUCCESS)
+    {
+        status = db_write_snapshot(&db, snapshot);
+        free_database(&db);
+    }
+    close(fd);
+    return status;
+}
+
+// partitions the employees of a bench file between the files of shard_count shards
+int create_shard_files(char *fname, size_t employees_size, size_t shard_count)
+{
+    employee *employees = malloc(employees_size * sizeof(employee));
+    employee *shard_employees = malloc(employees_size * sizeof(employee));
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        char name[64], address[64];
+        snprintf(name, sizeof(name), "Employee %zu", i);
+        snprintf(address, sizeof(address), "%zu Wallaby Way, Sydney", i % 997);
+        employees[i].name = strdup(name);
+        employees[i].address = strdup(address);
+        employees[i].hours = i % 200;
+    }
+
+    int status = STATUS_SUCCESS;
+    for (size_t shard = 0; shard < shard_count && status == STATUS_SUCCESS; shard++)
+    {
+        db_header dbhdr = { .fsize=sizeof(db_header), .employee_count=0 };
+        for (size_t i = 0; i < employees_size; i++)
+        {
+            if (db_shard_of(employees[i].name, shard_count) == shard)
+                shard_employees[dbhdr.employee_count++] = employees[i];
+        }
+
+        char path[256];
+        if (shard_count == 1)
+            snprintf(path, sizeof(path), "%s", fname);
+        else
+            snprintf(path, sizeof(path), "%s.%zu", fname, shard);
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1)
+        {
+            fprintf(stderr, "unable to open file '%s': (%d) %s\n", path, errno, strerror(errno));
+            status = STATUS_ERROR;
+            break;
+        }
+        status = checkpoint_db(fd, &dbhdr, shard_employees, DB_CHECKPOINT_OFFSETS | DB_CHECKPOINT_NAME_INDEX);
+        close(fd);
+    }
+
+    free(shard_employees);
+    free_employees(employees, employees_size);
+    return status;
+}
+
+// time until every shard is loaded, and to checkpoint one of them after a write
+int time_shards(char *fname, size_t shard_count, double *load_ms, double *checkpoint_ms)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    db_shard_options options = { .checkpoint_flags=DB_CHECKPOINT_OFFSETS | DB_CHECKPOINT_NAME_INDEX };
+    db_shards s;
+    if (db_shards_open(&s, fname, shard_count, false, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *load_ms = elapsed_ms(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int status = db_checkpoint(s.dbs);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *checkpoint_ms = elapsed_ms(&start, &end);
+
+    free_db_shards(&s);
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t employees_size = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    char *fname = argc > 2 ? argv[2] : "bench/load_bench.bin";
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = nprocs > 0 ? 2 * (size_t)nprocs : 2;
+
+    printf("employees: %zu, online cores: %ld\n", employees_size, nprocs);
+    printf("%-12s %-10s %12s\n", "directory", "threads", "load (ms)");
+
+    for (int with_directory = 0; with_directory < 2; with_directory++)
+    {
+        if (create_bench_file(fname, employees_size, with_directory ? DB_CHECKPOINT_OFFSETS : 0) == STATUS_ERROR)
+        {
+            fprintf(stderr, "create_bench_file() failed\n");
+            return STATUS_ERROR;
+        }
+
+        // warm the page cache so every run measures decoding rather than the disk
+        double ms;
+        if (time_load(fname, 1, &ms) == STATUS_ERROR)
+            return STATUS_ERROR;
+
+        if (!with_directory)
+        {
+            if (time_load(fname, 0, &ms) == STATUS_ERROR)
+                return STATUS_ERROR;
+            printf("%-12s %-10s %12.1f\n", "no", "serial", ms);
+        }
+
+        for (size_t nthreads = 1; nthreads <= max_threads; nthreads *= 2)
+        {
+            if (time_load(fname, nthreads, &ms) == STATUS_ERROR)
+            {
+                fprintf(stderr, "time_load() failed\n");
+                return STATUS_ERROR;
+            }
+            printf("%-12s %-10zu %12.1f\n", with_directory ? "yes" : "no", nthreads, ms);
+        }
+    }
+
+    // lazy loading reads the offset directory and maps the name index, the records are left alone,
+    // a snapshot is checked against its checksum and its tables copied or pointed into
+    char snapshot[256];
+    snprintf(snapshot, sizeof(snapshot), "%s.snap", fname);
+    printf("\n%-12s %12s %12s %14s\n", "employees", "eager (ms)", "lazy (ms)", "snapshot (ms)");
+    for (size_t size = employees_size / 100 ? employees_size / 100 : 1; size <= employees_size; size *= 10)
+    {
+        if (create_bench_file(fname, size, DB_CHECKPOINT_OFFSETS | DB_CHECKPOINT_NAME_INDEX) == STATUS_ERROR)
+        {
+            fprintf(stderr, "create_bench_file() failed\n");
+            return STATUS_ERROR;
+        }
+
+        double eager_ms, lazy_ms, snapshot_ms;
+        if (create_snapshot(fname, snapshot) == STATUS_ERROR ||
+            time_db_load(fname, LOAD_EAGER, snapshot, &eager_ms) == STATUS_ERROR ||
+            time_db_load(fname, LOAD_LAZY, snapshot, &lazy_ms) == STATUS_ERROR ||
+            time_db_load(fname, LOAD_SNAPSHOT, snapshot, &snapshot_ms) == STATUS_ERROR)
+        {
+            fprintf(stderr, "time_db_load() failed\n");
+            return STATUS_ERROR;
+        }
+        printf("%-12zu %12.1f %12.1f %14.1f\n", size, eager_ms, lazy_ms, snapshot_ms);
+    }
+
+    unlink(fname);
+    unlink(snapshot);
+
+    // every shard loads with threads of its own, and a checkpoint rewrites the file of one shard only
+    printf("\n%-12s %12s %16s\n", "shards", "load (ms)", "checkpoint (ms)");
+    for (size_t shard_count = 1; shard_count <= 8; shard_count *= 2)
+    {
+        double load_ms, checkpoint_ms;
+        if (create_shard_files(fname, employees_size, shard_count) == STATUS_ERROR ||
+            time_shards(fname, shard_count, &load_ms, &checkpoint_ms) == STATUS_ERROR)
+        {
+            fprintf(stderr, "time_shards() failed\n");
+            return STATUS_ERROR;
+        }
+        printf("%-12zu %12.1f %16.1f\n", shard_count, load_ms, checkpoint_ms);
+
+        for (size_t shard = 0; shard < shard_count; shard++)
+        {
+            char path[256];
+            if (shard_count == 1)
+                snprintf(path, sizeof(path), "%s", fname);
+            else
+                snprintf(path, sizeof(path), "%s.%zu", fname, shard);
+            unlink(path);
+        }
+    }
+    return STATUS_SUCCESS;
+}
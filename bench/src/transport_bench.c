@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "common.h"
+#include "frame.h"
+#include "db_client.h"
+#include "db_async.h"
+
+// Measures what a client on the server's host pays per request over TCP loopback against the server's unix domain
+// socket: the latency of blocking round trips, the rate of asynchronous requests all in flight at once and of a
+// list of every employee, and the CPU time the client and the server spend on each request.
+// usage: transport_bench [OPS] [PORT]
+// run from the repository root after 'make OPT=-O2 build build_server build_bench', the server is started on PORT and
+// BENCH_UNIX_PATH
+
+#define BENCH_DB_FILE "/tmp/transport_bench.db"
+#define BENCH_UNIX_PATH "/tmp/transport_bench.sock"
+#define BENCH_EMPLOYEES 10000
+#define BENCH_LISTS 200
+
+
+typedef struct {
+    const char *name;
+    const char *host;
+    const char *port;               /* NULL for the unix domain socket at host */
+} transport;
+
+typedef struct {
+    struct timespec wall;
+    double client_cpu_ms;
+    double server_cpu_ms;
+} sample;
+
+double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// user and system time of this process
+double client_cpu_ms(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+}
+
+// user and system time of the server, from the 14th and 15th fields of its stat in clock ticks
+double server_cpu_ms(pid_t server)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", server);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    char stat[1024];
+    size_t len = fread(stat, 1, sizeof(stat) - 1, f);
+    fclose(f);
+    stat[len] = '\0';
+
+    // the command name may hold spaces, the fields after it are counted from its closing parenthesis
+    char *cursor = strrchr(stat, ')');
+    unsigned long utime = 0, stime = 0;
+    if (!cursor || sscanf(cursor + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+        return 0;
+    return (utime + stime) * 1e3 / sysconf(_SC_CLK_TCK);
+}
+
+void take_sample(sample *s, pid_t server)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s->wall);
+    s->client_cpu_ms = client_cpu_ms();
+    s->server_cpu_ms = server_cpu_ms(server);
+}
+
+void print_row(const char *pattern, const transport *t, size_t count, sample *start, sample *end)
+{
+    double ms = elapsed_ms(&start->wall, &end->wall);
+    printf("%-24s %-8s %10.1f %12.0f %10.2f %10.2f %10.2f\n", pattern, t->name, ms, count / (ms / 1e3),
+        ms * 1e3 / count, (end->client_cpu_ms - start->client_cpu_ms) * 1e3 / count, (end->server_cpu_ms - start->server_cpu_ms) * 1e3 / count);
+}
+
+static void count_success(int status, const unsigned char *data, uint32_t data_len, void *arg)
+{
+    (void)data;
+    (void)data_len;
+    if (status == STATUS_SUCCESS)
+        (*(int *)arg)++;
+}
+
+static int count_view(const employee_view *e, void *arg)
+{
+    (void)e;
+    (*(size_t *)arg)++;
+    return STATUS_SUCCESS;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int wait_for_server(int port)
+{
+    struct sockaddr_in addr = { .sin_family=AF_INET, .sin_port=htons(port) };
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    for (int i = 0; i < 100; i++)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int status = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+        close(fd);
+        if (status == 0 && access(BENCH_UNIX_PATH, F_OK) == 0)
+            return STATUS_SUCCESS;
+        usleep(20000);
+    }
+    return STATUS_ERROR;
+}
+
+// blocking updates, each waits for its response, with the latency of every one kept for percentiles
+int bench_round_trips(const transport *t, pid_t server, size_t ops, double *latencies)
+{
+    db_client c;
+    if (db_client_connect(&c, t->host, t->port, PROTOCOL_V2, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    sample start, end;
+    take_sample(&start, server);
+    for (size_t i = 0; i < ops; i++)
+    {
+        struct timespec before, after;
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        if (db_client_update(&c, "Employee 0", (uint32_t)i) != STATUS_SUCCESS)
+            return STATUS_ERROR;
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        latencies[i] = elapsed_ms(&before, &after) * 1e3;
+    }
+    take_sample(&end, server);
+    free_db_client(&c);
+    print_row("round trip per update", t, ops, &start, &end);
+
+    qsort(latencies, ops, sizeof(double), compare_doubles);
+    printf("%-24s %-8s p50 %.1f us, p99 %.1f us\n", "", t->name, latencies[ops / 2], latencies[ops * 99 / 100]);
+    return STATUS_SUCCESS;
+}
+
+// one thread submits every update before waiting for any of them
+int bench_async(const transport *t, pid_t server, size_t ops)
+{
+    db_async_client ac;
+    if (db_async_connect(&ac, t->host, t->port, PROTOCOL_V2, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    int succeeded = 0;
+    sample start, end;
+    take_sample(&start, server);
+    for (size_t i = 0; i < ops; i++)
+    {
+        if (db_async_submit(&ac, &(db_client_request) { .option='u', .text="Employee 0", .hours=(uint32_t)i }, count_success, &succeeded) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (db_async_wait(&ac) == STATUS_ERROR || (size_t)succeeded != ops)
+        return STATUS_ERROR;
+    take_sample(&end, server);
+    free_db_async_client(&ac);
+    print_row("async, all in flight", t, ops, &start, &end);
+    return STATUS_SUCCESS;
+}
+
+// lists of every employee, where the cost is moving the bytes of the response rather than the round trip
+int bench_lists(const transport *t, pid_t server)
+{
+    db_client c;
+    if (db_client_connect(&c, t->host, t->port, PROTOCOL_V2, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    sample start, end;
+    take_sample(&start, server);
+    for (size_t i = 0; i < BENCH_LISTS; i++)
+    {
+        size_t count = 0;
+        if (db_client_each(&c, &(db_client_request) { .option='l' }, count_view, &count) != STATUS_SUCCESS || count != BENCH_EMPLOYEES)
+            return STATUS_ERROR;
+    }
+    take_sample(&end, server);
+    free_db_client(&c);
+    print_row("list of every employee", t, BENCH_LISTS, &start, &end);
+    return STATUS_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t ops = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    char *port = argc > 2 ? argv[2] : "7398";
+    if (ops == 0)
+        return 1;
+
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_UNIX_PATH);
+    pid_t server = fork();
+    if (server == -1)
+        return 1;
+    if (server == 0)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        execl("bin/server", "bin/server", "-n", "-f", BENCH_DB_FILE, "-a", "127.0.0.1", "-p", port, "-U", BENCH_UNIX_PATH, "-v", "2", NULL);
+        _exit(127);
+    }
+    if (wait_for_server(atoi(port)) == STATUS_ERROR)
+    {
+        fprintf(stderr, "unable to start bin/server\n");
+        kill(server, SIGTERM);
+        return 1;
+    }
+
+    // the employees are added over the unix domain socket, any transport would do
+    db_async_client ac;
+    if (db_async_connect(&ac, BENCH_UNIX_PATH, NULL, PROTOCOL_V2, 1) == STATUS_ERROR)
+        return 1;
+    int added = 0;
+    for (size_t i = 0; i < BENCH_EMPLOYEES; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %zu", i);
+        if (db_async_submit(&ac, &(db_client_request) { .option='a', .text=name, .address="1 Bench st.", .hours=(uint32_t)i }, count_success, &added) == STATUS_ERROR)
+            return 1;
+    }
+    if (db_async_wait(&ac) == STATUS_ERROR || added != BENCH_EMPLOYEES)
+        return 1;
+    free_db_async_client(&ac);
+
+    transport transports[] = {
+        { .name="tcp", .host="127.0.0.1", .port=port },
+        { .name="unix", .host=BENCH_UNIX_PATH, .port=NULL },
+    };
+    double *latencies = malloc(ops * sizeof(double));
+    if (!latencies)
+        return 1;
+
+    printf("%zu updates, %d lists of %d employees, per request: wall, client and server cpu\n", ops, BENCH_LISTS, BENCH_EMPLOYEES);
+    printf("%-24s %-8s %10s %12s %10s %10s %10s\n", "pattern", "via", "ms", "ops/s", "us", "client us", "server us");
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (bench_round_trips(transports + i, server, ops, latencies) == STATUS_ERROR)
+            return 1;
+    }
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (bench_async(transports + i, server, ops) == STATUS_ERROR)
+            return 1;
+    }
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (bench_lists(transports + i, server) == STATUS_ERROR)
+            return 1;
+    }
+
+    free(latencies);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(BENCH_DB_FILE);
+    return 0;
+}
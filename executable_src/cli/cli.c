@@ -8,10 +8,13 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include "common.h"
 #include "parse.h"
 #include "serialize.h"
+#include "checksums.h"
 
 
 
@@ -25,6 +28,14 @@ void print_usage(char *argv[])
     printf("\t-u <EMPLOYEE NAME> : Speicifies the name of the employee to be updated, requires that -h is also provided\n");
     printf("\t-h <EMPLOYEE HOURS> : The hours that will update the employee specified by -u\n");
     printf("\t-l : Flag to list all employees in the database\n");
+    printf("\t-i : Flag to write a record offset directory to the database file\n");
+    printf("\t-x : Flag to write a name index to the database file\n");
+    printf("\t-m : Flag to store each distinct address once, in a dictionary referenced by the records\n");
+    printf("\t-z : Flag to write the records in compressed blocks\n");
+    printf("\t-k : Flag to write checksums of the records, the file is verified whenever it is read in full\n");
+    printf("\t-V : Flag to verify the checksums of the database file, leaves the database file unchanged\n");
+    printf("\t-s <START> : List employees starting from record <START>, leaves the database file unchanged\n");
+    printf("\t-c <COUNT> : The number of employees listed by -s\n");
 }
 
 
@@ -37,9 +48,13 @@ int main(int argc, char *argv[])
     char *update_employee_hours_str = NULL;
     char *delete_employee_str = NULL;
     bool list_flag = false;
+    int checkpoint_flags = 0;
+    char *page_start_str = NULL;
+    char *page_count_str = NULL;
+    bool verify_flag = false;
     int c;
 
-    while ((c = getopt(argc, argv, "f:na:d:u:h:l")) != -1)
+    while ((c = getopt(argc, argv, "f:na:d:u:h:lixmzkVs:c:")) != -1)
     {
         switch (c)
         {
@@ -64,6 +79,30 @@ int main(int argc, char *argv[])
             case 'l':
                 list_flag = true;
                 break;
+            case 'i':
+                checkpoint_flags |= DB_CHECKPOINT_OFFSETS;
+                break;
+            case 'x':
+                checkpoint_flags |= DB_CHECKPOINT_NAME_INDEX;
+                break;
+            case 'm':
+                checkpoint_flags |= DB_CHECKPOINT_ADDRESS_DICTIONARY;
+                break;
+            case 'z':
+                checkpoint_flags |= DB_CHECKPOINT_COMPRESSED;
+                break;
+            case 'k':
+                checkpoint_flags |= DB_CHECKPOINT_CHECKSUMS;
+                break;
+            case 'V':
+                verify_flag = true;
+                break;
+            case 's':
+                page_start_str = optarg;
+                break;
+            case 'c':
+                page_count_str = optarg;
+                break;
             case '?':
                 print_usage(argv);
                 exit(0);
@@ -114,13 +153,175 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    // keep writing the optional sections the file already has
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    if (read_db_sections(fd, &dbhdr, sections, &section_count) == STATUS_ERROR)
+    {
+        exit(1);
+    }
+    if (find_db_section(sections, section_count, DB_SECTION_OFFSETS))
+        checkpoint_flags |= DB_CHECKPOINT_OFFSETS;
+    if (find_db_section(sections, section_count, DB_SECTION_NAME_INDEX))
+        checkpoint_flags |= DB_CHECKPOINT_NAME_INDEX;
+
+    // compressed blocks are decoded by the parallel loader, they cannot be read record by record
+    bool compressed = find_db_section(sections, section_count, DB_SECTION_BLOCKS) != NULL;
+    if (compressed)
+        checkpoint_flags |= DB_CHECKPOINT_COMPRESSED;
+
+    // the parallel loader also verifies the checksums before decoding anything
+    db_section *checksums_section = find_db_section(sections, section_count, DB_SECTION_CHECKSUMS);
+    if (checksums_section)
+        checkpoint_flags |= DB_CHECKPOINT_CHECKSUMS;
+    bool parallel = compressed || checksums_section;
+
+    if (verify_flag)
+    {
+        db_checksums checksums;
+        if (!checksums_section || checksums_section->length == 0)
+        {
+            fprintf(stderr, "%s has no checksums, add them with -k\n", fname);
+            exit(1);
+        }
+        if (read_db_checksums(&checksums, fd, checksums_section) == STATUS_ERROR)
+        {
+            exit(1);
+        }
+
+        unsigned char *map = mmap(NULL, dbhdr.fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED || checksums.end > dbhdr.fsize)
+        {
+            fprintf(stderr, "%s:%s:%d - unable to map database file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            exit(1);
+        }
+
+        // fault the file in first so that only the checksum computation is timed
+        volatile unsigned char sink = 0;
+        for (uint32_t i = 0; i < dbhdr.fsize; i += 4096)
+            sink ^= map[i];
+        (void)sink;
+
+        struct timespec start, stop;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int status = db_checksums_verify(&checksums, map);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+
+        double seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+        double bytes = checksums.end - checksums.start;
+        printf("%s %u chunks, %.0f bytes in %.3f ms (%.2f GB/s)\n", status == STATUS_SUCCESS ? "ok" : "corrupted",
+            checksums.count, bytes, seconds * 1e3, seconds > 0 ? bytes / seconds / 1e9 : 0.0);
+        munmap(map, dbhdr.fsize);
+        free_db_checksums(&checksums);
+        return status == STATUS_SUCCESS ? 0 : 1;
+    }
+
+    // records may reference addresses stored once in a dictionary
+    db_dictionary dictionary = { 0 };
+    db_section *addresses = find_db_section(sections, section_count, DB_SECTION_ADDRESSES);
+    if (addresses)
+    {
+        checkpoint_flags |= DB_CHECKPOINT_ADDRESS_DICTIONARY;
+        if (read_db_dictionary(fd, addresses, &dictionary) == STATUS_ERROR)
+        {
+            exit(1);
+        }
+    }
+
+    // list a single page of employees without reading the whole file
+    if (page_start_str || page_count_str)
+    {
+        uint32_t page_start = 0;
+        uint32_t page_count = dbhdr.employee_count;
+        if ((page_start_str && parse_employee_hours(page_start_str, &page_start) == STATUS_ERROR) ||
+            (page_count_str && parse_employee_hours(page_count_str, &page_count) == STATUS_ERROR))
+        {
+            fprintf(stderr, "invalid page arguments\n");
+            print_usage(argv);
+            exit(1);
+        }
+
+        if (page_start >= dbhdr.employee_count)
+            return 0;
+        if (page_count > dbhdr.employee_count - page_start)
+            page_count = dbhdr.employee_count - page_start;
+
+        if (compressed)
+        {
+            employee *employees = malloc(sizeof(employee) * (dbhdr.employee_count ? dbhdr.employee_count : 1));
+            if (!employees || read_employees_parallel(fd, &dbhdr, sections, section_count, employees, NULL, 0) == STATUS_ERROR)
+            {
+                exit(1);
+            }
+            for (uint32_t i = 0; i < dbhdr.employee_count; i++)
+            {
+                if (i >= page_start && i - page_start < page_count && employees[i].name[0] != '\0')
+                    printf("%s %s %u\n", employees[i].name, employees[i].address, employees[i].hours);
+                free(employees[i].name);
+                free(employees[i].address);
+            }
+            free(employees);
+            free_db_dictionary(&dictionary);
+            return 0;
+        }
+
+        if (seek_employee(fd, sections, section_count, page_start) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d seek_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            exit(1);
+        }
+
+        for (uint32_t i = 0; i < page_count; i++)
+        {
+            employee e;
+            if (fdeserialize_record(fd, &e, &dictionary) == STATUS_ERROR)
+            {
+                exit(1);
+            }
+            // deleted records have an empty name
+            if (e.name[0] != '\0')
+                printf("%s %s %u\n", e.name, e.address, e.hours);
+            free(e.name);
+            free(e.address);
+        }
+        free_db_dictionary(&dictionary);
+        return 0;
+    }
+
     // Read employees from data base
+    if (seek_employee(fd, sections, section_count, 0) == STATUS_ERROR)
+    {
+        exit(1);
+    }
     size_t employees_size = dbhdr.employee_count;      
-    employee *employees = (employee *) malloc(sizeof(employee) * employees_size);
-    if (read_employees(fd, &employees, employees_size) == STATUS_ERROR)
+    employee *employees = (employee *) malloc(sizeof(employee) * (employees_size ? employees_size : 1));
+    if (parallel)
+    {
+        if (read_employees_parallel(fd, &dbhdr, sections, section_count, employees, NULL, 0) == STATUS_ERROR)
+        {
+            exit(1);
+        }
+    }
+    else if (read_records(fd, &employees, employees_size, &dictionary) == STATUS_ERROR)
     {
         exit(1);
     }
+    free_db_dictionary(&dictionary);
+
+    // drop records deleted by the server, they are discarded when the file is written back
+    size_t live_size = 0;
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        if (employees[i].name[0] == '\0')
+        {
+            free(employees[i].name);
+            free(employees[i].address);
+            continue;
+        }
+        employees[live_size++] = employees[i];
+    }
+    employees_size = live_size;
+    dbhdr.employee_count = live_size;
     
     // process command line arguments
     if (add_employee_str)
@@ -193,9 +394,9 @@ int main(int argc, char *argv[])
     }
 
 	// Write output to file
-	if (write_db(fd, &dbhdr, employees) == STATUS_ERROR)
+	if (checkpoint_db(fd, &dbhdr, employees, checkpoint_flags) == STATUS_ERROR)
 	{
-		fprintf(stderr, "%s:%s:%d write_db failed()\n", __FILE__, __FUNCTION__, __LINE__);
+		fprintf(stderr, "%s:%s:%d checkpoint_db failed()\n", __FILE__, __FUNCTION__, __LINE__);
 		free(employees);
 		exit(1);
 	}
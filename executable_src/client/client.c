@@ -7,20 +7,52 @@
 #include <errno.h>
 #include <string.h>
 #include <stdbool.h>
+#include <endian.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
 #include "proto.h"
 #include "common.h"
 #include "serialize.h"
-
+#include "replication.h"
+#include "frame.h"
+
+
+// the options of one request, from the command line or from a line of a batch
+typedef struct {
+    char *add_employee_str;
+    char *update_employee_str;
+    char *update_hours_str;
+    char *delete_employee_str;
+    bool list_flag;
+    char *range_str;
+    char *top_str;
+    char *prefix_str;
+    char *address_str;
+    bool replication_status_flag;
+    char *changes_since_str;
+} request_options;
+
+// a request of a batch sent and not yet answered
+typedef struct {
+    size_t line_no;
+    bool replication_status;
+    bool changes_since;
+} pending_request;
+
+// requests of a batch sent before their responses are read, small enough for the socket buffers to hold
+#define BATCH_WINDOW 256
+#define BATCH_MAX_ARGS 32
+#define REQUEST_OPTSTRING "a:u:n:d:lr:t:s:c:mD:"
 
 void print_usage(char **argv);
-int send_handshake(int socket, uint16_t protocol_version);
-int receive_handshake(int socket);
-int deserialize_response(int socket);
+int parse_request_option(int c, char *arg, request_options *opts);
+int serialize_request(request_options *opts, uint16_t protocol_version, uint32_t request_id, unsigned char **buf, unsigned char **cursor, size_t *capacity);
+int deserialize_response(int socket, uint16_t protocol_version, uint32_t request_id, bool replication_status, bool changes_since, bool *request_failed);
+int print_employee_view(const employee_view *e, void *arg);
+int watch_changes(int socket, uint16_t protocol_version);
+int run_batch(int socket, uint16_t protocol_version, FILE *in);
 void decode_request_error(unsigned char error_flag);
-int get_socket(char *host, char *port);
 
 
 int main(int argc, char *argv[])
@@ -36,14 +68,13 @@ int main(int argc, char *argv[])
     char *protocol_version_str = NULL;
     char *host = NULL;
     char *port = NULL;
-    char *add_employee_str = NULL;
-    char *update_employee_str = NULL;
-    char *update_hours_str = NULL;
-    char *delete_employee_str = NULL;
-    bool list_flag = false;
+    char *unix_path = NULL;
+    bool watch_flag = false;
+    char *batch_path = NULL;
+    request_options opts = { 0 };
 
     int c;
-    while ((c = getopt(argc, argv, "v:h:p:a:u:n:d:l")) != -1)
+    while ((c = getopt(argc, argv, "v:h:p:U:wb:" REQUEST_OPTSTRING)) != -1)
     {
         switch (c)
         {
@@ -56,31 +87,26 @@ int main(int argc, char *argv[])
             case 'p':
                 port = optarg;
                 break;
-            case 'a':
-                add_employee_str  = optarg;
-                break;
-            case 'u':
-                update_employee_str = optarg;
+            case 'U':
+                unix_path = optarg;
                 break;
-            case 'n':
-                update_hours_str = optarg;
+            case 'w':
+                watch_flag = true;
                 break;
-            case 'd':
-                delete_employee_str = optarg;
+            case 'b':
+                batch_path = optarg;
                 break;
-            case 'l':
-                list_flag = true;
-                break;
-            case '?':
-                print_usage(argv);
-                exit(1);
             default:
-                abort();
+                if (parse_request_option(c, optarg, &opts) == STATUS_ERROR)
+                {
+                    print_usage(argv);
+                    exit(1);
+                }
         }
     }
 
-	// ensure host and port are both valid
-    if (!host || !port || !protocol_version_str)
+	// ensure host and port are both valid, unless connecting through a unix domain socket
+    if ((!unix_path && (!host || !port)) || !protocol_version_str)
     {
         print_usage(argv);
         exit(1);
@@ -95,9 +121,17 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    // open the batch before connecting, '-' reads it from stdin
+    FILE *batch = NULL;
+    if (batch_path && !(batch = strcmp(batch_path, "-") == 0 ? stdin : fopen(batch_path, "r")))
+    {
+        fprintf(stderr, "unable to open batch '%s': (%d) %s\n", batch_path, errno, strerror(errno));
+        exit(1);
+    }
+
     // get socket for server
     int sockfd;
-    if ((sockfd = get_socket(host, port)) == STATUS_ERROR)
+    if ((sockfd = unix_path ? get_unix_socket(unix_path) : get_socket(host, port)) == STATUS_ERROR)
     {
         fprintf(stderr, "get_socket() failed\n");
         exit(1);
@@ -117,67 +151,37 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    // create buffer and cursor for serializing request
-     size_t header_size = sizeof(proto_msg) + sizeof(uint32_t);
-     size_t capacity = header_size;
-     unsigned char *buf = malloc(capacity);
-
-     // write message type to buffer
-     *((proto_msg *)buf) = DB_ACCESS_REQUEST;
-     unsigned char *cursor = buf + capacity;
-
-	// serialize request's, writing to buffer
-     if (add_employee_str)
-     {
-        if (serialize_add_employee_option(&buf, &cursor, &capacity, add_employee_str) == STATUS_ERROR)
-        {
-            fprintf(stderr, "unable to serialize add employee request\n");
-            exit(1);
-        }
-     }
-
-     if (update_employee_str && update_hours_str)
-     {
-         if (serialize_update_employee_option(&buf, &cursor, &capacity, update_employee_str, update_hours_str) == STATUS_ERROR)
-         {
-             fprintf(stderr, "unable to serialize update employee request\n");
-             exit(1);
-         }
-     }
-     else if ((update_employee_str && !update_hours_str) || (!update_employee_str && update_hours_str))
-     {
-         print_usage(argv);
-         exit(1);
-     }
-
-    if (delete_employee_str)
+    // print changes as the server applies them until it closes the connection
+    if (watch_flag)
     {
-        if (serialize_delete_employee_option(&buf, &cursor, &capacity, delete_employee_str) == STATUS_ERROR)
-        {
-            fprintf(stderr, "unable to serialize delete employee request\n");
-            exit(1);
-        }
+        int status = watch_changes(sockfd, parsed_protocol_version);
+        close(sockfd);
+        return status == STATUS_ERROR ? 1 : 0;
     }
 
-    if (list_flag)
+    // send every request of the batch over this connection
+    if (batch)
     {
-        if (serialize_list_option(&buf, &cursor, &capacity) == STATUS_ERROR)
-        {
-            fprintf(stderr, "unable to serialize list request\n");
-            exit(1);
-        }
+        int status = run_batch(sockfd, parsed_protocol_version, batch);
+        if (batch != stdin)
+            fclose(batch);
+        close(sockfd);
+        return status == STATUS_ERROR ? 1 : 0;
     }
 
-    // Compute total length of request data
-    size_t total_len = (size_t)(cursor - buf);
-    uint32_t data_len = total_len - header_size;
-  
-    // write length of data to header
-    cursor = buf + sizeof(proto_msg);
-    *((uint32_t*)(cursor)) = htonl(data_len);
+    // serialize request, with the header the handshake negotiated
+    size_t capacity = 0;
+    unsigned char *buf = NULL;
+    unsigned char *cursor = NULL;
+    if (serialize_request(&opts, parsed_protocol_version, 1, &buf, &cursor, &capacity) == STATUS_ERROR)
+    {
+        if ((opts.update_employee_str == NULL) != (opts.update_hours_str == NULL))
+            print_usage(argv);
+        exit(1);
+    }
 
 	// send request
-    if (send_all(sockfd, buf, total_len, 0) == STATUS_ERROR)
+    if (send_all(sockfd, buf, (size_t)(cursor - buf), 0) == STATUS_ERROR)
     {
         fprintf(stderr, "unable to send request to server\n");
         exit(1);
@@ -186,7 +190,9 @@ int main(int argc, char *argv[])
     // free request buffer
     free(buf);
 
-    if (deserialize_response(sockfd) == STATUS_ERROR)
+    bool request_failed = false;
+    if (deserialize_response(sockfd, parsed_protocol_version, 1, opts.replication_status_flag, opts.changes_since_str != NULL, &request_failed) == STATUS_ERROR ||
+        request_failed)
     {
         fprintf(stderr, "deserialize_response() failed\n");
         exit(1);
@@ -265,195 +271,588 @@ int main(int argc, char *argv[])
 }
 
 
-void print_usage(char **argv)
+int parse_request_option(int c, char *arg, request_options *opts)
 {
-    printf("usage: %s -h <HOST> -p <PORT> -v <VERSION> [OPTIONS]\n", argv[0]);
-    printf("\t-v <VERSION> : (REQUIRED) protocol version\n");
-    printf("\t-h <HOST> : (REQUIRED) address of host\n");
-    printf("\t-p <PORT> : (REQUIRED) port of host\n");
-    printf("\t-a <EMPLOYEE> : add an employee to the database, <EMPLOYEE> should be a comma seperated list of values\n");
-    printf("\t-u <EMPLOYEE NAME> : name of an employee whose hours are to be updated, -n argument is also required to specify number of hours\n");
-    printf("\t-n <HOURS> : the number of hours to update a given employee\n");
-    printf("\t-d <EMPLOYEE NAME> : deletes an the employee with <EMPLOYEE NAME> from the databaes\n");
-    printf("\t-l : list all employees in the database\n");
-
+    switch (c)
+    {
+        case 'a':
+            opts->add_employee_str  = arg;
+            break;
+        case 'u':
+            opts->update_employee_str = arg;
+            break;
+        case 'n':
+            opts->update_hours_str = arg;
+            break;
+        case 'd':
+            opts->delete_employee_str = arg;
+            break;
+        case 'l':
+            opts->list_flag = true;
+            break;
+        case 'r':
+            opts->range_str = arg;
+            break;
+        case 't':
+            opts->top_str = arg;
+            break;
+        case 's':
+            opts->prefix_str = arg;
+            break;
+        case 'c':
+            opts->address_str = arg;
+            break;
+        case 'm':
+            opts->replication_status_flag = true;
+            break;
+        case 'D':
+            opts->changes_since_str = arg;
+            break;
+        default:
+            return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
 }
 
-
-int send_handshake(int socket, uint16_t protocol_version)
+// Appends a request made of the options to the buffer, after a header framing it as the handshake negotiated.
+// The buffer is grown as needed and can be reused for the requests after it.
+int serialize_request(request_options *opts, uint16_t protocol_version, uint32_t request_id, unsigned char **buf, unsigned char **cursor, size_t *capacity)
 {
-    // instantiate request
-    // size_t msg_size = sizeof(proto_msg) + sizeof(uint16_t);
-    proto_msg *handshake_req = malloc(HANDSHAKE_REQ_SIZE);
-    handshake_req[0] = HANDSHAKE_REQUEST;
-    *(uint16_t *)(handshake_req + 1) = htons(protocol_version);
+    // leave room for the header, its length is known once the options are written
+    size_t header_size = request_header_size(protocol_version);
+    if (resize_buffer(buf, cursor, capacity, header_size) == STATUS_ERROR)
+        return STATUS_ERROR;
+    size_t start = (size_t)(*cursor - *buf);
+    *cursor += header_size;
 
-    if (send_all(socket, handshake_req, HANDSHAKE_REQ_SIZE, 0) == STATUS_ERROR)
+	// serialize request's, writing to buffer
+    if (opts->add_employee_str)
+    {
+        if (serialize_add_employee_option(buf, cursor, capacity, opts->add_employee_str) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize add employee request\n");
+            return STATUS_ERROR;
+        }
+    }
+
+    if (opts->update_employee_str && opts->update_hours_str)
+    {
+        if (serialize_update_employee_option(buf, cursor, capacity, opts->update_employee_str, opts->update_hours_str) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize update employee request\n");
+            return STATUS_ERROR;
+        }
+    }
+    else if (opts->update_employee_str || opts->update_hours_str)
     {
+        fprintf(stderr, "-u and -n are required together\n");
         return STATUS_ERROR;
     }
 
-    return STATUS_SUCCESS;
-}
+    if (opts->delete_employee_str)
+    {
+        if (serialize_delete_employee_option(buf, cursor, capacity, opts->delete_employee_str) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize delete employee request\n");
+            return STATUS_ERROR;
+        }
+    }
 
+    if (opts->list_flag)
+    {
+        if (serialize_list_option(buf, cursor, capacity) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize list request\n");
+            return STATUS_ERROR;
+        }
+    }
 
-void decode_request_error(unsigned char error_flag)
-{
-    switch (error_flag)
+    if (opts->range_str)
     {
-        case 1:
-            printf("employee not present in database\n");
-            break;
-        default:
-            printf("unknown error occurred\n");
+        if (serialize_range_option(buf, cursor, capacity, opts->range_str) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize hours range request\n");
+            return STATUS_ERROR;
+        }
     }
-}
 
-int get_socket(char *host, char *port)
-{
-	// get info for host/port
-    int status;
-    struct addrinfo hints = {0}; 
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+    if (opts->top_str)
+    {
+        if (serialize_top_option(buf, cursor, capacity, opts->top_str) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize top hours request\n");
+            return STATUS_ERROR;
+        }
+    }
 
-    struct addrinfo *servinfo;
-    if ((status = getaddrinfo(host, port, &hints, &servinfo)) == -1)
+    if (opts->prefix_str)
     {
-        fprintf(stderr, "%s:%s:%d - getaddrinfo() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, status, gai_strerror(status));
-        return STATUS_ERROR;
+        if (serialize_prefix_option(buf, cursor, capacity, opts->prefix_str) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize name prefix request\n");
+            return STATUS_ERROR;
+        }
     }
-        
-	// attempt to create a socket from the given server
-    int sockfd;
-    struct addrinfo *ptr; 
-    for (ptr = servinfo; ptr; ptr = ptr->ai_next)
+
+    if (opts->address_str)
     {
-        if ((sockfd = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol)) == -1)
-            continue;
-        break;
+        if (serialize_address_search_option(buf, cursor, capacity, opts->address_str) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize address search request\n");
+            return STATUS_ERROR;
+        }
     }
 
-    // validate socket
-    if (sockfd == -1 || !ptr)
+    if (opts->changes_since_str)
     {
-        fprintf(stderr, "%s:%s:%d - unable to create socket: %s\n", __FILE__, __FUNCTION__, __LINE__, strerror(errno));
-        return STATUS_ERROR;
+        if (serialize_changes_since_option(buf, cursor, capacity, opts->changes_since_str) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize changes since request\n");
+            return STATUS_ERROR;
+        }
     }
 
-	// connect to socket and ensure connection has been established
-    if (connect(sockfd, ptr->ai_addr, ptr->ai_addrlen) == -1)
+    if (opts->replication_status_flag)
     {
-        fprintf(stderr, "%s:%s:%d - unable to connect to host: %s\n", __FILE__, __FUNCTION__, __LINE__, strerror(errno));
-        return STATUS_ERROR;
+        if (serialize_replication_status_option(buf, cursor, capacity) == STATUS_ERROR)
+        {
+            fprintf(stderr, "unable to serialize replication status request\n");
+            return STATUS_ERROR;
+        }
     }
-    
-    freeaddrinfo(servinfo);
-    return sockfd;
+
+    // write length of data to header
+    uint32_t data_len = (uint32_t)(*cursor - *buf - start - header_size);
+    encode_request_header(*buf + start, protocol_version, DB_ACCESS_REQUEST, request_id, data_len);
+    return STATUS_SUCCESS;
 }
 
-int receive_handshake(int socket)
+// splits a line of a batch into arguments at whitespace outside of quotes, in place
+static int split_batch_line(char *line, char **args, int max_args)
 {
-    // wait for handshake response from server, confirming protocol versions match
-    unsigned char *handshake_response = malloc(sizeof(proto_msg));
-    if (receive_all(socket, handshake_response, sizeof(proto_msg), 0) == STATUS_ERROR)
+    int count = 0;
+    char *p = line;
+    while (*p)
     {
-        fprintf(stderr, "%s:%s:%d - unable to receive handshake response\n", __FILE__, __FUNCTION__, __LINE__);
-        return STATUS_ERROR;
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+            p++;
+        if (!*p)
+            break;
+        if (count == max_args)
+            return STATUS_ERROR;
+
+        // an argument ends at whitespace outside of quotes, the quotes are dropped
+        char *out = p;
+        args[count++] = out;
+        char quote = 0;
+        for (; *p && (quote || (*p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')); p++)
+        {
+            if (!quote && (*p == '"' || *p == '\''))
+                quote = *p;
+            else if (quote && *p == quote)
+                quote = 0;
+            else
+                *out++ = *p;
+        }
+        if (quote)
+            return STATUS_ERROR;
+        if (*p)
+            p++;
+        *out = '\0';
     }
+    return count;
+}
 
-    if (*(proto_msg *)handshake_response != HANDSHAKE_RESPONSE)
+// reads the responses to the requests sent so far, in the order they were sent
+static int receive_batch_responses(int socket, uint16_t protocol_version, pending_request *pending, size_t pending_count, size_t *failed)
+{
+    for (size_t i = 0; i < pending_count; i++)
     {
-        fprintf(stderr, "%s:%s:%d - internal server error\n", __FILE__, __FUNCTION__, __LINE__);
-        return STATUS_ERROR;
+        bool request_failed = false;
+        if (deserialize_response(socket, protocol_version, (uint32_t)pending[i].line_no, pending[i].replication_status, pending[i].changes_since,
+            &request_failed) == STATUS_ERROR)
+        {
+            fprintf(stderr, "line %zu: unable to receive response\n", pending[i].line_no);
+            return STATUS_ERROR;
+        }
+        if (request_failed)
+        {
+            fprintf(stderr, "line %zu: request failed\n", pending[i].line_no);
+            (*failed)++;
+        }
     }
+    fflush(stdout);
+    return STATUS_SUCCESS;
+}
 
-    unsigned char handshake_flag;
-
-    if (receive_all(socket, &handshake_flag, 1, 0) == STATUS_ERROR)
+// Sends a request for every line of the batch over one connection. Each line holds the options of a request as on
+// the command line, blank lines and lines starting with '#' are skipped. Up to BATCH_WINDOW requests are written
+// with one send before their responses are read, and the results are printed as each window is answered.
+int run_batch(int socket, uint16_t protocol_version, FILE *in)
+{
+    pending_request pending[BATCH_WINDOW];
+    size_t pending_count = 0;
+    size_t failed = 0;
+    size_t capacity = 0;
+    unsigned char *buf = NULL;
+    unsigned char *cursor = NULL;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    size_t line_no = 0;
+    int status = STATUS_SUCCESS;
+
+    while (status == STATUS_SUCCESS)
     {
-        fprintf(stderr, "%s:%s:%d - unable to receive handshake response\n", __FILE__, __FUNCTION__, __LINE__);
-        return STATUS_ERROR;
+        ssize_t line_len = getline(&line, &line_capacity, in);
+        if (line_len != -1)
+        {
+            line_no++;
+            char *args[BATCH_MAX_ARGS + 1] = { "batch" };
+            int args_count = split_batch_line(line, args + 1, BATCH_MAX_ARGS);
+            if (args_count == STATUS_ERROR)
+            {
+                fprintf(stderr, "line %zu: unable to split into options\n", line_no);
+                failed++;
+                continue;
+            }
+            if (args_count == 0 || args[1][0] == '#')
+                continue;
+
+            // the options of a line are parsed as the command line's are
+            request_options opts = { 0 };
+            bool parsed = true;
+            int c;
+            optind = 0;
+            while ((c = getopt(args_count + 1, args, REQUEST_OPTSTRING)) != -1)
+            {
+                if (parse_request_option(c, optarg, &opts) == STATUS_ERROR)
+                    parsed = false;
+            }
+            if (!parsed || optind != args_count + 1)
+            {
+                fprintf(stderr, "line %zu: invalid options\n", line_no);
+                failed++;
+                continue;
+            }
+
+            size_t cursor_offset = (size_t)(cursor - buf);
+            if (serialize_request(&opts, protocol_version, (uint32_t)line_no, &buf, &cursor, &capacity) == STATUS_ERROR)
+            {
+                fprintf(stderr, "line %zu: unable to serialize request\n", line_no);
+                cursor = buf + cursor_offset;
+                failed++;
+                continue;
+            }
+            pending[pending_count++] = (pending_request) {
+                .line_no=line_no,
+                .replication_status=opts.replication_status_flag,
+                .changes_since=opts.changes_since_str != NULL,
+            };
+        }
+        else if (ferror(in))
+        {
+            fprintf(stderr, "unable to read batch: (%d) %s\n", errno, strerror(errno));
+            status = STATUS_ERROR;
+            break;
+        }
+
+        // send a full window, or what is left at the end of the batch, then read its responses
+        bool done = line_len == -1;
+        if (pending_count == BATCH_WINDOW || (done && pending_count > 0))
+        {
+            if (send_all(socket, buf, (size_t)(cursor - buf), 0) == STATUS_ERROR)
+            {
+                fprintf(stderr, "unable to send requests to server\n");
+                status = STATUS_ERROR;
+                break;
+            }
+            cursor = buf;
+            status = receive_batch_responses(socket, protocol_version, pending, pending_count, &failed);
+            pending_count = 0;
+        }
+        if (done)
+            break;
     }
 
-    if (handshake_flag)
+    free(line);
+    free(buf);
+    if (failed > 0)
+        fprintf(stderr, "%zu of %zu lines failed\n", failed, line_no);
+    return status == STATUS_ERROR || failed > 0 ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+void print_usage(char **argv)
+{
+    printf("usage: %s -h <HOST> -p <PORT> -v <VERSION> [OPTIONS]\n", argv[0]);
+    printf("       %s -U <PATH> -v <VERSION> [OPTIONS]\n", argv[0]);
+    printf("\t-v <VERSION> : (REQUIRED) protocol version (1 or 2)\n");
+    printf("\t-h <HOST> : (REQUIRED) address of host\n");
+    printf("\t-p <PORT> : (REQUIRED) port of host\n");
+    printf("\t-U <PATH> : connect through the server's unix domain socket at <PATH> instead of -h and -p, for a server on the same host\n");
+    printf("\t-a <EMPLOYEE> : add an employee to the database, <EMPLOYEE> should be a comma seperated list of values\n");
+    printf("\t-u <EMPLOYEE NAME> : name of an employee whose hours are to be updated, -n argument is also required to specify number of hours\n");
+    printf("\t-n <HOURS> : the number of hours to update a given employee\n");
+    printf("\t-d <EMPLOYEE NAME> : deletes an the employee with <EMPLOYEE NAME> from the databaes\n");
+    printf("\t-l : list all employees in the database\n");
+    printf("\t-r <MIN>,<MAX> : list employees with between <MIN> and <MAX> hours, ordered by hours\n");
+    printf("\t-t <COUNT> : list the <COUNT> employees with the most hours\n");
+    printf("\t-s <PREFIX> : list employees whose name starts with <PREFIX>, ordered by name\n");
+    printf("\t-c <TEXT> : list employees whose address contains <TEXT>\n");
+    printf("\t-D <VERSION> : list only the employees added, updated or deleted since <VERSION> and the version now, 0 answers with the version to\n");
+    printf("\t\tstart from before a full list, a version older than the server's change history asks for a full list again\n");
+    printf("\t-w : print every add, update and delete applied from now on, with its sequence number, instead of polling with -l\n");
+    printf("\t-b <FILE> : send a request for every line of <FILE>, or of stdin when <FILE> is '-', over one connection and print the\n");
+    printf("\t\tresults in order, a line holds the options of a request as above, e.g. -u \"Jane Doe\" -n 40\n");
+    printf("\t-m : show whether the server follows a primary, the newest change it applied and how far it lags behind\n");
+
+}
+
+
+void decode_request_error(unsigned char error_flag)
+{
+    switch (error_flag)
     {
-        fprintf(stderr, "%s:%s:%d - invalid protocol version\n", __FILE__, __FUNCTION__, __LINE__);
-        return STATUS_ERROR;
+        case 1:
+            printf("employee not present in database\n");
+            break;
+        case 2:
+            printf("server is a read-only follower, send writes to its primary\n");
+            break;
+        default:
+            printf("unknown error occurred\n");
     }
+}
+
 
-    free(handshake_response);
+// prints an employee of a list response, the stream being the argument
+int print_employee_view(const employee_view *e, void *arg)
+{
+    fprintf((FILE *)arg, "%s, %s, %u\n", e->name, e->address, e->hours);
     return STATUS_SUCCESS;
 }
 
-int deserialize_response(int socket)
+// Receives the response to a request and prints it. A response telling of an error is read in full and sets
+// request_failed, so the responses after it on the connection can still be read.
+int deserialize_response(int socket, uint16_t protocol_version, uint32_t request_id, bool replication_status, bool changes_since, bool *request_failed)
 {
-	// de-serialize and parse response
-    size_t response_header_size = sizeof(proto_msg) + sizeof(uint32_t) + 1;
-    unsigned char *response_header = malloc(response_header_size);
+    // de-serialize and parse response, the error flag is in the flags of a version 2 frame
+    proto_msg response_type;
+    unsigned char error_flag;
+    uint32_t data_len;
+    unsigned char *data = NULL;
+    if (protocol_version >= PROTOCOL_V2)
+    {
+        frame_header h;
+        if (receive_frame_header(socket, &h) <= 0)
+        {
+            fprintf(stderr, "%s:%s:%d - unable to receive response from server\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
 
-    if (receive_all(socket, response_header, response_header_size, 0) == STATUS_ERROR)
+        // responses come back in the order their requests were sent
+        if (h.request_id != request_id)
+        {
+            fprintf(stderr, "%s:%s:%d - response to request %u, expected %u\n", __FILE__, __FUNCTION__, __LINE__, h.request_id, request_id);
+            return STATUS_ERROR;
+        }
+        response_type = h.opcode;
+        error_flag = h.flags;
+        data_len = h.payload_len;
+    }
+    else
     {
-        fprintf(stderr, "%s:%s:%d - unable to receive response from server\n", __FILE__, __FUNCTION__, __LINE__);
-        return STATUS_ERROR;
+        size_t response_header_size = sizeof(proto_msg) + sizeof(uint32_t) + 1;
+        unsigned char response_header[sizeof(proto_msg) + sizeof(uint32_t) + 1];
+        if (receive_all(socket, response_header, response_header_size, 0) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d - unable to receive response from server\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+        response_type = *(proto_msg *)response_header;
+        error_flag = *(response_header + sizeof(proto_msg));
+        data_len = ntohl(*((uint32_t *)(response_header + sizeof(proto_msg) + 1)));
     }
 
-    // check response type in header
-    proto_msg response_type = *(proto_msg *)response_header;
+    // check response type in header, version 1 answers an invalid request with the type alone
     if (response_type == INVALID_REQUEST)
     {
         fprintf(stderr, "%s:%s:%d - invalid request\n", __FILE__, __FUNCTION__, __LINE__);
         return STATUS_ERROR;
     }
 
+    // employees are printed as their records arrive rather than once the whole list has been received
+    if (!error_flag && !replication_status && !changes_since)
+    {
+        if (data_len > 0 && receive_list_response(socket, data_len, print_employee_view, stdout) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d - unable to receive employees from server\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+        return STATUS_SUCCESS;
+    }
+
+    // read bytes sent from server
+    if (data_len > 0)
+    {
+        data = malloc(data_len);
+        if (!data || receive_all(socket, data, data_len, 0) <= 0)
+        {
+            fprintf(stderr, "%s:%s:%d - unable to receive serialized data from server\n", __FILE__, __FUNCTION__, __LINE__);
+            free(data);
+            return STATUS_ERROR;
+        }
+    }
+
     // check for errors in response
-    unsigned char error_flag = *(response_header + sizeof(proto_msg));
     if (error_flag)
     {
         fprintf(stderr, "request error\n");
         decode_request_error(error_flag);
-        return STATUS_ERROR;
+        *request_failed = true;
+        free(data);
+        return STATUS_SUCCESS;
     }
 
-    // parse length of response
-    uint32_t data_len = ntohl(*((uint32_t *)(response_header + sizeof(proto_msg) + 1)));
-    free(response_header);
-
-    if (data_len > 0)
+    if (replication_status && data_len > 0)
     {
-        // allocate for receiving serialized employees
-        unsigned char *serialized_employees = malloc(data_len);
-
-        // read bytes sent from server
-        if (receive_all(socket, serialized_employees, data_len, 0) == STATUS_ERROR)
+        bool follower;
+        uint64_t seq;
+        db_replication_stats stats;
+        if (deserialize_replication_status_response(data, data_len, &follower, &seq, &stats) == STATUS_ERROR)
         {
-            fprintf(stderr, "%s:%s:%d - unable to receive serialized data from server\n", __FILE__, __FUNCTION__, __LINE__);
+            fprintf(stderr, "%s:%s:%d - unable to deserialize replication status from raw bytes\n", __FILE__, __FUNCTION__, __LINE__);
+            free(data);
             return STATUS_ERROR;
         }
 
-        // for deserializing received employee bytes
+        printf("role: %s\n", follower ? "follower" : "primary");
+        printf("last change: %lu\n", (unsigned long)seq);
+        if (follower)
+        {
+            printf("primary last change: %lu\n", (unsigned long)stats.primary_seq);
+            printf("changes behind: %lu\n", (unsigned long)(stats.primary_seq - seq));
+            printf("lag: %lu us\n", (unsigned long)stats.lag_us);
+        }
+        printf("followers: %u\n", stats.follower_count);
+    }
+    else if (changes_since && data_len > 0)
+    {
+        bool resync;
+        uint64_t version;
+        char **deleted;
+        size_t deleted_size;
         employee *employees;
         size_t employees_size;
-        if (deserialize_list_employee_response(serialized_employees, data_len, &employees, &employees_size) == STATUS_ERROR)
+        if (deserialize_changes_since_response(data, data_len, &resync, &version, &deleted, &deleted_size, &employees, &employees_size) == STATUS_ERROR)
         {
-            fprintf(stderr, "%s:%s:%d - unable to deserialize employees from raw bytes\n", __FILE__, __FUNCTION__, __LINE__);
+            fprintf(stderr, "%s:%s:%d - unable to deserialize changes from raw bytes\n", __FILE__, __FUNCTION__, __LINE__);
+            free(data);
             return STATUS_ERROR;
         }
 
-        free(serialized_employees);
-
-        // display employees
+        // changes made after the list are sent again by the next request, applying them twice is harmless
+        printf("version: %lu\n", (unsigned long)version);
+        if (resync)
+            printf("resync: list every employee, then ask for the changes since %lu\n", (unsigned long)version);
+        for (size_t i = 0; i < deleted_size; i++)
+        {
+            printf("deleted: %s\n", deleted[i]);
+            free(deleted[i]);
+        }
+        free(deleted);
         for (size_t i = 0; i < employees_size; i++)
         {
-            printf("%s, %s, %u", employees[i].name, employees[i].address, employees[i].hours);
-            printf("\n");
+            printf("%s, %s, %u\n", employees[i].name, employees[i].address, employees[i].hours);
+            free(employees[i].name);
+            free(employees[i].address);
         }
-
         free(employees);
     }
-
+    free(data);
     return STATUS_SUCCESS;
 }
 
 
             
+
+
+// the request is framed as negotiated, the changes keep the framing of replication.h
+int watch_changes(int socket, uint16_t protocol_version)
+{
+    unsigned char header[sizeof(proto_msg) + sizeof(uint32_t)];
+    if (send_request(socket, protocol_version, SUBSCRIBE_REQUEST, 1, NULL, 0, 0) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to send subscribe request to server\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    size_t capacity = 0;
+    unsigned char *data = NULL;
+    while (true)
+    {
+        int nbytes_recv = receive_all(socket, header, sizeof(header), 0);
+        if (nbytes_recv == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d - unable to receive change from server\n", __FILE__, __FUNCTION__, __LINE__);
+            free(data);
+            return STATUS_ERROR;
+        }
+        if (nbytes_recv == 0)
+        {
+            // a subscriber too far behind is dropped, a new list and subscription bring it up to date again
+            printf("server closed the subscription\n");
+            free(data);
+            return STATUS_SUCCESS;
+        }
+
+        proto_msg msg_type = *(proto_msg *)header;
+        uint32_t data_len = ntohl(*(uint32_t *)(header + sizeof(proto_msg)));
+        if ((msg_type != SUBSCRIBE_RESPONSE && msg_type != REPLICATION_CHANGE) || data_len > REPLICATION_MAX_MESSAGE)
+        {
+            fprintf(stderr, "%s:%s:%d - unexpected message from server\n", __FILE__, __FUNCTION__, __LINE__);
+            free(data);
+            return STATUS_ERROR;
+        }
+        if (data_len > capacity)
+        {
+            unsigned char *new_data = realloc(data, data_len);
+            if (!new_data)
+            {
+                fprintf(stderr, "%s:%s:%d - unable to grow receive buffer\n", __FILE__, __FUNCTION__, __LINE__);
+                free(data);
+                return STATUS_ERROR;
+            }
+            data = new_data;
+            capacity = data_len;
+        }
+        if (receive_all(socket, data, data_len, 0) != (int)data_len)
+        {
+            fprintf(stderr, "%s:%s:%d - unable to receive change from server\n", __FILE__, __FUNCTION__, __LINE__);
+            free(data);
+            return STATUS_ERROR;
+        }
+
+        if (msg_type == SUBSCRIBE_RESPONSE)
+        {
+            printf("subscribed as of change %lu\n", (unsigned long)be64toh(*(uint64_t *)data));
+            fflush(stdout);
+            continue;
+        }
+
+        change c;
+        uint64_t head_seq;
+        if (replication_decode_change(data, data_len, &c, &head_seq) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d - invalid change from server\n", __FILE__, __FUNCTION__, __LINE__);
+            free(data);
+            return STATUS_ERROR;
+        }
+        if (c.type == CHANGE_ADD)
+            printf("%lu add %s, %s, %u\n", (unsigned long)c.seq, c.name, c.address, c.hours);
+        else if (c.type == CHANGE_UPDATE)
+            printf("%lu update %s, %u\n", (unsigned long)c.seq, c.name, c.hours);
+        else
+            printf("%lu delete %s\n", (unsigned long)c.seq, c.name);
+        fflush(stdout);
+    }
+}
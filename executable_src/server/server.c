@@ -8,35 +8,57 @@
 #include <errno.h>
 #include <unistd.h>
 #include <poll.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 
 #include "common.h"
 #include "serialize.h"
 #include "parse.h"
 #include "models.h"
 #include "proto.h"
+#include "db.h"
+#include "shard.h"
+#include "replication.h"
+#include "frame.h"
 
 #define ALPHA 0.5L
 #define MAX_SERV_LEN 100
 
+// set by SIGINT and SIGTERM, the accept loop stops and the server shuts down cleanly
+static volatile sig_atomic_t shutdown_requested = 0;
+
 
 void print_usage(char **argv);
 int get_listener_socket(char *address, char *port);
+int get_unix_listener_socket(char *path);
 int add_fd(struct pollfd **pfds, size_t *fd_count, nfds_t *fd_size, int fd);
 int remove_fd(struct pollfd *pfds, size_t *fd_count, connection_map *m, size_t conn_idx);
 int receive_from_client(int client_fd, client_connection *conn);
-int send_handshake_response(int client_fd, unsigned char flag);
-int send_invalid_request_response(int client_fd);
-int send_empty_response(int client_fd);
+int queue_handshake_response(client_connection *conn, unsigned char flag);
+int queue_invalid_request_response(client_connection *conn);
+int queue_empty_response(client_connection *conn);
+int queue_response(client_connection *conn, unsigned char *response_buf, size_t response_buf_size);
+int flush_responses(int client_fd, client_connection *conn);
+int send_queued(int client_fd, client_connection *conn);
 int accept_new_client(int listener, struct pollfd **pfds, size_t *fd_count, nfds_t *fd_size, connection_map *m);
 int handle_client_disconnect(struct pollfd **pfds, size_t *fd_count, nfds_t *fd_size, connection_map *client_connections, client_connection *conn);
-int handle_uninitialized_client(int client_fd, client_connection *conn, uint16_t protocol_version);
-int handle_initialized_client(int client_fd, client_connection *conn, int *nbytes_read);
-int handle_db_access_request(int dbfd, employee **employees, db_header *dbhdr, client_connection *conn, int client_fd);
+int handle_client_input(db_shards *shards, int client_fd, client_connection *conn, uint16_t protocol_version, bool *disconnect);
+short client_poll_events(client_connection *conn);
+int handle_uninitialized_client(client_connection *conn, uint16_t protocol_version, bool *disconnect);
+int handle_initialized_client(db_shards *shards, int client_fd, client_connection *conn, bool *disconnect);
+int ship_changes(db_shards *shards, struct pollfd **pfds, size_t *fd_count, nfds_t *fd_size, connection_map *client_connections, int listener);
+int handle_db_access_request(db_shards *shards, client_connection *conn);
+
+static void handle_shutdown_signal(int sig)
+{
+    (void)sig;
+    shutdown_requested = 1;
+}
 
 int main(int argc, char *argv[])
 {
@@ -52,9 +74,18 @@ int main(int argc, char *argv[])
     char *protocol_version_str = NULL;
     char *fname = NULL;
     bool new_file_flag = false;
+    int checkpoint_flags = 0;
+    char *load_threads_str = NULL;
+    char *budget_str = NULL;
+    bool address_index_flag = false;
+    bool lazy_flag = false;
+    char *snapshot_path = NULL;
+    char *shard_count_str = NULL;
+    char *primary_str = NULL;
+    char *unix_path = NULL;
     int c;
 
-    while ((c = getopt(argc, argv, ":f:a:p:v:n")) != -1)
+    while ((c = getopt(argc, argv, ":f:a:p:v:nixmzkglt:b:S:s:P:U:")) != -1)
     {
         switch (c)
         {
@@ -73,6 +104,45 @@ int main(int argc, char *argv[])
             case 'n':
                 new_file_flag = true;
                 break;
+            case 'i':
+                checkpoint_flags |= DB_CHECKPOINT_OFFSETS;
+                break;
+            case 'x':
+                checkpoint_flags |= DB_CHECKPOINT_NAME_INDEX;
+                break;
+            case 'm':
+                checkpoint_flags |= DB_CHECKPOINT_ADDRESS_DICTIONARY;
+                break;
+            case 'z':
+                checkpoint_flags |= DB_CHECKPOINT_COMPRESSED;
+                break;
+            case 'k':
+                checkpoint_flags |= DB_CHECKPOINT_CHECKSUMS;
+                break;
+            case 'g':
+                address_index_flag = true;
+                break;
+            case 'l':
+                lazy_flag = true;
+                break;
+            case 't':
+                load_threads_str = optarg;
+                break;
+            case 'b':
+                budget_str = optarg;
+                break;
+            case 'S':
+                snapshot_path = optarg;
+                break;
+            case 's':
+                shard_count_str = optarg;
+                break;
+            case 'P':
+                primary_str = optarg;
+                break;
+            case 'U':
+                unix_path = optarg;
+                break;
             case ':':
                 fprintf(stderr, "missing argument value\n");
                 print_usage(argv);
@@ -95,49 +165,87 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    // open database file
-    int fd;
-    if (new_file_flag)
+    // number of threads used for loading, 0 uses every online core
+    uint32_t load_threads = 0;
+    if (load_threads_str && parse_employee_hours(load_threads_str, &load_threads) == STATUS_ERROR)
     {
-        if ((fd = open(fname, O_RDWR | O_CREAT | O_EXCL, 0666)) == -1)
-        {
-            fprintf(stderr, "%s:%s:%d - error creating new file '%s' : (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, fname, errno, strerror(errno));
-            exit(1);
-        }
-        if (write_new_file_hdr(fd) == STATUS_ERROR) 
-        {
-            exit(1);
-        }
-		// reset file cursor to beginning
-		if (lseek(fd, 0, SEEK_SET) == -1)
-		{
-			fprintf(stderr, "%s:%s:%d - unable to reset file cursor: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
-			exit(1);
-		}
+        fprintf(stderr, "invalid number of load threads\n");
+        exit(1);
     }
-    else
+
+    // with a memory budget, records stay in the file and are read through a buffer pool of that size
+    uint32_t budget_mib = 0;
+    if (budget_str && (parse_employee_hours(budget_str, &budget_mib) == STATUS_ERROR || budget_mib == 0))
+    {
+        fprintf(stderr, "invalid buffer pool budget\n");
+        exit(1);
+    }
+    if (budget_str && address_index_flag)
     {
-        if ((fd = open(fname, O_RDWR, 0666)) == -1)
+        fprintf(stderr, "-g cannot be used with -b, a paged database scans its addresses\n");
+        exit(1);
+    }
+    if (budget_str && lazy_flag)
+    {
+        fprintf(stderr, "-l cannot be used with -b, a paged database never materializes its records\n");
+        exit(1);
+    }
+    if (snapshot_path && (budget_str || lazy_flag))
+    {
+        fprintf(stderr, "-S cannot be used with -b or -l, a snapshot holds the whole table\n");
+        exit(1);
+    }
+
+    // employees are partitioned by name across this many files, each loaded by threads of its own
+    uint32_t shard_count = 1;
+    if (shard_count_str && (parse_employee_hours(shard_count_str, &shard_count) == STATUS_ERROR || shard_count == 0 || shard_count > DB_SHARD_MAX))
+    {
+        fprintf(stderr, "invalid number of shards, between 1 and %d are supported\n", DB_SHARD_MAX);
+        exit(1);
+    }
+
+    // a follower starts from a copy of its primary's database, so its own files are replaced
+    char *primary_host = NULL;
+    char *primary_port = NULL;
+    if (primary_str)
+    {
+        char *separator = strrchr(primary_str, ':');
+        if (!separator || separator == primary_str || separator[1] == '\0')
         {
-            fprintf(stderr, "%s:%s:%d - unable to open file %s: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, fname, errno, strerror(errno));
+            fprintf(stderr, "invalid primary, expected <HOST>:<PORT>\n");
             exit(1);
         }
+        *separator = '\0';
+        primary_host = primary_str;
+        primary_port = separator + 1;
     }
-    
-    // Read database file header and stats from file
-    db_header dbhdr;
-    if(read_dbhdr(fd, &dbhdr) == STATUS_ERROR)
+    if (primary_str && snapshot_path)
     {
+        fprintf(stderr, "-S cannot be used with -P, a follower starts from a copy of its primary\n");
         exit(1);
     }
+    if (primary_str)
+    {
+        db_shards_remove_files(fname, shard_count);
+        new_file_flag = true;
+    }
 
-    // Read employees from data base
-    size_t employees_size = dbhdr.employee_count;      
-    employee *employees = (employee *) malloc(sizeof(employee) * employees_size);
-    if (read_employees(fd, &employees, employees_size) == STATUS_ERROR)
+    // Open or create the file of every shard and read their headers and employees, decoding ranges of records in parallel,
+    // or each record on its first use
+    db_shard_options options = {
+        .checkpoint_flags=checkpoint_flags,
+        .load_threads=load_threads,
+        .lazy=lazy_flag,
+        .budget=(size_t)budget_mib * 1024 * 1024,
+        .snapshot_path=snapshot_path,
+        .address_index=address_index_flag,
+    };
+    db_shards shards;
+    if (db_shards_open(&shards, fname, shard_count, new_file_flag, &options) == STATUS_ERROR)
     {
         exit(1);
     }
+    shards.read_only = primary_str != NULL;
 
     // convert/validate protocol version
     char *end = NULL;
@@ -149,6 +257,16 @@ int main(int argc, char *argv[])
     }
 
 
+    // receive the whole copy before serving anyone, the changes after it are applied as they arrive
+    replica replica = { .fd=-1 };
+    if (primary_str && replica_connect(&replica, primary_host, primary_port, parsed_protocol_version, &shards) == STATUS_ERROR)
+    {
+        fprintf(stderr, "unable to replicate from %s:%s\n", primary_host, primary_port);
+        exit(1);
+    }
+    if (primary_str)
+        printf("following %s:%s as of change %lu\n", primary_host, primary_port, (unsigned long)shards.changes.last_seq);
+
     // get listener for accepting new connections
     int listener = get_listener_socket(address, port);
     if (listener == STATUS_ERROR)
@@ -157,6 +275,23 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    // clients on the same host can skip the TCP stack, they are served like any other
+    int unix_listener = -1;
+    if (unix_path && (unix_listener = get_unix_listener_socket(unix_path)) == STATUS_ERROR)
+    {
+        fprintf(stderr, "getting unix domain listener socket failed\n");
+        exit(1);
+    }
+
+    // no SA_RESTART, so a signal interrupts poll() and the loop sees the request right away
+    struct sigaction sa = { .sa_handler=handle_shutdown_signal };
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGINT, &sa, NULL) == -1 || sigaction(SIGTERM, &sa, NULL) == -1)
+    {
+        fprintf(stderr, "unable to install signal handlers: (%d) %s\n", errno, strerror(errno));
+        exit(1);
+    }
+
     // for polling sockets
     nfds_t fd_count = 0;
     size_t fd_size = 16;
@@ -167,15 +302,28 @@ int main(int argc, char *argv[])
         fprintf(stderr, "unable to add listener to file descriptor set\n");
         exit(1);
     }
+    if (unix_listener != -1 && add_fd(&pfds, &fd_count, &fd_size, unix_listener) == STATUS_ERROR)
+    {
+        fprintf(stderr, "unable to add unix domain listener to file descriptor set\n");
+        exit(1);
+    }
+    if (replica.fd != -1 && add_fd(&pfds, &fd_count, &fd_size, replica.fd) == STATUS_ERROR)
+    {
+        fprintf(stderr, "unable to add primary to file descriptor set\n");
+        exit(1);
+    }
 
     // for mapping client file descriptors to client connection states
     connection_map client_connections;
     connection_map_init(&client_connections, ALPHA);
 
     // accpet loop
-    while (1)
+    while (!shutdown_requested)
     {
-        int poll_count = poll(pfds, fd_count, -1);
+        // don't block while a compaction of deleted records still has work to do
+        int poll_count = poll(pfds, fd_count, db_shards_compaction_pending(&shards) ? 0 : -1);
+        if (poll_count == -1 && errno == EINTR)
+            continue;
         if (poll_count == -1)
         {
             fprintf(stderr, "error polling sockets: (%d) %s\n", errno, strerror(errno));
@@ -188,15 +336,31 @@ int main(int argc, char *argv[])
             // check if socket is ready to be read from
             if (pfds[i].revents & POLLIN)
             {
-                if (pfds[i].fd == listener)
+                if (pfds[i].fd == listener || pfds[i].fd == unix_listener)
                 {
                     // We are accepting a new client
-                    if (accept_new_client(listener, &pfds, &fd_count, &fd_size, &client_connections) == STATUS_ERROR)
+                    if (accept_new_client(pfds[i].fd, &pfds, &fd_count, &fd_size, &client_connections) == STATUS_ERROR)
                     {
                         fprintf(stderr, "accept_new_client() failed\n");
                         continue;
                     }
                 }
+                else if (replica.fd != -1 && pfds[i].fd == replica.fd)
+                {
+                    // apply the changes sent by the primary, a follower that loses it keeps serving what it has
+                    int nbytes_read = replica_receive(&replica, &shards);
+                    if (nbytes_read == STATUS_ERROR || nbytes_read == 0)
+                    {
+                        fprintf(stderr, nbytes_read == 0 ? "primary disconnected\n" : "replication from primary failed\n");
+                        free_replica(&replica);
+                        pfds[i].fd = -1;
+                    }
+                    else
+                    {
+                        // a follower that starts over from a new copy does so on a new connection
+                        pfds[i].fd = replica.fd;
+                    }
+                }
                 else
                 {
                     // get client connection from map
@@ -216,6 +380,7 @@ int main(int argc, char *argv[])
                         exit(1);
                     }
 
+                    int client_fd = pfds[i].fd;
                     if (nbytes_read == 0)
                     {
                         // client's connection has terminated
@@ -224,51 +389,131 @@ int main(int argc, char *argv[])
                             fprintf(stderr, "handle_client_disconnect() failed\n");
                             exit(1);
                         }
+                        close(client_fd);
                         continue;
                     }
-                    else if (conn->state == UNINITIALIZED && nbytes_read == sizeof(proto_msg) + sizeof(uint16_t))
-                    {
-                        if (handle_uninitialized_client(pfds[i].fd, conn, parsed_protocol_version) == STATUS_ERROR)
-                        {
-                            fprintf(stderr, "handle_unitialized_client() failed\n");
-                            exit(1);
-                        }
-                    }
-                    else if (conn->state == INITIALIZED && nbytes_read == sizeof(proto_msg) + sizeof(uint32_t))
+
+                    // serve every request the bytes read complete, the client may have sent several back to back
+                    conn->in_start = 0;
+                    conn->in_len = (size_t)nbytes_read;
+                    bool disconnect = false;
+                    if (handle_client_input(&shards, client_fd, conn, parsed_protocol_version, &disconnect) == STATUS_ERROR)
                     {
-                        if (handle_initialized_client(pfds[i].fd, conn, &nbytes_read) == STATUS_ERROR)
-                        {
-                            fprintf(stderr, "handle_initialized_client() failed\n");
-                            exit(1);
-                        }
+                        fprintf(stderr, "handle_client_input() failed\n");
+                        exit(1);
                     }
 
-                    // Check if connection has been transistioned/or is in, request state and all bytes of request have been read successfully
-                    if (conn->state == REQUEST && nbytes_read == conn->buf_size)
+                    // the client sent something the rest of its stream can't be parsed after, or stopped reading
+                    if (disconnect)
                     {
-                        if (handle_db_access_request(fd, &employees, &dbhdr, conn, pfds[i].fd) == STATUS_ERROR)
+                        if (handle_client_disconnect(&pfds, &fd_count, &fd_size, &client_connections, conn) == STATUS_ERROR)
                         {
-                            fprintf(stderr, "handle_db_access_request() failed\n");
+                            fprintf(stderr, "handle_client_disconnect() failed\n");
                             exit(1);
                         }
+                        close(client_fd);
+                        continue;
                     }
+                    if (conn->state != FOLLOWER && conn->state != SUBSCRIBER)
+                        pfds[i].events = client_poll_events(conn);
                 }
             }   // check for pollin flag being set
+            else if ((pfds[i].revents & (POLLOUT | POLLERR | POLLHUP)) && connection_map_contains(&client_connections, pfds[i].fd))
+            {
+                // followers and subscribers are sent what they are owed by ship_changes()
+                client_connection *conn = connection_map_get(&client_connections, pfds[i].fd);
+                if (conn->state == FOLLOWER || conn->state == SUBSCRIBER)
+                    continue;
+
+                // the client took some of its responses, the requests read before it stopped taking them are served now
+                int client_fd = pfds[i].fd;
+                bool disconnect = flush_responses(client_fd, conn) == STATUS_ERROR;
+                if (!disconnect && handle_client_input(&shards, client_fd, conn, parsed_protocol_version, &disconnect) == STATUS_ERROR)
+                {
+                    fprintf(stderr, "handle_client_input() failed\n");
+                    exit(1);
+                }
+                if (disconnect)
+                {
+                    if (handle_client_disconnect(&pfds, &fd_count, &fd_size, &client_connections, conn) == STATUS_ERROR)
+                    {
+                        fprintf(stderr, "handle_client_disconnect() failed\n");
+                        exit(1);
+                    }
+                    close(client_fd);
+                    continue;
+                }
+                if (conn->state != FOLLOWER && conn->state != SUBSCRIBER)
+                    pfds[i].events = client_poll_events(conn);
+            }
         } // for loop checking sockets to poll
+
+        // queue each follower and subscriber the changes applied since it was last sent any, and send what its
+        // socket takes, which is also where a socket poll() reported writable is served
+        if (ship_changes(&shards, &pfds, &fd_count, &fd_size, &client_connections, listener) == STATUS_ERROR)
+        {
+            fprintf(stderr, "ship_changes() failed\n");
+            exit(1);
+        }
+
+        // copy the next batch of live records of each shard into its compacted file
+        if (db_shards_compact_step(&shards, DB_COMPACT_BATCH) == STATUS_ERROR)
+        {
+            fprintf(stderr, "db_shards_compact_step() failed\n");
+            exit(1);
+        }
+
+        // write the offset directory and name index again once enough records were appended since they were
+        if (db_shards_checkpoint(&shards, DB_CHECKPOINT_APPENDED) == STATUS_ERROR)
+        {
+            fprintf(stderr, "db_shards_checkpoint() failed\n");
+            exit(1);
+        }
     } // end while loop
 
-    return 0;
+    // the next start maps the offset directory and name index instead of rebuilding them
+    int exit_status = 0;
+    if (db_shards_checkpoint(&shards, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "unable to checkpoint\n");
+        exit_status = 1;
+    }
+
+    // the next start maps the snapshot instead of reading the file, unless the file changes before then
+    if (snapshot_path && db_shards_write_snapshots(&shards, snapshot_path) == STATUS_ERROR)
+    {
+        fprintf(stderr, "unable to write snapshot\n");
+        exit_status = 1;
+    }
+    if (unix_path)
+        unlink(unix_path);
+    free_replica(&replica);
+    free_db_shards(&shards);
+    return exit_status;
 }
 
 
 void print_usage(char **argv)
 {
     printf("usage: %s -f <FILE> -a <ADDRESS> -p <PORT> -v <VERSION>\n", argv[0]);
-    printf("-f <FILE>: (REQUIRED) the file of the database\n");
+    printf("-f <FILE>: (REQUIRED) the file of the database, the numbering of its changes is kept in <FILE>.seq\n");
     printf("-a <ADDRESS>: (REQUIRED) the address of the server\n");
     printf("-p <PORT>:  (REQUIRED) the port of the server\n");
-    printf("-v <VERSION>: (REQUIRED) the protocol version\n");
+    printf("-v <VERSION>: (REQUIRED) the protocol version (1 or 2), a version 2 server also accepts version 1 clients\n");
     printf("-n : (OPTIONAL) flag to create a new file\n");
+    printf("-i : (OPTIONAL) flag to write a record offset directory to the file, written again on shutdown and every %d added records\n", DB_CHECKPOINT_APPENDED);
+    printf("-x : (OPTIONAL) flag to write a name index to the file, written again on shutdown and every %d added records\n", DB_CHECKPOINT_APPENDED);
+    printf("-m : (OPTIONAL) flag to store each distinct address once, in a dictionary referenced by the records\n");
+    printf("-z : (OPTIONAL) flag to write the records in compressed blocks, records changed inside them are appended after them until the next compaction\n");
+    printf("-k : (OPTIONAL) flag to write checksums of the records, kept up to date by every write and verified on load\n");
+    printf("-g : (OPTIONAL) flag to build a trigram index over addresses for substring searches\n");
+    printf("-l : (OPTIONAL) flag to decode each record on its first use instead of at startup, needs the offset directory and name index of a checkpoint\n");
+    printf("-S <FILE>: (OPTIONAL) start from this snapshot when it matches the database file, and write one on shutdown\n");
+    printf("-s <SHARDS>: (OPTIONAL) partition employees by name across this many files, <FILE>.0 to <FILE>.<SHARDS - 1>, defaults to 1 which uses <FILE>\n");
+    printf("-t <THREADS>: (OPTIONAL) number of threads used to load the file, defaults to the number of cores\n");
+    printf("-b <MIB>: (OPTIONAL) keep records in the file and read them through a buffer pool of this many MiB, only the indexes stay in memory\n");
+    printf("-U <PATH>: (OPTIONAL) also listen on a unix domain socket at this path, for clients on the same host\n");
+    printf("-P <HOST>:<PORT>: (OPTIONAL) follow the primary at this address, replacing <FILE> with a copy of its database and applying its changes, writes are refused\n");
 }
 
 
@@ -340,6 +585,61 @@ int get_listener_socket(char *address, char *port)
     freeaddrinfo(ai);
     return listener;
 }
+
+// Binds a unix domain stream socket at path. A socket left behind at the path by a server that didn't shut down
+// cleanly is replaced, one another server still listens on is not, and neither is any other file there.
+int get_unix_listener_socket(char *path)
+{
+    struct sockaddr_un addr = { .sun_family=AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%s:%s:%d unix domain socket path longer than %zu bytes\n", __FILE__, __FUNCTION__, __LINE__, sizeof(addr.sun_path) - 1);
+        return STATUS_ERROR;
+    }
+    strcpy(addr.sun_path, path);
+
+    // a socket nothing accepts on anymore refuses the connection, a live one takes it or, with its backlog full, would block
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (probe == -1)
+        {
+            fprintf(stderr, "%s:%s:%d socket() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        int status = connect(probe, (struct sockaddr *)&addr, sizeof(addr));
+        int probe_errno = errno;
+        close(probe);
+        if (status == 0 || probe_errno == EAGAIN)
+        {
+            fprintf(stderr, "%s:%s:%d another server is listening at %s\n", __FILE__, __FUNCTION__, __LINE__, path);
+            return STATUS_ERROR;
+        }
+        if (probe_errno != ECONNREFUSED)
+        {
+            fprintf(stderr, "%s:%s:%d unable to tell whether a server is listening at %s: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, path, probe_errno, strerror(probe_errno));
+            return STATUS_ERROR;
+        }
+        unlink(path);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1)
+    {
+        fprintf(stderr, "%s:%s:%d socket() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(listener, 10) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to listen at %s: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, path, errno, strerror(errno));
+        close(listener);
+        return STATUS_ERROR;
+    }
+
+    printf("listening at %s...\n", path);
+    return listener;
+}
         
 
 int add_fd(struct pollfd **pfds, size_t *fd_count, nfds_t *fd_size, int fd)
@@ -385,115 +685,190 @@ int remove_fd(struct pollfd *pfds, size_t *fd_count, connection_map *m, size_t c
 
 int receive_from_client(int client_fd, client_connection *conn)
 {
-    if (conn->state == UNINITIALIZED)
+    // read whatever the socket has, up to a buffer's worth, instead of one header or request at a time
+    int nbytes_read = 0;
+    if ((nbytes_read = recv(client_fd, conn->in, CONNECTION_READ_SIZE, 0)) == -1)
     {
-        // compute number of byte remaining when in uninitialized state
-        size_t bytes_rem = sizeof(proto_msg) + sizeof(uint16_t) - (size_t)(conn->header_cursor - conn->header);
-        int nbytes_read = 0;
-        if ((nbytes_read = recv(client_fd, conn->header_cursor, bytes_rem, 0)) == -1)
-        {
-            fprintf(stderr, "%s:%s:%d unable to receive header bytes from client's socket: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
-            return STATUS_ERROR;
-        }
-        
-        if (nbytes_read == 0) return 0;     // client has terminated their connection
+        // a client that reset its connection has gone away like one that closed it
+        if (errno == ECONNRESET)
+            return 0;
 
-        // adjust cursor and return total bytes that have been read so far
-        conn->header_cursor += nbytes_read;
-        return (int)(conn->header_cursor - conn->header);
+        fprintf(stderr, "%s:%s:%d unable to receive bytes from client's socket: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
     }
-    else if (conn->state == INITIALIZED)
+    return nbytes_read;
+}
+
+// Serves the requests completed by the bytes read in the order they were sent. A request cut off at the end of
+// them is left in the connection's header or buffer until the next read completes it. The responses are queued
+// and leave together, so a client pipelining requests pays one round trip per batch instead of per request.
+// Once CONNECTION_MAX_BACKLOG of them wait for a client that doesn't read them, the rest of its bytes wait in
+// conn->in until its socket takes them.
+int handle_client_input(db_shards *shards, int client_fd, client_connection *conn, uint16_t protocol_version, bool *disconnect)
+{
+    unsigned char *cursor = conn->in + conn->in_start;
+    unsigned char *end = conn->in + conn->in_len;
+    while (cursor < end && !*disconnect)
     {
-        // compute bytes left to be read
-        size_t header_bytes_rem = sizeof(proto_msg) + sizeof(uint32_t) - (size_t)(conn->header_cursor - conn->header);
-        int nbytes_read = 0;
-        if ((nbytes_read = recv(client_fd, conn->header_cursor, header_bytes_rem, 0)) == -1)
+        // nothing is sent after a replication or subscribe request, reading only notices the client going away
+        if (conn->state == FOLLOWER || conn->state == SUBSCRIBER)
         {
-            fprintf(stderr, "%s:%s:%d unable to receive header bytes from client's socket: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
-            return STATUS_ERROR;
+            cursor = end;
+            break;
         }
 
-        if (nbytes_read == 0) return 0;
-
-        // adjust header cursor and check if header has been completely read
-        conn->header_cursor += nbytes_read;
-        return (int)(conn->header_cursor - conn->header);
-    }
-    else
-    {
-        // for keeping track of how many bytes to read and how many bytes were read
-        size_t buf_bytes_rem = conn->buf_size - (size_t)(conn->buf_cursor - conn->buf); 
-        int nbytes_read = 0;
-
-        if ((nbytes_read = recv(client_fd, conn->buf_cursor, buf_bytes_rem, 0)) == -1)
+        if (conn->state == REQUEST)
         {
-            fprintf(stderr, "%s:%s:%d unable to receive bytes from client's socket: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
-            return STATUS_ERROR;
+            // copy as much of the request's data as has arrived
+            size_t buf_bytes_rem = conn->buf_size - (size_t)(conn->buf_cursor - conn->buf);
+            size_t n = (size_t)(end - cursor) < buf_bytes_rem ? (size_t)(end - cursor) : buf_bytes_rem;
+            memcpy(conn->buf_cursor, cursor, n);
+            conn->buf_cursor += n;
+            cursor += n;
+            if (conn->buf_cursor < conn->buf + conn->buf_size)
+                break;
+
+            if (handle_db_access_request(shards, conn) == STATUS_ERROR)
+            {
+                fprintf(stderr, "%s:%s:%d - handle_db_access_request() failed\n", __FILE__, __FUNCTION__, __LINE__);
+                return STATUS_ERROR;
+            }
         }
+        else
+        {
+            // the handshake comes first, then the header of every request
+            size_t header_size = conn->state == UNINITIALIZED ? sizeof(proto_msg) + sizeof(uint16_t) : request_header_size(conn->version);
+            size_t header_bytes_rem = header_size - (size_t)(conn->header_cursor - conn->header);
+            size_t n = (size_t)(end - cursor) < header_bytes_rem ? (size_t)(end - cursor) : header_bytes_rem;
+            memcpy(conn->header_cursor, cursor, n);
+            conn->header_cursor += n;
+            cursor += n;
+            if (conn->header_cursor < conn->header + header_size)
+                break;
 
-        // client has ended connection early
-        if (nbytes_read == 0) return 0;
+            if (conn->state == UNINITIALIZED)
+            {
+                if (handle_uninitialized_client(conn, protocol_version, disconnect) == STATUS_ERROR)
+                {
+                    fprintf(stderr, "%s:%s:%d - handle_uninitialized_client() failed\n", __FILE__, __FUNCTION__, __LINE__);
+                    return STATUS_ERROR;
+                }
+            }
+            else if (handle_initialized_client(shards, client_fd, conn, disconnect) == STATUS_ERROR)
+            {
+                fprintf(stderr, "%s:%s:%d - handle_initialized_client() failed\n", __FILE__, __FUNCTION__, __LINE__);
+                return STATUS_ERROR;
+            }
+        }
 
-        // update buffer cursor
-        conn->buf_cursor += nbytes_read;
-        return (int)(conn->buf_cursor - conn->buf);
+        // don't let the responses to a long batch pile up, nor serve a client more than it takes
+        if (conn->out_len - conn->out_sent >= CONNECTION_READ_SIZE && flush_responses(client_fd, conn) == STATUS_ERROR)
+            *disconnect = true;
+        if (conn->out_len - conn->out_sent >= CONNECTION_MAX_BACKLOG)
+            break;
     }
+    conn->in_start = (size_t)(cursor - conn->in);
+
+    if (flush_responses(client_fd, conn) == STATUS_ERROR)
+        *disconnect = true;
+    return STATUS_SUCCESS;
 }
 
-            
-int send_handshake_response(int client_fd, unsigned char flag)
+// a client that can't be sent its responses is disconnected instead of taking the server down
+int flush_responses(int client_fd, client_connection *conn)
 {
-    // allocate buffer and serialize response data
-    unsigned char *response_buffer = malloc(sizeof(proto_msg) + 1);
-    *(proto_msg*)(response_buffer) = HANDSHAKE_RESPONSE;
-    *(response_buffer + sizeof(proto_msg)) = flag;
+    // what is queued for a follower or subscriber is sent by ship_changes()
+    if (conn->state == FOLLOWER || conn->state == SUBSCRIBER)
+        return STATUS_SUCCESS;
 
-    // send response to client
-    if (send_all(client_fd, response_buffer, sizeof(proto_msg) + 1, 0) == STATUS_ERROR)
+    if (send_queued(client_fd, conn) == STATUS_ERROR)
     {
-        fprintf(stderr, "%s:%s:%d unable to send handshake response to client\n", __FILE__, __FUNCTION__, __LINE__);
+        fprintf(stderr, "%s:%s:%d unable to send responses to client\n", __FILE__, __FUNCTION__, __LINE__);
         return STATUS_ERROR;
     }
-
-    free(response_buffer);
-
     return STATUS_SUCCESS;
 }
 
-    
-int send_invalid_request_response(int client_fd)
+// a client isn't read from while its responses are backlogged or bytes it sent before wait to be served, and is
+// polled for writing while any response waits for its socket
+short client_poll_events(client_connection *conn)
 {
-    // allocate buffer and serialize response data
-    unsigned char *response_buffer = malloc(sizeof(proto_msg) + sizeof(uint32_t) + 1);
-    *(proto_msg *)response_buffer = INVALID_REQUEST;
-    
-    // send response down the wire
-    if (send_all(client_fd, response_buffer, sizeof(proto_msg), 0) == STATUS_ERROR)
-    {
-        fprintf(stderr, "%s:%s:%d unable to send error response to client\n", __FILE__, __FUNCTION__, __LINE__);
-        return STATUS_ERROR;
+    bool backlogged = conn->out_len - conn->out_sent >= CONNECTION_MAX_BACKLOG || conn->in_start < conn->in_len;
+    return (backlogged ? 0 : POLLIN) | (conn->out_sent < conn->out_len ? POLLOUT : 0);
+}
+
+// sends what is queued for a client until its socket would block, the rest once poll() reports it writable, so a
+// client that doesn't read can't hold up the accept loop
+int send_queued(int client_fd, client_connection *conn)
+{
+    while (conn->out_sent < conn->out_len)
+    {
+        ssize_t nbytes_sent = send(client_fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (nbytes_sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (nbytes_sent == -1 && errno == EINTR)
+            continue;
+        if (nbytes_sent == -1)
+        {
+            fprintf(stderr, "%s:%s:%d unable to send to client: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        conn->out_sent += nbytes_sent;
     }
 
-    free(response_buffer);
+    // move what is left to the front once most of the buffer has been sent, so it does not keep growing
+    if (conn->out_sent == conn->out_len)
+    {
+        conn->out_len = 0;
+        conn->out_sent = 0;
+    }
+    else if (conn->out_sent >= conn->out_len / 2)
+    {
+        memmove(conn->out, conn->out + conn->out_sent, conn->out_len - conn->out_sent);
+        conn->out_len -= conn->out_sent;
+        conn->out_sent = 0;
+    }
     return STATUS_SUCCESS;
 }
 
-int send_empty_response(int client_fd)
+int queue_handshake_response(client_connection *conn, unsigned char flag)
 {
-    // allocate buffer and write values for an empty response
-    unsigned char *response_buffer = malloc(sizeof(proto_msg) + sizeof(uint32_t) + 1);
-    *((proto_msg *)response_buffer) = DB_ACCESS_RESPONSE;
-    *(response_buffer + sizeof(proto_msg)) = 0;
-    *((uint32_t *)(response_buffer + sizeof(proto_msg) + 1)) = 0;
+    // serialize response data
+    unsigned char response_buffer[sizeof(proto_msg) + 1];
+    *(proto_msg*)(response_buffer) = HANDSHAKE_RESPONSE;
+    *(response_buffer + sizeof(proto_msg)) = flag;
+    return client_connection_queue(conn, response_buffer, sizeof(response_buffer));
+}
 
-    if (send_all(client_fd, response_buffer, sizeof(proto_msg) + sizeof(uint32_t) + 1, 0) == STATUS_ERROR)
+int queue_invalid_request_response(client_connection *conn)
+{
+    if (conn->version >= PROTOCOL_V2)
     {
-        fprintf(stderr, "%s:%s:%d - unable to send empty response to client\n", __FILE__, __FUNCTION__, __LINE__);
-        return STATUS_ERROR;
+        unsigned char header[FRAME_HEADER_SIZE];
+        encode_frame_header(header, &(frame_header) { .opcode=INVALID_REQUEST, .request_id=conn->request_id });
+        return client_connection_queue(conn, header, FRAME_HEADER_SIZE);
     }
 
-    free(response_buffer);
-    return STATUS_SUCCESS;
+    // version 1 sends the message type alone
+    proto_msg response_type = INVALID_REQUEST;
+    return client_connection_queue(conn, &response_type, sizeof(proto_msg));
+}
+
+int queue_empty_response(client_connection *conn)
+{
+    if (conn->version >= PROTOCOL_V2)
+    {
+        unsigned char header[FRAME_HEADER_SIZE];
+        encode_frame_header(header, &(frame_header) { .opcode=DB_ACCESS_RESPONSE, .request_id=conn->request_id });
+        return client_connection_queue(conn, header, FRAME_HEADER_SIZE);
+    }
+
+    // write values for an empty response
+    unsigned char response_buffer[sizeof(proto_msg) + sizeof(uint32_t) + 1];
+    *((proto_msg *)response_buffer) = DB_ACCESS_RESPONSE;
+    *(response_buffer + sizeof(proto_msg)) = 0;
+    *((uint32_t *)(response_buffer + sizeof(proto_msg) + 1)) = 0;
+    return client_connection_queue(conn, response_buffer, sizeof(response_buffer));
 }
 
 int accept_new_client(int listener, struct pollfd **pfds, size_t *fd_count, nfds_t *fd_size, connection_map *m)
@@ -510,20 +885,26 @@ int accept_new_client(int listener, struct pollfd **pfds, size_t *fd_count, nfds
     }
     else
     {
-        char client_addr_buf[INET6_ADDRSTRLEN];
-        char client_serv_buf[MAX_SERV_LEN];
-        int status = getnameinfo(
-        (struct sockaddr *)&client_addr, client_addrlen, 
-        client_addr_buf, INET6_ADDRSTRLEN, 
-        client_serv_buf, MAX_SERV_LEN, NI_NUMERICHOST | NI_NUMERICSERV);
-
-        if (status)
+        if (client_addr.ss_family == AF_UNIX)
         {
-            fprintf(stderr, "%s:%s:%d - unable to get name info for client: %s\n", __FILE__, __FUNCTION__, __LINE__, gai_strerror(status));
-            return STATUS_ERROR;
+            // a peer on a unix domain socket has no address of its own
+            printf("accepting new connection on unix domain socket\n");
         }
         else
         {
+            char client_addr_buf[INET6_ADDRSTRLEN];
+            char client_serv_buf[MAX_SERV_LEN];
+            int status = getnameinfo(
+            (struct sockaddr *)&client_addr, client_addrlen, 
+            client_addr_buf, INET6_ADDRSTRLEN, 
+            client_serv_buf, MAX_SERV_LEN, NI_NUMERICHOST | NI_NUMERICSERV);
+
+            if (status)
+            {
+                fprintf(stderr, "%s:%s:%d - unable to get name info for client: %s\n", __FILE__, __FUNCTION__, __LINE__, gai_strerror(status));
+                close(client_fd);
+                return STATUS_ERROR;
+            }
             printf("accepting new connection from %s:%s\n", client_addr_buf, client_serv_buf);
         }
 
@@ -561,7 +942,7 @@ int handle_client_disconnect(struct pollfd **pfds, size_t *fd_count, nfds_t *fd_
     return STATUS_SUCCESS;
 }
 
-int handle_uninitialized_client(int client_fd, client_connection *conn, uint16_t protocol_version)
+int handle_uninitialized_client(client_connection *conn, uint16_t protocol_version, bool *disconnect)
 {
     // check message type
     proto_msg msg_type = *(proto_msg *)(conn->header);
@@ -571,9 +952,9 @@ int handle_uninitialized_client(int client_fd, client_connection *conn, uint16_t
         fprintf(stderr, "expected %d received %d\n", HANDSHAKE_REQUEST, msg_type);
 
         // send error response
-       if (send_invalid_request_response(client_fd)  == STATUS_ERROR)
+       if (queue_invalid_request_response(conn)  == STATUS_ERROR)
        {
-           fprintf(stderr, "%s:%s:%d - send_invalid_request_response() failed\n", __FILE__, __FUNCTION__, __LINE__);
+           fprintf(stderr, "%s:%s:%d - queue_invalid_request_response() failed\n", __FILE__, __FUNCTION__, __LINE__);
            return STATUS_ERROR;
        }
 
@@ -584,39 +965,96 @@ int handle_uninitialized_client(int client_fd, client_connection *conn, uint16_t
     {
         uint16_t client_protocol_version = ntohs(*(uint16_t *)(conn->header + sizeof(proto_msg)));
         int flag;
-        if (client_protocol_version != protocol_version)
+        // a server framing requests with version 2 still speaks version 1 to older clients
+        if (client_protocol_version != protocol_version && !(protocol_version >= PROTOCOL_V2 && client_protocol_version == PROTOCOL_V1))
         {
+            // nothing the client sends after it can be understood
             flag = 1;
+            *disconnect = true;
         }
         else
         {
             // set flag to 0 to signal no errors 
             flag = 0;
+            conn->version = client_protocol_version;
             // transistion state of client to initialized
             conn->state = INITIALIZED;
             // reset cursor for request header
             conn->header_cursor = conn->header;
         }
 
-       if (send_handshake_response(client_fd, flag) == STATUS_ERROR)
+       if (queue_handshake_response(conn, flag) == STATUS_ERROR)
        {
-           fprintf(stderr, "send_handshake_response() failed\n");
+           fprintf(stderr, "queue_handshake_response() failed\n");
            return STATUS_ERROR;
        }
     }
     return STATUS_SUCCESS;
 }
 
-int handle_initialized_client(int client_fd, client_connection *conn, int *nbytes_read)
+int handle_initialized_client(db_shards *shards, int client_fd, client_connection *conn, bool *disconnect)
 {
-    // parse message type 
-    proto_msg msg_type = *(proto_msg *)(conn->header);
-    if (msg_type != DB_ACCESS_REQUEST)
+    // parse message type and data length, from a fixed little endian header with version 2
+    proto_msg msg_type;
+    uint32_t data_len;
+    if (conn->version >= PROTOCOL_V2)
+    {
+        frame_header h;
+        if (decode_frame_header(conn->header, &h) == STATUS_ERROR || h.payload_len > FRAME_MAX_REQUEST)
+        {
+            fprintf(stderr, "%s:%s:%d - invalid frame received from client\n", __FILE__, __FUNCTION__, __LINE__);
+            *disconnect = true;
+            return queue_invalid_request_response(conn);
+        }
+        msg_type = h.opcode;
+        data_len = h.payload_len;
+        conn->request_id = h.request_id;
+    }
+    else
+    {
+        msg_type = *(proto_msg *)(conn->header);
+        data_len = ntohl(*(uint32_t *)(conn->header + sizeof(proto_msg)));
+    }
+
+    if (msg_type == REPLICATION_REQUEST)
+    {
+        // queue the follower a copy behind any responses, the changes after it are queued once per pass of the
+        // accept loop and all of it is sent as the follower takes it
+        printf("client is following\n");
+        size_t queued = conn->out_len;
+        if (replication_queue_copy(conn, shards) == STATUS_ERROR)
+        {
+            // a follower that did not get its copy can't catch up, it is dropped before it counts as one, with
+            // only the responses queued before the copy sent
+            fprintf(stderr, "%s:%s:%d - unable to send copy to follower\n", __FILE__, __FUNCTION__, __LINE__);
+            conn->out_len = queued;
+            *disconnect = true;
+            return STATUS_SUCCESS;
+        }
+        conn->shipped_seq = shards->changes.last_seq;
+        conn->state = FOLLOWER;
+        conn->header_cursor = conn->header;
+    }
+    else if (msg_type == SUBSCRIBE_REQUEST)
+    {
+        // changes are pushed from the newest one on instead of the client polling with full lists
+        printf("client subscribed\n");
+        if (replication_queue_subscribe(conn, shards) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d - unable to send subscribe response\n", __FILE__, __FUNCTION__, __LINE__);
+            *disconnect = true;
+            return STATUS_SUCCESS;
+        }
+        conn->shipped_seq = shards->changes.last_seq;
+        conn->state = SUBSCRIBER;
+        conn->header_cursor = conn->header;
+    }
+    else if (msg_type != DB_ACCESS_REQUEST)
     {
         fprintf(stderr, "%s:%s:%d - illegal message type received from client\n", __FILE__, __FUNCTION__, __LINE__);
-        if (send_invalid_request_response(client_fd)  == STATUS_ERROR)
+        if (queue_invalid_request_response(conn)  == STATUS_ERROR)
         {
-            fprintf(stderr, "%s:%s:%d - send_invalid_request_response() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            fprintf(stderr, "%s:%s:%d - queue_invalid_request_response() failed\n", __FILE__, __FUNCTION__, __LINE__);
             return STATUS_ERROR;
         }
         // reset header cursor for client connection
@@ -624,17 +1062,14 @@ int handle_initialized_client(int client_fd, client_connection *conn, int *nbyte
     }
     else
     {
-        // parse data length and allocate buffer for request data
-        uint32_t data_len = ntohl(*(uint32_t *)(conn->header + sizeof(proto_msg)));
-
         // check special case to see if client has sent empty request
         if (data_len == 0)
         {
             // client has sent empty request
             printf("client sent empty request\n");
-            if (send_empty_response(client_fd) == STATUS_ERROR)
+            if (queue_empty_response(conn) == STATUS_ERROR)
             {
-                fprintf(stderr, "%s:%s:%d - unable to send empty response to client\n", __FILE__, __FUNCTION__, __LINE__);
+                fprintf(stderr, "%s:%s:%d - unable to queue empty response to client\n", __FILE__, __FUNCTION__, __LINE__);
                 return STATUS_ERROR;
             }
 
@@ -647,23 +1082,14 @@ int handle_initialized_client(int client_fd, client_connection *conn, int *nbyte
             conn->buf_cursor = conn->buf;
             conn->buf_size = (size_t) data_len;
 
-            // transition state of connection
+            // transition state of connection, the data is copied in from what has been read
             conn->state = REQUEST;
-
-            // attempt to read any remaining bytes from client's socket just in case more were able to get through
-            // reset 'nbytes_read' to zero to keep track of bytes read from the request
-            *nbytes_read = 0;
-            if ((*nbytes_read = receive_from_client(client_fd, conn)) == STATUS_ERROR)
-            {
-                fprintf(stderr, "receive_from_client() failed\n");
-                return STATUS_ERROR;
-            }
         }
     }
     return STATUS_SUCCESS;
 }
 
-int handle_db_access_request(int dbfd, employee **employees, db_header *dbhdr, client_connection *conn, int client_fd)
+int handle_db_access_request(db_shards *shards, client_connection *conn)
 {
     // once this state is reached process request and reset state of connection
     // allocate buffer for response to client
@@ -672,18 +1098,19 @@ int handle_db_access_request(int dbfd, employee **employees, db_header *dbhdr, c
     *(proto_msg *)(response_buf) = DB_ACCESS_RESPONSE;
 
     // process request and write to response buffer depending on options requested
-    if (deserialize_request_options(dbfd, employees, dbhdr, &response_buf, &response_buf_size, conn) == STATUS_ERROR)
+    if (deserialize_request_options(shards, &response_buf, &response_buf_size, conn) == STATUS_ERROR)
     {
         fprintf(stderr, "%s:%s:%d - deserialize_request_options() failed\n", __FILE__, __FUNCTION__, __LINE__);
         return STATUS_ERROR;
     }
 
-    // send response back to client
-    if (send_all(client_fd, response_buf, response_buf_size, 0) == STATUS_ERROR)
+    // queue response for the client, it leaves with the rest of the batch
+    if (queue_response(conn, response_buf, response_buf_size) == STATUS_ERROR)
     {
-        fprintf(stderr, "%s:%s:%d - send_all() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        fprintf(stderr, "%s:%s:%d - queue_response() failed\n", __FILE__, __FUNCTION__, __LINE__);
         return STATUS_ERROR;
     }
+    free(response_buf);
 
     // reset client, reset header and buf cursor's and state to initialized
     conn->state = INITIALIZED;
@@ -694,4 +1121,57 @@ int handle_db_access_request(int dbfd, employee **employees, db_header *dbhdr, c
     return STATUS_SUCCESS;
 }
 
+// a response is written with the version 1 header, version 2 moves its error flag into the flags of a frame
+int queue_response(client_connection *conn, unsigned char *response_buf, size_t response_buf_size)
+{
+    if (conn->version < PROTOCOL_V2)
+        return client_connection_queue(conn, response_buf, response_buf_size);
+
+    size_t response_header_size = sizeof(proto_msg) + sizeof(uint32_t) + 1;
+    frame_header h = {
+        .opcode=*(proto_msg *)response_buf,
+        .flags=response_buf[sizeof(proto_msg)],
+        .request_id=conn->request_id,
+        .payload_len=(uint32_t)(response_buf_size - response_header_size),
+    };
+    unsigned char header[FRAME_HEADER_SIZE];
+    encode_frame_header(header, &h);
+    if (client_connection_queue(conn, header, FRAME_HEADER_SIZE) == STATUS_ERROR)
+        return STATUS_ERROR;
+    return client_connection_queue(conn, response_buf + response_header_size, h.payload_len);
+}
 
+int ship_changes(db_shards *shards, struct pollfd **pfds, size_t *fd_count, nfds_t *fd_size, connection_map *client_connections, int listener)
+{
+    // downwards, a dropped follower is replaced by a connection that has been visited already
+    uint32_t follower_count = 0;
+    for (size_t i = *fd_count; i-- > 0;)
+    {
+        int client_fd = (*pfds)[i].fd;
+        if (client_fd == listener || client_fd == -1 || !connection_map_contains(client_connections, client_fd))
+            continue;
+
+        client_connection *conn = connection_map_get(client_connections, client_fd);
+        if (conn->state != FOLLOWER && conn->state != SUBSCRIBER)
+            continue;
+
+        // the changes are queued behind anything the connection has not taken yet, sent as far as its socket
+        // takes them now and the rest once poll() reports it writable
+        if (replication_queue_changes(conn, shards) == STATUS_ERROR || send_queued(client_fd, conn) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d - dropping %s\n", __FILE__, __FUNCTION__, __LINE__, conn->state == FOLLOWER ? "follower" : "subscriber");
+            if (handle_client_disconnect(pfds, fd_count, fd_size, client_connections, conn) == STATUS_ERROR)
+            {
+                fprintf(stderr, "%s:%s:%d - handle_client_disconnect() failed\n", __FILE__, __FUNCTION__, __LINE__);
+                return STATUS_ERROR;
+            }
+            close(client_fd);
+            continue;
+        }
+        (*pfds)[i].events = conn->out_len > 0 ? POLLIN | POLLOUT : POLLIN;
+        follower_count += conn->state == FOLLOWER;
+    }
+
+    shards->replication.follower_count = follower_count;
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BUFFER_POOL_PAGE_SIZE (4 * 1024)
+// smallest number of frames a pool is given, whatever its budget
+#define BUFFER_POOL_MIN_FRAMES 16
+#define BUFFER_POOL_NO_FRAME UINT32_MAX
+
+
+typedef struct {
+    uint32_t page;                  /* file page held by the frame */
+    uint32_t next;                  /* next frame in the same hash bucket, BUFFER_POOL_NO_FRAME at the end */
+    uint32_t pins;                  /* frames in use cannot be evicted */
+    bool valid;                     /* the frame holds a page */
+    bool referenced;                /* second chance bit of the clock */
+    bool scanned;                   /* read in by a scan and not used since, a later scan reuses the frame */
+} buffer_frame;
+
+// fixed set of page frames over a file, a missing page replaces the first unreferenced frame the clock hand finds,
+// except that a scan keeps reusing the frame of the page it read last so that it pushes out at most one other page
+typedef struct {
+    int fd;
+    unsigned char *data;            /* frame_count pages, frame i at i * BUFFER_POOL_PAGE_SIZE */
+    buffer_frame *frames;
+    uint32_t frame_count;
+    uint32_t *buckets;              /* first frame of each hash bucket */
+    uint32_t bucket_mask;
+    uint32_t hand;                  /* next frame the clock looks at */
+    uint32_t scan_frame;            /* frame the last scan read a page into, BUFFER_POOL_NO_FRAME if none */
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+} buffer_pool;
+
+int buffer_pool_init(buffer_pool *pool, int fd, size_t budget);
+const unsigned char *buffer_pool_pin(buffer_pool *pool, uint32_t page, bool scan);
+void buffer_pool_unpin(buffer_pool *pool, const unsigned char *frame);
+int buffer_pool_read(buffer_pool *pool, uint32_t offset, void *buf, size_t len, bool scan);
+void buffer_pool_write(buffer_pool *pool, uint32_t offset, const void *buf, size_t len);
+void free_buffer_pool(buffer_pool *pool);
+
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// number of the most recent changes kept in memory, older ones are only reflected in the database
+#define CHANGELOG_CAPACITY 65536
+// sequence numbers a log may hand out before the highest one it may use is written to its file again
+#define CHANGELOG_RESERVE 65536
+
+typedef enum {
+    CHANGE_ADD = 'a',
+    CHANGE_UPDATE = 'u',
+    CHANGE_DELETE = 'd',
+} change_type;
+
+typedef struct {
+    uint64_t seq;                   /* sequence number, one higher than the change before it */
+    uint64_t time_us;               /* wall clock time the change was applied on the primary */
+    uint8_t type;                   /* change_type */
+    uint32_t hours;                 /* hours of an added or updated employee */
+    char *name;
+    char *address;                  /* address of an added employee, NULL otherwise */
+} change;
+
+// ring of the changes applied to the database in order, a new change replaces the oldest once it is full
+typedef struct {
+    change *entries;
+    size_t capacity;
+    size_t count;
+    size_t start;                   /* position of the oldest change in entries */
+    uint64_t last_seq;              /* sequence number of the newest change, or of the state the log started from */
+    int fd;                         /* file holding reserved_seq, -1 when the numbers aren't kept across restarts */
+    uint64_t reserved_seq;          /* highest sequence number that may be used before fd is written again */
+} changelog;
+
+uint64_t changelog_now_us(void);
+int changelog_init(changelog *log, size_t capacity, uint64_t last_seq);
+int changelog_open(changelog *log, size_t capacity, const char *path);
+void changelog_reset(changelog *log, uint64_t last_seq);
+int changelog_append(changelog *log, uint64_t seq, uint64_t time_us, uint8_t type, const char *name, const char *address, uint32_t hours);
+int changelog_record(changelog *log, uint8_t type, const char *name, const char *address, uint32_t hours);
+bool changelog_covers(changelog *log, uint64_t seq);
+size_t changelog_find(changelog *log, uint64_t seq);
+change *changelog_get(changelog *log, size_t pos);
+void free_changelog(changelog *log);
+
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef CHECKSUMS_H
+#define CHECKSUMS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+// bytes covered by each checksum, the last chunk may be shorter
+#define DB_CHECKSUM_CHUNK (64 * 1024)
+
+
+// CRC32C of every DB_CHECKSUM_CHUNK bytes of the file between start and end, in host byte order
+typedef struct {
+    uint32_t *crcs;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t start;                 /* first byte covered, right after the header */
+    uint32_t end;                   /* end of the covered bytes, the end of the records region */
+} db_checksums;
+
+int db_checksums_init(db_checksums *c, uint32_t start);
+int db_checksums_extend(db_checksums *c, const void *buf, size_t len);
+int db_checksums_patch(db_checksums *c, uint32_t offset, const void *old_bytes, const void *new_bytes, size_t len);
+int db_checksums_compute(db_checksums *c, int fd, uint32_t start, uint32_t end);
+int db_checksums_verify(db_checksums *c, const unsigned char *map);
+int db_checksums_verify_chunks(db_checksums *c, const unsigned char *map, uint32_t first, uint32_t last);
+int write_db_checksums(db_checksums *c, int fd, uint32_t offset, db_section *section);
+int pwrite_db_checksums(db_checksums *c, int fd, db_section *section, uint32_t first, uint32_t last);
+int read_db_checksums(db_checksums *c, int fd, db_section *section);
+void free_db_checksums(db_checksums *c);
+
+
+#endif
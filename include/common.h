@@ -17,5 +17,54 @@ typedef struct {
     uint32_t employee_count;       /* count of employees in file */
 } db_header;
 
+// optional sections are described by a table at the end of the database file, which the header marks by
+// setting DB_HEADER_SECTIONS, files without it only contain the header followed by the employee records
+#define DB_FOOTER_MAGIC 0x45444246U    /* "EDBF" */
+// set in employee_count as stored in the file, no count reaches it since every record takes several bytes
+// of a file of at most 4 GiB
+#define DB_HEADER_SECTIONS 0x80000000U
+#define DB_MAX_SECTIONS 16
+
+typedef enum {
+    DB_SECTION_RECORDS = 1,     /* Variable length employee records */
+    DB_SECTION_OFFSETS = 2,     /* Offset directory, one uint32_t file offset per record */
+    DB_SECTION_NAME_INDEX = 3,  /* Hash table from employee name to record, see name_index.h */
+    DB_SECTION_ADDRESSES = 4,   /* Dictionary of distinct addresses, placed before the records that reference it */
+    DB_SECTION_BLOCKS = 5,      /* Index of the compressed blocks at the start of the records region, placed before it */
+    DB_SECTION_CHECKSUMS = 6,   /* CRC32C of every chunk of the file between the header and the end of the records, see checksums.h */
+    DB_SECTION_BLOCK_TOMBSTONES = 7, /* One bit per record of the compressed blocks, set once it is deleted, placed before the records */
+} db_section_type;
+
+typedef struct {
+    uint32_t type;                 /* db_section_type of the section */
+    uint32_t offset;               /* offset of the section from the beginning of the file */
+    uint32_t length;               /* length of the section in bytes */
+} db_section;
+
+// entry of the block index, the blocks hold the first records of the file back to back and
+// the records appended since the last checkpoint follow the last block uncompressed
+typedef struct {
+    uint32_t offset;               /* offset of the block from the beginning of the file */
+    uint32_t length;               /* compressed length, equal to raw_length if the block is stored uncompressed */
+    uint32_t raw_length;           /* length of the records encoded in the block */
+    uint32_t record_count;         /* number of records in the block */
+} db_block;
+
+typedef struct {
+    uint32_t section_count;        /* number of db_section entries preceding the footer */
+    uint32_t magic;                /* DB_FOOTER_MAGIC */
+} db_footer;
+
+// flags for selecting which optional sections are written by checkpoint_db()
+#define DB_CHECKPOINT_OFFSETS 0x1
+#define DB_CHECKPOINT_NAME_INDEX 0x2
+#define DB_CHECKPOINT_ADDRESS_DICTIONARY 0x4
+#define DB_CHECKPOINT_COMPRESSED 0x8
+#define DB_CHECKPOINT_CHECKSUMS 0x10
+// records are grouped into blocks of at least DB_BLOCK_SIZE encoded bytes, except for the last
+#define DB_BLOCK_SIZE (64 * 1024)
+// sections that hold 8 byte fields start on a multiple of DB_SECTION_ALIGN
+#define DB_SECTION_ALIGN 8
+
 
 #endif
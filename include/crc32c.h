@@ -0,0 +1,18 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// reversed Castagnoli polynomial, the one computed by the SSE4.2 crc32 instruction
+#define CRC32C_POLY 0x82F63B78U
+// bytes hashed by each of the three interleaved streams of the PCLMUL implementation
+#define CRC32C_STREAM_LEN 4096
+
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len);
+uint32_t crc32c_patch(uint32_t crc, const void *old_bytes, const void *new_bytes, size_t len, size_t len_after);
+
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef DB_H
+#define DB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "common.h"
+#include "name_index.h"
+#include "hours_index.h"
+#include "radix_tree.h"
+#include "trigram_index.h"
+#include "string_pool.h"
+#include "checksums.h"
+#include "buffer_pool.h"
+#include "serialize.h"
+
+// compaction starts once at least DB_COMPACT_MIN_DEAD records, and DB_COMPACT_RATIO of all records, are dead
+#define DB_COMPACT_MIN_DEAD 1024
+#define DB_COMPACT_RATIO 0.5
+// number of table slots copied by each call to db_compact_step()
+#define DB_COMPACT_BATCH 4096
+// bytes of records a paged compaction reads through the pool before writing them to the new file
+#define DB_PAGED_COMPACT_BYTES (64 * 1024)
+#define DB_COMPACT_SUFFIX ".compact"
+// appends empty the offset directory and name index of the file, a server writes them again with a checkpoint
+// once this many records were appended since
+#define DB_CHECKPOINT_APPENDED 4096
+
+
+typedef struct {
+    int fd;                         /* temporary file receiving live records, -1 when no compaction is running */
+    char *path;                     /* path of the temporary file */
+    size_t cursor;                  /* next slot of the employee table to copy */
+    uint32_t *offsets;              /* offset in the new file of each copied slot, 0 if the slot was not copied */
+    db_section dictionary;          /* address dictionary written ahead of the records, if any */
+    uint32_t records_start;         /* start of the records region in the new file */
+    uint32_t records_end;           /* end of the records copied so far */
+    uint32_t record_count;          /* number of records copied so far */
+    db_checksums checksums;         /* checksums of the new file up to records_end, if kept */
+    db_section checksums_section;   /* where the tail put the checksums of the new file */
+    db_section blocks;              /* block index of a compressed file, room for block_capacity blocks is reserved */
+    db_section block_tombstones;    /* tombstones of the records copied into blocks, reserved after the index */
+    db_block *block_entries;        /* blocks written so far */
+    size_t block_count;
+    size_t block_capacity;
+    bool blocks_open;               /* records are still copied into blocks rather than after them */
+    size_t block_cursor;            /* slots before it were copied into blocks, their offsets hold their new slot + 1 */
+    unsigned char *raw;             /* records of the block being filled */
+    size_t raw_len;
+    uint32_t raw_count;
+    unsigned char *compressed;
+    size_t compressed_cap;
+} db_compaction;
+
+typedef struct {
+    int fd;                         /* database file */
+    const char *path;               /* path of the database file, required for compaction */
+    db_header hdr;                  /* header in host byte order, employee_count includes deleted records */
+    employee *employees;            /* in memory table of every record in the file, deleted records have no name, NULL when paged */
+    uint32_t *offsets;              /* file offset of each record in employees, 0 if it is inside a compressed block */
+    uint32_t records_start;         /* start of the records region, after the address dictionary if there is one */
+    uint32_t records_end;           /* end of the records region, new records are appended here */
+    uint32_t dead_count;            /* number of deleted records still present in the file */
+    uint32_t unindexed_count;       /* records appended since the offset directory and name index were written */
+    int checkpoint_flags;           /* optional sections written by db_checkpoint() */
+    name_index names;               /* lookup of live records by name, mapped from the file when it has an index */
+    hours_index hours;              /* live records ordered by hours */
+    radix_tree prefixes;            /* live records ordered by name, for prefix searches, root is NULL until the first one after a lazy or snapshot load */
+    trigram_index addresses;        /* optional substring index over addresses, table is NULL when not built */
+    string_pool address_pool;       /* owner of the addresses in employees, equal addresses share one copy */
+    db_section dictionary;          /* address dictionary of the file, referenced by records written since it */
+    db_section blocks;              /* index of the compressed blocks of the file, their records have an offset of 0 */
+    db_section block_tombstones;    /* bit per record of the blocks, set when it is deleted, empty in files written without */
+    db_checksums checksums;         /* checksums of the file up to records_end, crcs is NULL when not kept */
+    db_section checksums_section;   /* where the checksums were last written, rewritten in place after in place writes */
+    buffer_pool pool;               /* pages of the records when loaded by db_load_paged(), frames is NULL otherwise */
+    db_dictionary address_dictionary; /* addresses referenced by the paged records, the pool holds the records only */
+    employee *results;              /* records read through the pool for the last request, owned by the database */
+    size_t results_size;
+    size_t results_capacity;
+    bool *materialized;             /* whether each slot was decoded into employees, NULL once every record is */
+    unsigned char *map;             /* mapping of the file records are decoded from on first use when loaded by db_load_lazy() */
+    size_t map_len;
+    bool *verified;                 /* whether each checksum chunk inside the mapping was checked */
+    uint32_t verified_count;
+    unsigned char *snapshot;        /* mapped snapshot the names of the records loaded from it point into, NULL otherwise */
+    size_t snapshot_len;
+    size_t compact_min_dead;
+    double compact_ratio;
+    db_compaction compaction;
+} database;
+
+size_t employee_record_size(employee *e);
+size_t employee_ref_record_size(employee *e);
+int db_load(database *db, int fd, int checkpoint_flags, size_t load_threads);
+int db_load_lazy(database *db, int fd, int checkpoint_flags, size_t load_threads);
+int db_load_snapshot(database *db, int fd, int checkpoint_flags, const char *path);
+int db_write_snapshot(database *db, const char *path);
+int db_load_paged(database *db, int fd, int checkpoint_flags, size_t budget);
+int db_checkpoint(database *db);
+int db_find_employee(database *db, const char *name, size_t *idx);
+int db_add_employee(database *db, employee *e);
+int db_update_hours(database *db, size_t idx, uint32_t hours);
+int db_delete_employee(database *db, size_t idx);
+int db_list_employees(database *db, employee **employees, size_t *employees_size);
+int db_hours_range(database *db, uint32_t min_hours, uint32_t max_hours, employee **employees, size_t *employees_size);
+int db_top_hours(database *db, size_t k, employee **employees, size_t *employees_size);
+int db_lookup_employees(database *db, char **names, size_t names_size, employee **employees, size_t *employees_size);
+int db_prefix_search(database *db, const char *prefix, employee **employees, size_t *employees_size);
+int db_build_address_index(database *db);
+int db_address_search(database *db, const char *substring, employee **employees, size_t *employees_size);
+bool db_checkpoint_pending(database *db, size_t min_appended);
+bool db_compaction_pending(database *db);
+int db_compact_step(database *db, size_t max_records);
+void db_abort_compaction(database *db);
+void free_database(database *db);
+
+
+#endif
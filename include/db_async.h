@@ -0,0 +1,65 @@
+#ifndef DB_ASYNC_H
+#define DB_ASYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
+
+#include "db_client.h"
+
+// An asynchronous client, driven by one thread. Requests are submitted without waiting for anything and are
+// spread over a few non-blocking connections. db_async_poll() sends what was submitted, reads whatever responses
+// have arrived and calls the callback of each request as its response completes. The server answers the requests
+// of a connection in order, so any number of them can be in flight on each.
+//
+// A callback gets the status a db_client call would return and the data of the response, the employees of a query
+// in the layout for_each_employee_view() reads without copying them. The data is only valid during the callback.
+// A callback may submit more requests. Requests in flight on a connection that fails complete with STATUS_ERROR,
+// and later requests go to the connections left.
+// Like db_client_connect(), a NULL port connects to the unix domain socket at the path given as host.
+#define DB_ASYNC_READ_SIZE (64 * 1024)
+
+typedef void (*db_async_callback)(int status, const unsigned char *data, uint32_t data_len, void *arg);
+
+typedef struct {
+    db_async_callback callback;
+    void *arg;
+    uint32_t request_id;
+} db_async_pending;
+
+typedef struct {
+    int fd;                         /* -1 once the connection failed */
+    uint32_t next_request_id;
+    unsigned char *out;             /* requests submitted, sent from out_sent on */
+    size_t out_len;
+    size_t out_sent;
+    size_t out_capacity;
+    unsigned char *in;              /* bytes received that don't make a whole response yet */
+    size_t in_len;
+    size_t in_capacity;
+    db_async_pending *pending;      /* ring of the requests waiting for a response, oldest at pending_head */
+    size_t pending_head;
+    size_t pending_count;
+    size_t pending_capacity;
+    bool wants_write;               /* waiting for room in the socket's send buffer */
+} db_async_conn;
+
+typedef struct {
+    int epoll_fd;
+    uint16_t protocol_version;
+    db_async_conn *conns;
+    size_t size;
+    size_t next_conn;               /* connection the next request is submitted on */
+    size_t in_flight;
+    struct epoll_event *events;
+} db_async_client;
+
+int db_async_connect(db_async_client *c, const char *host, const char *port, uint16_t protocol_version, size_t conn_count);
+int db_async_submit(db_async_client *c, const db_client_request *r, db_async_callback callback, void *arg);
+int db_async_poll(db_async_client *c, int timeout_ms);
+int db_async_wait(db_async_client *c);
+void free_db_async_client(db_async_client *c);
+
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef DB_CLIENT_H
+#define DB_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "proto.h"
+
+// A client for services talking to the server. It keeps a pool of connections that have done their handshake, and
+// any number of threads can call it at once. A call takes an idle connection, or waits for one, and costs one round
+// trip. Each connection keeps its request and response buffers between calls.
+//
+// A call returns STATUS_SUCCESS, or STATUS_ERROR when the server can't be reached or its answer can't be read. It
+// returns the error code of the response when the server answered the request with one. A connection that failed
+// is reconnected by the next call that takes it.
+//
+// With a NULL port, host is the path of the server's unix domain socket, for services on the same host.
+#define DB_CLIENT_NOT_FOUND 1   /* no employee has the name of an update or delete */
+#define DB_CLIENT_READ_ONLY 2   /* the server is a follower, writes go to its primary */
+
+// one request, the option of bin/client it stands for and its arguments
+typedef struct {
+    char option;                    /* 'a', 'u', 'd', 'l', 'r', 't', 'p' or 'c' */
+    const char *text;               /* name of a write, prefix or address text of a query */
+    const char *address;            /* address of an added employee */
+    uint32_t hours;                 /* hours of a write, least hours of a range or count of a top query */
+    uint32_t max_hours;             /* most hours of a range */
+} db_client_request;
+
+typedef struct {
+    int fd;                         /* -1 until connected, or once the connection failed */
+    uint32_t next_request_id;
+    unsigned char *buf;             /* request being written, kept for the life of the connection */
+    size_t capacity;
+    unsigned char *payload;         /* data of the last response, reused by the next one */
+    size_t payload_capacity;
+} db_client_conn;
+
+typedef struct {
+    char *host;
+    char *port;                     /* NULL when host is the path of a unix domain socket */
+    uint16_t protocol_version;
+    db_client_conn *conns;
+    size_t size;                    /* connections in the pool, 0 until its lock is set up */
+    size_t *idle;                   /* indices of the connections no call is using */
+    size_t idle_count;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+} db_client;
+
+int encode_db_client_request(unsigned char **buf, unsigned char **cursor, size_t *capacity, uint16_t protocol_version, uint32_t request_id, const db_client_request *r);
+int db_client_connect(db_client *c, const char *host, const char *port, uint16_t protocol_version, size_t pool_size);
+int db_client_add(db_client *c, const char *name, const char *address, uint32_t hours);
+int db_client_update(db_client *c, const char *name, uint32_t hours);
+int db_client_delete(db_client *c, const char *name);
+int db_client_each(db_client *c, const db_client_request *r, employee_view_callback callback, void *arg);
+int db_client_list(db_client *c, employee **employees, size_t *employees_size);
+int db_client_range(db_client *c, uint32_t min_hours, uint32_t max_hours, employee **employees, size_t *employees_size);
+int db_client_top(db_client *c, uint32_t count, employee **employees, size_t *employees_size);
+int db_client_prefix(db_client *c, const char *prefix, employee **employees, size_t *employees_size);
+int db_client_search_address(db_client *c, const char *text, employee **employees, size_t *employees_size);
+void db_client_free_employees(employee *employees, size_t employees_size);
+void free_db_client(db_client *c);
+
+
+#endif
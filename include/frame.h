@@ -0,0 +1,38 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// The handshake negotiates the framing of every message after it. Version 1 frames a message as a host sized
+// proto_msg followed by the uint32_t length of its data in network byte order, a response adding an error flag
+// in between. Version 2 frames every message with a fixed header of FRAME_HEADER_SIZE bytes in little endian
+//   uint16_t magic, uint8_t opcode, uint8_t flags, uint32_t request id, uint32_t payload length
+// followed by the payload. The opcode is a proto_msg, the flags of a response hold its error code and the request
+// id of a response is the one of its request. A server started with version 2 still accepts version 1 clients.
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+#define FRAME_MAGIC 0xDB02
+#define FRAME_HEADER_SIZE 12
+// largest payload of a request the server accepts, responses may be larger
+#define FRAME_MAX_REQUEST (16 * 1024 * 1024)
+
+typedef struct {
+    uint8_t opcode;                 /* proto_msg of the message */
+    uint8_t flags;                  /* error code of a response, 0 otherwise */
+    uint32_t request_id;            /* chosen by the client, echoed by the response */
+    uint32_t payload_len;
+} frame_header;
+
+void encode_frame_header(unsigned char *buf, const frame_header *h);
+int decode_frame_header(const unsigned char *buf, frame_header *h);
+int send_frame(int socket, const frame_header *h, const void *payload, int flags);
+size_t request_header_size(uint16_t protocol_version);
+size_t encode_request_header(unsigned char *buf, uint16_t protocol_version, uint8_t opcode, uint32_t request_id, uint32_t data_len);
+int send_request(int socket, uint16_t protocol_version, uint8_t opcode, uint32_t request_id, const void *data, uint32_t data_len, int flags);
+int receive_frame_header(int socket, frame_header *h);
+int receive_frame(int socket, frame_header *h, unsigned char **payload, size_t *capacity);
+
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef HOURS_INDEX_H
+#define HOURS_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+#define HOURS_INDEX_INIT_CAPACITY 64
+
+
+typedef struct {
+    uint32_t hours;
+    uint32_t slot;                  /* index of the employee in the employee table */
+} hours_index_entry;
+
+// live employees sorted by hours, ties ordered by slot so every entry has a unique position
+typedef struct {
+    hours_index_entry *entries;
+    size_t capacity;
+    size_t count;
+} hours_index;
+
+int hours_index_build(hours_index *idx, employee *employees, size_t employees_size);
+int hours_index_append(hours_index *idx, uint32_t hours, uint32_t slot);
+void hours_index_sort(hours_index *idx);
+int hours_index_insert(hours_index *idx, uint32_t hours, uint32_t slot);
+int hours_index_remove(hours_index *idx, uint32_t hours, uint32_t slot);
+int hours_index_update(hours_index *idx, uint32_t slot, uint32_t old_hours, uint32_t new_hours);
+void hours_index_remap(hours_index *idx, const uint32_t *slot_map);
+size_t hours_index_range(hours_index *idx, uint32_t min_hours, uint32_t max_hours, size_t *start);
+void free_hours_index(hours_index *idx);
+
+
+#endif
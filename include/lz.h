@@ -0,0 +1,21 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ77 byte codec in the style of LZ4: every sequence is a token byte holding a literal length and a
+// match length of 4 nibbles each, extended by 255 valued bytes when the nibble is 15, followed by the
+// literals, a 2 byte big endian match offset and the extension of the match length. The last sequence
+// only has literals.
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+
+size_t lz_compress_bound(size_t src_len);
+int lz_compress(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_cap);
+int lz_decompress(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_len);
+
+
+#endif
@@ -10,14 +10,26 @@ typedef enum {
     DB_ACCESS_REQUEST,  /* Request from client to access the database */
     DB_ACCESS_RESPONSE, /* Response from server to a client's db access request */
     INVALID_REQUEST,    /* Informs client that request is invalid */
+    REPLICATION_REQUEST,    /* Request from a follower for a copy of the database and every change after it */
+    REPLICATION_RESPONSE,   /* Sequence number and record count of the copy sent to a follower, the records follow as changes */
+    REPLICATION_CHANGE,     /* A change applied by the primary, see replication.h */
+    SUBSCRIBE_REQUEST,      /* Request from a client to be sent every change applied from then on */
+    SUBSCRIBE_RESPONSE,     /* Sequence number of the newest change when a subscription starts */
 } proto_msg;
 
 typedef enum {
     UNINITIALIZED,  /* Connected but handshake has not been confirmed */
     INITIALIZED,    /* Protocol version has been validated, waiting to read request */
     REQUEST,        /* Processing request */
+    FOLLOWER,       /* Follower being sent every change applied to the database */
+    SUBSCRIBER,     /* Client being sent every change applied since it subscribed */
 } client_state;
 
+// bytes read from a client at once, every request they complete is served before the next read
+#define CONNECTION_READ_SIZE (64 * 1024)
+// responses a client may leave unread before no more of its requests are read or served
+#define CONNECTION_MAX_BACKLOG (16 * CONNECTION_READ_SIZE)
+
 typedef struct {
     unsigned char *header;
     unsigned char *header_cursor;
@@ -26,10 +38,21 @@ typedef struct {
     size_t buf_size;
     size_t conn_idx;
     client_state state;
+    uint64_t shipped_seq;   /* newest change sent to a follower or subscriber */
+    uint16_t version;       /* protocol version negotiated by the handshake, see frame.h */
+    uint32_t request_id;    /* id of the request being read, version 2 only */
+    unsigned char *in;      /* bytes read from the socket, CONNECTION_READ_SIZE of them at most */
+    size_t in_start;        /* first byte of in not served yet */
+    size_t in_len;          /* bytes in in, those after in_start wait for the client to take its responses */
+    unsigned char *out;     /* responses queued while serving the bytes read, sent together */
+    size_t out_len;
+    size_t out_capacity;
+    size_t out_sent;        /* bytes of out the client has taken, the rest waits for its socket */
 } client_connection;
 
 void client_connection_set_handshake_header(client_connection *conn);
 void client_connection_init(client_connection *conn, size_t conn_idx);
+int client_connection_queue(client_connection *conn, const void *data, size_t len);
 void free_client_connection(client_connection *conn);
 
 // for defining hashmap
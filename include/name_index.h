@@ -0,0 +1,42 @@
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "common.h"
+
+#define NAME_INDEX_INIT_CAPACITY 64
+// maximum ratio of entries to slots before the table is doubled
+#define NAME_INDEX_ALPHA 0.5
+
+
+// entries are kept in network byte order so the table can be written to, and mapped from, the database file
+typedef struct {
+    uint64_t hash;                  /* hash of the employee's name, 0 marks an empty entry */
+    uint32_t slot;                  /* index of the employee in the employee table */
+    uint32_t offset;                /* file offset of the employee's record */
+} name_index_entry;
+
+typedef struct {
+    name_index_entry *entries;
+    size_t capacity;                /* number of entries, always a power of two */
+    size_t count;                   /* number of occupied entries */
+    void *map;                      /* mapping the entries live in, NULL when allocated on the heap */
+    size_t map_len;
+} name_index;
+
+uint64_t hash_name(const char *name);
+int name_index_init(name_index *idx, size_t capacity);
+int name_index_build(name_index *idx, employee *employees, uint32_t *offsets, size_t employees_size);
+int name_index_insert(name_index *idx, const char *name, uint32_t slot, uint32_t offset);
+int name_index_find(name_index *idx, employee *employees, size_t employees_size, const char *name, size_t *slot);
+int name_index_probe(name_index *idx, const char *name, bool (*match)(void *ctx, uint32_t slot), void *ctx, size_t *slot);
+int name_index_remove(name_index *idx, const char *name, uint32_t slot);
+int name_index_write(name_index *idx, int fd, uint32_t offset, db_section *section);
+int name_index_map(name_index *idx, int fd, db_section *section, size_t employees_size);
+int name_index_detach(name_index *idx);
+void free_name_index(name_index *idx);
+
+
+#endif
@@ -6,10 +6,27 @@
 #include "common.h"
 #include "serialize.h"
 #include "models.h"
+#include "db.h"
+#include "shard.h"
 
 
 #define HANDSHAKE_REQ_SIZE sizeof(proto_msg) + sizeof(uint16_t)
 #define HANDSHAKE_RESP_SIZE sizeof(proto_msg) + 1
+// follower flag, newest change, primary's newest change, lag and follower count
+#define REPLICATION_STATUS_SIZE (1 + 3 * sizeof(uint64_t) + sizeof(uint32_t))
+// resync flag, version answered for and number of deleted names, followed by the names and the changed employees
+#define CHANGES_SINCE_HEADER_SIZE (1 + sizeof(uint64_t) + sizeof(uint32_t))
+// bytes of a list response read from the socket at once when it is decoded as it arrives
+#define LIST_CHUNK_SIZE (64 * 1024)
+
+// an employee of a list response where it lies in the bytes received, valid as long as they are
+typedef struct {
+    const char *name;
+    const char *address;
+    uint32_t hours;
+} employee_view;
+
+typedef int (*employee_view_callback)(const employee_view *e, void *arg);
 
 int send_all(int socket, const void *buf, size_t buf_size, int flags);
 int receive_all(int socket, void *buf, size_t buf_size, int flags);
@@ -18,12 +35,33 @@ int serialize_add_employee_option(unsigned char **buf, unsigned char **cursor, s
 int serialize_update_employee_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *update_employee_name, char *shours);
 int serialize_delete_employee_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *delete_employee_name);
 int serialize_list_option(unsigned char **buf, unsigned char **cursor, size_t *capacity);
+int serialize_range_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *range_str);
+int serialize_top_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *count_str);
+int serialize_prefix_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *prefix);
+int serialize_address_search_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *substring);
+int serialize_replication_status_option(unsigned char **buf, unsigned char **cursor, size_t *capacity);
+int serialize_replication_status_response(unsigned char *buf, db_shards *shards);
+int deserialize_replication_status_response(unsigned char *buf, size_t buf_size, bool *follower, uint64_t *seq, db_replication_stats *stats);
+int serialize_changes_since_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *version_str);
+int deserialize_changes_since_option(unsigned char **cursor, uint64_t *version);
+int deserialize_changes_since_response(unsigned char *buf, size_t buf_size, bool *resync, uint64_t *version, char ***deleted, size_t *deleted_size, employee **employees, size_t *employees_size);
 int serialize_list_employee_response(unsigned char **buf, unsigned char *cursor, uint32_t *buf_len, employee *employees, size_t employees_size);
 int deserialize_list_employee_response(unsigned char *buf, size_t buf_size, employee **employees, size_t *employees_size);
+int decode_employee_view(const unsigned char *buf, size_t buf_size, employee_view *e);
+int for_each_employee_view(const unsigned char *buf, size_t buf_size, employee_view_callback callback, void *arg);
+int receive_list_response(int socket, uint32_t data_len, employee_view_callback callback, void *arg);
 int deserialize_add_employee_option(unsigned char **cursor, employee *e);
 int deserialize_update_employee_option(unsigned char **cursor, char **employee_name, uint32_t *hours);
 int deserialize_delete_employee_option(unsigned char **cursor, char **employee_name);
-int deserialize_request_options(int fd, employee **employees, db_header *dbhdr, unsigned char **response_buf, size_t *response_buf_size, client_connection *conn);
+int deserialize_range_option(unsigned char **cursor, uint32_t *min_hours, uint32_t *max_hours);
+int deserialize_top_option(unsigned char **cursor, uint32_t *count);
+int deserialize_prefix_option(unsigned char **cursor, char **prefix);
+int deserialize_address_search_option(unsigned char **cursor, char **substring);
+int deserialize_request_options(db_shards *shards, unsigned char **response_buf, size_t *response_buf_size, client_connection *conn);
+int get_socket(char *host, char *port);
+int get_unix_socket(const char *path);
+int send_handshake(int socket, uint16_t protocol_version);
+int receive_handshake(int socket);
 
 
 
@@ -0,0 +1,35 @@
+#ifndef RADIX_TREE_H
+#define RADIX_TREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+
+// path compressed trie, every edge label is stored on the node it leads to
+typedef struct radix_node {
+    char *label;                    /* bytes consumed by the edge into this node, not null terminated */
+    uint32_t label_len;
+    struct radix_node **children;   /* sorted by the first byte of their label */
+    uint32_t child_count;
+    uint32_t child_capacity;
+    uint32_t *slots;                /* employee table slots of the names ending at this node */
+    uint32_t slot_count;
+    uint32_t slot_capacity;
+} radix_node;
+
+typedef struct {
+    radix_node *root;
+    size_t count;                   /* number of indexed slots */
+} radix_tree;
+
+int radix_tree_init(radix_tree *tree);
+int radix_tree_build(radix_tree *tree, employee *employees, size_t employees_size);
+int radix_tree_insert(radix_tree *tree, const char *name, uint32_t slot);
+int radix_tree_remove(radix_tree *tree, const char *name, uint32_t slot);
+int radix_tree_prefix(radix_tree *tree, const char *prefix, uint32_t **slots, size_t *slots_size);
+void radix_tree_remap(radix_tree *tree, const uint32_t *slot_map);
+void free_radix_tree(radix_tree *tree);
+
+
+#endif
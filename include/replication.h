@@ -0,0 +1,53 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+#include "models.h"
+#include "changelog.h"
+#include "shard.h"
+
+// A follower connects to its primary like a client and sends a REPLICATION_REQUEST after the handshake. The primary
+// answers with a REPLICATION_RESPONSE holding the sequence number of its newest change and the number of records of
+// its copy, sends each record as an added employee, then sends every change it applies from then on. Each message
+// is a proto_msg followed by the uint32_t length of its data, the data of a REPLICATION_CHANGE being
+//   uint64_t seq, uint64_t primary's newest seq, uint64_t time_us, uint8_t type, uint32_t hours,
+//   uint16_t name length, name, uint16_t address length, address
+// in network byte order, the lengths including the null terminator and the address empty unless added.
+// A client sending a SUBSCRIBE_REQUEST instead is answered with a SUBSCRIBE_RESPONSE holding the sequence number of
+// the newest change, and is then sent the same REPLICATION_CHANGE messages without a copy to begin with. Messages are
+// queued on the connection and leave as its socket takes them, so followers and subscribers that stop reading fall
+// behind, and once further behind than the changelog reaches are disconnected and have to start over. A follower
+// that is sent a change other than the one after its last starts over from a new copy as well.
+#define REPLICATION_RESPONSE_SIZE (sizeof(uint64_t) + sizeof(uint32_t))
+#define SUBSCRIBE_RESPONSE_SIZE sizeof(uint64_t)
+// largest message a follower accepts, names and addresses are far shorter
+#define REPLICATION_MAX_MESSAGE (1 << 20)
+// changes are sent in batches of about this many bytes
+#define REPLICATION_BATCH_SIZE (64 * 1024)
+// bytes queued for a follower or subscriber that it has not taken yet, past which its changes wait in the changelog
+#define REPLICATION_MAX_BACKLOG (16 * REPLICATION_BATCH_SIZE)
+
+
+// the connection of a follower to its primary
+typedef struct {
+    int fd;                         /* -1 once the primary is lost */
+    char *host;                     /* where the primary is, for starting over */
+    char *port;
+    uint16_t protocol_version;
+    unsigned char *buf;             /* messages received but not applied yet */
+    size_t buf_len;
+    size_t buf_capacity;
+} replica;
+
+int replication_decode_change(unsigned char *data, size_t data_len, change *c, uint64_t *head_seq);
+int replication_queue_copy(client_connection *conn, db_shards *s);
+int replication_queue_subscribe(client_connection *conn, db_shards *s);
+int replication_queue_changes(client_connection *conn, db_shards *s);
+int replica_connect(replica *r, char *host, char *port, uint16_t protocol_version, db_shards *s);
+int replica_receive(replica *r, db_shards *s);
+void free_replica(replica *r);
+
+
+#endif
@@ -1,18 +1,45 @@
 #ifndef SERIALIZE_H
 #define SERIALIZE_H
+#include <stddef.h>
 #include "common.h"
 
+// records with an address length of 0 hold a uint32_t index into the address dictionary instead of the address
+#define DB_ADDRESS_INLINE UINT32_MAX
+// a block is cut once its records reach DB_BLOCK_SIZE bytes, so it is never longer than that and one more record
+#define DB_BLOCK_RAW_CAPACITY (DB_BLOCK_SIZE + 2 * (sizeof(uint16_t) + UINT16_MAX) + 2 * sizeof(uint32_t))
+
+typedef struct {
+    char **addresses;
+    uint32_t count;
+} db_dictionary;
+
 
 int serialize_employee(employee *e, unsigned char **buf, size_t *buf_len);
 int deserialize_employee(employee *e, unsigned char *buf, size_t *buf_len);
 int fserialize_employee(int fd, employee *e);
 int fdeserialize_employee(int fd, employee *e);
+int fdeserialize_record(int fd, employee *e, db_dictionary *dictionary);
 int read_employees(int fd, employee **employees, size_t employees_size);
+int read_records(int fd, employee **employees, size_t employees_size, db_dictionary *dictionary);
+int encode_employee_record(employee *e, uint32_t address_ref, unsigned char *record);
+int decode_employee_record(const unsigned char *record, const unsigned char *end, db_dictionary *dictionary, employee *e);
+int read_employees_parallel(int fd, db_header *dbhdr, db_section *sections, size_t section_count, employee *employees, uint32_t **offsets_out, size_t nthreads);
 int write_new_file_hdr(int fd);
 int read_dbhdr(int fd, db_header *dbhdr);
 int write_employees(int fd, employee *employees, size_t employees_size);
 int write_all(int fd, void *buf, size_t buf_size);
 int write_db(int fd, db_header *dbhdr, employee *employees);
+int checkpoint_db(int fd, db_header *dbhdr, employee *employees, int flags);
+int write_db_footer(int fd, db_section *sections, size_t section_count);
+int read_db_sections(int fd, db_header *dbhdr, db_section *sections, size_t *section_count);
+db_section *find_db_section(db_section *sections, size_t section_count, uint32_t type);
+int read_offset_directory(int fd, db_section *directory, uint32_t **offsets, size_t employees_size);
+int seek_employee(int fd, db_section *sections, size_t section_count, size_t idx);
+int write_db_dictionary(int fd, char **addresses, uint32_t count);
+int read_db_dictionary(int fd, db_section *section, db_dictionary *dictionary);
+void free_db_dictionary(db_dictionary *dictionary);
+int read_db_blocks(int fd, db_section *section, db_block **blocks, size_t *block_count);
+int compress_db_block(const unsigned char *raw, size_t raw_len, unsigned char *compressed, size_t compressed_cap, const unsigned char **block);
 
 
 #endif
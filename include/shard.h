@@ -0,0 +1,62 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "common.h"
+#include "db.h"
+#include "changelog.h"
+
+// employees are partitioned by a hash of their name across the files <FILE>.0 to <FILE>.<COUNT - 1>,
+// each a database of its own with its own header, compaction and checkpoints, a single shard uses <FILE> itself
+#define DB_SHARD_MAX 64
+
+
+// how every shard is loaded, the threads and buffer pool budget are divided between the shards
+typedef struct {
+    int checkpoint_flags;           /* optional sections written by each shard's checkpoints */
+    size_t load_threads;            /* threads decoding the shards in total, 0 uses every online core */
+    bool lazy;                      /* decode each record on first use, see db_load_lazy() */
+    size_t budget;                  /* bytes of buffer pool for all shards together, 0 keeps the records in memory */
+    const char *snapshot_path;      /* snapshot of each shard, <PATH>.<SHARD> when there is more than one, may be NULL */
+    bool address_index;             /* build the trigram index of each shard */
+} db_shard_options;
+
+// replication state reported by a server, see replication.h
+typedef struct {
+    uint64_t primary_seq;           /* newest change of the primary as of the last one it sent, followers only */
+    uint64_t lag_us;                /* time between the primary and the follower applying the last change, followers only */
+    uint32_t follower_count;        /* followers being sent the changes of a primary */
+} db_replication_stats;
+
+typedef struct {
+    database *dbs;                  /* one database per shard */
+    int *fds;
+    char **paths;
+    size_t count;
+    employee *results;              /* live records of every shard for the last list, shallow copies */
+    size_t results_capacity;
+    changelog changes;              /* most recent changes to the shards, in the order they were applied */
+    bool read_only;                 /* set on a follower, which applies the changes of its primary only */
+    db_replication_stats replication;
+} db_shards;
+
+size_t db_shard_of(const char *name, size_t shard_count);
+int db_shards_open(db_shards *s, const char *path, size_t shard_count, bool create, db_shard_options *options);
+void db_shards_remove_files(const char *path, size_t shard_count);
+database *db_shard_for(db_shards *s, const char *name);
+int db_shards_list(db_shards *s, employee **employees, size_t *employees_size);
+int db_shards_hours_range(db_shards *s, uint32_t min_hours, uint32_t max_hours, employee **employees, size_t *employees_size);
+int db_shards_top_hours(db_shards *s, size_t k, employee **employees, size_t *employees_size);
+int db_shards_prefix_search(db_shards *s, const char *prefix, employee **employees, size_t *employees_size);
+int db_shards_address_search(db_shards *s, const char *substring, employee **employees, size_t *employees_size);
+int db_shards_changes_since(db_shards *s, uint64_t version, bool *resync, employee **changed, size_t *changed_size, char ***deleted, size_t *deleted_size);
+bool db_shards_compaction_pending(db_shards *s);
+int db_shards_compact_step(db_shards *s, size_t max_records);
+int db_shards_checkpoint(db_shards *s, size_t min_appended);
+int db_shards_clear(db_shards *s);
+int db_shards_write_snapshots(db_shards *s, const char *path);
+void free_db_shards(db_shards *s);
+
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+// a snapshot is an image of the in memory database that is mapped back instead of decoding the database file,
+// it is written in host byte order with every reference an offset from its start, so it can be mapped at any
+// address but is only read back on the machine that wrote it
+#define DB_SNAPSHOT_MAGIC 0x50414e53U    /* "SNAP" */
+#define DB_SNAPSHOT_VERSION 1
+#define DB_SNAPSHOT_MAX_SECTIONS 8
+// name of a deleted record in the employee table
+#define DB_SNAPSHOT_DELETED UINT32_MAX
+
+typedef enum {
+    DB_SNAPSHOT_NAME_INDEX = 1,     /* name index as written to a database file, first so its offset fits a db_section */
+    DB_SNAPSHOT_OFFSETS = 2,        /* file offset of each slot */
+    DB_SNAPSHOT_HOURS = 3,          /* entries of the hours index, in order */
+    DB_SNAPSHOT_EMPLOYEES = 4,      /* db_snapshot_employee for each slot */
+    DB_SNAPSHOT_ADDRESSES = 5,      /* db_snapshot_address for each distinct address */
+    DB_SNAPSHOT_STRINGS = 6,        /* null terminated names and addresses */
+} db_snapshot_section_type;
+
+typedef struct {
+    uint32_t type;                  /* db_snapshot_section_type of the section */
+    uint32_t reserved;
+    uint64_t offset;                /* offset of the section from the start of the snapshot, a multiple of DB_SECTION_ALIGN */
+    uint64_t length;
+} db_snapshot_section;
+
+// the database file the snapshot was taken of, a file written since no longer matches
+typedef struct {
+    uint64_t size;
+    uint64_t inode;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t crc;                   /* CRC32C of the header, the section table and the checksums section */
+    uint32_t reserved;
+} db_snapshot_source;
+
+typedef struct {
+    uint32_t magic;                 /* DB_SNAPSHOT_MAGIC */
+    uint32_t version;               /* DB_SNAPSHOT_VERSION */
+    uint64_t length;                /* length of the whole snapshot */
+    uint32_t crc;                   /* CRC32C of every byte after the header */
+    uint32_t section_count;
+    db_snapshot_source source;
+    db_snapshot_section sections[DB_SNAPSHOT_MAX_SECTIONS];
+} db_snapshot_header;
+
+typedef struct {
+    uint32_t name;                  /* offset of the name in the strings section, DB_SNAPSHOT_DELETED if deleted */
+    uint32_t address;               /* index of the address in the addresses section */
+    uint32_t hours;
+} db_snapshot_employee;
+
+typedef struct {
+    uint32_t str;                   /* offset of the address in the strings section */
+    uint32_t refs;                  /* number of live records with the address */
+} db_snapshot_address;
+
+// sections are written one after the other into a temporary file that replaces the snapshot once complete
+typedef struct {
+    int fd;
+    char *path;
+    char *tmp_path;
+    uint64_t length;                /* bytes written so far */
+    uint32_t crc;                   /* of the bytes written after the header so far */
+    db_snapshot_header hdr;
+} db_snapshot_writer;
+
+int db_snapshot_source_of(int fd, db_header *hdr, db_section *sections, size_t section_count, db_snapshot_source *source);
+int db_snapshot_create(db_snapshot_writer *w, const char *path);
+int db_snapshot_begin_section(db_snapshot_writer *w, uint32_t type);
+int db_snapshot_write(db_snapshot_writer *w, const void *buf, size_t len);
+int db_snapshot_commit(db_snapshot_writer *w, db_snapshot_source *source);
+void db_snapshot_abort(db_snapshot_writer *w);
+int db_snapshot_map(int fd, unsigned char **map, size_t *map_len);
+db_snapshot_section *find_db_snapshot_section(db_snapshot_header *hdr, uint32_t type);
+
+
+#endif
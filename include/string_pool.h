@@ -0,0 +1,33 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STRING_POOL_INIT_CAPACITY 64
+// maximum ratio of strings to entries before the table is doubled
+#define STRING_POOL_ALPHA 0.5
+
+
+typedef struct {
+    char *str;                      /* shared copy of the string, NULL marks an empty entry */
+    uint64_t hash;
+    uint32_t refs;                  /* number of holders of str */
+    uint32_t index;                 /* position in the address dictionary being written, if any */
+} string_pool_entry;
+
+// reference counted table of distinct strings, so that equal strings share storage
+typedef struct {
+    string_pool_entry *entries;
+    size_t capacity;                /* always a power of two */
+    size_t count;
+} string_pool;
+
+int string_pool_init(string_pool *pool);
+char *string_pool_intern(string_pool *pool, char *s);
+string_pool_entry *string_pool_find(string_pool *pool, const char *s);
+void string_pool_release(string_pool *pool, const char *s);
+void free_string_pool(string_pool *pool);
+
+
+#endif
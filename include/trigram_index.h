@@ -0,0 +1,45 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+#define TRIGRAM_INDEX_INIT_CAPACITY 1024
+// maximum ratio of trigrams to table entries before the table is doubled
+#define TRIGRAM_INDEX_ALPHA 0.5
+
+
+// slots sharing their upper 16 bits, stored as their sorted lower 16 bits
+typedef struct {
+    uint16_t high;
+    uint32_t count;
+    uint32_t capacity;
+    uint16_t *lows;
+} trigram_chunk;
+
+// posting list of every slot whose address contains the trigram, chunks are sorted by high
+typedef struct {
+    uint32_t trigram;               /* the three bytes of the trigram, 0 marks an empty entry */
+    trigram_chunk *chunks;
+    uint32_t chunk_count;
+    uint32_t chunk_capacity;
+} trigram_postings;
+
+typedef struct {
+    trigram_postings *table;
+    size_t capacity;                /* always a power of two */
+    size_t count;                   /* number of distinct trigrams */
+} trigram_index;
+
+int trigram_index_init(trigram_index *idx);
+int trigram_index_build(trigram_index *idx, employee *employees, size_t employees_size);
+int trigram_index_insert(trigram_index *idx, const char *address, uint32_t slot);
+int trigram_index_remove(trigram_index *idx, const char *address, uint32_t slot);
+int trigram_index_remap(trigram_index *idx, const uint32_t *slot_map);
+int trigram_index_search(trigram_index *idx, employee *employees, size_t employees_size, const char *substring, uint32_t **slots, size_t *slots_size);
+size_t intersect_sorted_u16(const uint16_t *a, size_t a_size, const uint16_t *b, size_t b_size, uint16_t *out);
+void free_trigram_index(trigram_index *idx);
+
+
+#endif
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "buffer_pool.h"
+
+
+static uint32_t buffer_pool_bucket(buffer_pool *pool, uint32_t page)
+{
+    // fibonacci hashing spreads the consecutive pages of a scan over the buckets
+    return (uint32_t)(((uint64_t)page * 11400714819323198485ULL) >> 32) & pool->bucket_mask;
+}
+
+static uint32_t buffer_pool_lookup(buffer_pool *pool, uint32_t page)
+{
+    uint32_t f = pool->buckets[buffer_pool_bucket(pool, page)];
+    while (f != BUFFER_POOL_NO_FRAME && pool->frames[f].page != page)
+        f = pool->frames[f].next;
+    return f;
+}
+
+static void buffer_pool_unlink(buffer_pool *pool, uint32_t frame)
+{
+    uint32_t *link = pool->buckets + buffer_pool_bucket(pool, pool->frames[frame].page);
+    while (*link != frame)
+        link = &pool->frames[*link].next;
+    *link = pool->frames[frame].next;
+    pool->frames[frame].valid = false;
+}
+
+int buffer_pool_init(buffer_pool *pool, int fd, size_t budget)
+{
+    size_t frame_count = budget / BUFFER_POOL_PAGE_SIZE;
+    if (frame_count < BUFFER_POOL_MIN_FRAMES)
+        frame_count = BUFFER_POOL_MIN_FRAMES;
+    if (frame_count >= BUFFER_POOL_NO_FRAME)
+        frame_count = BUFFER_POOL_NO_FRAME - 1;
+
+    size_t bucket_count = 1;
+    while (bucket_count < frame_count)
+        bucket_count <<= 1;
+
+    pool->data = malloc(frame_count * BUFFER_POOL_PAGE_SIZE);
+    pool->frames = calloc(frame_count, sizeof(buffer_frame));
+    pool->buckets = malloc(bucket_count * sizeof(uint32_t));
+    if (!pool->data || !pool->frames || !pool->buckets)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate buffer pool of %zu frames: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, frame_count, errno, strerror(errno));
+        free(pool->data);
+        free(pool->frames);
+        free(pool->buckets);
+        *pool = (buffer_pool) { 0 };
+        return STATUS_ERROR;
+    }
+
+    pool->frame_count = frame_count;
+    pool->bucket_mask = bucket_count - 1;
+    for (size_t i = 0; i < bucket_count; i++)
+        pool->buckets[i] = BUFFER_POOL_NO_FRAME;
+    pool->fd = fd;
+    pool->hand = 0;
+    pool->scan_frame = BUFFER_POOL_NO_FRAME;
+    pool->hits = 0;
+    pool->misses = 0;
+    pool->evictions = 0;
+    return STATUS_SUCCESS;
+}
+
+const unsigned char *buffer_pool_pin(buffer_pool *pool, uint32_t page, bool scan)
+{
+    // pages touched by a scan are not marked referenced, so a scan does not make them look hot
+    uint32_t f = buffer_pool_lookup(pool, page);
+    if (f != BUFFER_POOL_NO_FRAME)
+    {
+        pool->hits++;
+        pool->frames[f].pins++;
+        if (!scan)
+        {
+            pool->frames[f].referenced = true;
+            pool->frames[f].scanned = false;
+        }
+        return pool->data + (size_t)f * BUFFER_POOL_PAGE_SIZE;
+    }
+
+    // a scan reads its next page into the frame of its previous one, if nothing else has used that page since
+    if (scan && pool->scan_frame != BUFFER_POOL_NO_FRAME &&
+        pool->frames[pool->scan_frame].scanned && !pool->frames[pool->scan_frame].pins)
+        f = pool->scan_frame;
+
+    // otherwise sweep the clock, clearing reference bits, until an unpinned and unreferenced frame comes up
+    for (uint64_t swept = 0; f == BUFFER_POOL_NO_FRAME; swept++)
+    {
+        if (swept == 2 * (uint64_t)pool->frame_count)
+        {
+            fprintf(stderr, "%s:%s:%d every frame of the buffer pool is pinned\n", __FILE__, __FUNCTION__, __LINE__);
+            return NULL;
+        }
+
+        buffer_frame *frame = pool->frames + pool->hand;
+        pool->hand = (pool->hand + 1) % pool->frame_count;
+        if (frame->pins)
+            continue;
+        if (frame->valid && frame->referenced)
+        {
+            frame->referenced = false;
+            continue;
+        }
+        f = frame - pool->frames;
+    }
+
+    if (pool->frames[f].valid)
+    {
+        buffer_pool_unlink(pool, f);
+        pool->frames[f].valid = false;
+        pool->evictions++;
+    }
+
+    // the last page of the file is short, the rest of its frame is left as it was
+    unsigned char *data = pool->data + (size_t)f * BUFFER_POOL_PAGE_SIZE;
+    if (pread(pool->fd, data, BUFFER_POOL_PAGE_SIZE, (off_t)page * BUFFER_POOL_PAGE_SIZE) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to read page %u: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, page, errno, strerror(errno));
+        return NULL;
+    }
+
+    uint32_t bucket = buffer_pool_bucket(pool, page);
+    pool->frames[f] = (buffer_frame) { .page=page, .next=pool->buckets[bucket], .pins=1, .valid=true, .referenced=!scan, .scanned=scan };
+    pool->buckets[bucket] = f;
+    if (scan)
+        pool->scan_frame = f;
+    pool->misses++;
+    return data;
+}
+
+void buffer_pool_unpin(buffer_pool *pool, const unsigned char *frame)
+{
+    pool->frames[(frame - pool->data) / BUFFER_POOL_PAGE_SIZE].pins--;
+}
+
+int buffer_pool_read(buffer_pool *pool, uint32_t offset, void *buf, size_t len, bool scan)
+{
+    unsigned char *out = buf;
+    while (len > 0)
+    {
+        uint32_t page_offset = offset % BUFFER_POOL_PAGE_SIZE;
+        size_t n = BUFFER_POOL_PAGE_SIZE - page_offset < len ? BUFFER_POOL_PAGE_SIZE - page_offset : len;
+        const unsigned char *frame = buffer_pool_pin(pool, offset / BUFFER_POOL_PAGE_SIZE, scan);
+        if (!frame)
+            return STATUS_ERROR;
+        memcpy(out, frame + page_offset, n);
+        buffer_pool_unpin(pool, frame);
+        offset += n;
+        out += n;
+        len -= n;
+    }
+    return STATUS_SUCCESS;
+}
+
+void buffer_pool_write(buffer_pool *pool, uint32_t offset, const void *buf, size_t len)
+{
+    // the file was written with pwrite(), only copies of the written bytes already in a frame need updating
+    const unsigned char *in = buf;
+    while (len > 0)
+    {
+        uint32_t page_offset = offset % BUFFER_POOL_PAGE_SIZE;
+        size_t n = BUFFER_POOL_PAGE_SIZE - page_offset < len ? BUFFER_POOL_PAGE_SIZE - page_offset : len;
+        uint32_t f = buffer_pool_lookup(pool, offset / BUFFER_POOL_PAGE_SIZE);
+        if (f != BUFFER_POOL_NO_FRAME)
+            memcpy(pool->data + (size_t)f * BUFFER_POOL_PAGE_SIZE + page_offset, in, n);
+        offset += n;
+        in += n;
+        len -= n;
+    }
+}
+
+void free_buffer_pool(buffer_pool *pool)
+{
+    free(pool->data);
+    free(pool->frames);
+    free(pool->buckets);
+    *pool = (buffer_pool) { 0 };
+}
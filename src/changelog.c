@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <endian.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "common.h"
+#include "changelog.h"
+
+
+uint64_t changelog_now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+int changelog_init(changelog *log, size_t capacity, uint64_t last_seq)
+{
+    *log = (changelog) { .capacity=capacity, .last_seq=last_seq, .fd=-1 };
+    log->entries = calloc(capacity, sizeof(change));
+    if (!log->entries)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate changelog: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// makes the numbers up to seq + CHANGELOG_RESERVE usable, once the file says so
+static int changelog_reserve(changelog *log, uint64_t seq)
+{
+    uint64_t reserved_seq = htobe64(seq + CHANGELOG_RESERVE);
+    if (pwrite(log->fd, &reserved_seq, sizeof(uint64_t), 0) != sizeof(uint64_t) || fdatasync(log->fd) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to reserve sequence numbers: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    log->reserved_seq = seq + CHANGELOG_RESERVE;
+    return STATUS_SUCCESS;
+}
+
+// Starts a log whose sequence numbers keep increasing across restarts, with the highest number it may use kept
+// in the file at path. It continues after every number an earlier log could have used, or from the wall clock
+// when that is further on, so a clock set back doesn't hand out a number twice.
+int changelog_open(changelog *log, size_t capacity, const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to open %s: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, path, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // a new file has nothing reserved yet
+    uint64_t reserved_seq = 0;
+    ssize_t nbytes = pread(fd, &reserved_seq, sizeof(uint64_t), 0);
+    if (nbytes != 0 && nbytes != sizeof(uint64_t))
+    {
+        fprintf(stderr, "%s:%s:%d unable to read reserved sequence numbers from %s\n", __FILE__, __FUNCTION__, __LINE__, path);
+        close(fd);
+        return STATUS_ERROR;
+    }
+    reserved_seq = be64toh(reserved_seq);
+
+    uint64_t now = changelog_now_us();
+    if (changelog_init(log, capacity, reserved_seq > now ? reserved_seq : now) == STATUS_ERROR)
+    {
+        close(fd);
+        return STATUS_ERROR;
+    }
+    log->fd = fd;
+    if (changelog_reserve(log, log->last_seq) == STATUS_ERROR)
+    {
+        free_changelog(log);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+static void free_change(change *c)
+{
+    free(c->name);
+    free(c->address);
+    c->name = NULL;
+    c->address = NULL;
+}
+
+// drops every change, the log continues from last_seq
+void changelog_reset(changelog *log, uint64_t last_seq)
+{
+    for (size_t i = 0; i < log->count; i++)
+        free_change(changelog_get(log, i));
+    log->count = 0;
+    log->start = 0;
+    log->last_seq = last_seq;
+}
+
+// appends a change applied elsewhere under its own sequence number, which has to follow the newest
+int changelog_append(changelog *log, uint64_t seq, uint64_t time_us, uint8_t type, const char *name, const char *address, uint32_t hours)
+{
+    if (seq <= log->last_seq)
+    {
+        fprintf(stderr, "%s:%s:%d change %lu is not newer than %lu\n", __FILE__, __FUNCTION__, __LINE__, (unsigned long)seq, (unsigned long)log->last_seq);
+        return STATUS_ERROR;
+    }
+    if (log->fd != -1 && seq > log->reserved_seq && changelog_reserve(log, seq) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    change c = { .seq=seq, .time_us=time_us, .type=type, .hours=hours };
+    c.name = strdup(name);
+    c.address = address ? strdup(address) : NULL;
+    if (!c.name || (address && !c.address))
+    {
+        fprintf(stderr, "%s:%s:%d unable to copy change: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free_change(&c);
+        return STATUS_ERROR;
+    }
+
+    // the oldest change makes room once the ring is full
+    if (log->count == log->capacity)
+    {
+        free_change(log->entries + log->start);
+        log->entries[log->start] = c;
+        log->start = (log->start + 1) % log->capacity;
+    }
+    else
+    {
+        log->entries[(log->start + log->count) % log->capacity] = c;
+        log->count++;
+    }
+    log->last_seq = seq;
+    return STATUS_SUCCESS;
+}
+
+// appends a change applied to this database, numbered after the newest
+int changelog_record(changelog *log, uint8_t type, const char *name, const char *address, uint32_t hours)
+{
+    return changelog_append(log, log->last_seq + 1, changelog_now_us(), type, name, address, hours);
+}
+
+// whether every change after seq is still in the log
+bool changelog_covers(changelog *log, uint64_t seq)
+{
+    if (seq > log->last_seq)
+        return false;
+    uint64_t oldest = log->count ? changelog_get(log, 0)->seq : log->last_seq + 1;
+    return seq + 1 >= oldest;
+}
+
+// position of the oldest change newer than seq, count if there is none
+size_t changelog_find(changelog *log, uint64_t seq)
+{
+    size_t lo = 0, hi = log->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (changelog_get(log, mid)->seq <= seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// the change at a position counted from the oldest
+change *changelog_get(changelog *log, size_t pos)
+{
+    return log->entries + (log->start + pos) % log->capacity;
+}
+
+void free_changelog(changelog *log)
+{
+    if (log->entries)
+    {
+        changelog_reset(log, log->last_seq);
+        if (log->fd != -1)
+            close(log->fd);
+    }
+    free(log->entries);
+    log->entries = NULL;
+    log->capacity = 0;
+    log->fd = -1;
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "serialize.h"
+#include "crc32c.h"
+#include "checksums.h"
+
+// the section holds the chunk length, the covered range and the number of checksums, followed by the checksums
+#define DB_CHECKSUMS_HDR_LEN (4 * sizeof(uint32_t))
+
+
+int db_checksums_init(db_checksums *c, uint32_t start)
+{
+    c->crcs = malloc(16 * sizeof(uint32_t));
+    if (!c->crcs)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate checksums: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    c->count = 0;
+    c->capacity = 16;
+    c->start = start;
+    c->end = start;
+    return STATUS_SUCCESS;
+}
+
+int db_checksums_extend(db_checksums *c, const void *buf, size_t len)
+{
+    // crc32c() continues from a previous crc, so a partial last chunk is extended where it left off
+    const unsigned char *p = buf;
+    while (len > 0)
+    {
+        uint32_t chunk_used = (c->end - c->start) % DB_CHECKSUM_CHUNK;
+        if (chunk_used == 0)
+        {
+            if (c->count == c->capacity)
+            {
+                uint32_t *crcs = realloc(c->crcs, 2 * c->capacity * sizeof(uint32_t));
+                if (!crcs)
+                {
+                    fprintf(stderr, "%s:%s:%d unable to grow checksums: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+                    return STATUS_ERROR;
+                }
+                c->crcs = crcs;
+                c->capacity *= 2;
+            }
+            c->crcs[c->count++] = 0;
+        }
+
+        size_t n = DB_CHECKSUM_CHUNK - chunk_used < len ? DB_CHECKSUM_CHUNK - chunk_used : len;
+        c->crcs[c->count - 1] = crc32c(c->crcs[c->count - 1], p, n);
+        c->end += n;
+        p += n;
+        len -= n;
+    }
+    return STATUS_SUCCESS;
+}
+
+int db_checksums_patch(db_checksums *c, uint32_t offset, const void *old_bytes, const void *new_bytes, size_t len)
+{
+    if (offset < c->start || offset + len > c->end)
+    {
+        fprintf(stderr, "%s:%s:%d write at %u is not covered by the checksums\n", __FILE__, __FUNCTION__, __LINE__, offset);
+        return STATUS_ERROR;
+    }
+
+    // a write may straddle two chunks
+    const unsigned char *o = old_bytes, *n = new_bytes;
+    while (len > 0)
+    {
+        uint32_t chunk = (offset - c->start) / DB_CHECKSUM_CHUNK;
+        uint32_t chunk_end = c->start + (chunk + 1) * DB_CHECKSUM_CHUNK < c->end ? c->start + (chunk + 1) * DB_CHECKSUM_CHUNK : c->end;
+        size_t k = chunk_end - offset < len ? chunk_end - offset : len;
+        c->crcs[chunk] = crc32c_patch(c->crcs[chunk], o, n, k, chunk_end - offset - k);
+        offset += k;
+        o += k;
+        n += k;
+        len -= k;
+    }
+    return STATUS_SUCCESS;
+}
+
+int db_checksums_compute(db_checksums *c, int fd, uint32_t start, uint32_t end)
+{
+    if (db_checksums_init(c, start) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    unsigned char *buf = malloc(DB_CHECKSUM_CHUNK);
+    if (!buf)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate chunk buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free_db_checksums(c);
+        return STATUS_ERROR;
+    }
+
+    while (c->end < end)
+    {
+        size_t n = end - c->end < DB_CHECKSUM_CHUNK ? end - c->end : DB_CHECKSUM_CHUNK;
+        if (pread(fd, buf, n, c->end) != (ssize_t)n)
+        {
+            fprintf(stderr, "%s:%s:%d - unable to read chunk at %u: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, c->end, errno, strerror(errno));
+            free(buf);
+            free_db_checksums(c);
+            return STATUS_ERROR;
+        }
+        if (db_checksums_extend(c, buf, n) == STATUS_ERROR)
+        {
+            free(buf);
+            free_db_checksums(c);
+            return STATUS_ERROR;
+        }
+    }
+
+    free(buf);
+    return STATUS_SUCCESS;
+}
+
+int db_checksums_verify(db_checksums *c, const unsigned char *map)
+{
+    if (c->count == 0)
+        return STATUS_SUCCESS;
+    return db_checksums_verify_chunks(c, map, 0, c->count - 1);
+}
+
+int db_checksums_verify_chunks(db_checksums *c, const unsigned char *map, uint32_t first, uint32_t last)
+{
+    for (uint32_t i = first; i <= last && i < c->count; i++)
+    {
+        uint32_t chunk_start = c->start + i * DB_CHECKSUM_CHUNK;
+        uint32_t chunk_len = c->end - chunk_start < DB_CHECKSUM_CHUNK ? c->end - chunk_start : DB_CHECKSUM_CHUNK;
+        if (crc32c(0, map + chunk_start, chunk_len) != c->crcs[i])
+        {
+            fprintf(stderr, "%s:%s:%d - corrupted data, checksum mismatch in bytes %u to %u\n", __FILE__, __FUNCTION__, __LINE__, chunk_start, chunk_start + chunk_len);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int write_db_checksums(db_checksums *c, int fd, uint32_t offset, db_section *section)
+{
+    size_t section_len = DB_CHECKSUMS_HDR_LEN + c->count * sizeof(uint32_t);
+    uint32_t *buf = malloc(section_len);
+    if (!buf)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate checksums section: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    buf[0] = htonl(DB_CHECKSUM_CHUNK);
+    buf[1] = htonl(c->start);
+    buf[2] = htonl(c->end);
+    buf[3] = htonl(c->count);
+    for (uint32_t i = 0; i < c->count; i++)
+        buf[4 + i] = htonl(c->crcs[i]);
+
+    int status = write_all(fd, buf, section_len);
+    free(buf);
+    if (status == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write checksums\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    *section = (db_section) { .type=DB_SECTION_CHECKSUMS, .offset=offset, .length=(uint32_t)section_len };
+    return (int)section_len;
+}
+
+int pwrite_db_checksums(db_checksums *c, int fd, db_section *section, uint32_t first, uint32_t last)
+{
+    // rewrite checksums first to last of a section written before, after an in place write to the file
+    for (uint32_t i = first; i <= last; i++)
+    {
+        uint32_t crc = htonl(c->crcs[i]);
+        off_t offset = section->offset + DB_CHECKSUMS_HDR_LEN + i * sizeof(uint32_t);
+        if (pwrite(fd, &crc, sizeof(crc), offset) != sizeof(crc))
+        {
+            fprintf(stderr, "%s:%s:%d unable to write checksum: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int read_db_checksums(db_checksums *c, int fd, db_section *section)
+{
+    uint32_t hdr[4];
+    if (section->length < DB_CHECKSUMS_HDR_LEN || pread(fd, hdr, sizeof(hdr), section->offset) != sizeof(hdr))
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read checksums: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    uint32_t chunk_len = ntohl(hdr[0]), start = ntohl(hdr[1]), end = ntohl(hdr[2]), count = ntohl(hdr[3]);
+    uint64_t expected = end > start ? ((uint64_t)end - start + DB_CHECKSUM_CHUNK - 1) / DB_CHECKSUM_CHUNK : 0;
+    if (chunk_len != DB_CHECKSUM_CHUNK || start > end || count != expected || section->length != DB_CHECKSUMS_HDR_LEN + (uint64_t)count * sizeof(uint32_t))
+    {
+        fprintf(stderr, "%s:%s:%d - corrupted data, invalid checksums section\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    c->crcs = malloc((count ? count : 1) * sizeof(uint32_t));
+    if (!c->crcs)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to allocate checksums: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    if (pread(fd, c->crcs, count * sizeof(uint32_t), section->offset + DB_CHECKSUMS_HDR_LEN) != (ssize_t)(count * sizeof(uint32_t)))
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read checksums: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(c->crcs);
+        c->crcs = NULL;
+        return STATUS_ERROR;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+        c->crcs[i] = ntohl(c->crcs[i]);
+    c->count = count;
+    c->capacity = count ? count : 1;
+    c->start = start;
+    c->end = end;
+    return STATUS_SUCCESS;
+}
+
+void free_db_checksums(db_checksums *c)
+{
+    free(c->crcs);
+    *c = (db_checksums) { 0 };
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "common.h"
+#include "crc32c.h"
+
+// Every crc here is the raw register without the initial and final inversion, which only the public
+// functions apply. Polynomials are stored reflected, bit 31 holds the coefficient of x^0.
+
+static uint32_t crc32c_table[8][256];
+static uint32_t x2n_table[64];              /* x^(2^n) mod p */
+static uint32_t stream_shift[2];            /* constants moving the crc of a stream past one and two streams */
+static int has_sse42;
+static int has_pclmul;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+
+// a * b mod p
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1U << 31, p = 0;
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^n mod p
+static uint32_t xnmodp(uint64_t n)
+{
+    uint32_t p = 1U << 31;
+    for (int k = 0; n; n >>= 1, k++)
+    {
+        if (n & 1)
+            p = multmodp(x2n_table[k], p);
+    }
+    return p;
+}
+
+static void crc32c_init(void)
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc32c_table[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        for (int k = 1; k < 8; k++)
+            crc32c_table[k][n] = (crc32c_table[k - 1][n] >> 8) ^ crc32c_table[0][crc32c_table[k - 1][n] & 0xff];
+    }
+
+    x2n_table[0] = 1U << 30;
+    for (int k = 1; k < 64; k++)
+        x2n_table[k] = multmodp(x2n_table[k - 1], x2n_table[k - 1]);
+
+    // the carry-less product of two reflected values lands one bit short and the crc32 instruction
+    // multiplies by x^32, so a shift by n bits is a product with x^(n - 33)
+    stream_shift[0] = xnmodp(8 * CRC32C_STREAM_LEN - 33);
+    stream_shift[1] = xnmodp(16 * CRC32C_STREAM_LEN - 33);
+
+    has_sse42 = __builtin_cpu_supports("sse4.2");
+    has_pclmul = has_sse42 && __builtin_cpu_supports("pclmul");
+}
+
+static uint32_t crc32c_raw_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len >= 8)
+    {
+        crc ^= (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        crc = crc32c_table[7][crc & 0xff] ^ crc32c_table[6][(crc >> 8) & 0xff] ^
+            crc32c_table[5][(crc >> 16) & 0xff] ^ crc32c_table[4][crc >> 24] ^
+            crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^ crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_raw_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t c = crc;
+    while (len >= 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, sizeof(uint64_t));
+        c = _mm_crc32_u64(c, w);
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    return (uint32_t)c;
+}
+
+// the crc32 instruction has a latency of three cycles but a throughput of one, so three independent
+// streams keep it busy, and their crcs are combined by carry-less multiplication
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crc32c_raw_pclmul(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len >= 3 * CRC32C_STREAM_LEN)
+    {
+        uint64_t a = crc, b = 0, c = 0;
+        for (size_t i = 0; i < CRC32C_STREAM_LEN; i += 8)
+        {
+            uint64_t wa, wb, wc;
+            memcpy(&wa, p + i, sizeof(uint64_t));
+            memcpy(&wb, p + CRC32C_STREAM_LEN + i, sizeof(uint64_t));
+            memcpy(&wc, p + 2 * CRC32C_STREAM_LEN + i, sizeof(uint64_t));
+            a = _mm_crc32_u64(a, wa);
+            b = _mm_crc32_u64(b, wb);
+            c = _mm_crc32_u64(c, wc);
+        }
+
+        __m128i shifted_a = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)a), _mm_cvtsi32_si128((int)stream_shift[1]), 0);
+        __m128i shifted_b = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)b), _mm_cvtsi32_si128((int)stream_shift[0]), 0);
+        uint64_t folded = (uint64_t)_mm_cvtsi128_si64(_mm_xor_si128(shifted_a, shifted_b));
+        crc = (uint32_t)_mm_crc32_u64(0, folded) ^ (uint32_t)c;
+
+        p += 3 * CRC32C_STREAM_LEN;
+        len -= 3 * CRC32C_STREAM_LEN;
+    }
+    return crc32c_raw_sse42(crc, p, len);
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    if (has_pclmul)
+        return ~crc32c_raw_pclmul(~crc, buf, len);
+    if (has_sse42)
+        return ~crc32c_raw_sse42(~crc, buf, len);
+    return ~crc32c_raw_sw(~crc, buf, len);
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    return ~crc32c_raw_sw(~crc, buf, len);
+}
+
+uint32_t crc32c_patch(uint32_t crc, const void *old_bytes, const void *new_bytes, size_t len, size_t len_after)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+
+    // the crc is linear in the message, so the change is the crc of the xor of the bytes, moved past the rest
+    unsigned char delta[8];
+    uint32_t raw = 0;
+    const unsigned char *o = old_bytes, *n = new_bytes;
+    for (size_t i = 0; i < len; i += sizeof(delta))
+    {
+        size_t chunk = len - i < sizeof(delta) ? len - i : sizeof(delta);
+        for (size_t k = 0; k < chunk; k++)
+            delta[k] = o[i + k] ^ n[i + k];
+        raw = crc32c_raw_sw(raw, delta, chunk);
+    }
+    return crc ^ multmodp(xnmodp(8 * (uint64_t)len_after), raw);
+}
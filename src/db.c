@@ -0,0 +1,2336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "serialize.h"
+#include "db.h"
+#include "snapshot.h"
+#include "lz.h"
+
+
+size_t employee_record_size(employee *e)
+{
+    // length prefixed name and address, both including their null terminators, followed by hours
+    return 2 * sizeof(uint16_t) + strlen(e->name) + 1 + strlen(e->address) + 1 + sizeof(uint32_t);
+}
+
+size_t employee_ref_record_size(employee *e)
+{
+    // the address is replaced by an index into the address dictionary
+    return 2 * sizeof(uint16_t) + strlen(e->name) + 1 + 2 * sizeof(uint32_t);
+}
+
+static int pwrite_all(int fd, const void *buf, size_t buf_size, off_t offset)
+{
+    size_t total = 0;
+    while (total < buf_size)
+    {
+        ssize_t nbytes = pwrite(fd, (const unsigned char *)buf + total, buf_size - total, offset + total);
+        if (nbytes == -1)
+        {
+            fprintf(stderr, "%s:%s:%d error writing bytes to file descriptor: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        total += nbytes;
+    }
+    return STATUS_SUCCESS;
+}
+
+static int db_compute_offsets(database *db)
+{
+    uint32_t *offsets = realloc(db->offsets, (db->hdr.employee_count ? db->hdr.employee_count : 1) * sizeof(uint32_t));
+    if (!offsets)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate record offsets: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    db->offsets = offsets;
+
+    // checkpoint_db() writes the address dictionary and the block index right after the header
+    db->records_start = sizeof(db_header);
+    db->dictionary = (db_section) { .type=DB_SECTION_ADDRESSES, .offset=sizeof(db_header), .length=0 };
+    db->blocks = (db_section) { .type=DB_SECTION_BLOCKS, .offset=sizeof(db_header), .length=0 };
+    db->block_tombstones = (db_section) { .type=DB_SECTION_BLOCK_TOMBSTONES, .offset=sizeof(db_header), .length=0 };
+    if (db->checkpoint_flags & (DB_CHECKPOINT_ADDRESS_DICTIONARY | DB_CHECKPOINT_COMPRESSED | DB_CHECKPOINT_CHECKSUMS))
+    {
+        db_section sections[DB_MAX_SECTIONS];
+        size_t section_count;
+        if (read_db_sections(db->fd, &db->hdr, sections, &section_count) == STATUS_ERROR)
+            return STATUS_ERROR;
+
+        db_section *checksums = find_db_section(sections, section_count, DB_SECTION_CHECKSUMS);
+        if (checksums)
+        {
+            free_db_checksums(&db->checksums);
+            if (read_db_checksums(&db->checksums, db->fd, checksums) == STATUS_ERROR)
+                return STATUS_ERROR;
+            db->checksums_section = *checksums;
+        }
+
+        db_section *dictionary = find_db_section(sections, section_count, DB_SECTION_ADDRESSES);
+        if (dictionary)
+            db->dictionary = *dictionary;
+        db_section *blocks = find_db_section(sections, section_count, DB_SECTION_BLOCKS);
+        if (blocks)
+            db->blocks = *blocks;
+        db_section *block_tombstones = find_db_section(sections, section_count, DB_SECTION_BLOCK_TOMBSTONES);
+        if (block_tombstones)
+            db->block_tombstones = *block_tombstones;
+        db_section *records = find_db_section(sections, section_count, DB_SECTION_RECORDS);
+        if (records)
+            db->records_start = records->offset;
+
+        // every record is inside a compressed block
+        if (blocks && records)
+        {
+            memset(db->offsets, 0, db->hdr.employee_count * sizeof(uint32_t));
+            db->records_end = records->offset + records->length;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    // records are laid out back to back
+    uint32_t offset = db->records_start;
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        db->offsets[i] = offset;
+        if (db->checkpoint_flags & DB_CHECKPOINT_ADDRESS_DICTIONARY)
+            offset += employee_ref_record_size(db->employees + i);
+        else
+            offset += employee_record_size(db->employees + i);
+    }
+    db->records_end = offset;
+    return STATUS_SUCCESS;
+}
+
+// offset of the hours field of a slot, hours are the last field of every record
+static uint32_t db_hours_offset(database *db, size_t idx)
+{
+    uint32_t record_end = idx + 1 < db->hdr.employee_count ? db->offsets[idx + 1] : db->records_end;
+    return record_end - sizeof(uint32_t);
+}
+
+// brings the checksums up to date after bytes at offset were overwritten, rewriting the changed ones in the file
+static int db_patch_checksums(database *db, uint32_t offset, const void *old_bytes, const void *new_bytes, size_t len)
+{
+    if (!db->checksums.crcs)
+        return STATUS_SUCCESS;
+
+    if (db_checksums_patch(&db->checksums, offset, old_bytes, new_bytes, len) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // an empty section is written in full by the next checkpoint or append
+    if (db->checksums_section.length == 0)
+        return STATUS_SUCCESS;
+
+    uint32_t first = (offset - db->checksums.start) / DB_CHECKSUM_CHUNK;
+    uint32_t last = (offset + len - 1 - db->checksums.start) / DB_CHECKSUM_CHUNK;
+    return pwrite_db_checksums(&db->checksums, db->fd, &db->checksums_section, first, last);
+}
+
+// reads the record at offset through the buffer pool and returns its length, a deleted record is read with an empty name
+static int db_read_record(database *db, uint32_t offset, employee *e, bool scan)
+{
+    uint16_t name_len, address_len;
+    if ((uint64_t)offset + sizeof(uint16_t) > db->records_end ||
+        buffer_pool_read(&db->pool, offset, &name_len, sizeof(uint16_t), scan) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    uint64_t address_offset = (uint64_t)offset + sizeof(uint16_t) + ntohs(name_len);
+    if (address_offset + sizeof(uint16_t) > db->records_end ||
+        buffer_pool_read(&db->pool, address_offset, &address_len, sizeof(uint16_t), scan) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    size_t record_len = address_offset - offset + sizeof(uint16_t) + (address_len ? ntohs(address_len) + sizeof(uint32_t) : 2 * sizeof(uint32_t));
+    if ((uint64_t)offset + record_len > db->records_end)
+    {
+        fprintf(stderr, "%s:%s:%d corrupted data, record at %u extends past the records\n", __FILE__, __FUNCTION__, __LINE__, offset);
+        return STATUS_ERROR;
+    }
+
+    // most records lie within one page and are decoded straight from its frame
+    int nbytes;
+    uint32_t page_offset = offset % BUFFER_POOL_PAGE_SIZE;
+    if (page_offset + record_len <= BUFFER_POOL_PAGE_SIZE)
+    {
+        const unsigned char *frame = buffer_pool_pin(&db->pool, offset / BUFFER_POOL_PAGE_SIZE, scan);
+        if (!frame)
+            return STATUS_ERROR;
+        nbytes = decode_employee_record(frame + page_offset, frame + page_offset + record_len, &db->address_dictionary, e);
+        buffer_pool_unpin(&db->pool, frame);
+    }
+    else
+    {
+        unsigned char *record = malloc(record_len);
+        if (!record)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate record: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        nbytes = buffer_pool_read(&db->pool, offset, record, record_len, scan);
+        if (nbytes != STATUS_ERROR)
+            nbytes = decode_employee_record(record, record + record_len, &db->address_dictionary, e);
+        free(record);
+    }
+
+    if (nbytes == STATUS_ERROR)
+        fprintf(stderr, "%s:%s:%d corrupted data, unable to decode record at %u\n", __FILE__, __FUNCTION__, __LINE__, offset);
+    return nbytes;
+}
+
+// updates the pages of a paged database after the file was written, and the checksums, from the old bytes
+static int db_paged_write(database *db, uint32_t offset, const void *old_bytes, const void *new_bytes, size_t len)
+{
+    if (pwrite_all(db->fd, new_bytes, len, offset) == STATUS_ERROR)
+        return STATUS_ERROR;
+    buffer_pool_write(&db->pool, offset, new_bytes, len);
+    return db_patch_checksums(db, offset, old_bytes, new_bytes, len);
+}
+
+static void db_clear_results(database *db)
+{
+    for (size_t i = 0; i < db->results_size; i++)
+    {
+        free(db->results[i].name);
+        free(db->results[i].address);
+    }
+    db->results_size = 0;
+}
+
+// keeps a record read through the pool until the next request, taking ownership of its strings
+static int db_push_result(database *db, employee *e)
+{
+    if (db->results_size == db->results_capacity)
+    {
+        size_t capacity = db->results_capacity ? 2 * db->results_capacity : 64;
+        employee *results = realloc(db->results, capacity * sizeof(employee));
+        if (!results)
+        {
+            fprintf(stderr, "%s:%s:%d unable to grow results: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            free(e->name);
+            free(e->address);
+            return STATUS_ERROR;
+        }
+        db->results = results;
+        db->results_capacity = capacity;
+    }
+    db->results[db->results_size++] = *e;
+    return STATUS_SUCCESS;
+}
+
+static int db_push_slot(database *db, uint32_t slot)
+{
+    employee e;
+    if (db_read_record(db, db->offsets[slot], &e, false) == STATUS_ERROR)
+        return STATUS_ERROR;
+    return db_push_result(db, &e);
+}
+
+// reads every record through the pool, keeping the live ones that match, a scan does not evict the hot pages
+static int db_paged_scan(database *db, bool (*match)(employee *e, const char *arg), const char *arg)
+{
+    db_clear_results(db);
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        employee e;
+        if (db_read_record(db, db->offsets[i], &e, true) == STATUS_ERROR)
+            return STATUS_ERROR;
+
+        if (e.name[0] != '\0' && (!match || match(&e, arg)))
+        {
+            if (db_push_result(db, &e) == STATUS_ERROR)
+                return STATUS_ERROR;
+            continue;
+        }
+        free(e.name);
+        free(e.address);
+    }
+    return STATUS_SUCCESS;
+}
+
+// shallow copies of the results, the strings stay owned by the database
+static int db_copy_results(database *db, employee **employees, size_t *employees_size)
+{
+    *employees = malloc((db->results_size ? db->results_size : 1) * sizeof(employee));
+    if (!*employees)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate results: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    memcpy(*employees, db->results, db->results_size * sizeof(employee));
+    *employees_size = db->results_size;
+    return STATUS_SUCCESS;
+}
+
+struct db_name_probe {
+    database *db;
+    const char *name;
+};
+
+static bool db_slot_has_name(void *ctx, uint32_t slot)
+{
+    struct db_name_probe *probe = ctx;
+    employee e;
+    if (slot >= probe->db->hdr.employee_count || db_read_record(probe->db, probe->db->offsets[slot], &e, false) == STATUS_ERROR)
+        return false;
+
+    bool match = !strcmp(e.name, probe->name);
+    free(e.name);
+    free(e.address);
+    return match;
+}
+
+// checks the chunks holding bytes [offset, offset + len) of a lazily loaded file the first time any of them is read
+static int db_verify_lazy(database *db, uint32_t offset, size_t len)
+{
+    if (!db->verified || len == 0)
+        return STATUS_SUCCESS;
+
+    uint32_t first = (offset - db->checksums.start) / DB_CHECKSUM_CHUNK;
+    uint32_t last = (offset + len - 1 - db->checksums.start) / DB_CHECKSUM_CHUNK;
+    for (uint32_t i = first; i <= last && i < db->verified_count; i++)
+    {
+        if (db->verified[i])
+            continue;
+        if (db_checksums_verify_chunks(&db->checksums, db->map, i, i) == STATUS_ERROR)
+            return STATUS_ERROR;
+        db->verified[i] = true;
+    }
+    return STATUS_SUCCESS;
+}
+
+// decodes the record of a slot into the employee table on its first use, as db_load() does for every record
+static int db_materialize(database *db, size_t idx)
+{
+    if (!db->materialized || db->materialized[idx])
+        return STATUS_SUCCESS;
+
+    // records appended since the load were materialized when added, so the rest lie within the mapping
+    employee *e = db->employees + idx;
+    uint32_t offset = db->offsets[idx];
+    size_t end = db->records_end < db->map_len ? db->records_end : db->map_len;
+    int nbytes = offset >= db->records_start && offset < end ?
+        decode_employee_record(db->map + offset, db->map + end, &db->address_dictionary, e) : STATUS_ERROR;
+    if (nbytes == STATUS_ERROR || db_verify_lazy(db, offset, nbytes) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d corrupted data, unable to decode record at %u\n", __FILE__, __FUNCTION__, __LINE__, offset);
+        if (nbytes != STATUS_ERROR)
+        {
+            free(e->name);
+            free(e->address);
+        }
+        *e = (employee) { 0 };
+        return STATUS_ERROR;
+    }
+
+    if (e->name[0] == '\0')
+    {
+        free(e->name);
+        free(e->address);
+        e->name = NULL;
+        e->address = NULL;
+        db->dead_count++;
+    }
+    else
+    {
+        char *address = string_pool_intern(&db->address_pool, e->address);
+        if (!address)
+        {
+            free(e->name);
+            free(e->address);
+            *e = (employee) { 0 };
+            return STATUS_ERROR;
+        }
+        e->address = address;
+    }
+    db->materialized[idx] = true;
+    return STATUS_SUCCESS;
+}
+
+static bool db_slot_is_named(void *ctx, uint32_t slot)
+{
+    struct db_name_probe *probe = ctx;
+    database *db = probe->db;
+    if (slot >= db->hdr.employee_count || db_materialize(db, slot) == STATUS_ERROR)
+        return false;
+    return db->employees[slot].name && !strcmp(db->employees[slot].name, probe->name);
+}
+
+// names of the records loaded from a snapshot point into its mapping rather than the heap
+static void db_free_name(database *db, char *name)
+{
+    uintptr_t p = (uintptr_t)name, start = (uintptr_t)db->snapshot;
+    if (!db->snapshot || p < start || p >= start + db->snapshot_len)
+        free(name);
+}
+
+static void db_free_lazy(database *db)
+{
+    free(db->materialized);
+    free(db->verified);
+    if (db->map)
+        munmap(db->map, db->map_len);
+    db->materialized = NULL;
+    db->verified = NULL;
+    db->verified_count = 0;
+    db->map = NULL;
+    db->map_len = 0;
+}
+
+// decodes every record not used yet and builds the hours index, after which the database is the same
+// as one loaded by db_load() except for the tree, which is built by the first prefix search
+static int db_materialize_all(database *db)
+{
+    if (!db->materialized)
+        return STATUS_SUCCESS;
+
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        if (db_materialize(db, i) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (db_verify_lazy(db, db->checksums.start, (size_t)db->verified_count * DB_CHECKSUM_CHUNK) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    if (hours_index_build(&db->hours, db->employees, db->hdr.employee_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+    db_free_lazy(db);
+    return STATUS_SUCCESS;
+}
+
+// dictionary index an address is written with by the running compaction, DB_ADDRESS_INLINE if it is not in its dictionary
+static uint32_t db_compaction_address_ref(database *db, const char *address)
+{
+    if (!(db->checkpoint_flags & DB_CHECKPOINT_ADDRESS_DICTIONARY))
+        return DB_ADDRESS_INLINE;
+
+    string_pool_entry *entry = string_pool_find(&db->address_pool, address);
+    return entry ? entry->index : DB_ADDRESS_INLINE;
+}
+
+static size_t db_compaction_record_size(database *db, employee *e)
+{
+    if (db_compaction_address_ref(db, e->address) == DB_ADDRESS_INLINE)
+        return employee_record_size(e);
+    return employee_ref_record_size(e);
+}
+
+// writes the footer after the records region followed by the header, then drops anything past the new end of file
+static int db_write_tail(database *db)
+{
+    uint32_t fsize = db->records_end;
+    if (db->checkpoint_flags)
+    {
+        // records were appended over the optional sections, they are written again by the next
+        // checkpoint or compaction, an empty directory records that one is still wanted
+        db_section sections[DB_MAX_SECTIONS];
+        size_t section_count = 0;
+        if (db->checkpoint_flags & DB_CHECKPOINT_ADDRESS_DICTIONARY)
+            sections[section_count++] = db->dictionary;
+        if (db->checkpoint_flags & DB_CHECKPOINT_COMPRESSED)
+            sections[section_count++] = db->blocks;
+        if ((db->checkpoint_flags & DB_CHECKPOINT_COMPRESSED) && db->block_tombstones.length > 0)
+            sections[section_count++] = db->block_tombstones;
+        sections[section_count++] = (db_section) { .type=DB_SECTION_RECORDS, .offset=db->records_start, .length=db->records_end - db->records_start };
+        if (db->checkpoint_flags & DB_CHECKPOINT_OFFSETS)
+            sections[section_count++] = (db_section) { .type=DB_SECTION_OFFSETS, .offset=db->records_end, .length=0 };
+        if (db->checkpoint_flags & DB_CHECKPOINT_NAME_INDEX)
+            sections[section_count++] = (db_section) { .type=DB_SECTION_NAME_INDEX, .offset=db->records_end, .length=0 };
+
+        if (lseek(db->fd, db->records_end, SEEK_SET) == -1)
+        {
+            fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+
+        // checksums are small and kept in memory, so they are always written in full
+        if (db->checksums.crcs)
+        {
+            int nbytes = write_db_checksums(&db->checksums, db->fd, fsize, &db->checksums_section);
+            if (nbytes == STATUS_ERROR)
+                return STATUS_ERROR;
+            sections[section_count++] = db->checksums_section;
+            fsize += nbytes;
+        }
+
+        int nbytes = write_db_footer(db->fd, sections, section_count);
+        if (nbytes == STATUS_ERROR)
+            return STATUS_ERROR;
+        fsize += nbytes;
+    }
+
+    db->hdr.fsize = fsize;
+    db_header hdr = { .fsize=htonl(db->hdr.fsize), .employee_count=htonl(db->hdr.employee_count | (db->checkpoint_flags ? DB_HEADER_SECTIONS : 0)) };
+    if (pwrite_all(db->fd, &hdr, sizeof(db_header), 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    if (ftruncate(db->fd, fsize) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d ftruncate() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// resets every field and reads the header and section table, shared by the loaders
+static int db_open(database *db, int fd, int checkpoint_flags, db_section *sections, size_t *section_count)
+{
+    db->fd = fd;
+    db->path = NULL;
+    db->employees = NULL;
+    db->offsets = NULL;
+    db->names = (name_index) { 0 };
+    db->hours = (hours_index) { 0 };
+    db->prefixes = (radix_tree) { 0 };
+    db->addresses = (trigram_index) { 0 };
+    db->address_pool = (string_pool) { 0 };
+    db->dead_count = 0;
+    db->unindexed_count = 0;
+    db->checkpoint_flags = checkpoint_flags;
+    db->compact_min_dead = DB_COMPACT_MIN_DEAD;
+    db->compact_ratio = DB_COMPACT_RATIO;
+    db->compaction = (db_compaction) { .fd=-1 };
+    db->checksums = (db_checksums) { 0 };
+    db->pool = (buffer_pool) { 0 };
+    db->address_dictionary = (db_dictionary) { 0 };
+    db->results = NULL;
+    db->results_size = 0;
+    db->results_capacity = 0;
+    db->materialized = NULL;
+    db->map = NULL;
+    db->map_len = 0;
+    db->verified = NULL;
+    db->verified_count = 0;
+    db->snapshot = NULL;
+    db->snapshot_len = 0;
+
+    // Read database file header and stats from file
+    if (read_dbhdr(fd, &db->hdr) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // keep writing an offset directory if the file already has one
+    if (read_db_sections(fd, &db->hdr, sections, section_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (find_db_section(sections, *section_count, DB_SECTION_OFFSETS))
+        db->checkpoint_flags |= DB_CHECKPOINT_OFFSETS;
+    if (find_db_section(sections, *section_count, DB_SECTION_NAME_INDEX))
+        db->checkpoint_flags |= DB_CHECKPOINT_NAME_INDEX;
+    db_section *dictionary = find_db_section(sections, *section_count, DB_SECTION_ADDRESSES);
+    if (dictionary)
+        db->checkpoint_flags |= DB_CHECKPOINT_ADDRESS_DICTIONARY;
+    db_section *blocks = find_db_section(sections, *section_count, DB_SECTION_BLOCKS);
+    if (blocks)
+        db->checkpoint_flags |= DB_CHECKPOINT_COMPRESSED;
+    db_section *block_tombstones = find_db_section(sections, *section_count, DB_SECTION_BLOCK_TOMBSTONES);
+    db_section *checksums = find_db_section(sections, *section_count, DB_SECTION_CHECKSUMS);
+    if (checksums)
+        db->checkpoint_flags |= DB_CHECKPOINT_CHECKSUMS;
+
+    // sections left empty by appends after the last checkpoint cover none of the records
+    db_section *offsets = find_db_section(sections, *section_count, DB_SECTION_OFFSETS);
+    db_section *names = find_db_section(sections, *section_count, DB_SECTION_NAME_INDEX);
+    if (db->hdr.employee_count > 0 && ((offsets && offsets->length == 0) || (names && names->length == 0)))
+        db->unindexed_count = db->hdr.employee_count;
+
+    db_section *records = find_db_section(sections, *section_count, DB_SECTION_RECORDS);
+    db->records_start = records ? records->offset : sizeof(db_header);
+    db->records_end = records ? records->offset + records->length : db->hdr.fsize;
+    db->dictionary = dictionary ? *dictionary : (db_section) { .type=DB_SECTION_ADDRESSES, .offset=sizeof(db_header), .length=0 };
+    db->blocks = blocks ? *blocks : (db_section) { .type=DB_SECTION_BLOCKS, .offset=db->records_start, .length=0 };
+    db->block_tombstones = block_tombstones ? *block_tombstones : (db_section) { .type=DB_SECTION_BLOCK_TOMBSTONES, .offset=db->records_start, .length=0 };
+    db->checksums_section = checksums ? *checksums : (db_section) { .type=DB_SECTION_CHECKSUMS, .offset=db->records_end, .length=0 };
+    return STATUS_SUCCESS;
+}
+
+int db_load(database *db, int fd, int checkpoint_flags, size_t load_threads)
+{
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    if (db_open(db, fd, checkpoint_flags, sections, &section_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+    db_section *index_section = find_db_section(sections, section_count, DB_SECTION_NAME_INDEX);
+
+    if (string_pool_init(&db->address_pool) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // read employees, keeping the offset of every record for in place writes
+    db->employees = malloc((db->hdr.employee_count ? db->hdr.employee_count : 1) * sizeof(employee));
+    if (!db->employees)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate employees: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    if (read_employees_parallel(fd, &db->hdr, sections, section_count, db->employees, &db->offsets, load_threads) == STATUS_ERROR)
+    {
+        free(db->employees);
+        db->employees = NULL;
+        free_string_pool(&db->address_pool);
+        return STATUS_ERROR;
+    }
+
+    // the checksums were verified while loading, a file without them has them computed on first use
+    if (db->checkpoint_flags & DB_CHECKPOINT_CHECKSUMS)
+    {
+        int status = db->checksums_section.length > 0 ?
+            read_db_checksums(&db->checksums, fd, &db->checksums_section) :
+            db_checksums_compute(&db->checksums, fd, sizeof(db_header), db->records_end);
+        if (status == STATUS_ERROR)
+        {
+            for (size_t i = 0; i < db->hdr.employee_count; i++)
+            {
+                free(db->employees[i].name);
+                free(db->employees[i].address);
+            }
+            free(db->employees);
+            free(db->offsets);
+            db->employees = NULL;
+            db->offsets = NULL;
+            free_string_pool(&db->address_pool);
+            return STATUS_ERROR;
+        }
+    }
+
+    // deleted records are left in the file with an empty name until the next compaction
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        if (db->employees[i].name[0] == '\0')
+        {
+            free(db->employees[i].name);
+            free(db->employees[i].address);
+            db->employees[i].name = NULL;
+            db->employees[i].address = NULL;
+            db->dead_count++;
+        }
+    }
+
+    // live records share one copy of each distinct address
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        char *address = db->employees[i].address;
+        if (address && !(db->employees[i].address = string_pool_intern(&db->address_pool, address)))
+        {
+            for (size_t j = i; j < db->hdr.employee_count; j++)
+                free(j == i ? address : db->employees[j].address);
+            free_database(db);
+            return STATUS_ERROR;
+        }
+    }
+
+    if (hours_index_build(&db->hours, db->employees, db->hdr.employee_count) == STATUS_ERROR ||
+        radix_tree_build(&db->prefixes, db->employees, db->hdr.employee_count) == STATUS_ERROR)
+    {
+        free_database(db);
+        return STATUS_ERROR;
+    }
+
+    // map the name index written by the last checkpoint, an empty section means records were appended since
+    if (index_section && index_section->length > 0 &&
+        name_index_map(&db->names, fd, index_section, db->hdr.employee_count) == STATUS_SUCCESS)
+        return STATUS_SUCCESS;
+
+    if (name_index_build(&db->names, db->employees, db->offsets, db->hdr.employee_count) == STATUS_ERROR)
+    {
+        free_database(db);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int db_load_lazy(database *db, int fd, int checkpoint_flags, size_t load_threads)
+{
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    if (db_open(db, fd, checkpoint_flags, sections, &section_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // records are found through the offset directory and name index of the last checkpoint, once records
+    // were appended since then they have to be read in full to be found, as do compressed ones
+    db_section *directory = find_db_section(sections, section_count, DB_SECTION_OFFSETS);
+    db_section *index_section = find_db_section(sections, section_count, DB_SECTION_NAME_INDEX);
+    if (!directory || directory->length == 0 || !index_section || index_section->length == 0 ||
+        (db->checkpoint_flags & DB_CHECKPOINT_COMPRESSED) ||
+        ((db->checkpoint_flags & DB_CHECKPOINT_CHECKSUMS) && db->checksums_section.length == 0))
+    {
+        if (lseek(fd, 0, SEEK_SET) == -1)
+        {
+            fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        return db_load(db, fd, checkpoint_flags, load_threads);
+    }
+
+    void *map = mmap(NULL, db->hdr.fsize, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s:%s:%d unable to map database file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    db->map = map;
+    db->map_len = db->hdr.fsize;
+
+    // the table starts out empty, records are decoded into it as they are used
+    size_t table_size = db->hdr.employee_count ? db->hdr.employee_count : 1;
+    db->employees = calloc(table_size, sizeof(employee));
+    db->materialized = calloc(table_size, sizeof(bool));
+    db_section *addresses = find_db_section(sections, section_count, DB_SECTION_ADDRESSES);
+    if (!db->employees || !db->materialized || string_pool_init(&db->address_pool) == STATUS_ERROR ||
+        read_offset_directory(fd, directory, &db->offsets, db->hdr.employee_count) == STATUS_ERROR ||
+        (addresses && read_db_dictionary(fd, addresses, &db->address_dictionary) == STATUS_ERROR) ||
+        name_index_map(&db->names, fd, index_section, db->hdr.employee_count) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to set up lazy records\n", __FILE__, __FUNCTION__, __LINE__);
+        free_database(db);
+        return STATUS_ERROR;
+    }
+
+    // each chunk is checked the first time a record is read from it, the dictionary is read now
+    if (db->checkpoint_flags & DB_CHECKPOINT_CHECKSUMS)
+    {
+        if (read_db_checksums(&db->checksums, fd, &db->checksums_section) == STATUS_ERROR ||
+            !(db->verified = calloc(db->checksums.count ? db->checksums.count : 1, sizeof(bool))))
+        {
+            free_database(db);
+            return STATUS_ERROR;
+        }
+        db->verified_count = db->checksums.count;
+
+        if (db->checksums.start != sizeof(db_header) || db->checksums.end != db->records_end ||
+            (addresses && db_verify_lazy(db, addresses->offset, addresses->length) == STATUS_ERROR))
+        {
+            fprintf(stderr, "%s:%s:%d corrupted data, checksums do not match the records\n", __FILE__, __FUNCTION__, __LINE__);
+            free_database(db);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int db_load_snapshot(database *db, int fd, int checkpoint_flags, const char *path)
+{
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    if (db_open(db, fd, checkpoint_flags, sections, &section_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    int snapshot_fd = open(path, O_RDONLY);
+    if (snapshot_fd == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to open snapshot '%s': (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, path, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    if (db_snapshot_map(snapshot_fd, &db->snapshot, &db->snapshot_len) == STATUS_ERROR)
+    {
+        close(snapshot_fd);
+        return STATUS_ERROR;
+    }
+
+    // the snapshot only stands in for the file it was taken of, as it was then
+    db_snapshot_header *hdr = (db_snapshot_header *)db->snapshot;
+    db_snapshot_source source;
+    if (db_snapshot_source_of(fd, &db->hdr, sections, section_count, &source) == STATUS_ERROR ||
+        memcmp(&source, &hdr->source, sizeof(db_snapshot_source)))
+    {
+        fprintf(stderr, "%s:%s:%d snapshot '%s' does not match the database file\n", __FILE__, __FUNCTION__, __LINE__, path);
+        close(snapshot_fd);
+        free_database(db);
+        return STATUS_ERROR;
+    }
+
+    size_t count = db->hdr.employee_count;
+    db_snapshot_section *index_section = find_db_snapshot_section(hdr, DB_SNAPSHOT_NAME_INDEX);
+    db_snapshot_section *offsets_section = find_db_snapshot_section(hdr, DB_SNAPSHOT_OFFSETS);
+    db_snapshot_section *hours_section = find_db_snapshot_section(hdr, DB_SNAPSHOT_HOURS);
+    db_snapshot_section *employees_section = find_db_snapshot_section(hdr, DB_SNAPSHOT_EMPLOYEES);
+    db_snapshot_section *addresses_section = find_db_snapshot_section(hdr, DB_SNAPSHOT_ADDRESSES);
+    db_snapshot_section *strings_section = find_db_snapshot_section(hdr, DB_SNAPSHOT_STRINGS);
+    if (!index_section || index_section->offset + index_section->length > UINT32_MAX ||
+        !offsets_section || offsets_section->length != count * sizeof(uint32_t) ||
+        !hours_section || hours_section->length % sizeof(hours_index_entry) || hours_section->length > count * sizeof(hours_index_entry) ||
+        !employees_section || employees_section->length != count * sizeof(db_snapshot_employee) ||
+        !addresses_section || addresses_section->length % sizeof(db_snapshot_address) ||
+        !strings_section || strings_section->length > UINT32_MAX ||
+        (strings_section->length && db->snapshot[strings_section->offset + strings_section->length - 1] != '\0'))
+    {
+        fprintf(stderr, "%s:%s:%d corrupted data, invalid snapshot sections\n", __FILE__, __FUNCTION__, __LINE__);
+        close(snapshot_fd);
+        free_database(db);
+        return STATUS_ERROR;
+    }
+
+    // the index is mapped as it is from a database file, everything else is copied or pointed into
+    db_section index = { .type=DB_SECTION_NAME_INDEX, .offset=index_section->offset, .length=index_section->length };
+    int status = name_index_map(&db->names, snapshot_fd, &index, count);
+    close(snapshot_fd);
+    if (status == STATUS_ERROR || string_pool_init(&db->address_pool) == STATUS_ERROR)
+    {
+        free_database(db);
+        return STATUS_ERROR;
+    }
+
+    // every distinct address is copied into the pool once, holding a reference for each record with it
+    const char *strings = (const char *)db->snapshot + strings_section->offset;
+    const db_snapshot_address *snapshot_addresses = (const db_snapshot_address *)(db->snapshot + addresses_section->offset);
+    size_t address_count = addresses_section->length / sizeof(db_snapshot_address);
+    char **addresses = malloc((address_count ? address_count : 1) * sizeof(char *));
+    db->employees = malloc((count ? count : 1) * sizeof(employee));
+    db->offsets = malloc((count ? count : 1) * sizeof(uint32_t));
+    db->hours.capacity = hours_section->length / sizeof(hours_index_entry);
+    db->hours.entries = malloc((db->hours.capacity ? db->hours.capacity : 1) * sizeof(hours_index_entry));
+    if (!addresses || !db->employees || !db->offsets || !db->hours.entries)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate tables: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(addresses);
+        db->hdr.employee_count = 0;
+        free_database(db);
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < address_count; i++)
+    {
+        string_pool_entry *entry = NULL;
+        char *address = snapshot_addresses[i].str < strings_section->length ? strdup(strings + snapshot_addresses[i].str) : NULL;
+        if (!address || !(addresses[i] = string_pool_intern(&db->address_pool, address)) ||
+            !(entry = string_pool_find(&db->address_pool, addresses[i])) || entry->refs != 1)
+        {
+            fprintf(stderr, "%s:%s:%d unable to restore address %zu\n", __FILE__, __FUNCTION__, __LINE__, i);
+            if (!entry)
+                free(address);
+            free(addresses);
+            db->hdr.employee_count = 0;
+            free_database(db);
+            return STATUS_ERROR;
+        }
+        entry->refs = snapshot_addresses[i].refs;
+    }
+
+    // names are used straight from the mapping
+    const db_snapshot_employee *snapshot_employees = (const db_snapshot_employee *)(db->snapshot + employees_section->offset);
+    for (size_t i = 0; i < count; i++)
+    {
+        const db_snapshot_employee *e = snapshot_employees + i;
+        if (e->name == DB_SNAPSHOT_DELETED)
+        {
+            db->employees[i] = (employee) { .name=NULL, .address=NULL, .hours=e->hours };
+            db->dead_count++;
+            continue;
+        }
+        if (e->name >= strings_section->length || e->address >= address_count)
+        {
+            fprintf(stderr, "%s:%s:%d corrupted data, invalid snapshot record %zu\n", __FILE__, __FUNCTION__, __LINE__, i);
+            free(addresses);
+            db->hdr.employee_count = i;
+            free_database(db);
+            return STATUS_ERROR;
+        }
+        db->employees[i] = (employee) { .name=(char *)strings + e->name, .address=addresses[e->address], .hours=e->hours };
+    }
+    free(addresses);
+
+    memcpy(db->offsets, db->snapshot + offsets_section->offset, offsets_section->length);
+    memcpy(db->hours.entries, db->snapshot + hours_section->offset, hours_section->length);
+    db->hours.count = db->hours.capacity;
+
+    // checksums are kept in the file rather than the snapshot, a file without them has them computed
+    if (db->checkpoint_flags & DB_CHECKPOINT_CHECKSUMS)
+    {
+        status = db->checksums_section.length > 0 ?
+            read_db_checksums(&db->checksums, fd, &db->checksums_section) :
+            db_checksums_compute(&db->checksums, fd, sizeof(db_header), db->records_end);
+        if (status == STATUS_ERROR)
+        {
+            free_database(db);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int db_write_snapshot(database *db, const char *path)
+{
+    if (db->pool.frames)
+    {
+        fprintf(stderr, "%s:%s:%d a paged database has no tables to snapshot\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    if (db_materialize_all(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    db_snapshot_source source;
+    if (read_db_sections(db->fd, &db->hdr, sections, &section_count) == STATUS_ERROR ||
+        db_snapshot_source_of(db->fd, &db->hdr, sections, section_count, &source) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // each distinct address gets the position of its pool entry, names and addresses share one strings section
+    size_t count = db->hdr.employee_count;
+    size_t strings_len = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (db->employees[i].name)
+            strings_len += strlen(db->employees[i].name) + 1;
+    }
+    for (size_t i = 0; i < db->address_pool.capacity; i++)
+    {
+        if (db->address_pool.entries[i].str)
+            strings_len += strlen(db->address_pool.entries[i].str) + 1;
+    }
+    if (strings_len > UINT32_MAX)
+    {
+        fprintf(stderr, "%s:%s:%d strings too long for a snapshot\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    char *strings = malloc(strings_len ? strings_len : 1);
+    uint32_t *address_ids = malloc((db->address_pool.capacity ? db->address_pool.capacity : 1) * sizeof(uint32_t));
+    db_snapshot_address *addresses = malloc((db->address_pool.count ? db->address_pool.count : 1) * sizeof(db_snapshot_address));
+    db_snapshot_employee *employees = malloc((count ? count : 1) * sizeof(db_snapshot_employee));
+    int status = strings && address_ids && addresses && employees ? STATUS_SUCCESS : STATUS_ERROR;
+    if (status == STATUS_ERROR)
+        fprintf(stderr, "%s:%s:%d unable to allocate snapshot tables: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+
+    size_t strings_used = 0;
+    uint32_t address_count = 0;
+    for (size_t i = 0; status == STATUS_SUCCESS && i < db->address_pool.capacity; i++)
+    {
+        string_pool_entry *entry = db->address_pool.entries + i;
+        if (!entry->str)
+            continue;
+        size_t len = strlen(entry->str) + 1;
+        memcpy(strings + strings_used, entry->str, len);
+        address_ids[i] = address_count;
+        addresses[address_count++] = (db_snapshot_address) { .str=strings_used, .refs=entry->refs };
+        strings_used += len;
+    }
+    for (size_t i = 0; status == STATUS_SUCCESS && i < count; i++)
+    {
+        employee *e = db->employees + i;
+        if (!e->name)
+        {
+            employees[i] = (db_snapshot_employee) { .name=DB_SNAPSHOT_DELETED, .address=0, .hours=e->hours };
+            continue;
+        }
+        size_t len = strlen(e->name) + 1;
+        memcpy(strings + strings_used, e->name, len);
+        string_pool_entry *entry = string_pool_find(&db->address_pool, e->address);
+        employees[i] = (db_snapshot_employee) { .name=strings_used, .address=address_ids[entry - db->address_pool.entries], .hours=e->hours };
+        strings_used += len;
+    }
+
+    // the name index comes first so it can be mapped through a db_section
+    db_snapshot_writer w;
+    uint32_t index_hdr[2] = { htonl((uint32_t)db->names.capacity), htonl((uint32_t)db->names.count) };
+    if (status == STATUS_SUCCESS &&
+        (db_snapshot_create(&w, path) == STATUS_ERROR ||
+        db_snapshot_begin_section(&w, DB_SNAPSHOT_NAME_INDEX) == STATUS_ERROR ||
+        db_snapshot_write(&w, index_hdr, sizeof(index_hdr)) == STATUS_ERROR ||
+        db_snapshot_write(&w, db->names.entries, db->names.capacity * sizeof(name_index_entry)) == STATUS_ERROR ||
+        db_snapshot_begin_section(&w, DB_SNAPSHOT_OFFSETS) == STATUS_ERROR ||
+        db_snapshot_write(&w, db->offsets, count * sizeof(uint32_t)) == STATUS_ERROR ||
+        db_snapshot_begin_section(&w, DB_SNAPSHOT_HOURS) == STATUS_ERROR ||
+        db_snapshot_write(&w, db->hours.entries, db->hours.count * sizeof(hours_index_entry)) == STATUS_ERROR ||
+        db_snapshot_begin_section(&w, DB_SNAPSHOT_EMPLOYEES) == STATUS_ERROR ||
+        db_snapshot_write(&w, employees, count * sizeof(db_snapshot_employee)) == STATUS_ERROR ||
+        db_snapshot_begin_section(&w, DB_SNAPSHOT_ADDRESSES) == STATUS_ERROR ||
+        db_snapshot_write(&w, addresses, address_count * sizeof(db_snapshot_address)) == STATUS_ERROR ||
+        db_snapshot_begin_section(&w, DB_SNAPSHOT_STRINGS) == STATUS_ERROR ||
+        db_snapshot_write(&w, strings, strings_len) == STATUS_ERROR ||
+        db_snapshot_commit(&w, &source) == STATUS_ERROR))
+    {
+        db_snapshot_abort(&w);
+        status = STATUS_ERROR;
+    }
+
+    free(strings);
+    free(address_ids);
+    free(addresses);
+    free(employees);
+    return status;
+}
+
+int db_load_paged(database *db, int fd, int checkpoint_flags, size_t budget)
+{
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    if (db_open(db, fd, checkpoint_flags, sections, &section_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // records inside compressed blocks have no offset to read them from
+    if (db->checkpoint_flags & DB_CHECKPOINT_COMPRESSED)
+    {
+        fprintf(stderr, "%s:%s:%d records in compressed blocks cannot be paged\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // nothing is decoded up front, so the file is checked against its checksums by reading it once
+    if (db->checkpoint_flags & DB_CHECKPOINT_CHECKSUMS)
+    {
+        if (db_checksums_compute(&db->checksums, fd, sizeof(db_header), db->records_end) == STATUS_ERROR)
+            return STATUS_ERROR;
+
+        db_checksums stored;
+        if (db->checksums_section.length > 0)
+        {
+            if (read_db_checksums(&stored, fd, &db->checksums_section) == STATUS_ERROR)
+            {
+                free_db_checksums(&db->checksums);
+                return STATUS_ERROR;
+            }
+            bool match = stored.start == db->checksums.start && stored.end == db->checksums.end && stored.count == db->checksums.count &&
+                !memcmp(stored.crcs, db->checksums.crcs, stored.count * sizeof(uint32_t));
+            free_db_checksums(&stored);
+            if (!match)
+            {
+                fprintf(stderr, "%s:%s:%d corrupted data, checksum mismatch\n", __FILE__, __FUNCTION__, __LINE__);
+                free_db_checksums(&db->checksums);
+                return STATUS_ERROR;
+            }
+        }
+    }
+
+    db_section *addresses = find_db_section(sections, section_count, DB_SECTION_ADDRESSES);
+    db->offsets = malloc((db->hdr.employee_count ? db->hdr.employee_count : 1) * sizeof(uint32_t));
+    if (!db->offsets || buffer_pool_init(&db->pool, fd, budget) == STATUS_ERROR ||
+        (addresses && read_db_dictionary(fd, addresses, &db->address_dictionary) == STATUS_ERROR))
+    {
+        fprintf(stderr, "%s:%s:%d unable to set up paged records\n", __FILE__, __FUNCTION__, __LINE__);
+        free_database(db);
+        return STATUS_ERROR;
+    }
+
+    // map the name index written by the last checkpoint, an empty section means records were appended since
+    db_section *index_section = find_db_section(sections, section_count, DB_SECTION_NAME_INDEX);
+    bool mapped = index_section && index_section->length > 0 &&
+        name_index_map(&db->names, fd, index_section, db->hdr.employee_count) == STATUS_SUCCESS;
+    if (!mapped && name_index_init(&db->names, (size_t)(db->hdr.employee_count / NAME_INDEX_ALPHA) + 1) == STATUS_ERROR)
+    {
+        free_database(db);
+        return STATUS_ERROR;
+    }
+
+    // one pass over the records through the pool builds the indexes, only the offsets and indexes stay in memory
+    uint32_t offset = db->records_start;
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        employee e;
+        int nbytes = db_read_record(db, offset, &e, true);
+        if (nbytes == STATUS_ERROR)
+        {
+            free_database(db);
+            return STATUS_ERROR;
+        }
+
+        int status = STATUS_SUCCESS;
+        db->offsets[i] = offset;
+        if (e.name[0] == '\0')
+            db->dead_count++;
+        else if (hours_index_append(&db->hours, e.hours, i) == STATUS_ERROR ||
+            (!mapped && name_index_insert(&db->names, e.name, i, offset) == STATUS_ERROR))
+            status = STATUS_ERROR;
+        free(e.name);
+        free(e.address);
+        if (status == STATUS_ERROR)
+        {
+            free_database(db);
+            return STATUS_ERROR;
+        }
+        offset += nbytes;
+    }
+    hours_index_sort(&db->hours);
+
+    if (offset != db->records_end)
+    {
+        fprintf(stderr, "%s:%s:%d corrupted data, records end at %u instead of %u\n", __FILE__, __FUNCTION__, __LINE__, offset, db->records_end);
+        free_database(db);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// a paged database is rewritten the way it is compacted, see below
+static int db_paged_compact(database *db);
+
+int db_checkpoint(database *db)
+{
+    // the rewrite works from the employee table, which a paged database does not have
+    if (db->pool.frames)
+        return db_paged_compact(db);
+
+    if (db_materialize_all(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // a full rewrite supersedes any compaction in progress
+    db_abort_compaction(db);
+
+    // drop deleted records from the table before rewriting the file
+    size_t live_count = 0;
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        if (db->employees[i].name)
+            db->employees[live_count++] = db->employees[i];
+    }
+    db->hdr.employee_count = live_count;
+    db->dead_count = 0;
+    db->unindexed_count = 0;
+
+    // slots change and a mapped index would see the file being rewritten
+    free_name_index(&db->names);
+    if (checkpoint_db(db->fd, &db->hdr, db->employees, db->checkpoint_flags) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d checkpoint_db() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    if (db_compute_offsets(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    free_hours_index(&db->hours);
+    if (hours_index_build(&db->hours, db->employees, db->hdr.employee_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_radix_tree(&db->prefixes);
+    if (radix_tree_build(&db->prefixes, db->employees, db->hdr.employee_count) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (db->addresses.table)
+    {
+        free_trigram_index(&db->addresses);
+        if (trigram_index_build(&db->addresses, db->employees, db->hdr.employee_count) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    return name_index_build(&db->names, db->employees, db->offsets, db->hdr.employee_count);
+}
+
+int db_find_employee(database *db, const char *name, size_t *idx)
+{
+    if (db->pool.frames)
+    {
+        struct db_name_probe probe = { .db=db, .name=name };
+        return name_index_probe(&db->names, name, db_slot_has_name, &probe, idx);
+    }
+    if (db->materialized)
+    {
+        struct db_name_probe probe = { .db=db, .name=name };
+        return name_index_probe(&db->names, name, db_slot_is_named, &probe, idx);
+    }
+    return name_index_find(&db->names, db->employees, db->hdr.employee_count, name, idx);
+}
+
+int db_add_employee(database *db, employee *e)
+{
+    // add space for new employee and its offset, a paged database has no employee table
+    size_t employees_size = db->hdr.employee_count + 1;
+    if (!db->pool.frames)
+    {
+        employee *new_employees = realloc(db->employees, employees_size * sizeof(employee));
+        if (!new_employees)
+        {
+            fprintf(stderr, "%s:%s:%d error reallocating employee buffer\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+        db->employees = new_employees;
+    }
+    if (db->materialized)
+    {
+        bool *materialized = realloc(db->materialized, employees_size * sizeof(bool));
+        if (!materialized)
+        {
+            fprintf(stderr, "%s:%s:%d error reallocating materialized slots\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+        db->materialized = materialized;
+    }
+
+    uint32_t *new_offsets = realloc(db->offsets, employees_size * sizeof(uint32_t));
+    if (!new_offsets)
+    {
+        fprintf(stderr, "%s:%s:%d error reallocating offset buffer\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    db->offsets = new_offsets;
+
+    // a running compaction copies the new record once its cursor reaches it
+    if (db->compaction.fd != -1)
+    {
+        new_offsets = realloc(db->compaction.offsets, employees_size * sizeof(uint32_t));
+        if (!new_offsets)
+        {
+            fprintf(stderr, "%s:%s:%d error reallocating compaction offsets\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+        db->compaction.offsets = new_offsets;
+        db->compaction.offsets[employees_size - 1] = 0;
+    }
+
+    // the append overwrites the file region a mapped index was read from, and the last checksum
+    // of a lazily loaded file stops matching the mapping once it covers the new record
+    if (name_index_detach(&db->names) == STATUS_ERROR ||
+        (db->verified && db_verify_lazy(db, db->records_end - 1, 1) == STATUS_ERROR))
+        return STATUS_ERROR;
+
+    // append the record to the end of the records region
+    size_t record_size = employee_record_size(e);
+    unsigned char *record = malloc(record_size);
+    if (!record)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate record: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    encode_employee_record(e, DB_ADDRESS_INLINE, record);
+
+    int status = pwrite_all(db->fd, record, record_size, db->records_end);
+    if (status == STATUS_SUCCESS && db->checksums.crcs)
+        status = db_checksums_extend(&db->checksums, record, record_size);
+    if (status == STATUS_SUCCESS && db->pool.frames)
+        buffer_pool_write(&db->pool, db->records_end, record, record_size);
+    free(record);
+    if (status == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    if (db->pool.frames)
+    {
+        // a paged database keeps the record in the file only
+        if (name_index_insert(&db->names, e->name, db->hdr.employee_count, db->records_end) == STATUS_ERROR ||
+            hours_index_insert(&db->hours, e->hours, db->hdr.employee_count) == STATUS_ERROR)
+            status = STATUS_ERROR;
+        free(e->name);
+        free(e->address);
+        if (status == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    else
+    {
+        // appended records keep their address inline, the next checkpoint or compaction moves it to the dictionary
+        char *address = string_pool_intern(&db->address_pool, e->address);
+        if (!address)
+            return STATUS_ERROR;
+        e->address = address;
+
+        // a lazily loaded database builds its hours index once every record is materialized, and a tree
+        // with no root is built by the first prefix search
+        if (name_index_insert(&db->names, e->name, db->hdr.employee_count, db->records_end) == STATUS_ERROR ||
+            (!db->materialized && hours_index_insert(&db->hours, e->hours, db->hdr.employee_count) == STATUS_ERROR) ||
+            (db->prefixes.root && radix_tree_insert(&db->prefixes, e->name, db->hdr.employee_count) == STATUS_ERROR) ||
+            (db->addresses.table && trigram_index_insert(&db->addresses, e->address, db->hdr.employee_count) == STATUS_ERROR))
+            return STATUS_ERROR;
+
+        db->employees[db->hdr.employee_count] = *e;
+        if (db->materialized)
+            db->materialized[db->hdr.employee_count] = true;
+    }
+    db->offsets[db->hdr.employee_count] = db->records_end;
+    db->hdr.employee_count++;
+    db->records_end += record_size;
+    if (db->checkpoint_flags & (DB_CHECKPOINT_OFFSETS | DB_CHECKPOINT_NAME_INDEX))
+        db->unindexed_count++;
+
+    return db_write_tail(db);
+}
+
+// the old hours and the name of a paged record are read back through the pool before it is written
+static int db_paged_update_hours(database *db, size_t idx, uint32_t hours)
+{
+    employee e;
+    if (db_read_record(db, db->offsets[idx], &e, false) == STATUS_ERROR)
+        return STATUS_ERROR;
+    uint32_t old_hours = htonl(e.hours);
+    uint32_t serialized_hours = htonl(hours);
+    hours_index_update(&db->hours, idx, e.hours, hours);
+    free(e.name);
+    free(e.address);
+
+    if (db_paged_write(db, db_hours_offset(db, idx), &old_hours, &serialized_hours, sizeof(uint32_t)) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write hours to database file\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+static int db_paged_delete(database *db, size_t idx)
+{
+    employee e;
+    if (db_read_record(db, db->offsets[idx], &e, false) == STATUS_ERROR)
+        return STATUS_ERROR;
+    name_index_remove(&db->names, e.name, idx);
+    hours_index_remove(&db->hours, e.hours, idx);
+    unsigned char first_byte = e.name[0];
+    free(e.name);
+    free(e.address);
+    db->dead_count++;
+
+    unsigned char tombstone = '\0';
+    if (db_paged_write(db, db->offsets[idx] + sizeof(uint16_t), &first_byte, &tombstone, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write tombstone to database file\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// sets the tombstone bit of a record inside the compressed blocks, returning the byte holding it before and after
+static int db_set_block_tombstone(int fd, db_section *tombstones, size_t slot, unsigned char *old_byte, unsigned char *new_byte)
+{
+    uint32_t offset = tombstones->offset + slot / 8;
+    if (pread(fd, old_byte, 1, offset) != 1)
+    {
+        fprintf(stderr, "%s:%s:%d pread() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    *new_byte = *old_byte | (1 << (slot % 8));
+    return pwrite_all(fd, new_byte, 1, offset);
+}
+
+// whether a record inside a compressed block can be deleted by its tombstone bit, files written before
+// the bits existed are rewritten by a checkpoint instead
+static bool db_has_block_tombstone(database *db, size_t idx)
+{
+    return (uint64_t)db->block_tombstones.length * 8 > idx;
+}
+
+// whether the running compaction copied a record into one of the compressed blocks of the new file
+static bool db_compaction_in_block(database *db, size_t idx)
+{
+    return db->compaction.fd != -1 && db->compaction.offsets[idx] && idx < db->compaction.block_cursor;
+}
+
+// a record inside a compressed block cannot be written in place, a copy with the new hours is appended
+// before the original is deleted, so that a crash in between leaves both rather than neither
+static int db_replace_employee(database *db, size_t idx, uint32_t hours)
+{
+    // the copy shares the pooled address, interning it again counts one more reference
+    employee e = { .name=strdup(db->employees[idx].name), .address=db->employees[idx].address, .hours=hours };
+    if (!e.name)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate name: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    if (db_add_employee(db, &e) == STATUS_ERROR)
+        return STATUS_ERROR;
+    return db_delete_employee(db, idx);
+}
+
+int db_update_hours(database *db, size_t idx, uint32_t hours)
+{
+    if (db->pool.frames)
+        return db_paged_update_hours(db, idx, hours);
+    if (db_materialize(db, idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    if ((!db->offsets[idx] && db_has_block_tombstone(db, idx)) || db_compaction_in_block(db, idx))
+        return db_replace_employee(db, idx, hours);
+
+    uint32_t old_hours = htonl(db->employees[idx].hours);
+    if (!db->materialized)
+        hours_index_update(&db->hours, idx, db->employees[idx].hours, hours);
+    db->employees[idx].hours = hours;
+
+    if (!db->offsets[idx])
+        return db_checkpoint(db);
+
+    // hours are the last fixed size field of the record, so only those 4 bytes need rewriting
+    uint32_t serialized_hours = htonl(hours);
+    uint32_t offset = db_hours_offset(db, idx);
+    if (pwrite_all(db->fd, &serialized_hours, sizeof(uint32_t), offset) == STATUS_ERROR ||
+        db_patch_checksums(db, offset, &old_hours, &serialized_hours, sizeof(uint32_t)) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write hours to database file\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // keep an already copied record up to date in the compacted file
+    if (db->compaction.fd != -1 && db->compaction.offsets[idx])
+    {
+        offset = db->compaction.offsets[idx] + db_compaction_record_size(db, db->employees + idx) - sizeof(uint32_t);
+        if (pwrite_all(db->compaction.fd, &serialized_hours, sizeof(uint32_t), offset) == STATUS_ERROR ||
+            (db->compaction.checksums.crcs &&
+                db_checksums_patch(&db->compaction.checksums, offset, &old_hours, &serialized_hours, sizeof(uint32_t)) == STATUS_ERROR))
+        {
+            fprintf(stderr, "%s:%s:%d unable to write hours to compacted file\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int db_delete_employee(database *db, size_t idx)
+{
+    if (db->pool.frames)
+        return db_paged_delete(db, idx);
+    if (db_materialize(db, idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    unsigned char first_byte = db->employees[idx].name[0];
+    name_index_remove(&db->names, db->employees[idx].name, idx);
+    if (!db->materialized)
+        hours_index_remove(&db->hours, db->employees[idx].hours, idx);
+    if (db->prefixes.root)
+        radix_tree_remove(&db->prefixes, db->employees[idx].name, idx);
+    if (db->addresses.table)
+        trigram_index_remove(&db->addresses, db->employees[idx].address, idx);
+    db_free_name(db, db->employees[idx].name);
+    string_pool_release(&db->address_pool, db->employees[idx].address);
+    db->employees[idx].name = NULL;
+    db->employees[idx].address = NULL;
+    db->dead_count++;
+
+    if (!db->offsets[idx] && !db_has_block_tombstone(db, idx))
+        return db_checkpoint(db);
+
+    // mark the record dead by clearing the first byte of its name, or its bit if it is inside a compressed block
+    unsigned char tombstone = '\0';
+    unsigned char old_byte, new_byte;
+    int status;
+    if (!db->offsets[idx])
+    {
+        status = db_set_block_tombstone(db->fd, &db->block_tombstones, idx, &old_byte, &new_byte);
+        if (status == STATUS_SUCCESS)
+            status = db_patch_checksums(db, db->block_tombstones.offset + idx / 8, &old_byte, &new_byte, 1);
+    }
+    else
+    {
+        status = pwrite_all(db->fd, &tombstone, 1, db->offsets[idx] + sizeof(uint16_t));
+        if (status == STATUS_SUCCESS)
+            status = db_patch_checksums(db, db->offsets[idx] + sizeof(uint16_t), &first_byte, &tombstone, 1);
+    }
+    if (status == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write tombstone to database file\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    db_compaction *c = &db->compaction;
+    if (c->fd == -1 || !c->offsets[idx])
+        return STATUS_SUCCESS;
+
+    // slots copied into a block hold their new slot + 1 rather than an offset
+    if (idx < c->block_cursor)
+    {
+        size_t slot = c->offsets[idx] - 1;
+        status = db_set_block_tombstone(c->fd, &c->block_tombstones, slot, &old_byte, &new_byte);
+        if (status == STATUS_SUCCESS && c->checksums.crcs)
+            status = db_checksums_patch(&c->checksums, c->block_tombstones.offset + slot / 8, &old_byte, &new_byte, 1);
+    }
+    else
+    {
+        status = pwrite_all(c->fd, &tombstone, 1, c->offsets[idx] + sizeof(uint16_t));
+        if (status == STATUS_SUCCESS && c->checksums.crcs)
+            status = db_checksums_patch(&c->checksums, c->offsets[idx] + sizeof(uint16_t), &first_byte, &tombstone, 1);
+    }
+    if (status == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write tombstone to compacted file\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+static bool db_name_has_prefix(employee *e, const char *prefix)
+{
+    return !strncmp(e->name, prefix, strlen(prefix));
+}
+
+static bool db_address_contains(employee *e, const char *substring)
+{
+    return strstr(e->address, substring) != NULL;
+}
+
+static int db_employee_name_cmp(const void *a, const void *b)
+{
+    return strcmp(((const employee *)a)->name, ((const employee *)b)->name);
+}
+
+int db_list_employees(database *db, employee **employees, size_t *employees_size)
+{
+    // every slot of the table, deleted ones have no name, a paged database reads its live records into the results
+    if (db->pool.frames)
+    {
+        if (db_paged_scan(db, NULL, NULL) == STATUS_ERROR)
+            return STATUS_ERROR;
+        *employees = db->results;
+        *employees_size = db->results_size;
+        return STATUS_SUCCESS;
+    }
+
+    // queries over every record materialize a lazily loaded table in full the first time
+    if (db_materialize_all(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+    *employees = db->employees;
+    *employees_size = db->hdr.employee_count;
+    return STATUS_SUCCESS;
+}
+
+int db_hours_range(database *db, uint32_t min_hours, uint32_t max_hours, employee **employees, size_t *employees_size)
+{
+    if (db_materialize_all(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    size_t start;
+    size_t count = hours_index_range(&db->hours, min_hours, max_hours, &start);
+
+    // the index gives the slots, a paged database reads their records through the pool
+    if (db->pool.frames)
+    {
+        db_clear_results(db);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (db_push_slot(db, db->hours.entries[start + i].slot) == STATUS_ERROR)
+                return STATUS_ERROR;
+        }
+        return db_copy_results(db, employees, employees_size);
+    }
+
+    // shallow copies, the strings stay owned by the employee table
+    *employees = malloc((count ? count : 1) * sizeof(employee));
+    if (!*employees)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate range result: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        (*employees)[i] = db->employees[db->hours.entries[start + i].slot];
+    *employees_size = count;
+    return STATUS_SUCCESS;
+}
+
+int db_top_hours(database *db, size_t k, employee **employees, size_t *employees_size)
+{
+    if (db_materialize_all(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    size_t count = k < db->hours.count ? k : db->hours.count;
+    if (db->pool.frames)
+    {
+        db_clear_results(db);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (db_push_slot(db, db->hours.entries[db->hours.count - 1 - i].slot) == STATUS_ERROR)
+                return STATUS_ERROR;
+        }
+        return db_copy_results(db, employees, employees_size);
+    }
+
+    *employees = malloc((count ? count : 1) * sizeof(employee));
+    if (!*employees)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate top hours result: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // highest hours first
+    for (size_t i = 0; i < count; i++)
+        (*employees)[i] = db->employees[db->hours.entries[db->hours.count - 1 - i].slot];
+    *employees_size = count;
+    return STATUS_SUCCESS;
+}
+
+// the live records of the given names in their order, names without one are skipped
+int db_lookup_employees(database *db, char **names, size_t names_size, employee **employees, size_t *employees_size)
+{
+    if (db->pool.frames)
+    {
+        db_clear_results(db);
+        for (size_t i = 0; i < names_size; i++)
+        {
+            size_t idx;
+            if (db_find_employee(db, names[i], &idx) == STATUS_SUCCESS && db_push_slot(db, idx) == STATUS_ERROR)
+                return STATUS_ERROR;
+        }
+        return db_copy_results(db, employees, employees_size);
+    }
+
+    *employees = malloc((names_size ? names_size : 1) * sizeof(employee));
+    if (!*employees)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate lookup result: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // only the records looked up are decoded in a lazily loaded table
+    size_t count = 0;
+    for (size_t i = 0; i < names_size; i++)
+    {
+        size_t idx;
+        if (db_find_employee(db, names[i], &idx) == STATUS_ERROR)
+            continue;
+        if (db_materialize(db, idx) == STATUS_ERROR)
+        {
+            free(*employees);
+            return STATUS_ERROR;
+        }
+        (*employees)[count++] = db->employees[idx];
+    }
+    *employees_size = count;
+    return STATUS_SUCCESS;
+}
+
+int db_prefix_search(database *db, const char *prefix, employee **employees, size_t *employees_size)
+{
+    // a paged database has no tree over the names, its records are scanned instead
+    if (db->pool.frames)
+    {
+        if (db_paged_scan(db, db_name_has_prefix, prefix) == STATUS_ERROR)
+            return STATUS_ERROR;
+        qsort(db->results, db->results_size, sizeof(employee), db_employee_name_cmp);
+        return db_copy_results(db, employees, employees_size);
+    }
+    if (db_materialize_all(db) == STATUS_ERROR ||
+        (!db->prefixes.root && radix_tree_build(&db->prefixes, db->employees, db->hdr.employee_count) == STATUS_ERROR))
+        return STATUS_ERROR;
+
+    uint32_t *slots;
+    size_t count;
+    if (radix_tree_prefix(&db->prefixes, prefix, &slots, &count) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // matches come back ordered by name
+    *employees = malloc((count ? count : 1) * sizeof(employee));
+    if (!*employees)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate prefix result: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(slots);
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        (*employees)[i] = db->employees[slots[i]];
+    *employees_size = count;
+    free(slots);
+    return STATUS_SUCCESS;
+}
+
+int db_build_address_index(database *db)
+{
+    if (db->pool.frames)
+    {
+        fprintf(stderr, "%s:%s:%d an address index needs the employee table, a paged database scans its addresses instead\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    if (db_materialize_all(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    free_trigram_index(&db->addresses);
+    return trigram_index_build(&db->addresses, db->employees, db->hdr.employee_count);
+}
+
+int db_address_search(database *db, const char *substring, employee **employees, size_t *employees_size)
+{
+    if (db->pool.frames)
+    {
+        if (db_paged_scan(db, db_address_contains, substring) == STATUS_ERROR)
+            return STATUS_ERROR;
+        return db_copy_results(db, employees, employees_size);
+    }
+    if (db_materialize_all(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // without an index every address is scanned
+    if (!db->addresses.table)
+    {
+        *employees = malloc((db->hdr.employee_count ? db->hdr.employee_count : 1) * sizeof(employee));
+        if (!*employees)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate search result: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+
+        *employees_size = 0;
+        for (size_t i = 0; i < db->hdr.employee_count; i++)
+        {
+            if (db->employees[i].address && strstr(db->employees[i].address, substring))
+                (*employees)[(*employees_size)++] = db->employees[i];
+        }
+        return STATUS_SUCCESS;
+    }
+
+    uint32_t *slots;
+    size_t count;
+    if (trigram_index_search(&db->addresses, db->employees, db->hdr.employee_count, substring, &slots, &count) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    *employees = malloc((count ? count : 1) * sizeof(employee));
+    if (!*employees)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate search result: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(slots);
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        (*employees)[i] = db->employees[slots[i]];
+    *employees_size = count;
+    free(slots);
+    return STATUS_SUCCESS;
+}
+
+// whether a checkpoint would write the offset directory and name index of at least min_appended records appended
+// after they were last written
+bool db_checkpoint_pending(database *db, size_t min_appended)
+{
+    // a running compaction writes both when it finishes
+    if (db->compaction.fd != -1)
+        return false;
+    return db->unindexed_count > 0 && db->unindexed_count >= min_appended;
+}
+
+bool db_compaction_pending(database *db)
+{
+    if (db->compaction.fd != -1)
+        return true;
+
+    return db->path && db->dead_count > 0 && db->dead_count >= db->compact_min_dead &&
+        db->dead_count >= db->compact_ratio * db->hdr.employee_count;
+}
+
+void db_abort_compaction(database *db)
+{
+    if (db->compaction.fd == -1)
+        return;
+
+    close(db->compaction.fd);
+    unlink(db->compaction.path);
+    free(db->compaction.path);
+    free(db->compaction.offsets);
+    free_db_checksums(&db->compaction.checksums);
+    free(db->compaction.block_entries);
+    free(db->compaction.raw);
+    free(db->compaction.compressed);
+    db->compaction = (db_compaction) { .fd=-1 };
+}
+
+// reserves the block index and the tombstones of a compressed file after the dictionary, with room for as
+// many blocks as the live records fill, records added meanwhile are copied after the blocks once it runs out
+static int db_reserve_compaction_blocks(database *db)
+{
+    db_compaction *c = &db->compaction;
+    size_t live_count = 0;
+    size_t live_bytes = 0;
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        if (!db->employees[i].name)
+            continue;
+        live_count++;
+        live_bytes += db_compaction_record_size(db, db->employees + i);
+    }
+
+    c->block_capacity = live_bytes / DB_BLOCK_SIZE + 1;
+    size_t index_len = sizeof(uint32_t) + c->block_capacity * sizeof(db_block);
+    size_t tombstones_len = (live_count + 7) / 8;
+    c->block_entries = malloc(c->block_capacity * sizeof(db_block));
+    c->raw = malloc(DB_BLOCK_RAW_CAPACITY);
+    c->compressed_cap = lz_compress_bound(DB_BLOCK_RAW_CAPACITY);
+    c->compressed = malloc(c->compressed_cap);
+    unsigned char *zeros = calloc(index_len + tombstones_len, 1);
+    int status = STATUS_ERROR;
+    if (!c->block_entries || !c->raw || !c->compressed || !zeros)
+        fprintf(stderr, "%s:%s:%d unable to allocate compaction blocks: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+    else
+        status = pwrite_all(c->fd, zeros, index_len + tombstones_len, c->records_start);
+    free(zeros);
+    if (status == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    c->blocks = (db_section) { .type=DB_SECTION_BLOCKS, .offset=c->records_start, .length=sizeof(uint32_t) };
+    c->block_tombstones = (db_section) { .type=DB_SECTION_BLOCK_TOMBSTONES, .offset=c->records_start + index_len, .length=tombstones_len };
+    c->records_start += index_len + tombstones_len;
+    c->blocks_open = live_count > 0;
+    return STATUS_SUCCESS;
+}
+
+// writes the block being filled after the copied records, the blocks are closed once the reserved
+// index or tombstones are full
+static int db_flush_compaction_block(database *db)
+{
+    db_compaction *c = &db->compaction;
+    if (c->raw_count > 0)
+    {
+        const unsigned char *block;
+        int length = compress_db_block(c->raw, c->raw_len, c->compressed, c->compressed_cap, &block);
+        if (length == STATUS_ERROR || pwrite_all(c->fd, block, length, c->records_end) == STATUS_ERROR ||
+            (c->checksums.crcs && db_checksums_extend(&c->checksums, block, length) == STATUS_ERROR))
+        {
+            fprintf(stderr, "%s:%s:%d unable to write block to compacted file\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+
+        // kept in file order until the index is written
+        c->block_entries[c->block_count++] = (db_block) {
+            .offset=htonl(c->records_end), .length=htonl(length), .raw_length=htonl(c->raw_len), .record_count=htonl(c->raw_count)
+        };
+        c->records_end += length;
+        c->raw_len = 0;
+        c->raw_count = 0;
+    }
+
+    if (c->block_count == c->block_capacity || c->record_count >= (uint64_t)c->block_tombstones.length * 8)
+        c->blocks_open = false;
+    return STATUS_SUCCESS;
+}
+
+// copies a record into the block being filled, its slot holds its new slot + 1 until the compaction finishes
+static int db_copy_to_compaction_block(database *db, size_t idx)
+{
+    db_compaction *c = &db->compaction;
+    employee *e = db->employees + idx;
+    c->raw_len += encode_employee_record(e, db_compaction_address_ref(db, e->address), c->raw + c->raw_len);
+    c->raw_count++;
+    c->offsets[idx] = c->record_count + 1;
+    c->record_count++;
+    c->block_cursor = idx + 1;
+
+    if (c->raw_len >= DB_BLOCK_SIZE || c->record_count >= (uint64_t)c->block_tombstones.length * 8)
+        return db_flush_compaction_block(db);
+    return STATUS_SUCCESS;
+}
+
+// writes the last block and puts the index in the room reserved for it
+static int db_write_compaction_blocks(database *db)
+{
+    db_compaction *c = &db->compaction;
+    if (c->blocks_open && db_flush_compaction_block(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+    c->blocks_open = false;
+
+    size_t index_len = sizeof(uint32_t) + c->block_count * sizeof(db_block);
+    unsigned char *index = malloc(index_len);
+    unsigned char *zeros = calloc(index_len, 1);
+    int status = STATUS_ERROR;
+    if (!index || !zeros)
+        fprintf(stderr, "%s:%s:%d unable to allocate block index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+    else
+    {
+        uint32_t count = htonl((uint32_t)c->block_count);
+        memcpy(index, &count, sizeof(uint32_t));
+        memcpy(index + sizeof(uint32_t), c->block_entries, c->block_count * sizeof(db_block));
+        status = pwrite_all(c->fd, index, index_len, c->blocks.offset);
+        if (status == STATUS_SUCCESS && c->checksums.crcs)
+            status = db_checksums_patch(&c->checksums, c->blocks.offset, zeros, index, index_len);
+    }
+    free(index);
+    free(zeros);
+    c->blocks.length = index_len;
+    return status;
+}
+
+static int db_start_compaction(database *db)
+{
+    db_compaction *c = &db->compaction;
+    c->path = malloc(strlen(db->path) + sizeof(DB_COMPACT_SUFFIX));
+    c->offsets = calloc(db->hdr.employee_count ? db->hdr.employee_count : 1, sizeof(uint32_t));
+    if (!c->path || !c->offsets)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate compaction state: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(c->path);
+        free(c->offsets);
+        *c = (db_compaction) { .fd=-1 };
+        return STATUS_ERROR;
+    }
+    strcpy(c->path, db->path);
+    strcat(c->path, DB_COMPACT_SUFFIX);
+
+    if ((c->fd = open(c->path, O_RDWR | O_CREAT | O_TRUNC, 0666)) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to create compaction file '%s': (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, c->path, errno, strerror(errno));
+        free(c->path);
+        free(c->offsets);
+        *c = (db_compaction) { .fd=-1 };
+        return STATUS_ERROR;
+    }
+
+    c->cursor = 0;
+    c->records_start = sizeof(db_header);
+    c->dictionary = (db_section) { .type=DB_SECTION_ADDRESSES, .offset=sizeof(db_header), .length=0 };
+    c->record_count = 0;
+
+    // the current addresses become the dictionary of the new file, records copied with one of them reference it,
+    // a paged database copies its records as they are and keeps the dictionary they reference in the same order
+    if (db->checkpoint_flags & DB_CHECKPOINT_ADDRESS_DICTIONARY)
+    {
+        char **addresses = db->pool.frames ? db->address_dictionary.addresses :
+            malloc((db->address_pool.count ? db->address_pool.count : 1) * sizeof(char *));
+        if (!addresses && !db->pool.frames)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate address dictionary: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            db_abort_compaction(db);
+            return STATUS_ERROR;
+        }
+
+        uint32_t count = db->pool.frames ? db->address_dictionary.count : 0;
+        for (size_t i = 0; !db->pool.frames && i < db->address_pool.capacity; i++)
+        {
+            if (!db->address_pool.entries[i].str)
+                continue;
+            db->address_pool.entries[i].index = count;
+            addresses[count++] = db->address_pool.entries[i].str;
+        }
+
+        int nbytes = STATUS_ERROR;
+        if (lseek(c->fd, sizeof(db_header), SEEK_SET) == -1)
+            fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        else
+            nbytes = write_db_dictionary(c->fd, addresses, count);
+        if (!db->pool.frames)
+            free(addresses);
+        if (nbytes == STATUS_ERROR)
+        {
+            db_abort_compaction(db);
+            return STATUS_ERROR;
+        }
+        c->dictionary.length = nbytes;
+        c->records_start += nbytes;
+    }
+
+    // records of a compressed file are copied into blocks again
+    if ((db->checkpoint_flags & DB_CHECKPOINT_COMPRESSED) && db_reserve_compaction_blocks(db) == STATUS_ERROR)
+    {
+        db_abort_compaction(db);
+        return STATUS_ERROR;
+    }
+    c->records_end = c->records_start;
+
+    // the dictionary is read back once, copied records are added to the checksums as they are written
+    if ((db->checkpoint_flags & DB_CHECKPOINT_CHECKSUMS) &&
+        db_checksums_compute(&c->checksums, c->fd, sizeof(db_header), c->records_start) == STATUS_ERROR)
+    {
+        db_abort_compaction(db);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// writes the optional sections and footer after the copied records, followed by the header of the compacted file
+static int db_write_compaction_tail(database *db, name_index *names, uint32_t *fsize)
+{
+    db_compaction *c = &db->compaction;
+
+    // copied slots are in file order, so their offsets form the new directory
+    if (db->checkpoint_flags)
+    {
+        db_section sections[DB_MAX_SECTIONS];
+        size_t section_count = 0;
+        if (db->checkpoint_flags & DB_CHECKPOINT_ADDRESS_DICTIONARY)
+            sections[section_count++] = c->dictionary;
+        if (db->checkpoint_flags & DB_CHECKPOINT_COMPRESSED)
+        {
+            sections[section_count++] = c->blocks;
+            sections[section_count++] = c->block_tombstones;
+        }
+        sections[section_count++] = (db_section) { .type=DB_SECTION_RECORDS, .offset=c->records_start, .length=c->records_end - c->records_start };
+
+        // records inside blocks have no offset, a compressed file has no directory
+        if ((db->checkpoint_flags & DB_CHECKPOINT_OFFSETS) && !(db->checkpoint_flags & DB_CHECKPOINT_COMPRESSED))
+        {
+            uint32_t *directory = malloc((c->record_count ? c->record_count : 1) * sizeof(uint32_t));
+            if (!directory)
+            {
+                fprintf(stderr, "%s:%s:%d unable to allocate offset directory: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+                return STATUS_ERROR;
+            }
+
+            size_t n = 0;
+            for (size_t i = 0; i < db->hdr.employee_count; i++)
+            {
+                if (c->offsets[i])
+                    directory[n++] = htonl(c->offsets[i]);
+            }
+
+            int status = pwrite_all(c->fd, directory, n * sizeof(uint32_t), *fsize);
+            free(directory);
+            if (status == STATUS_ERROR)
+                return STATUS_ERROR;
+
+            sections[section_count++] = (db_section) { .type=DB_SECTION_OFFSETS, .offset=*fsize, .length=n * sizeof(uint32_t) };
+            *fsize += n * sizeof(uint32_t);
+        }
+
+        if (lseek(c->fd, *fsize, SEEK_SET) == -1)
+        {
+            fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+
+        if (db->checkpoint_flags & DB_CHECKPOINT_NAME_INDEX)
+        {
+            int nbytes = name_index_write(names, c->fd, *fsize, sections + section_count);
+            if (nbytes == STATUS_ERROR)
+                return STATUS_ERROR;
+            section_count++;
+            *fsize += nbytes;
+        }
+
+        if (c->checksums.crcs)
+        {
+            int nbytes = write_db_checksums(&c->checksums, c->fd, *fsize, &c->checksums_section);
+            if (nbytes == STATUS_ERROR)
+                return STATUS_ERROR;
+            sections[section_count++] = c->checksums_section;
+            *fsize += nbytes;
+        }
+
+        int nbytes = write_db_footer(c->fd, sections, section_count);
+        if (nbytes == STATUS_ERROR)
+            return STATUS_ERROR;
+        *fsize += nbytes;
+    }
+
+    db_header hdr = { .fsize=htonl(*fsize), .employee_count=htonl(c->record_count | (db->checkpoint_flags ? DB_HEADER_SECTIONS : 0)) };
+    return pwrite_all(c->fd, &hdr, sizeof(db_header), 0);
+}
+
+static int db_finish_compaction(database *db)
+{
+    db_compaction *c = &db->compaction;
+    if ((db->checkpoint_flags & DB_CHECKPOINT_COMPRESSED) && db_write_compaction_blocks(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+    uint32_t fsize = c->records_end;
+
+    // index the copied slots by the position they will have once the table is compacted
+    name_index names;
+    if (name_index_init(&names, (size_t)(c->record_count / NAME_INDEX_ALPHA) + 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    for (size_t i = 0, n = 0; i < db->hdr.employee_count; i++)
+    {
+        if (!c->offsets[i])
+            continue;
+
+        uint32_t offset = i < c->block_cursor ? 0 : c->offsets[i];
+        if (db->employees[i].name && name_index_insert(&names, db->employees[i].name, n, offset) == STATUS_ERROR)
+        {
+            free_name_index(&names);
+            return STATUS_ERROR;
+        }
+        n++;
+    }
+
+    // new slot of every old slot, for renumbering the ordered indexes
+    uint32_t *slot_map = malloc((db->hdr.employee_count ? db->hdr.employee_count : 1) * sizeof(uint32_t));
+    if (!slot_map)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate slot map: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free_name_index(&names);
+        return STATUS_ERROR;
+    }
+
+    if (db_write_compaction_tail(db, &names, &fsize) == STATUS_ERROR)
+    {
+        free_name_index(&names);
+        free(slot_map);
+        return STATUS_ERROR;
+    }
+
+    // make the new file durable before it replaces the old one
+    if (fsync(c->fd) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d fsync() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free_name_index(&names);
+        free(slot_map);
+        return STATUS_ERROR;
+    }
+
+    if (rename(c->path, db->path) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to rename '%s' to '%s': (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, c->path, db->path, errno, strerror(errno));
+        free_name_index(&names);
+        free(slot_map);
+        return STATUS_ERROR;
+    }
+
+    close(db->fd);
+    db->fd = c->fd;
+    free_name_index(&db->names);
+    db->names = names;
+    db->unindexed_count = 0;
+
+    // keep only the copied slots, records deleted after being copied stay as tombstones
+    size_t n = 0;
+    db->dead_count = 0;
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        slot_map[i] = c->offsets[i] ? n : UINT32_MAX;
+        if (!c->offsets[i])
+            continue;
+
+        if (!db->employees[i].name)
+            db->dead_count++;
+        db->employees[n] = db->employees[i];
+        c->offsets[n] = i < c->block_cursor ? 0 : c->offsets[i];
+        n++;
+    }
+    hours_index_remap(&db->hours, slot_map);
+    if (db->prefixes.root)
+        radix_tree_remap(&db->prefixes, slot_map);
+    if (db->addresses.table && trigram_index_remap(&db->addresses, slot_map) == STATUS_ERROR)
+    {
+        // searches fall back to a scan rather than failing the compaction
+        fprintf(stderr, "%s:%s:%d unable to renumber address index, dropping it\n", __FILE__, __FUNCTION__, __LINE__);
+        free_trigram_index(&db->addresses);
+    }
+    free(slot_map);
+
+    free(db->offsets);
+    db->offsets = c->offsets;
+    db->hdr.employee_count = n;
+    db->hdr.fsize = fsize;
+    db->records_start = c->records_start;
+    db->records_end = c->records_end;
+    db->dictionary = c->dictionary;
+    if (db->checkpoint_flags & DB_CHECKPOINT_COMPRESSED)
+    {
+        db->blocks = c->blocks;
+        db->block_tombstones = c->block_tombstones;
+    }
+    free_db_checksums(&db->checksums);
+    db->checksums = c->checksums;
+    db->checksums_section = c->checksums_section;
+
+    free(c->path);
+    free(c->block_entries);
+    free(c->raw);
+    free(c->compressed);
+    *c = (db_compaction) { .fd=-1 };
+    return STATUS_SUCCESS;
+}
+
+// A paged database has no employee table to copy from. Its live records are read through the pool and copied as
+// they are stored into the new file, in one pass that holds a batch of them in memory at a time, and the indexes
+// are renumbered for the slots of the new file. Appended records keep their address inline, unlike a checkpoint
+// of a database in memory.
+static int db_paged_compact(database *db)
+{
+    if (!db->path)
+    {
+        fprintf(stderr, "%s:%s:%d a paged database is rewritten through its path, which is not set\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    if (db_start_compaction(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    db_compaction *c = &db->compaction;
+    name_index names;
+    uint32_t *slot_map = malloc((db->hdr.employee_count ? db->hdr.employee_count : 1) * sizeof(uint32_t));
+    if (!slot_map || name_index_init(&names, (size_t)((db->hdr.employee_count - db->dead_count) / NAME_INDEX_ALPHA) + 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate compaction state: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(slot_map);
+        db_abort_compaction(db);
+        return STATUS_ERROR;
+    }
+
+    unsigned char *batch = NULL;
+    size_t batch_len = 0;
+    size_t batch_capacity = 0;
+    int status = STATUS_SUCCESS;
+    for (size_t i = 0; i < db->hdr.employee_count && status == STATUS_SUCCESS; i++)
+    {
+        employee e;
+        int nbytes = db_read_record(db, db->offsets[i], &e, true);
+        if (nbytes == STATUS_ERROR)
+        {
+            status = STATUS_ERROR;
+            break;
+        }
+
+        slot_map[i] = UINT32_MAX;
+        if (e.name[0] != '\0')
+        {
+            if (batch_len + nbytes > batch_capacity)
+            {
+                size_t capacity = batch_len + nbytes > DB_PAGED_COMPACT_BYTES ? batch_len + nbytes : DB_PAGED_COMPACT_BYTES;
+                unsigned char *resized = realloc(batch, capacity);
+                if (!resized)
+                    fprintf(stderr, "%s:%s:%d unable to allocate compaction buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+                else
+                {
+                    batch = resized;
+                    batch_capacity = capacity;
+                }
+            }
+
+            c->offsets[i] = c->records_end + (uint32_t)batch_len;
+            slot_map[i] = c->record_count;
+            status = batch_len + nbytes > batch_capacity ||
+                buffer_pool_read(&db->pool, db->offsets[i], batch + batch_len, nbytes, true) == STATUS_ERROR ||
+                name_index_insert(&names, e.name, c->record_count, c->offsets[i]) == STATUS_ERROR ? STATUS_ERROR : STATUS_SUCCESS;
+            batch_len += nbytes;
+            c->record_count++;
+        }
+        free(e.name);
+        free(e.address);
+
+        // write the batch once it is full or the last record was read
+        if (status == STATUS_SUCCESS && batch_len > 0 && (batch_len >= DB_PAGED_COMPACT_BYTES || i + 1 == db->hdr.employee_count))
+        {
+            status = pwrite_all(c->fd, batch, batch_len, c->records_end);
+            if (status == STATUS_SUCCESS && c->checksums.crcs)
+                status = db_checksums_extend(&c->checksums, batch, batch_len);
+            c->records_end += batch_len;
+            batch_len = 0;
+        }
+    }
+    free(batch);
+
+    // make the new file durable before it replaces the old one
+    uint32_t fsize = c->records_end;
+    if (status == STATUS_SUCCESS && db_write_compaction_tail(db, &names, &fsize) == STATUS_ERROR)
+        status = STATUS_ERROR;
+    if (status == STATUS_SUCCESS && fsync(c->fd) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d fsync() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        status = STATUS_ERROR;
+    }
+    if (status == STATUS_SUCCESS && rename(c->path, db->path) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to rename '%s' to '%s': (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, c->path, db->path, errno, strerror(errno));
+        status = STATUS_ERROR;
+    }
+    if (status == STATUS_ERROR)
+    {
+        free_name_index(&names);
+        free(slot_map);
+        db_abort_compaction(db);
+        return STATUS_ERROR;
+    }
+
+    // the pages held by the pool are those of the old file
+    size_t budget = (size_t)db->pool.frame_count * BUFFER_POOL_PAGE_SIZE;
+    free_buffer_pool(&db->pool);
+    close(db->fd);
+    db->fd = c->fd;
+    free_name_index(&db->names);
+    db->names = names;
+    hours_index_remap(&db->hours, slot_map);
+    free(slot_map);
+
+    size_t n = 0;
+    for (size_t i = 0; i < db->hdr.employee_count; i++)
+    {
+        if (c->offsets[i])
+            c->offsets[n++] = c->offsets[i];
+    }
+    free(db->offsets);
+    db->offsets = c->offsets;
+    db->hdr.employee_count = n;
+    db->hdr.fsize = fsize;
+    db->dead_count = 0;
+    db->unindexed_count = 0;
+    db->records_start = c->records_start;
+    db->records_end = c->records_end;
+    db->dictionary = c->dictionary;
+    free_db_checksums(&db->checksums);
+    db->checksums = c->checksums;
+    db->checksums_section = c->checksums_section;
+    free(c->path);
+    *c = (db_compaction) { .fd=-1 };
+    return buffer_pool_init(&db->pool, db->fd, budget);
+}
+
+int db_compact_step(database *db, size_t max_records)
+{
+    if (!db_compaction_pending(db))
+        return STATUS_SUCCESS;
+    if (db->pool.frames)
+        return db_paged_compact(db);
+    if (db_materialize_all(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    db_compaction *c = &db->compaction;
+    if (c->fd == -1 && db_start_compaction(db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // the first records of a compressed file go into blocks while there is room for them
+    size_t stop = c->cursor + max_records < db->hdr.employee_count ? c->cursor + max_records : db->hdr.employee_count;
+    size_t start = c->cursor;
+    for (; start < stop && c->blocks_open; start++)
+    {
+        if (db->employees[start].name && db_copy_to_compaction_block(db, start) == STATUS_ERROR)
+        {
+            db_abort_compaction(db);
+            return STATUS_ERROR;
+        }
+    }
+
+    // encode the next batch of live records into one buffer
+    size_t batch_len = 0;
+    for (size_t i = start; i < stop; i++)
+    {
+        if (db->employees[i].name)
+            batch_len += db_compaction_record_size(db, db->employees + i);
+    }
+
+    if (batch_len > 0)
+    {
+        unsigned char *batch = malloc(batch_len);
+        if (!batch)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate compaction buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            db_abort_compaction(db);
+            return STATUS_ERROR;
+        }
+
+        unsigned char *p = batch;
+        for (size_t i = start; i < stop; i++)
+        {
+            if (!db->employees[i].name)
+                continue;
+            c->offsets[i] = c->records_end + (uint32_t)(p - batch);
+            p += encode_employee_record(db->employees + i, db_compaction_address_ref(db, db->employees[i].address), p);
+            c->record_count++;
+        }
+
+        int status = pwrite_all(c->fd, batch, batch_len, c->records_end);
+        if (status == STATUS_SUCCESS && c->checksums.crcs)
+            status = db_checksums_extend(&c->checksums, batch, batch_len);
+        free(batch);
+        if (status == STATUS_ERROR)
+        {
+            db_abort_compaction(db);
+            return STATUS_ERROR;
+        }
+        c->records_end += batch_len;
+    }
+    c->cursor = stop;
+
+    if (c->cursor < db->hdr.employee_count)
+        return STATUS_SUCCESS;
+
+    if (db_finish_compaction(db) == STATUS_ERROR)
+    {
+        db_abort_compaction(db);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+void free_database(database *db)
+{
+    db_abort_compaction(db);
+    for (size_t i = 0; db->employees && i < db->hdr.employee_count; i++)
+        db_free_name(db, db->employees[i].name);
+    free(db->employees);
+    free(db->offsets);
+    free_name_index(&db->names);
+    free_hours_index(&db->hours);
+    free_radix_tree(&db->prefixes);
+    free_trigram_index(&db->addresses);
+    free_string_pool(&db->address_pool);
+    free_db_checksums(&db->checksums);
+    db_clear_results(db);
+    free(db->results);
+    free_db_dictionary(&db->address_dictionary);
+    free_buffer_pool(&db->pool);
+    db_free_lazy(db);
+    if (db->snapshot)
+        munmap(db->snapshot, db->snapshot_len);
+    db->snapshot = NULL;
+    db->snapshot_len = 0;
+    db->results = NULL;
+    db->results_capacity = 0;
+    db->employees = NULL;
+    db->offsets = NULL;
+}
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "common.h"
+#include "models.h"
+#include "proto.h"
+#include "frame.h"
+#include "db_async.h"
+
+
+static int db_async_watch(db_async_client *c, size_t idx, int op, bool wants_write)
+{
+    struct epoll_event event = { .events=EPOLLIN | (wants_write ? EPOLLOUT : 0), .data.u64=idx };
+    if (epoll_ctl(c->epoll_fd, op, c->conns[idx].fd, &event) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d epoll_ctl() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    c->conns[idx].wants_write = wants_write;
+    return STATUS_SUCCESS;
+}
+
+int db_async_connect(db_async_client *c, const char *host, const char *port, uint16_t protocol_version, size_t conn_count)
+{
+    *c = (db_async_client) {
+        .epoll_fd=epoll_create1(0),
+        .protocol_version=protocol_version,
+        .conns=calloc(conn_count, sizeof(db_async_conn)),
+        .size=conn_count,
+        .events=malloc(conn_count * sizeof(struct epoll_event)),
+    };
+    for (size_t i = 0; c->conns && i < conn_count; i++)
+        c->conns[i].fd = -1;
+    if (c->epoll_fd == -1 || !c->conns || !c->events || conn_count == 0)
+    {
+        fprintf(stderr, "%s:%s:%d unable to set up %zu connections: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, conn_count, errno, strerror(errno));
+        free_db_async_client(c);
+        return STATUS_ERROR;
+    }
+
+    // the handshake blocks, the connection only stops blocking once it is ready for requests
+    for (size_t i = 0; i < conn_count; i++)
+    {
+        db_async_conn *conn = c->conns + i;
+        if ((conn->fd = port ? get_socket((char *)host, (char *)port) : get_unix_socket(host)) == STATUS_ERROR ||
+            send_handshake(conn->fd, protocol_version) == STATUS_ERROR || receive_handshake(conn->fd) == STATUS_ERROR ||
+            fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK) == -1 ||
+            db_async_watch(c, i, EPOLL_CTL_ADD, false) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d unable to connect to %s:%s\n", __FILE__, __FUNCTION__, __LINE__, host, port ? port : "unix");
+            free_db_async_client(c);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+// removes the oldest request waiting on a connection, before its callback runs so the callback can submit more
+static db_async_pending db_async_pop(db_async_client *c, db_async_conn *conn)
+{
+    db_async_pending p = conn->pending[conn->pending_head];
+    conn->pending_head = (conn->pending_head + 1) % conn->pending_capacity;
+    conn->pending_count--;
+    c->in_flight--;
+    return p;
+}
+
+// Closes a connection whose stream can't be trusted anymore. Every request waiting on it completes with
+// STATUS_ERROR, returns how many did.
+static int db_async_fail(db_async_client *c, db_async_conn *conn)
+{
+    close(conn->fd);
+    conn->fd = -1;
+    conn->out_len = conn->out_sent = conn->in_len = 0;
+    int completed = 0;
+    while (conn->pending_count > 0)
+    {
+        db_async_pending p = db_async_pop(c, conn);
+        p.callback(STATUS_ERROR, NULL, 0, p.arg);
+        completed++;
+    }
+    return completed;
+}
+
+int db_async_submit(db_async_client *c, const db_client_request *r, db_async_callback callback, void *arg)
+{
+    // requests go round the connections still open
+    db_async_conn *conn = NULL;
+    for (size_t i = 0; i < c->size && !conn; i++)
+    {
+        size_t idx = (c->next_conn + i) % c->size;
+        if (c->conns[idx].fd != -1)
+        {
+            conn = c->conns + idx;
+            c->next_conn = idx + 1;
+        }
+    }
+    if (!conn)
+    {
+        fprintf(stderr, "%s:%s:%d no connection left to submit on\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (conn->pending_count == conn->pending_capacity)
+    {
+        // the ring is unwrapped into the new array, oldest first
+        size_t capacity = conn->pending_capacity ? conn->pending_capacity * 2 : 64;
+        db_async_pending *pending = malloc(capacity * sizeof(db_async_pending));
+        if (!pending)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate %zu pending requests: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, capacity, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        for (size_t i = 0; i < conn->pending_count; i++)
+            pending[i] = conn->pending[(conn->pending_head + i) % conn->pending_capacity];
+        free(conn->pending);
+        conn->pending = pending;
+        conn->pending_head = 0;
+        conn->pending_capacity = capacity;
+    }
+
+    uint32_t request_id = conn->next_request_id + 1;
+    unsigned char *cursor = conn->out + conn->out_len;
+    if (encode_db_client_request(&conn->out, &cursor, &conn->out_capacity, c->protocol_version, request_id, r) == STATUS_ERROR)
+        return STATUS_ERROR;
+    conn->out_len = (size_t)(cursor - conn->out);
+    conn->next_request_id = request_id;
+    conn->pending[(conn->pending_head + conn->pending_count++) % conn->pending_capacity] = (db_async_pending) {
+        .callback=callback,
+        .arg=arg,
+        .request_id=request_id,
+    };
+    c->in_flight++;
+    return STATUS_SUCCESS;
+}
+
+// sends what the socket takes without blocking, watching for room in its send buffer when some is left
+static int db_async_flush(db_async_client *c, size_t idx)
+{
+    db_async_conn *conn = c->conns + idx;
+    while (conn->out_sent < conn->out_len)
+    {
+        ssize_t nbytes_sent = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (nbytes_sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return conn->wants_write ? STATUS_SUCCESS : db_async_watch(c, idx, EPOLL_CTL_MOD, true);
+        if (nbytes_sent == -1)
+        {
+            fprintf(stderr, "%s:%s:%d failed to send requests: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        conn->out_sent += nbytes_sent;
+    }
+    conn->out_len = conn->out_sent = 0;
+    return conn->wants_write ? db_async_watch(c, idx, EPOLL_CTL_MOD, false) : STATUS_SUCCESS;
+}
+
+// Completes every request whose whole response has been received and keeps the rest of the bytes for the next
+// read. Returns how many completed, or STATUS_ERROR when a response doesn't match what is waiting for it.
+static int db_async_dispatch(db_async_client *c, db_async_conn *conn)
+{
+    int completed = 0;
+    size_t offset = 0;
+    while (conn->pending_count > 0)
+    {
+        unsigned char *start = conn->in + offset;
+        size_t available = conn->in_len - offset;
+        size_t header_size;
+        unsigned char error_flag;
+        uint32_t data_len;
+        db_async_pending *p = conn->pending + conn->pending_head;
+        if (c->protocol_version >= PROTOCOL_V2)
+        {
+            frame_header h;
+            header_size = FRAME_HEADER_SIZE;
+            if (available < header_size)
+                break;
+            if (decode_frame_header(start, &h) == STATUS_ERROR || h.opcode != DB_ACCESS_RESPONSE || h.request_id != p->request_id)
+            {
+                fprintf(stderr, "%s:%s:%d unexpected response to request %u\n", __FILE__, __FUNCTION__, __LINE__, p->request_id);
+                return STATUS_ERROR;
+            }
+            error_flag = h.flags;
+            data_len = h.payload_len;
+        }
+        else
+        {
+            header_size = sizeof(proto_msg) + 1 + sizeof(uint32_t);
+            if (available >= sizeof(proto_msg) && *(proto_msg *)start != DB_ACCESS_RESPONSE)
+            {
+                fprintf(stderr, "%s:%s:%d unexpected response type %u\n", __FILE__, __FUNCTION__, __LINE__, *(proto_msg *)start);
+                return STATUS_ERROR;
+            }
+            if (available < header_size)
+                break;
+            error_flag = start[sizeof(proto_msg)];
+            data_len = ntohl(*(uint32_t *)(start + sizeof(proto_msg) + 1));
+        }
+        if (available - header_size < data_len)
+            break;
+
+        db_async_pending done = db_async_pop(c, conn);
+        done.callback(error_flag, start + header_size, data_len, done.arg);
+        offset += header_size + data_len;
+        completed++;
+    }
+
+    if (offset > 0)
+    {
+        memmove(conn->in, conn->in + offset, conn->in_len - offset);
+        conn->in_len -= offset;
+    }
+    return completed;
+}
+
+// reads until the socket has nothing more, completing requests as their responses arrive
+static int db_async_read(db_async_client *c, db_async_conn *conn)
+{
+    int completed = 0;
+    for (;;)
+    {
+        if (conn->in_capacity - conn->in_len < DB_ASYNC_READ_SIZE)
+        {
+            unsigned char *cursor = conn->in + conn->in_len;
+            if (resize_buffer(&conn->in, &cursor, &conn->in_capacity, DB_ASYNC_READ_SIZE) == STATUS_ERROR)
+                return STATUS_ERROR;
+        }
+        ssize_t nbytes_recv = recv(conn->fd, conn->in + conn->in_len, conn->in_capacity - conn->in_len, 0);
+        if (nbytes_recv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return completed;
+        if (nbytes_recv == -1 || nbytes_recv == 0)
+        {
+            fprintf(stderr, "%s:%s:%d connection lost: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, nbytes_recv ? errno : 0, nbytes_recv ? strerror(errno) : "closed by server");
+            return STATUS_ERROR;
+        }
+        conn->in_len += nbytes_recv;
+
+        int status = db_async_dispatch(c, conn);
+        if (status == STATUS_ERROR)
+            return STATUS_ERROR;
+        completed += status;
+    }
+}
+
+// Sends what was submitted and waits up to timeout_ms for responses, -1 waits until one arrives. Returns how many
+// requests completed, failed ones included.
+int db_async_poll(db_async_client *c, int timeout_ms)
+{
+    int completed = 0;
+    for (size_t i = 0; i < c->size; i++)
+    {
+        if (c->conns[i].fd != -1 && c->conns[i].out_len > 0 && db_async_flush(c, i) == STATUS_ERROR)
+            completed += db_async_fail(c, c->conns + i);
+    }
+    if (c->in_flight == 0)
+        return completed;
+
+    int nevents = epoll_wait(c->epoll_fd, c->events, (int)c->size, completed > 0 ? 0 : timeout_ms);
+    if (nevents == -1)
+    {
+        if (errno == EINTR)
+            return completed;
+        fprintf(stderr, "%s:%s:%d epoll_wait() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    for (int i = 0; i < nevents; i++)
+    {
+        size_t idx = (size_t)c->events[i].data.u64;
+        db_async_conn *conn = c->conns + idx;
+        if (conn->fd == -1)
+            continue;
+
+        int status = STATUS_SUCCESS;
+        if (c->events[i].events & EPOLLOUT)
+            status = db_async_flush(c, idx);
+        if (status != STATUS_ERROR && c->events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            status = db_async_read(c, conn);
+        if (status == STATUS_ERROR)
+            completed += db_async_fail(c, conn);
+        else
+            completed += status;
+    }
+    return completed;
+}
+
+// polls until every request submitted has completed
+int db_async_wait(db_async_client *c)
+{
+    while (c->in_flight > 0)
+    {
+        if (db_async_poll(c, -1) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// requests still in flight complete with STATUS_ERROR
+void free_db_async_client(db_async_client *c)
+{
+    for (size_t i = 0; c->conns && i < c->size; i++)
+    {
+        if (c->conns[i].fd != -1)
+            db_async_fail(c, c->conns + i);
+        free(c->conns[i].out);
+        free(c->conns[i].in);
+        free(c->conns[i].pending);
+    }
+    if (c->epoll_fd != -1)
+        close(c->epoll_fd);
+    free(c->conns);
+    free(c->events);
+    *c = (db_async_client) { .epoll_fd=-1 };
+}
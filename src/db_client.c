@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "models.h"
+#include "proto.h"
+#include "frame.h"
+#include "db_client.h"
+
+
+static int db_client_conn_open(db_client *c, db_client_conn *conn)
+{
+    if ((conn->fd = c->port ? get_socket(c->host, c->port) : get_unix_socket(c->host)) == STATUS_ERROR)
+    {
+        conn->fd = -1;
+        return STATUS_ERROR;
+    }
+    if (send_handshake(conn->fd, c->protocol_version) == STATUS_ERROR || receive_handshake(conn->fd) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d handshake with %s:%s failed\n", __FILE__, __FUNCTION__, __LINE__, c->host, c->port ? c->port : "unix");
+        close(conn->fd);
+        conn->fd = -1;
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// what was sent or read of a request on a connection that failed is unknown, the next call starts over
+static void db_client_conn_fail(db_client_conn *conn)
+{
+    close(conn->fd);
+    conn->fd = -1;
+}
+
+int db_client_connect(db_client *c, const char *host, const char *port, uint16_t protocol_version, size_t pool_size)
+{
+    *c = (db_client) { .protocol_version=protocol_version };
+    if (pool_size == 0)
+    {
+        fprintf(stderr, "%s:%s:%d a pool needs at least one connection\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // the lock is set up before anything can fail, so that free_db_client() always has one to tear down
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->available, NULL);
+    c->host = strdup(host);
+    c->port = port ? strdup(port) : NULL;
+    c->conns = calloc(pool_size, sizeof(db_client_conn));
+    c->size = pool_size;
+    c->idle = malloc(pool_size * sizeof(size_t));
+    for (size_t i = 0; c->conns && i < pool_size; i++)
+        c->conns[i].fd = -1;
+    if (!c->host || (port && !c->port) || !c->conns || !c->idle)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate pool of %zu connections\n", __FILE__, __FUNCTION__, __LINE__, pool_size);
+        free_db_client(c);
+        return STATUS_ERROR;
+    }
+
+    // every connection does its handshake now rather than in the first call to use it
+    for (size_t i = 0; i < pool_size; i++)
+        c->idle[c->idle_count++] = i;
+    for (size_t i = 0; i < pool_size; i++)
+    {
+        if (db_client_conn_open(c, c->conns + i) == STATUS_ERROR)
+        {
+            free_db_client(c);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+// takes an idle connection, waiting for one when all of them are in use
+static db_client_conn *db_client_acquire(db_client *c)
+{
+    pthread_mutex_lock(&c->lock);
+    while (c->idle_count == 0)
+        pthread_cond_wait(&c->available, &c->lock);
+    db_client_conn *conn = c->conns + c->idle[--c->idle_count];
+    pthread_mutex_unlock(&c->lock);
+    return conn;
+}
+
+static void db_client_release(db_client *c, db_client_conn *conn)
+{
+    pthread_mutex_lock(&c->lock);
+    c->idle[c->idle_count++] = (size_t)(conn - c->conns);
+    pthread_cond_signal(&c->available);
+    pthread_mutex_unlock(&c->lock);
+}
+
+// writes a string with its length, the layout of every name, prefix or address in a request
+static int put_string(unsigned char **buf, unsigned char **cursor, size_t *capacity, const char *s)
+{
+    size_t len = strlen(s);
+    if (len > UINT16_MAX)
+    {
+        fprintf(stderr, "%s:%s:%d size of string exceeds allowed maximum\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    if (resize_buffer(buf, cursor, capacity, sizeof(uint16_t) + len) == STATUS_ERROR)
+        return STATUS_ERROR;
+    *(uint16_t *)(*cursor) = htons((uint16_t)len);
+    *cursor += sizeof(uint16_t);
+    memcpy(*cursor, s, len);
+    *cursor += len;
+    return STATUS_SUCCESS;
+}
+
+static int put_u32(unsigned char **buf, unsigned char **cursor, size_t *capacity, uint32_t value)
+{
+    if (resize_buffer(buf, cursor, capacity, sizeof(uint32_t)) == STATUS_ERROR)
+        return STATUS_ERROR;
+    *(uint32_t *)(*cursor) = htonl(value);
+    *cursor += sizeof(uint32_t);
+    return STATUS_SUCCESS;
+}
+
+// Appends a whole request at the cursor, framed for the protocol version. The header is written last, once the
+// length of the option is known, so requests can be appended one after another to be sent together.
+int encode_db_client_request(unsigned char **buf, unsigned char **cursor, size_t *capacity, uint16_t protocol_version, uint32_t request_id, const db_client_request *r)
+{
+    size_t header_size = request_header_size(protocol_version);
+    if (resize_buffer(buf, cursor, capacity, header_size + 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    size_t start = (size_t)(*cursor - *buf);
+    *cursor += header_size;
+    *(*cursor)++ = r->option;
+
+    int status = STATUS_SUCCESS;
+    switch (r->option)
+    {
+        case 'a':
+            status = put_string(buf, cursor, capacity, r->text) == STATUS_ERROR ||
+                     put_string(buf, cursor, capacity, r->address) == STATUS_ERROR ||
+                     put_u32(buf, cursor, capacity, r->hours) == STATUS_ERROR ? STATUS_ERROR : STATUS_SUCCESS;
+            break;
+        case 'u':
+            status = put_string(buf, cursor, capacity, r->text) == STATUS_ERROR ||
+                     put_u32(buf, cursor, capacity, r->hours) == STATUS_ERROR ? STATUS_ERROR : STATUS_SUCCESS;
+            break;
+        case 'd':
+        case 'p':
+        case 'c':
+            status = put_string(buf, cursor, capacity, r->text);
+            break;
+        case 'r':
+            status = put_u32(buf, cursor, capacity, r->hours) == STATUS_ERROR ||
+                     put_u32(buf, cursor, capacity, r->max_hours) == STATUS_ERROR ? STATUS_ERROR : STATUS_SUCCESS;
+            break;
+        case 't':
+            status = put_u32(buf, cursor, capacity, r->hours);
+            break;
+        case 'l':
+            break;
+        default:
+            fprintf(stderr, "%s:%s:%d unknown option '%c'\n", __FILE__, __FUNCTION__, __LINE__, r->option);
+            status = STATUS_ERROR;
+    }
+    if (status == STATUS_ERROR)
+    {
+        // nothing of a request that can't be written is left behind
+        *cursor = *buf + start;
+        return STATUS_ERROR;
+    }
+    encode_request_header(*buf + start, protocol_version, DB_ACCESS_REQUEST, request_id, (uint32_t)(*cursor - *buf - start - header_size));
+    return STATUS_SUCCESS;
+}
+
+// Sends one request and receives its response. The employees of a successful response are passed to each one by
+// one as they arrive when it is set, the data is received into the connection's payload buffer otherwise. Returns
+// the error code of the response, or STATUS_ERROR with the connection closed when it failed.
+static int db_client_round_trip(db_client *c, db_client_conn *conn, const db_client_request *r, uint32_t *data_len, employee_view_callback each, void *arg)
+{
+    if (conn->fd == -1 && db_client_conn_open(c, conn) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    uint32_t request_id = ++conn->next_request_id;
+    unsigned char *cursor = conn->buf;
+    if (encode_db_client_request(&conn->buf, &cursor, &conn->capacity, c->protocol_version, request_id, r) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (send_all(conn->fd, conn->buf, (size_t)(cursor - conn->buf), MSG_NOSIGNAL) == STATUS_ERROR)
+    {
+        db_client_conn_fail(conn);
+        return STATUS_ERROR;
+    }
+
+    unsigned char error_flag;
+    if (c->protocol_version >= PROTOCOL_V2)
+    {
+        frame_header h;
+        if (receive_frame_header(conn->fd, &h) <= 0 || h.request_id != request_id || h.opcode != DB_ACCESS_RESPONSE)
+        {
+            fprintf(stderr, "%s:%s:%d unable to receive response to request %u\n", __FILE__, __FUNCTION__, __LINE__, request_id);
+            db_client_conn_fail(conn);
+            return STATUS_ERROR;
+        }
+        error_flag = h.flags;
+        *data_len = h.payload_len;
+    }
+    else
+    {
+        // version 1 answers an invalid request with the message type alone
+        unsigned char header[sizeof(proto_msg) + 1 + sizeof(uint32_t)];
+        if (receive_all(conn->fd, header, sizeof(proto_msg), 0) <= 0 || *(proto_msg *)header != DB_ACCESS_RESPONSE ||
+            receive_all(conn->fd, header + sizeof(proto_msg), 1 + sizeof(uint32_t), 0) <= 0)
+        {
+            fprintf(stderr, "%s:%s:%d unable to receive response\n", __FILE__, __FUNCTION__, __LINE__);
+            db_client_conn_fail(conn);
+            return STATUS_ERROR;
+        }
+        error_flag = header[sizeof(proto_msg)];
+        *data_len = ntohl(*(uint32_t *)(header + sizeof(proto_msg) + 1));
+    }
+
+    if (each && !error_flag)
+    {
+        // a callback stopping the list leaves the rest of it on the connection
+        if (*data_len > 0 && receive_list_response(conn->fd, *data_len, each, arg) == STATUS_ERROR)
+        {
+            db_client_conn_fail(conn);
+            return STATUS_ERROR;
+        }
+        return STATUS_SUCCESS;
+    }
+    cursor = conn->payload;
+    if (resize_buffer(&conn->payload, &cursor, &conn->payload_capacity, *data_len) == STATUS_ERROR ||
+        (*data_len > 0 && receive_all(conn->fd, conn->payload, *data_len, 0) <= 0))
+    {
+        fprintf(stderr, "%s:%s:%d unable to receive response data\n", __FILE__, __FUNCTION__, __LINE__);
+        db_client_conn_fail(conn);
+        return STATUS_ERROR;
+    }
+    return error_flag;
+}
+
+// a write's answer carries no data
+static int db_client_write(db_client *c, const db_client_request *r)
+{
+    db_client_conn *conn = db_client_acquire(c);
+    uint32_t data_len;
+    int status = db_client_round_trip(c, conn, r, &data_len, NULL, NULL);
+    db_client_release(c, conn);
+    return status;
+}
+
+int db_client_add(db_client *c, const char *name, const char *address, uint32_t hours)
+{
+    return db_client_write(c, &(db_client_request) { .option='a', .text=name, .address=address, .hours=hours });
+}
+
+int db_client_update(db_client *c, const char *name, uint32_t hours)
+{
+    return db_client_write(c, &(db_client_request) { .option='u', .text=name, .hours=hours });
+}
+
+int db_client_delete(db_client *c, const char *name)
+{
+    return db_client_write(c, &(db_client_request) { .option='d', .text=name });
+}
+
+// Copies the employees of a query's response out of the connection's buffer so they outlive the call. They are
+// freed with db_client_free_employees().
+static int db_client_query(db_client *c, const db_client_request *r, employee **employees, size_t *employees_size)
+{
+    db_client_conn *conn = db_client_acquire(c);
+    uint32_t data_len;
+    int status = db_client_round_trip(c, conn, r, &data_len, NULL, NULL);
+
+    *employees = NULL;
+    *employees_size = 0;
+    if (status == STATUS_SUCCESS && data_len > 0 &&
+        deserialize_list_employee_response(conn->payload, data_len, employees, employees_size) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to deserialize employees\n", __FILE__, __FUNCTION__, __LINE__);
+        status = STATUS_ERROR;
+    }
+    db_client_release(c, conn);
+    return status;
+}
+
+// Runs a query and calls back with each employee of its response as soon as its record is received, without
+// copying it. The memory used stays the same however many employees match. A callback returning STATUS_ERROR
+// stops the query, which then fails.
+int db_client_each(db_client *c, const db_client_request *r, employee_view_callback callback, void *arg)
+{
+    db_client_conn *conn = db_client_acquire(c);
+    uint32_t data_len;
+    int status = db_client_round_trip(c, conn, r, &data_len, callback, arg);
+    db_client_release(c, conn);
+    return status;
+}
+
+int db_client_list(db_client *c, employee **employees, size_t *employees_size)
+{
+    return db_client_query(c, &(db_client_request) { .option='l' }, employees, employees_size);
+}
+
+int db_client_range(db_client *c, uint32_t min_hours, uint32_t max_hours, employee **employees, size_t *employees_size)
+{
+    return db_client_query(c, &(db_client_request) { .option='r', .hours=min_hours, .max_hours=max_hours }, employees, employees_size);
+}
+
+int db_client_top(db_client *c, uint32_t count, employee **employees, size_t *employees_size)
+{
+    return db_client_query(c, &(db_client_request) { .option='t', .hours=count }, employees, employees_size);
+}
+
+int db_client_prefix(db_client *c, const char *prefix, employee **employees, size_t *employees_size)
+{
+    return db_client_query(c, &(db_client_request) { .option='p', .text=prefix }, employees, employees_size);
+}
+
+int db_client_search_address(db_client *c, const char *text, employee **employees, size_t *employees_size)
+{
+    return db_client_query(c, &(db_client_request) { .option='c', .text=text }, employees, employees_size);
+}
+
+void db_client_free_employees(employee *employees, size_t employees_size)
+{
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        free(employees[i].name);
+        free(employees[i].address);
+    }
+    free(employees);
+}
+
+// no call may be using the client
+void free_db_client(db_client *c)
+{
+    for (size_t i = 0; c->conns && i < c->size; i++)
+    {
+        if (c->conns[i].fd != -1)
+            close(c->conns[i].fd);
+        free(c->conns[i].buf);
+        free(c->conns[i].payload);
+    }
+    if (c->size > 0)
+    {
+        pthread_mutex_destroy(&c->lock);
+        pthread_cond_destroy(&c->available);
+    }
+    free(c->conns);
+    free(c->idle);
+    free(c->host);
+    free(c->port);
+    *c = (db_client) { 0 };
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "frame.h"
+#include "models.h"
+
+
+void encode_frame_header(unsigned char *buf, const frame_header *h)
+{
+    uint16_t magic = htole16(FRAME_MAGIC);
+    uint32_t request_id = htole32(h->request_id);
+    uint32_t payload_len = htole32(h->payload_len);
+    memcpy(buf, &magic, sizeof(uint16_t));
+    buf[2] = h->opcode;
+    buf[3] = h->flags;
+    memcpy(buf + 4, &request_id, sizeof(uint32_t));
+    memcpy(buf + 8, &payload_len, sizeof(uint32_t));
+}
+
+// fails on a header without the magic, the stream can't be trusted after it
+int decode_frame_header(const unsigned char *buf, frame_header *h)
+{
+    uint16_t magic;
+    uint32_t request_id, payload_len;
+    memcpy(&magic, buf, sizeof(uint16_t));
+    if (le16toh(magic) != FRAME_MAGIC)
+    {
+        fprintf(stderr, "%s:%s:%d invalid frame magic 0x%04x\n", __FILE__, __FUNCTION__, __LINE__, le16toh(magic));
+        return STATUS_ERROR;
+    }
+    memcpy(&request_id, buf + 4, sizeof(uint32_t));
+    memcpy(&payload_len, buf + 8, sizeof(uint32_t));
+    h->opcode = buf[2];
+    h->flags = buf[3];
+    h->request_id = le32toh(request_id);
+    h->payload_len = le32toh(payload_len);
+    return STATUS_SUCCESS;
+}
+
+// sends both parts with one call where possible, so a header leaves in the same segment as its payload
+static int send_parts(int socket, void *header, size_t header_len, const void *payload, size_t payload_len, int flags)
+{
+    struct iovec iov[2] = {
+        { .iov_base=header, .iov_len=header_len },
+        { .iov_base=(void *)payload, .iov_len=payload ? payload_len : 0 },
+    };
+    struct msghdr msg = { .msg_iov=iov, .msg_iovlen=2 };
+    size_t remaining = header_len + iov[1].iov_len;
+    while (remaining > 0)
+    {
+        ssize_t nbytes_sent = sendmsg(socket, &msg, flags);
+        if (nbytes_sent == -1)
+        {
+            fprintf(stderr, "%s:%s:%d failed to send frame: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+
+        // skip what was sent, a partial send can end inside either part
+        remaining -= nbytes_sent;
+        while (msg.msg_iovlen > 0 && (size_t)nbytes_sent >= msg.msg_iov->iov_len)
+        {
+            nbytes_sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0)
+        {
+            msg.msg_iov->iov_base = (unsigned char *)msg.msg_iov->iov_base + nbytes_sent;
+            msg.msg_iov->iov_len -= nbytes_sent;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int send_frame(int socket, const frame_header *h, const void *payload, int flags)
+{
+    unsigned char header[FRAME_HEADER_SIZE];
+    encode_frame_header(header, h);
+    return send_parts(socket, header, FRAME_HEADER_SIZE, payload, h->payload_len, flags);
+}
+
+// the header a request is framed with under a protocol version
+size_t request_header_size(uint16_t protocol_version)
+{
+    return protocol_version >= PROTOCOL_V2 ? FRAME_HEADER_SIZE : sizeof(proto_msg) + sizeof(uint32_t);
+}
+
+// writes the header of a request framed the way the handshake negotiated, returns its size
+size_t encode_request_header(unsigned char *buf, uint16_t protocol_version, uint8_t opcode, uint32_t request_id, uint32_t data_len)
+{
+    if (protocol_version >= PROTOCOL_V2)
+    {
+        encode_frame_header(buf, &(frame_header) { .opcode=opcode, .request_id=request_id, .payload_len=data_len });
+        return FRAME_HEADER_SIZE;
+    }
+
+    *(proto_msg *)buf = opcode;
+    *(uint32_t *)(buf + sizeof(proto_msg)) = htonl(data_len);
+    return sizeof(proto_msg) + sizeof(uint32_t);
+}
+
+int send_request(int socket, uint16_t protocol_version, uint8_t opcode, uint32_t request_id, const void *data, uint32_t data_len, int flags)
+{
+    unsigned char header[FRAME_HEADER_SIZE > sizeof(proto_msg) + sizeof(uint32_t) ? FRAME_HEADER_SIZE : sizeof(proto_msg) + sizeof(uint32_t)];
+    size_t header_len = encode_request_header(header, protocol_version, opcode, request_id, data_len);
+    return send_parts(socket, header, header_len, data, data_len, flags);
+}
+
+static int receive_exactly(int socket, unsigned char *buf, size_t len)
+{
+    size_t total_bytes_recv = 0;
+    while (total_bytes_recv < len)
+    {
+        ssize_t nbytes_recv = recv(socket, buf + total_bytes_recv, len - total_bytes_recv, 0);
+        if (nbytes_recv == -1)
+        {
+            fprintf(stderr, "%s:%s:%d failed to receive bytes: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        if (nbytes_recv == 0)
+            return 0;
+        total_bytes_recv += nbytes_recv;
+    }
+    return 1;
+}
+
+// Blocks for the header of a frame, leaving its payload to be read by the caller as it sees fit. Returns the bytes
+// of the header, 0 when the connection closed before a frame started.
+int receive_frame_header(int socket, frame_header *h)
+{
+    unsigned char header[FRAME_HEADER_SIZE];
+    int status = receive_exactly(socket, header, FRAME_HEADER_SIZE);
+    if (status != 1)
+        return status;
+    if (decode_frame_header(header, h) == STATUS_ERROR)
+        return STATUS_ERROR;
+    return FRAME_HEADER_SIZE;
+}
+
+// Blocks for a whole frame, growing the payload buffer as needed so it can be reused across frames. Returns the
+// bytes of the frame as receive_all() does, 0 when the connection closed before a frame started.
+int receive_frame(int socket, frame_header *h, unsigned char **payload, size_t *capacity)
+{
+    int status = receive_frame_header(socket, h);
+    if (status <= 0)
+        return status;
+
+    if (h->payload_len > *capacity)
+    {
+        unsigned char *new_payload = realloc(*payload, h->payload_len);
+        if (!new_payload)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate payload of %u bytes: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, h->payload_len, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        *payload = new_payload;
+        *capacity = h->payload_len;
+    }
+    if (h->payload_len > 0 && receive_exactly(socket, *payload, h->payload_len) != 1)
+    {
+        fprintf(stderr, "%s:%s:%d connection closed inside a frame\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    return (int)(FRAME_HEADER_SIZE + h->payload_len);
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+#include "hours_index.h"
+
+
+static int hours_entry_cmp(const void *a, const void *b)
+{
+    const hours_index_entry *x = a, *y = b;
+    if (x->hours != y->hours)
+        return x->hours < y->hours ? -1 : 1;
+    if (x->slot != y->slot)
+        return x->slot < y->slot ? -1 : 1;
+    return 0;
+}
+
+// position of the first entry not ordered before (hours, slot)
+static size_t hours_index_lower_bound(hours_index *idx, uint32_t hours, uint32_t slot)
+{
+    hours_index_entry key = { .hours=hours, .slot=slot };
+    size_t lo = 0, hi = idx->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (hours_entry_cmp(idx->entries + mid, &key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int hours_index_build(hours_index *idx, employee *employees, size_t employees_size)
+{
+    idx->capacity = employees_size > HOURS_INDEX_INIT_CAPACITY ? employees_size : HOURS_INDEX_INIT_CAPACITY;
+    idx->count = 0;
+    idx->entries = malloc(idx->capacity * sizeof(hours_index_entry));
+    if (!idx->entries)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate hours index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // deleted records have no name
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        if (employees[i].name)
+            idx->entries[idx->count++] = (hours_index_entry) { .hours=employees[i].hours, .slot=i };
+    }
+
+    qsort(idx->entries, idx->count, sizeof(hours_index_entry), hours_entry_cmp);
+    return STATUS_SUCCESS;
+}
+
+static int hours_index_reserve(hours_index *idx)
+{
+    if (idx->count < idx->capacity)
+        return STATUS_SUCCESS;
+
+    size_t capacity = idx->capacity ? 2 * idx->capacity : HOURS_INDEX_INIT_CAPACITY;
+    hours_index_entry *entries = realloc(idx->entries, capacity * sizeof(hours_index_entry));
+    if (!entries)
+    {
+        fprintf(stderr, "%s:%s:%d unable to resize hours index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    idx->entries = entries;
+    idx->capacity = capacity;
+    return STATUS_SUCCESS;
+}
+
+int hours_index_append(hours_index *idx, uint32_t hours, uint32_t slot)
+{
+    // for building an index without an employee table, hours_index_sort() must be called before any other use
+    if (hours_index_reserve(idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    idx->entries[idx->count++] = (hours_index_entry) { .hours=hours, .slot=slot };
+    return STATUS_SUCCESS;
+}
+
+void hours_index_sort(hours_index *idx)
+{
+    qsort(idx->entries, idx->count, sizeof(hours_index_entry), hours_entry_cmp);
+}
+
+int hours_index_insert(hours_index *idx, uint32_t hours, uint32_t slot)
+{
+    if (hours_index_reserve(idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    size_t pos = hours_index_lower_bound(idx, hours, slot);
+    memmove(idx->entries + pos + 1, idx->entries + pos, (idx->count - pos) * sizeof(hours_index_entry));
+    idx->entries[pos] = (hours_index_entry) { .hours=hours, .slot=slot };
+    idx->count++;
+    return STATUS_SUCCESS;
+}
+
+int hours_index_remove(hours_index *idx, uint32_t hours, uint32_t slot)
+{
+    size_t pos = hours_index_lower_bound(idx, hours, slot);
+    if (pos == idx->count || idx->entries[pos].hours != hours || idx->entries[pos].slot != slot)
+        return STATUS_ERROR;
+
+    memmove(idx->entries + pos, idx->entries + pos + 1, (idx->count - pos - 1) * sizeof(hours_index_entry));
+    idx->count--;
+    return STATUS_SUCCESS;
+}
+
+int hours_index_update(hours_index *idx, uint32_t slot, uint32_t old_hours, uint32_t new_hours)
+{
+    size_t from = hours_index_lower_bound(idx, old_hours, slot);
+    if (from == idx->count || idx->entries[from].hours != old_hours || idx->entries[from].slot != slot)
+        return STATUS_ERROR;
+
+    // only the entries between the old and the new position move
+    size_t to = hours_index_lower_bound(idx, new_hours, slot);
+    if (to > from)
+    {
+        to--;
+        memmove(idx->entries + from, idx->entries + from + 1, (to - from) * sizeof(hours_index_entry));
+    }
+    else if (to < from)
+    {
+        memmove(idx->entries + to + 1, idx->entries + to, (from - to) * sizeof(hours_index_entry));
+    }
+    idx->entries[to] = (hours_index_entry) { .hours=new_hours, .slot=slot };
+    return STATUS_SUCCESS;
+}
+
+void hours_index_remap(hours_index *idx, const uint32_t *slot_map)
+{
+    // slots keep their relative order when the table is compacted, so the entries stay sorted
+    size_t n = 0;
+    for (size_t i = 0; i < idx->count; i++)
+    {
+        uint32_t slot = slot_map[idx->entries[i].slot];
+        if (slot == UINT32_MAX)
+            continue;
+        idx->entries[n].hours = idx->entries[i].hours;
+        idx->entries[n].slot = slot;
+        n++;
+    }
+    idx->count = n;
+}
+
+size_t hours_index_range(hours_index *idx, uint32_t min_hours, uint32_t max_hours, size_t *start)
+{
+    if (min_hours > max_hours)
+    {
+        *start = 0;
+        return 0;
+    }
+
+    // entries from the first with min_hours up to, but excluding, the first with more than max_hours
+    *start = hours_index_lower_bound(idx, min_hours, 0);
+    size_t end = max_hours == UINT32_MAX ? idx->count : hours_index_lower_bound(idx, max_hours + 1, 0);
+    return end - *start;
+}
+
+void free_hours_index(hours_index *idx)
+{
+    free(idx->entries);
+    idx->entries = NULL;
+    idx->capacity = 0;
+    idx->count = 0;
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "lz.h"
+
+
+static inline uint32_t load32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(uint32_t));
+    return v;
+}
+
+static inline uint32_t hash_sequence(uint32_t seq)
+{
+    return (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+size_t lz_compress_bound(size_t src_len)
+{
+    // incompressible input costs one extension byte per 255 literals plus the token
+    return src_len + src_len / 255 + 16;
+}
+
+// writes a length of at least 15 as a run of 255 valued bytes and the remainder
+static unsigned char *write_length(unsigned char *op, size_t len)
+{
+    for (len -= 15; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static unsigned char *write_sequence(unsigned char *op, const unsigned char *literals, size_t literal_len, uint32_t offset, size_t match_len)
+{
+    unsigned char *token = op++;
+    *token = (unsigned char)((literal_len < 15 ? literal_len : 15) << 4);
+    if (literal_len >= 15)
+        op = write_length(op, literal_len);
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+
+    // the last sequence stops after its literals
+    if (match_len == 0)
+        return op;
+
+    *op++ = (unsigned char)(offset >> 8);
+    *op++ = (unsigned char)offset;
+    match_len -= LZ_MIN_MATCH;
+    *token |= (unsigned char)(match_len < 15 ? match_len : 15);
+    if (match_len >= 15)
+        op = write_length(op, match_len);
+    return op;
+}
+
+int lz_compress(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_cap)
+{
+    if (dst_cap < lz_compress_bound(src_len))
+    {
+        fprintf(stderr, "%s:%s:%d output buffer of %zu bytes too small for %zu bytes\n", __FILE__, __FUNCTION__, __LINE__, dst_cap, src_len);
+        return STATUS_ERROR;
+    }
+
+    // last position each hashed 4 byte sequence was seen at, plus one so that 0 means never
+    uint32_t *table = calloc(1 << LZ_HASH_BITS, sizeof(uint32_t));
+    if (!table)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate hash table\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    unsigned char *op = dst;
+    size_t anchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= src_len)
+    {
+        uint32_t seq = load32(src + i);
+        uint32_t h = hash_sequence(seq);
+        size_t candidate = table[h];
+        table[h] = (uint32_t)i + 1;
+
+        if (candidate == 0 || i - (candidate - 1) > LZ_MAX_OFFSET || load32(src + candidate - 1) != seq)
+        {
+            // skip faster through input that does not compress
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+
+        size_t ref = candidate - 1;
+        size_t match_len = LZ_MIN_MATCH;
+        while (i + match_len < src_len && src[ref + match_len] == src[i + match_len])
+            match_len++;
+
+        op = write_sequence(op, src + anchor, i - anchor, (uint32_t)(i - ref), match_len);
+        i += match_len;
+        anchor = i;
+    }
+
+    op = write_sequence(op, src + anchor, src_len - anchor, 0, 0);
+    free(table);
+    return (int)(op - dst);
+}
+
+// reads the extension of a length nibble of 15, returns STATUS_ERROR when it runs past the input
+static int read_length(const unsigned char **ip, const unsigned char *end, size_t *len)
+{
+    unsigned char b;
+    do
+    {
+        if (*ip >= end)
+            return STATUS_ERROR;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return STATUS_SUCCESS;
+}
+
+int lz_decompress(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_len)
+{
+    const unsigned char *ip = src, *end = src + src_len;
+    unsigned char *op = dst, *dst_end = dst + dst_len;
+
+    // every stream ends with a sequence of only literals, possibly none
+    for (;;)
+    {
+        if (ip >= end)
+            return STATUS_ERROR;
+        unsigned char token = *ip++;
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && read_length(&ip, end, &literal_len) == STATUS_ERROR)
+            return STATUS_ERROR;
+        if ((size_t)(end - ip) < literal_len || (size_t)(dst_end - op) < literal_len)
+            return STATUS_ERROR;
+        if (literal_len <= 16 && end - ip >= 16 && dst_end - op >= 16)
+            memcpy(op, ip, 16);
+        else
+            memcpy(op, ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+
+        // the input ends after the literals of the last sequence
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return STATUS_ERROR;
+        size_t offset = ((size_t)ip[0] << 8) | ip[1];
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && read_length(&ip, end, &match_len) == STATUS_ERROR)
+            return STATUS_ERROR;
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(dst_end - op) < match_len)
+            return STATUS_ERROR;
+
+        // matches closer than their length repeat the bytes being written
+        const unsigned char *ref = op - offset;
+        if (offset >= 16 && match_len <= 16 && dst_end - op >= 16)
+        {
+            memcpy(op, ref, 16);
+            op += match_len;
+        }
+        else if (offset >= match_len)
+        {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        }
+        else
+        {
+            for (size_t k = 0; k < match_len; k++)
+                *op++ = ref[k];
+        }
+    }
+
+    return op == dst_end ? STATUS_SUCCESS : STATUS_ERROR;
+}
@@ -1,8 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
 #include "models.h"
 #include "common.h"
+#include "frame.h"
 
 void client_connection_set_handshake_header(client_connection *conn)
 {
@@ -11,13 +14,45 @@ void client_connection_set_handshake_header(client_connection *conn)
 
 void client_connection_init(client_connection *conn, size_t conn_idx)
 {
-    // allocate enough space for any request type in header
-    conn->header = malloc(sizeof(proto_msg) + sizeof(uint32_t));
+    // allocate enough space for any request type in header, of either framing
+    conn->header = malloc(FRAME_HEADER_SIZE > sizeof(proto_msg) + sizeof(uint32_t) ? FRAME_HEADER_SIZE : sizeof(proto_msg) + sizeof(uint32_t));
     conn->header_cursor = conn->header;
     conn->state = UNINITIALIZED;
     conn->conn_idx = conn_idx;
     conn->buf = NULL;
     conn->buf_cursor = NULL;
+    conn->shipped_seq = 0;
+    conn->version = PROTOCOL_V1;
+    conn->request_id = 0;
+    conn->in = malloc(CONNECTION_READ_SIZE);
+    conn->in_start = 0;
+    conn->in_len = 0;
+    conn->out = NULL;
+    conn->out_len = 0;
+    conn->out_capacity = 0;
+    conn->out_sent = 0;
+}
+
+// appends to the responses waiting to be sent, the buffer is kept for the life of the connection
+int client_connection_queue(client_connection *conn, const void *data, size_t len)
+{
+    if (conn->out_len + len > conn->out_capacity)
+    {
+        size_t new_capacity = conn->out_capacity ? conn->out_capacity : 256;
+        while (new_capacity < conn->out_len + len)
+            new_capacity *= 2;
+        unsigned char *new_out = realloc(conn->out, new_capacity);
+        if (!new_out)
+        {
+            fprintf(stderr, "%s:%s:%d unable to grow response buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        conn->out = new_out;
+        conn->out_capacity = new_capacity;
+    }
+    memcpy(conn->out + conn->out_len, data, len);
+    conn->out_len += len;
+    return STATUS_SUCCESS;
 }
 
 void free_client_connection(client_connection *conn)
@@ -25,6 +60,8 @@ void free_client_connection(client_connection *conn)
     free(conn->header);
     if (conn->buf)
         free(conn->buf);
+    free(conn->in);
+    free(conn->out);
     free(conn);
 }
 
@@ -102,6 +139,7 @@ void connection_map_insert(connection_map *m, int key, client_connection *conn)
     neo->conn = conn;
     neo->next = m->table[idx];
     m->table[idx] = neo;
+    m->entry_count++;
 
     // check if map needs to be resized
     if (((double)m->entry_count / (double)m->capacity) > m->alpha)
@@ -148,16 +186,16 @@ void connection_map_remove(connection_map *m, int key)
         prev = cur;
         cur = cur->next;
     }
-    if (cur && prev)
-    {
-        prev = cur->next;
-        free(cur);
-    }
-    else if (cur && !prev)
-    {
-        m->table[idx]->next = cur->next;
-        free(cur);
-    }
+    if (!cur)
+        return;
+
+    // unlink the node from its bucket, the connection it maps to is freed by the caller
+    if (prev)
+        prev->next = cur->next;
+    else
+        m->table[idx] = cur->next;
+    free(cur);
+    m->entry_count--;
 }
 
 void free_connection_map(connection_map *m)
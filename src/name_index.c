@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "models.h"
+#include "serialize.h"
+#include "name_index.h"
+
+
+uint64_t hash_name(const char *name)
+{
+    uint64_t hash = FNV_OFFSET;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+    {
+        hash ^= (uint64_t)*p;
+        hash *= FNV_PRIME;
+    }
+
+    // 0 is reserved for empty entries
+    return hash ? hash : 1;
+}
+
+int name_index_init(name_index *idx, size_t capacity)
+{
+    // round capacity up to a power of two so probing can mask instead of dividing
+    size_t cap = NAME_INDEX_INIT_CAPACITY;
+    while (cap < capacity)
+        cap *= 2;
+
+    idx->entries = calloc(cap, sizeof(name_index_entry));
+    if (!idx->entries)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate name index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    idx->capacity = cap;
+    idx->count = 0;
+    idx->map = NULL;
+    idx->map_len = 0;
+    return STATUS_SUCCESS;
+}
+
+static void name_index_place(name_index_entry *entries, size_t capacity, name_index_entry *entry)
+{
+    size_t mask = capacity - 1;
+    size_t i = be64toh(entry->hash) & mask;
+    while (entries[i].hash)
+        i = (i + 1) & mask;
+    entries[i] = *entry;
+}
+
+static int name_index_resize(name_index *idx, size_t capacity)
+{
+    name_index_entry *entries = calloc(capacity, sizeof(name_index_entry));
+    if (!entries)
+    {
+        fprintf(stderr, "%s:%s:%d unable to resize name index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < idx->capacity; i++)
+    {
+        if (idx->entries[i].hash)
+            name_index_place(entries, capacity, idx->entries + i);
+    }
+
+    // a mapped table is replaced by the heap copy
+    if (idx->map)
+        munmap(idx->map, idx->map_len);
+    else
+        free(idx->entries);
+
+    idx->entries = entries;
+    idx->capacity = capacity;
+    idx->map = NULL;
+    idx->map_len = 0;
+    return STATUS_SUCCESS;
+}
+
+int name_index_build(name_index *idx, employee *employees, uint32_t *offsets, size_t employees_size)
+{
+    if (name_index_init(idx, (size_t)(employees_size / NAME_INDEX_ALPHA) + 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        // deleted records have no name
+        if (employees[i].name && name_index_insert(idx, employees[i].name, i, offsets ? offsets[i] : 0) == STATUS_ERROR)
+        {
+            free_name_index(idx);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int name_index_insert(name_index *idx, const char *name, uint32_t slot, uint32_t offset)
+{
+    if ((double)(idx->count + 1) > NAME_INDEX_ALPHA * idx->capacity && name_index_resize(idx, 2 * idx->capacity) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    name_index_entry entry = { .hash=htobe64(hash_name(name)), .slot=htonl(slot), .offset=htonl(offset) };
+    name_index_place(idx->entries, idx->capacity, &entry);
+    idx->count++;
+    return STATUS_SUCCESS;
+}
+
+int name_index_find(name_index *idx, employee *employees, size_t employees_size, const char *name, size_t *slot)
+{
+    uint64_t hash = htobe64(hash_name(name));
+    size_t mask = idx->capacity - 1;
+    for (size_t i = be64toh(hash) & mask; idx->entries[i].hash; i = (i + 1) & mask)
+    {
+        if (idx->entries[i].hash != hash)
+            continue;
+
+        // entries of records deleted since the index was written point at slots without a name
+        uint32_t s = ntohl(idx->entries[i].slot);
+        if (s < employees_size && employees[s].name && !strcmp(employees[s].name, name))
+        {
+            *slot = s;
+            return STATUS_SUCCESS;
+        }
+    }
+    return STATUS_ERROR;
+}
+
+int name_index_probe(name_index *idx, const char *name, bool (*match)(void *ctx, uint32_t slot), void *ctx, size_t *slot)
+{
+    // for callers without an employee table, match() compares name with the record in the slot
+    uint64_t hash = htobe64(hash_name(name));
+    size_t mask = idx->capacity - 1;
+    for (size_t i = be64toh(hash) & mask; idx->entries[i].hash; i = (i + 1) & mask)
+    {
+        if (idx->entries[i].hash != hash)
+            continue;
+
+        uint32_t s = ntohl(idx->entries[i].slot);
+        if (match(ctx, s))
+        {
+            *slot = s;
+            return STATUS_SUCCESS;
+        }
+    }
+    return STATUS_ERROR;
+}
+
+int name_index_remove(name_index *idx, const char *name, uint32_t slot)
+{
+    uint64_t hash = htobe64(hash_name(name));
+    uint32_t serialized_slot = htonl(slot);
+    size_t mask = idx->capacity - 1;
+    size_t i = be64toh(hash) & mask;
+    while (idx->entries[i].hash && (idx->entries[i].hash != hash || idx->entries[i].slot != serialized_slot))
+        i = (i + 1) & mask;
+
+    if (!idx->entries[i].hash)
+        return STATUS_ERROR;
+
+    // shift back later entries of the probe sequence so no tombstones are needed
+    for (size_t j = (i + 1) & mask; idx->entries[j].hash; j = (j + 1) & mask)
+    {
+        size_t home = be64toh(idx->entries[j].hash) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            idx->entries[i] = idx->entries[j];
+            i = j;
+        }
+    }
+
+    idx->entries[i] = (name_index_entry) { 0 };
+    idx->count--;
+    return STATUS_SUCCESS;
+}
+
+int name_index_write(name_index *idx, int fd, uint32_t offset, db_section *section)
+{
+    // pad from the cursor at offset so the entries can be mapped with their natural alignment
+    static const unsigned char padding[DB_SECTION_ALIGN] = { 0 };
+    uint32_t padding_len = (DB_SECTION_ALIGN - offset % DB_SECTION_ALIGN) % DB_SECTION_ALIGN;
+    if (padding_len && write_all(fd, (void *)padding, padding_len) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // capacity and count followed by the entries, which are already in network byte order
+    uint32_t hdr[2] = { htonl((uint32_t)idx->capacity), htonl((uint32_t)idx->count) };
+    if (write_all(fd, hdr, sizeof(hdr)) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    size_t entries_len = idx->capacity * sizeof(name_index_entry);
+    if (write_all(fd, idx->entries, entries_len) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    *section = (db_section) { .type=DB_SECTION_NAME_INDEX, .offset=offset + padding_len, .length=sizeof(hdr) + entries_len };
+    return (int)(padding_len + section->length);
+}
+
+int name_index_map(name_index *idx, int fd, db_section *section, size_t employees_size)
+{
+    uint32_t hdr[2];
+    if (section->length < sizeof(hdr) || pread(fd, hdr, sizeof(hdr), section->offset) != sizeof(hdr))
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read name index header\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    size_t capacity = ntohl(hdr[0]);
+    size_t count = ntohl(hdr[1]);
+    if (section->offset % DB_SECTION_ALIGN || capacity == 0 || (capacity & (capacity - 1)) || count >= capacity || section->length != sizeof(hdr) + capacity * sizeof(name_index_entry) || count > employees_size)
+    {
+        fprintf(stderr, "%s:%s:%d - corrupted data, invalid name index\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // map from the enclosing page, private so updates never reach the file
+    long page_size = sysconf(_SC_PAGESIZE);
+    off_t map_offset = section->offset - section->offset % page_size;
+    size_t map_len = section->offset + section->length - map_offset;
+    unsigned char *map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, map_offset);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to map name index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    idx->entries = (name_index_entry *)(map + (section->offset - map_offset) + sizeof(hdr));
+    idx->capacity = capacity;
+    idx->count = count;
+    idx->map = map;
+    idx->map_len = map_len;
+    return STATUS_SUCCESS;
+}
+
+int name_index_detach(name_index *idx)
+{
+    // copy a mapped table to the heap before the file region behind it is overwritten
+    if (!idx->map)
+        return STATUS_SUCCESS;
+    return name_index_resize(idx, idx->capacity);
+}
+
+void free_name_index(name_index *idx)
+{
+    if (idx->map)
+        munmap(idx->map, idx->map_len);
+    else
+        free(idx->entries);
+
+    idx->entries = NULL;
+    idx->capacity = 0;
+    idx->count = 0;
+    idx->map = NULL;
+}
@@ -5,6 +5,10 @@
 #include <sys/socket.h>
 #include <stdint.h>
 #include <arpa/inet.h>
+#include <endian.h>
+#include <netdb.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "proto.h"
 //#include "common.h"
@@ -290,12 +294,157 @@ int serialize_list_option(unsigned char **buf, unsigned char **cursor, size_t *c
     return STATUS_SUCCESS;
 }
 
+
+int serialize_range_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *range_str)
+{
+    // range is given as MIN,MAX
+    char *separator = strchr(range_str, ',');
+    if (!separator)
+    {
+        fprintf(stderr, "%s:%s:%d hours range must be of the form MIN,MAX\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    uint32_t min_hours, max_hours;
+    *separator = '\0';
+    int status = parse_employee_hours(range_str, &min_hours);
+    *separator = ',';
+    if (status == STATUS_ERROR || parse_employee_hours(separator + 1, &max_hours) == STATUS_ERROR)
+    {
+        return STATUS_ERROR;
+    }
+
+    if (resize_buffer(buf, cursor, capacity, 2 * sizeof(uint32_t) + 1) == STATUS_ERROR)
+    {
+        return STATUS_ERROR;
+    }
+
+    // write option type followed by the bounds
+    *(*cursor)++ = 'r';
+    *((uint32_t*)(*cursor)) = htonl(min_hours);
+    (*cursor) += sizeof(uint32_t);
+    *((uint32_t*)(*cursor)) = htonl(max_hours);
+    (*cursor) += sizeof(uint32_t);
+
+    return STATUS_SUCCESS;
+}
+
+
+int deserialize_range_option(unsigned char **cursor, uint32_t *min_hours, uint32_t *max_hours)
+{
+    *min_hours = ntohl(*((uint32_t*)(*cursor)));
+    (*cursor) += sizeof(uint32_t);
+    *max_hours = ntohl(*((uint32_t*)(*cursor)));
+    (*cursor) += sizeof(uint32_t);
+    return STATUS_SUCCESS;
+}
+
+
+int serialize_top_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *count_str)
+{
+    uint32_t count;
+    if (parse_employee_hours(count_str, &count) == STATUS_ERROR)
+    {
+        return STATUS_ERROR;
+    }
+
+    if (resize_buffer(buf, cursor, capacity, sizeof(uint32_t) + 1) == STATUS_ERROR)
+    {
+        return STATUS_ERROR;
+    }
+
+    // write option type followed by the number of employees wanted
+    *(*cursor)++ = 't';
+    *((uint32_t*)(*cursor)) = htonl(count);
+    (*cursor) += sizeof(uint32_t);
+
+    return STATUS_SUCCESS;
+}
+
+
+int deserialize_top_option(unsigned char **cursor, uint32_t *count)
+{
+    *count = ntohl(*((uint32_t*)(*cursor)));
+    (*cursor) += sizeof(uint32_t);
+    return STATUS_SUCCESS;
+}
+
+
+int serialize_prefix_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *prefix)
+{
+    // compute length of prefix, and validate it does not exceed maximum
+    size_t prefix_len = strlen(prefix);
+    if (prefix_len > UINT16_MAX)
+    {
+        fprintf(stderr, "%s:%s:%d size of prefix exceeds allowed maximum", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (resize_buffer(buf, cursor, capacity, sizeof(uint16_t) + prefix_len + 1) == STATUS_ERROR)
+    {
+        return STATUS_ERROR;
+    }
+
+    // write option type, prefix length and prefix to buffer
+    *(*cursor)++ = 'p';
+    *((uint16_t*)(*cursor)) = htons((uint16_t)prefix_len);
+    (*cursor) += sizeof(uint16_t);
+    memcpy(*cursor, prefix, prefix_len);
+    (*cursor) += prefix_len;
+
+    return STATUS_SUCCESS;
+}
+
+
+int deserialize_prefix_option(unsigned char **cursor, char **prefix)
+{
+    // same layout as a delete option
+    return deserialize_delete_employee_option(cursor, prefix);
+}
+
+
+int serialize_address_search_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *substring)
+{
+    // compute length of substring, and validate it does not exceed maximum
+    size_t substring_len = strlen(substring);
+    if (substring_len > UINT16_MAX)
+    {
+        fprintf(stderr, "%s:%s:%d size of substring exceeds allowed maximum", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (resize_buffer(buf, cursor, capacity, sizeof(uint16_t) + substring_len + 1) == STATUS_ERROR)
+    {
+        return STATUS_ERROR;
+    }
+
+    // write option type, substring length and substring to buffer
+    *(*cursor)++ = 'c';
+    *((uint16_t*)(*cursor)) = htons((uint16_t)substring_len);
+    (*cursor) += sizeof(uint16_t);
+    memcpy(*cursor, substring, substring_len);
+    (*cursor) += substring_len;
+
+    return STATUS_SUCCESS;
+}
+
+
+int deserialize_address_search_option(unsigned char **cursor, char **substring)
+{
+    // same layout as a delete option
+    return deserialize_delete_employee_option(cursor, substring);
+}
+
     
 int serialize_list_employee_response(unsigned char **buf, unsigned char *cursor, uint32_t *buf_len, employee *employees, size_t employees_size)
 {
     // serialize each employee one by one into the response buffer
     for (size_t i = 0; i < employees_size; i++)
     {
+        // deleted records have no name
+        if (!employees[i].name)
+            continue;
+
         // add one to automatically copy null terminating character whenever 'strncpy' is used
         uint16_t name_len = strlen(employees[i].name) + 1;
         uint16_t address_len = strlen(employees[i].address) + 1;
@@ -334,85 +483,404 @@ int serialize_list_employee_response(unsigned char **buf, unsigned char *cursor,
     return STATUS_SUCCESS;
 }
 
+// Decodes the record of a list response at the start of buf without copying it, its strings point into buf. Returns
+// the bytes of the record, 0 when buf ends before the record does or STATUS_ERROR when the record is malformed.
+int decode_employee_view(const unsigned char *buf, size_t buf_size, employee_view *e)
+{
+    uint16_t name_len, address_len;
+    uint32_t hours;
+    if (buf_size < sizeof(uint16_t))
+        return 0;
+    memcpy(&name_len, buf, sizeof(uint16_t));
+    size_t address_offset = sizeof(uint16_t) + ntohs(name_len);
+    if (buf_size < address_offset + sizeof(uint16_t))
+        return 0;
+    memcpy(&address_len, buf + address_offset, sizeof(uint16_t));
+    size_t hours_offset = address_offset + sizeof(uint16_t) + ntohs(address_len);
+    if (buf_size < hours_offset + sizeof(uint32_t))
+        return 0;
+
+    // the strings are sent with their terminator, so they can be used where they lie
+    if (name_len == 0 || address_len == 0 || buf[address_offset - 1] != '\0' || buf[hours_offset - 1] != '\0')
+    {
+        fprintf(stderr, "%s:%s:%d invalid employee record\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    memcpy(&hours, buf + hours_offset, sizeof(uint32_t));
+    e->name = (const char *)buf + sizeof(uint16_t);
+    e->address = (const char *)buf + address_offset + sizeof(uint16_t);
+    e->hours = ntohl(hours);
+    return (int)(hours_offset + sizeof(uint32_t));
+}
+
+// calls back with every employee of a list response held in memory, stops at the first callback failing
+int for_each_employee_view(const unsigned char *buf, size_t buf_size, employee_view_callback callback, void *arg)
+{
+    size_t offset = 0;
+    while (offset < buf_size)
+    {
+        employee_view e;
+        int record_len = decode_employee_view(buf + offset, buf_size - offset, &e);
+        if (record_len <= 0)
+        {
+            fprintf(stderr, "%s:%s:%d list response truncated or malformed at byte %zu\n", __FILE__, __FUNCTION__, __LINE__, offset);
+            return STATUS_ERROR;
+        }
+        if (callback(&e, arg) == STATUS_ERROR)
+            return STATUS_ERROR;
+        offset += record_len;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Reads a list response of data_len bytes from the socket a chunk at a time and calls back with each employee as
+// soon as its record is whole. A record cut by the end of a chunk is moved to the front for the next read, so the
+// memory used stays that of a chunk however many employees there are. The response is left partly unread on the
+// socket when this fails.
+int receive_list_response(int socket, uint32_t data_len, employee_view_callback callback, void *arg)
+{
+    size_t capacity = LIST_CHUNK_SIZE;
+    size_t len = 0;
+    unsigned char *buf = malloc(capacity);
+    if (!buf)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate list chunk: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    int status = STATUS_SUCCESS;
+    while (data_len > 0 && status == STATUS_SUCCESS)
+    {
+        // only a record larger than a chunk grows the buffer, names and addresses are at most UINT16_MAX bytes
+        if (len == capacity)
+        {
+            unsigned char *cursor = buf + len;
+            if (resize_buffer(&buf, &cursor, &capacity, capacity) == STATUS_ERROR)
+            {
+                status = STATUS_ERROR;
+                break;
+            }
+        }
+        size_t want = capacity - len < data_len ? capacity - len : data_len;
+        ssize_t nbytes_recv = recv(socket, buf + len, want, 0);
+        if (nbytes_recv <= 0)
+        {
+            fprintf(stderr, "%s:%s:%d failed to receive list response: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, nbytes_recv ? errno : 0, nbytes_recv ? strerror(errno) : "connection closed");
+            status = STATUS_ERROR;
+            break;
+        }
+        len += nbytes_recv;
+        data_len -= nbytes_recv;
+
+        size_t offset = 0;
+        employee_view e;
+        int record_len;
+        while ((record_len = decode_employee_view(buf + offset, len - offset, &e)) > 0)
+        {
+            if (callback(&e, arg) == STATUS_ERROR)
+            {
+                status = STATUS_ERROR;
+                break;
+            }
+            offset += record_len;
+        }
+        if (record_len == STATUS_ERROR)
+            status = STATUS_ERROR;
+        memmove(buf, buf + offset, len - offset);
+        len -= offset;
+    }
+    if (status == STATUS_SUCCESS && len > 0)
+    {
+        fprintf(stderr, "%s:%s:%d list response ends inside a record\n", __FILE__, __FUNCTION__, __LINE__);
+        status = STATUS_ERROR;
+    }
+    free(buf);
+    return status;
+}
+
+// employees copied out of a list response as they are decoded
+typedef struct {
+    employee *employees;
+    size_t len;
+    size_t capacity;
+} employee_array;
+
+static int append_employee(const employee_view *e, void *arg)
+{
+    employee_array *a = arg;
+    if (a->len == a->capacity)
+    {
+        size_t capacity = a->capacity * 2;
+        employee *employees = realloc(a->employees, capacity * sizeof(employee));
+        if (!employees)
+        {
+            fprintf(stderr, "%s:%s:%d error reallocating employee buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        a->employees = employees;
+        a->capacity = capacity;
+    }
+    employee *copy = a->employees + a->len;
+    if (!(copy->name = strdup(e->name)) || !(copy->address = strdup(e->address)))
+    {
+        free(copy->name);
+        return STATUS_ERROR;
+    }
+    copy->hours = e->hours;
+    a->len++;
+    return STATUS_SUCCESS;
+}
+
+// copies every employee of a list response out of buf, the caller frees each name and address and the array
 int deserialize_list_employee_response(unsigned char *buf, size_t buf_size, employee **employees, size_t *employees_size)
 {
-    // for keeping track of the number of bytes we have read from buf
-    size_t total_bytes_read = 0;
-    unsigned char *cursor = buf;
+    employee_array a = { .employees=malloc(32 * sizeof(employee)), .capacity=32 };
+    if (!a.employees)
+    {
+        fprintf(stderr, "%s:%s:%d error allocating employee buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    if (for_each_employee_view(buf, buf_size, append_employee, &a) == STATUS_ERROR)
+    {
+        for (size_t i = 0; i < a.len; i++)
+        {
+            free(a.employees[i].name);
+            free(a.employees[i].address);
+        }
+        free(a.employees);
+        return STATUS_ERROR;
+    }
 
-    // allocate for deserializing employees
-    *employees = malloc(32 * sizeof(employee));
-    *employees_size = 32;
-    size_t employees_len = 0;
+    *employees = a.employees;
+    *employees_size = a.len;
+    return STATUS_SUCCESS;
+}
 
-    while (total_bytes_read < buf_size)
+int serialize_replication_status_option(unsigned char **buf, unsigned char **cursor, size_t *capacity)
+{
+    if (resize_buffer(buf, cursor, capacity, 1) == STATUS_ERROR)
     {
-        // parse name length of employee
-        uint16_t name_len = ntohs(*(uint16_t*)cursor);
-        cursor += sizeof(uint16_t);
-        total_bytes_read += sizeof(uint16_t);
+        return STATUS_ERROR;
+    }
 
-        // copy employee name
-        char *name = malloc(name_len);
-        strncpy(name, (char*)cursor, name_len);
-        cursor += name_len;
-        total_bytes_read += name_len;
-        
-        // parse length of address
-        uint16_t address_len = ntohs(*(uint16_t*)cursor);
+    *(*cursor)++ = 'm';
+    return STATUS_SUCCESS;
+}
+
+
+// whether the server is a follower, the newest change it applied and its replication stats
+int serialize_replication_status_response(unsigned char *buf, db_shards *shards)
+{
+    *buf++ = shards->read_only;
+    *(uint64_t *)buf = htobe64(shards->changes.last_seq);
+    buf += sizeof(uint64_t);
+    *(uint64_t *)buf = htobe64(shards->replication.primary_seq);
+    buf += sizeof(uint64_t);
+    *(uint64_t *)buf = htobe64(shards->replication.lag_us);
+    buf += sizeof(uint64_t);
+    *(uint32_t *)buf = htonl(shards->replication.follower_count);
+    return STATUS_SUCCESS;
+}
+
+
+int deserialize_replication_status_response(unsigned char *buf, size_t buf_size, bool *follower, uint64_t *seq, db_replication_stats *stats)
+{
+    if (buf_size != REPLICATION_STATUS_SIZE)
+    {
+        fprintf(stderr, "%s:%s:%d invalid replication status of %zu bytes\n", __FILE__, __FUNCTION__, __LINE__, buf_size);
+        return STATUS_ERROR;
+    }
+
+    *follower = *buf++;
+    *seq = be64toh(*(uint64_t *)buf);
+    buf += sizeof(uint64_t);
+    stats->primary_seq = be64toh(*(uint64_t *)buf);
+    buf += sizeof(uint64_t);
+    stats->lag_us = be64toh(*(uint64_t *)buf);
+    buf += sizeof(uint64_t);
+    stats->follower_count = ntohl(*(uint32_t *)buf);
+    return STATUS_SUCCESS;
+}
+
+
+int serialize_changes_since_option(unsigned char **buf, unsigned char **cursor, size_t *capacity, char *version_str)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long long version = strtoull(version_str, &end, 10);
+    if (!end || end == version_str || *end != '\0' || errno == ERANGE || version_str[0] == '-')
+    {
+        fprintf(stderr, "%s:%s:%d invalid version '%s'\n", __FILE__, __FUNCTION__, __LINE__, version_str);
+        return STATUS_ERROR;
+    }
+
+    if (resize_buffer(buf, cursor, capacity, sizeof(uint64_t) + 1) == STATUS_ERROR)
+    {
+        return STATUS_ERROR;
+    }
+
+    // write option type followed by the version the client is up to date with
+    *(*cursor)++ = 'v';
+    *((uint64_t*)(*cursor)) = htobe64(version);
+    (*cursor) += sizeof(uint64_t);
+    return STATUS_SUCCESS;
+}
+
+
+int deserialize_changes_since_option(unsigned char **cursor, uint64_t *version)
+{
+    *version = be64toh(*((uint64_t*)(*cursor)));
+    (*cursor) += sizeof(uint64_t);
+    return STATUS_SUCCESS;
+}
+
+
+// the version is the sequence number of the newest change, a client applying the answer is up to date with it
+static int write_changes_since_response(unsigned char **response_buf, size_t *response_buf_size, db_shards *shards, uint64_t version)
+{
+    bool resync;
+    employee *changed;
+    size_t changed_size;
+    char **deleted;
+    size_t deleted_size;
+    if (db_shards_changes_since(shards, version, &resync, &changed, &changed_size, &deleted, &deleted_size) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_shards_changes_since() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    size_t response_header_size = sizeof(proto_msg) + sizeof(uint32_t) + 1;
+    size_t capacity = response_header_size + CHANGES_SINCE_HEADER_SIZE;
+    for (size_t i = 0; i < deleted_size; i++)
+        capacity += sizeof(uint16_t) + strlen(deleted[i]) + 1;
+    unsigned char *new_buf = realloc(*response_buf, capacity);
+    if (!new_buf)
+    {
+        fprintf(stderr, "%s:%s:%d unable to grow response buffer\n", __FILE__, __FUNCTION__, __LINE__);
+        free(changed);
+        free(deleted);
+        return STATUS_ERROR;
+    }
+    *response_buf = new_buf;
+
+    unsigned char *cursor = *response_buf + response_header_size;
+    *cursor++ = resync;
+    *(uint64_t *)cursor = htobe64(shards->changes.last_seq);
+    cursor += sizeof(uint64_t);
+    *(uint32_t *)cursor = htonl(deleted_size);
+    cursor += sizeof(uint32_t);
+    for (size_t i = 0; i < deleted_size; i++)
+    {
+        uint16_t name_len = strlen(deleted[i]) + 1;
+        *(uint16_t *)cursor = htons(name_len);
         cursor += sizeof(uint16_t);
-        total_bytes_read += sizeof(uint16_t);
+        memcpy(cursor, deleted[i], name_len);
+        cursor += name_len;
+    }
+    free(deleted);
 
-        // copy employee address
-        char *address = malloc(address_len);
-        strncpy(address, (char*)cursor, address_len);
-        cursor += address_len;
-        total_bytes_read += address_len;
+    // the changed employees follow in the layout of a list
+    uint32_t response_size = (uint32_t)capacity;
+    int status = serialize_list_employee_response(response_buf, *response_buf + capacity, &response_size, changed, changed_size);
+    free(changed);
+    if (status == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d serialize_list_employee_response() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
 
-        // parse hours
-        uint32_t hours = ntohl(*(uint32_t*)cursor);
-        cursor +=  sizeof(uint32_t);
-        total_bytes_read += sizeof(uint32_t);
+    *((*response_buf) + sizeof(proto_msg)) = 0;
+    *(uint32_t *)((*response_buf) + sizeof(proto_msg) + 1) = htonl(response_size - response_header_size);
+    *response_buf_size = response_size;
+    return STATUS_SUCCESS;
+}
 
-        // add employee to employees
-        if (employees_len == *employees_size)
-        {
-            *employees_size *= 2;
-            employee *new_employees = malloc(*employees_size * sizeof(employee));
-            if (!new_employees)
-            {
-                fprintf(stderr, "%s:%s:%d error reallocating employee buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
-                return STATUS_ERROR;
-            }
 
-            *employees = new_employees;
+int deserialize_changes_since_response(unsigned char *buf, size_t buf_size, bool *resync, uint64_t *version, char ***deleted, size_t *deleted_size, employee **employees, size_t *employees_size)
+{
+    if (buf_size < CHANGES_SINCE_HEADER_SIZE)
+    {
+        fprintf(stderr, "%s:%s:%d invalid changes of %zu bytes\n", __FILE__, __FUNCTION__, __LINE__, buf_size);
+        return STATUS_ERROR;
+    }
+
+    unsigned char *end = buf + buf_size;
+    *resync = *buf++;
+    *version = be64toh(*(uint64_t *)buf);
+    buf += sizeof(uint64_t);
+    uint32_t count = ntohl(*(uint32_t *)buf);
+    buf += sizeof(uint32_t);
+
+    *deleted = malloc((count ? count : 1) * sizeof(char *));
+    if (!*deleted)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate deleted names: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    for (*deleted_size = 0; *deleted_size < count; (*deleted_size)++)
+    {
+        uint16_t name_len = (size_t)(end - buf) >= sizeof(uint16_t) ? ntohs(*(uint16_t *)buf) : 0;
+        if (name_len == 0 || (size_t)(end - buf) < sizeof(uint16_t) + name_len || buf[sizeof(uint16_t) + name_len - 1] != '\0' ||
+            !((*deleted)[*deleted_size] = strdup((char *)buf + sizeof(uint16_t))))
+        {
+            fprintf(stderr, "%s:%s:%d invalid deleted name\n", __FILE__, __FUNCTION__, __LINE__);
+            for (size_t i = 0; i < *deleted_size; i++)
+                free((*deleted)[i]);
+            free(*deleted);
+            return STATUS_ERROR;
         }
+        buf += sizeof(uint16_t) + name_len;
+    }
 
-        ((*employees) + employees_len)->name = name;
-        ((*employees) + employees_len)->address = address;
-        ((*employees) + employees_len)->hours = hours;
-        employees_len++;
+    if (buf == end)
+    {
+        *employees = NULL;
+        *employees_size = 0;
+        return STATUS_SUCCESS;
     }
+    return deserialize_list_employee_response(buf, (size_t)(end - buf), employees, employees_size);
+}
 
-    // resize employee buffer
-    employee *resized_employees = realloc(*employees, employees_len * sizeof(employee));
-    if (!resized_employees)
+
+static int write_employees_response(unsigned char **response_buf, size_t *response_buf_size, employee *employees, size_t employees_size)
+{
+    // serialize employees after the response header
+    uint32_t response_header_size = sizeof(proto_msg) + sizeof(uint32_t) + 1;
+    uint32_t response_size = response_header_size;
+    unsigned char *response_cursor = (*response_buf) + response_size;
+    if (serialize_list_employee_response(response_buf, response_cursor, &response_size, employees, employees_size) == STATUS_ERROR)
     {
-        fprintf(stderr, "%s:%s:%d error reallocating employee buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        fprintf(stderr, "%s:%s:%d serialize_list_employee_response() failed\n", __FILE__, __FUNCTION__, __LINE__);
         return STATUS_ERROR;
     }
 
-    *employees = resized_employees;
-    *employees_size = employees_len; 
+    // write success flag to response buffer
+    *((*response_buf) + sizeof(proto_msg)) = 0;
+
+    // compute length of data
+    uint32_t data_len = response_size - response_header_size;
+
+    // write data length to response buffer
+    *(uint32_t *)((*response_buf) + sizeof(proto_msg) + 1) = htonl(data_len);
+    *response_buf_size = (size_t)response_size;
     return STATUS_SUCCESS;
 }
 
 
-int deserialize_request_options(int fd, employee **employees, db_header *dbhdr, unsigned char **response_buf, size_t *response_buf_size,  client_connection *conn)
+int deserialize_request_options(db_shards *shards, unsigned char **response_buf, size_t *response_buf_size,  client_connection *conn)
 {
     // set cursor to beginning of request buffer
     conn->buf_cursor = conn->buf;
 
+    // a follower only changes through its primary, writes come before any other option in a request
+    if (shards->read_only && conn->buf_size > 0 && (*conn->buf_cursor == 'a' || *conn->buf_cursor == 'u' || *conn->buf_cursor == 'd'))
+    {
+        // write error code 2 to response buffer
+        *((*response_buf) + sizeof(proto_msg)) = 2;
+        *(uint32_t*)((*response_buf) + sizeof(proto_msg) + 1) = 0;
+        return STATUS_SUCCESS;
+    }
+
     // check for add employee option
     if ((size_t)(conn->buf_cursor - conn->buf) < conn->buf_size && *conn->buf_cursor == 'a')
     {
@@ -420,28 +888,25 @@ int deserialize_request_options(int fd, employee **employees, db_header *dbhdr,
         // move cursor past option character
         conn->buf_cursor++;
 
-        // add space for new employee
-        (dbhdr->employee_count)++;
-        employee *new_employees = realloc(*employees, dbhdr->employee_count * sizeof(employee));
-        if (!new_employees)
+        // attempt to deserialize add employee request
+        employee e;
+        if (deserialize_add_employee_option(&conn->buf_cursor, &e) == STATUS_ERROR)
         {
-            fprintf(stderr, "%s:%s:%d error reallocating employee buffer\n", __FILE__, __FUNCTION__, __LINE__);
+            fprintf(stderr, "%s:%s:%d deserialize_add_employee_option() failed\n", __FILE__, __FUNCTION__, __LINE__);
             return STATUS_ERROR;
         }
 
-        (*employees) = new_employees;
-
-        // attempt to deserialize add employee request
-        if (deserialize_add_employee_option(&conn->buf_cursor, (*employees) + (dbhdr->employee_count - 1)) == STATUS_ERROR)
+        // the change is logged first, the database takes ownership of the strings
+        if (changelog_record(&shards->changes, CHANGE_ADD, e.name, e.address, e.hours) == STATUS_ERROR)
         {
-            fprintf(stderr, "%s:%s:%d deserialize_add_employee_option() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            fprintf(stderr, "%s:%s:%d changelog_record() failed\n", __FILE__, __FUNCTION__, __LINE__);
             return STATUS_ERROR;
         }
 
-        // write to file
-        if (write_db(fd, dbhdr, *employees) == STATUS_ERROR)
+        // add to the table of the shard owning the name and write to its file
+        if (db_add_employee(db_shard_for(shards, e.name), &e) == STATUS_ERROR)
         {
-            fprintf(stderr, "%s:%s:%d write_db() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            fprintf(stderr, "%s:%s:%d db_add_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
             return STATUS_ERROR;
         }
     }
@@ -460,31 +925,30 @@ int deserialize_request_options(int fd, employee **employees, db_header *dbhdr,
             return STATUS_ERROR;
         }
 
-        // search for employee
-        bool found = false;
-        for (size_t i = 0; i < dbhdr->employee_count; i++)
-        {
-            if (!strcmp((*employees)[i].name, employee_name))
-            {
-                found = true;
-                (*employees)[i].hours = hours;
-                break;
-            }
-        }
-
+        // search for employee in the shard owning the name
+        size_t idx;
+        database *db = db_shard_for(shards, employee_name);
+        bool found = db_find_employee(db, employee_name, &idx) == STATUS_SUCCESS;
+        int status = found ? changelog_record(&shards->changes, CHANGE_UPDATE, employee_name, NULL, hours) : STATUS_SUCCESS;
         free(employee_name);
 
         if (!found)
         {
-            // write error code 1 to response buffer
+            // write error code 1 to response buffer, with no data after it
             *((*response_buf) + sizeof(proto_msg)) = 1;
+            *(uint32_t*)((*response_buf) + sizeof(proto_msg) + 1) = 0;
             return STATUS_SUCCESS;
         }
+        if (status == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d changelog_record() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
 
-        // write to file
-        if (write_db(fd, dbhdr, *employees) == STATUS_ERROR)
+        // write hours in place
+        if (db_update_hours(db, idx, hours) == STATUS_ERROR)
         {
-            fprintf(stderr, "%s:%s:%d write_db() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            fprintf(stderr, "%s:%s:%d db_update_hours() failed\n", __FILE__, __FUNCTION__, __LINE__);
             return STATUS_ERROR;
         }
     }
@@ -503,31 +967,30 @@ int deserialize_request_options(int fd, employee **employees, db_header *dbhdr,
             return STATUS_ERROR;
         }
 
-        // search for employee
-        bool found = false;
-        for (size_t i = 0; i < dbhdr->employee_count; i++)
-        {
-            if (!strcmp((*employees)[i].name, employee_name))
-            {
-                found = true;
-                (*employees)[i] = (*employees)[--dbhdr->employee_count];
-                break;
-            }
-        }
-
+        // search for employee in the shard owning the name
+        size_t idx;
+        database *db = db_shard_for(shards, employee_name);
+        bool found = db_find_employee(db, employee_name, &idx) == STATUS_SUCCESS;
+        int status = found ? changelog_record(&shards->changes, CHANGE_DELETE, employee_name, NULL, 0) : STATUS_SUCCESS;
         free(employee_name);
 
         if (!found)
         {
-            // write error code 1 to response buffer
+            // write error code 1 to response buffer, with no data after it
             *((*response_buf) + sizeof(proto_msg)) = 1;
+            *(uint32_t*)((*response_buf) + sizeof(proto_msg) + 1) = 0;
             return STATUS_SUCCESS;
         }
+        if (status == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d changelog_record() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
 
-        // write to file
-        if (write_db(fd, dbhdr, *employees) == STATUS_ERROR)
+        // remove from table and write to file
+        if (db_delete_employee(db, idx) == STATUS_ERROR)
         {
-            fprintf(stderr, "%s:%s:%d write_db() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            fprintf(stderr, "%s:%s:%d db_delete_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
             return STATUS_ERROR;
         }
     }
@@ -535,25 +998,127 @@ int deserialize_request_options(int fd, employee **employees, db_header *dbhdr,
     // check for list option
     if ((size_t)(conn->buf_cursor - conn->buf) < conn->buf_size && *conn->buf_cursor == 'l')
     {
-        // we need to serialize all employees into the response buffer
-        uint32_t response_header_size = sizeof(proto_msg) + sizeof(uint32_t) + 1;
-        uint32_t response_size = response_header_size;
-        unsigned char *response_cursor = (*response_buf) + response_size;
-        if (serialize_list_employee_response(response_buf, response_cursor, &response_size, *employees, (size_t)dbhdr->employee_count) == STATUS_ERROR)
+        // we need to serialize all employees of every shard into the response buffer
+        employee *employees;
+        size_t employees_size;
+        if (db_shards_list(shards, &employees, &employees_size) == STATUS_ERROR)
         {
-            fprintf(stderr, "%s:%s:%d serialize_list_employee_response() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            fprintf(stderr, "%s:%s:%d db_shards_list() failed\n", __FILE__, __FUNCTION__, __LINE__);
             return STATUS_ERROR;
         }
+        return write_employees_response(response_buf, response_buf_size, employees, employees_size);
+    }
 
-        // write success flag to response buffer
-        *((*response_buf) + sizeof(proto_msg)) = 0;
+    // check for hours range option
+    if ((size_t)(conn->buf_cursor - conn->buf) < conn->buf_size && *conn->buf_cursor == 'r')
+    {
+        conn->buf_cursor++;
+        uint32_t min_hours, max_hours;
+        deserialize_range_option(&conn->buf_cursor, &min_hours, &max_hours);
+
+        // employees in the range, ordered by hours
+        employee *employees;
+        size_t employees_size;
+        if (db_shards_hours_range(shards, min_hours, max_hours, &employees, &employees_size) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d db_shards_hours_range() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+
+        int status = write_employees_response(response_buf, response_buf_size, employees, employees_size);
+        free(employees);
+        return status;
+    }
 
-        // compute length of data
-        uint32_t data_len = response_size - response_header_size;
+    // check for top hours option
+    if ((size_t)(conn->buf_cursor - conn->buf) < conn->buf_size && *conn->buf_cursor == 't')
+    {
+        conn->buf_cursor++;
+        uint32_t count;
+        deserialize_top_option(&conn->buf_cursor, &count);
+
+        employee *employees;
+        size_t employees_size;
+        if (db_shards_top_hours(shards, count, &employees, &employees_size) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d db_shards_top_hours() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+
+        int status = write_employees_response(response_buf, response_buf_size, employees, employees_size);
+        free(employees);
+        return status;
+    }
+
+    // check for name prefix option
+    if ((size_t)(conn->buf_cursor - conn->buf) < conn->buf_size && *conn->buf_cursor == 'p')
+    {
+        conn->buf_cursor++;
+        char *prefix;
+        deserialize_prefix_option(&conn->buf_cursor, &prefix);
+
+        employee *employees;
+        size_t employees_size;
+        int status = db_shards_prefix_search(shards, prefix, &employees, &employees_size);
+        free(prefix);
+        if (status == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d db_shards_prefix_search() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+
+        status = write_employees_response(response_buf, response_buf_size, employees, employees_size);
+        free(employees);
+        return status;
+    }
+
+    // check for address substring option
+    if ((size_t)(conn->buf_cursor - conn->buf) < conn->buf_size && *conn->buf_cursor == 'c')
+    {
+        conn->buf_cursor++;
+        char *substring;
+        deserialize_address_search_option(&conn->buf_cursor, &substring);
+
+        employee *employees;
+        size_t employees_size;
+        int status = db_shards_address_search(shards, substring, &employees, &employees_size);
+        free(substring);
+        if (status == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d db_shards_address_search() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+
+        status = write_employees_response(response_buf, response_buf_size, employees, employees_size);
+        free(employees);
+        return status;
+    }
+
+    // check for changes since a version option
+    if ((size_t)(conn->buf_cursor - conn->buf) + sizeof(uint64_t) < conn->buf_size && *conn->buf_cursor == 'v')
+    {
+        conn->buf_cursor++;
+        uint64_t version;
+        deserialize_changes_since_option(&conn->buf_cursor, &version);
+        return write_changes_since_response(response_buf, response_buf_size, shards, version);
+    }
 
-        // write data length to response buffer
-        *(uint32_t *)((*response_buf) + sizeof(proto_msg) + 1) = htonl(data_len);
-        *response_buf_size = (size_t)response_size;
+    // check for replication status option
+    if ((size_t)(conn->buf_cursor - conn->buf) < conn->buf_size && *conn->buf_cursor == 'm')
+    {
+        conn->buf_cursor++;
+        size_t response_header_size = sizeof(proto_msg) + sizeof(uint32_t) + 1;
+        unsigned char *new_buf = realloc(*response_buf, response_header_size + REPLICATION_STATUS_SIZE);
+        if (!new_buf)
+        {
+            fprintf(stderr, "%s:%s:%d unable to grow response buffer\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+        *response_buf = new_buf;
+        serialize_replication_status_response(*response_buf + response_header_size, shards);
+        *((*response_buf) + sizeof(proto_msg)) = 0;
+        *(uint32_t*)((*response_buf) + sizeof(proto_msg) + 1) = htonl(REPLICATION_STATUS_SIZE);
+        *response_buf_size = response_header_size + REPLICATION_STATUS_SIZE;
         return STATUS_SUCCESS;
     }
 
@@ -571,3 +1136,120 @@ int deserialize_request_options(int fd, employee **employees, db_header *dbhdr,
     
 
 
+int send_handshake(int socket, uint16_t protocol_version)
+{
+    // instantiate request
+    // size_t msg_size = sizeof(proto_msg) + sizeof(uint16_t);
+    proto_msg *handshake_req = malloc(HANDSHAKE_REQ_SIZE);
+    handshake_req[0] = HANDSHAKE_REQUEST;
+    *(uint16_t *)(handshake_req + 1) = htons(protocol_version);
+
+    int status = send_all(socket, handshake_req, HANDSHAKE_REQ_SIZE, 0);
+    free(handshake_req);
+    return status;
+}
+
+int get_socket(char *host, char *port)
+{
+	// get info for host/port
+    int status;
+    struct addrinfo hints = {0}; 
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *servinfo;
+    if ((status = getaddrinfo(host, port, &hints, &servinfo)) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d - getaddrinfo() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, status, gai_strerror(status));
+        return STATUS_ERROR;
+    }
+        
+	// attempt to create a socket from the given server
+    int sockfd;
+    struct addrinfo *ptr; 
+    for (ptr = servinfo; ptr; ptr = ptr->ai_next)
+    {
+        if ((sockfd = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol)) == -1)
+            continue;
+        break;
+    }
+
+    // validate socket
+    if (sockfd == -1 || !ptr)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to create socket: %s\n", __FILE__, __FUNCTION__, __LINE__, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+	// connect to socket and ensure connection has been established
+    if (connect(sockfd, ptr->ai_addr, ptr->ai_addrlen) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to connect to host: %s\n", __FILE__, __FUNCTION__, __LINE__, strerror(errno));
+        return STATUS_ERROR;
+    }
+    
+    freeaddrinfo(servinfo);
+    return sockfd;
+}
+
+// connects to a server listening on a unix domain socket at path, for clients on the same host
+int get_unix_socket(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family=AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%s:%s:%d - unix domain socket path longer than %zu bytes\n", __FILE__, __FUNCTION__, __LINE__, sizeof(addr.sun_path) - 1);
+        return STATUS_ERROR;
+    }
+    strcpy(addr.sun_path, path);
+
+    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd == -1)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to create socket: %s\n", __FILE__, __FUNCTION__, __LINE__, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to connect to %s: %s\n", __FILE__, __FUNCTION__, __LINE__, path, strerror(errno));
+        close(sockfd);
+        return STATUS_ERROR;
+    }
+
+    return sockfd;
+}
+
+int receive_handshake(int socket)
+{
+    // wait for handshake response from server, confirming protocol versions match
+    unsigned char *handshake_response = malloc(sizeof(proto_msg));
+    if (receive_all(socket, handshake_response, sizeof(proto_msg), 0) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to receive handshake response\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (*(proto_msg *)handshake_response != HANDSHAKE_RESPONSE)
+    {
+        fprintf(stderr, "%s:%s:%d - internal server error\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    unsigned char handshake_flag;
+
+    if (receive_all(socket, &handshake_flag, 1, 0) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to receive handshake response\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (handshake_flag)
+    {
+        fprintf(stderr, "%s:%s:%d - invalid protocol version\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free(handshake_response);
+    return STATUS_SUCCESS;
+}
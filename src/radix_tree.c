@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+#include "radix_tree.h"
+
+
+static radix_node *radix_node_new(const char *label, uint32_t label_len)
+{
+    radix_node *node = calloc(1, sizeof(radix_node));
+    if (!node)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate radix node: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return NULL;
+    }
+
+    if (label_len > 0)
+    {
+        node->label = malloc(label_len);
+        if (!node->label)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate radix label: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            free(node);
+            return NULL;
+        }
+        memcpy(node->label, label, label_len);
+    }
+    node->label_len = label_len;
+    return node;
+}
+
+static void radix_node_free(radix_node *node)
+{
+    for (uint32_t i = 0; i < node->child_count; i++)
+        radix_node_free(node->children[i]);
+    free(node->children);
+    free(node->slots);
+    free(node->label);
+    free(node);
+}
+
+// index of the child whose label starts with c, or of the position it would be inserted at
+static uint32_t radix_child_pos(radix_node *node, unsigned char c)
+{
+    uint32_t lo = 0, hi = node->child_count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ((unsigned char)node->children[mid]->label[0] < c)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static radix_node *radix_find_child(radix_node *node, unsigned char c, uint32_t *pos)
+{
+    *pos = radix_child_pos(node, c);
+    if (*pos < node->child_count && (unsigned char)node->children[*pos]->label[0] == c)
+        return node->children[*pos];
+    return NULL;
+}
+
+static int radix_add_child(radix_node *node, uint32_t pos, radix_node *child)
+{
+    if (node->child_count == node->child_capacity)
+    {
+        uint32_t capacity = node->child_capacity ? 2 * node->child_capacity : 2;
+        radix_node **children = realloc(node->children, capacity * sizeof(radix_node *));
+        if (!children)
+        {
+            fprintf(stderr, "%s:%s:%d unable to grow radix children: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        node->children = children;
+        node->child_capacity = capacity;
+    }
+
+    memmove(node->children + pos + 1, node->children + pos, (node->child_count - pos) * sizeof(radix_node *));
+    node->children[pos] = child;
+    node->child_count++;
+    return STATUS_SUCCESS;
+}
+
+static int radix_add_slot(radix_node *node, uint32_t slot)
+{
+    if (node->slot_count == node->slot_capacity)
+    {
+        uint32_t capacity = node->slot_capacity ? 2 * node->slot_capacity : 1;
+        uint32_t *slots = realloc(node->slots, capacity * sizeof(uint32_t));
+        if (!slots)
+        {
+            fprintf(stderr, "%s:%s:%d unable to grow radix slots: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        node->slots = slots;
+        node->slot_capacity = capacity;
+    }
+
+    node->slots[node->slot_count++] = slot;
+    return STATUS_SUCCESS;
+}
+
+static uint32_t common_prefix_len(const char *label, uint32_t label_len, const char *s)
+{
+    uint32_t n = 0;
+    while (n < label_len && s[n] && label[n] == s[n])
+        n++;
+    return n;
+}
+
+int radix_tree_init(radix_tree *tree)
+{
+    tree->count = 0;
+    tree->root = radix_node_new(NULL, 0);
+    return tree->root ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+int radix_tree_build(radix_tree *tree, employee *employees, size_t employees_size)
+{
+    if (radix_tree_init(tree) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        // deleted records have no name
+        if (employees[i].name && radix_tree_insert(tree, employees[i].name, i) == STATUS_ERROR)
+        {
+            free_radix_tree(tree);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int radix_tree_insert(radix_tree *tree, const char *name, uint32_t slot)
+{
+    radix_node *node = tree->root;
+    const char *p = name;
+    while (*p)
+    {
+        uint32_t pos;
+        radix_node *child = radix_find_child(node, (unsigned char)*p, &pos);
+        if (!child)
+        {
+            // the rest of the name becomes a new leaf
+            radix_node *leaf = radix_node_new(p, strlen(p));
+            if (!leaf || radix_add_slot(leaf, slot) == STATUS_ERROR || radix_add_child(node, pos, leaf) == STATUS_ERROR)
+            {
+                if (leaf)
+                    radix_node_free(leaf);
+                return STATUS_ERROR;
+            }
+            tree->count++;
+            return STATUS_SUCCESS;
+        }
+
+        uint32_t common = common_prefix_len(child->label, child->label_len, p);
+        if (common < child->label_len)
+        {
+            // split the edge where the name leaves it
+            radix_node *mid = radix_node_new(child->label, common);
+            char *rest = malloc(child->label_len - common);
+            if (!mid || !rest || radix_add_child(mid, 0, child) == STATUS_ERROR)
+            {
+                fprintf(stderr, "%s:%s:%d unable to split radix node\n", __FILE__, __FUNCTION__, __LINE__);
+                if (mid)
+                {
+                    mid->child_count = 0;
+                    radix_node_free(mid);
+                }
+                free(rest);
+                return STATUS_ERROR;
+            }
+
+            memcpy(rest, child->label + common, child->label_len - common);
+            free(child->label);
+            child->label = rest;
+            child->label_len -= common;
+            node->children[pos] = mid;
+            child = mid;
+        }
+
+        node = child;
+        p += common;
+    }
+
+    if (radix_add_slot(node, slot) == STATUS_ERROR)
+        return STATUS_ERROR;
+    tree->count++;
+    return STATUS_SUCCESS;
+}
+
+// merges a node that only routes to a single child with that child
+static int radix_merge_child(radix_node *node)
+{
+    radix_node *child = node->children[0];
+    char *label = malloc(node->label_len + child->label_len);
+    if (!label)
+    {
+        fprintf(stderr, "%s:%s:%d unable to merge radix nodes: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    memcpy(label, node->label, node->label_len);
+    memcpy(label + node->label_len, child->label, child->label_len);
+
+    free(node->label);
+    free(node->children);
+    free(node->slots);
+    node->label = label;
+    node->label_len += child->label_len;
+    node->children = child->children;
+    node->child_count = child->child_count;
+    node->child_capacity = child->child_capacity;
+    node->slots = child->slots;
+    node->slot_count = child->slot_count;
+    node->slot_capacity = child->slot_capacity;
+
+    free(child->label);
+    free(child);
+    return STATUS_SUCCESS;
+}
+
+static int radix_remove(radix_node *node, const char *p, uint32_t slot)
+{
+    if (!*p)
+    {
+        for (uint32_t i = 0; i < node->slot_count; i++)
+        {
+            if (node->slots[i] == slot)
+            {
+                node->slots[i] = node->slots[--node->slot_count];
+                return STATUS_SUCCESS;
+            }
+        }
+        return STATUS_ERROR;
+    }
+
+    uint32_t pos;
+    radix_node *child = radix_find_child(node, (unsigned char)*p, &pos);
+    if (!child)
+        return STATUS_ERROR;
+
+    uint32_t common = common_prefix_len(child->label, child->label_len, p);
+    if (common < child->label_len || radix_remove(child, p + common, slot) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // drop children left without names and keep the tree path compressed
+    if (child->slot_count == 0 && child->child_count == 0)
+    {
+        radix_node_free(child);
+        memmove(node->children + pos, node->children + pos + 1, (node->child_count - pos - 1) * sizeof(radix_node *));
+        node->child_count--;
+    }
+    else if (child->slot_count == 0 && child->child_count == 1)
+    {
+        // the tree stays valid if merging fails, it is just less compact
+        radix_merge_child(child);
+    }
+    return STATUS_SUCCESS;
+}
+
+int radix_tree_remove(radix_tree *tree, const char *name, uint32_t slot)
+{
+    if (radix_remove(tree->root, name, slot) == STATUS_ERROR)
+        return STATUS_ERROR;
+    tree->count--;
+    return STATUS_SUCCESS;
+}
+
+typedef struct {
+    uint32_t *slots;
+    size_t size;
+    size_t capacity;
+} slot_list;
+
+static int radix_collect(radix_node *node, slot_list *list)
+{
+    // names ending here sort before the longer names below
+    if (list->size + node->slot_count > list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity : 16;
+        while (capacity < list->size + node->slot_count)
+            capacity *= 2;
+        uint32_t *slots = realloc(list->slots, capacity * sizeof(uint32_t));
+        if (!slots)
+        {
+            fprintf(stderr, "%s:%s:%d unable to grow prefix result: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        list->slots = slots;
+        list->capacity = capacity;
+    }
+    memcpy(list->slots + list->size, node->slots, node->slot_count * sizeof(uint32_t));
+    list->size += node->slot_count;
+
+    for (uint32_t i = 0; i < node->child_count; i++)
+    {
+        if (radix_collect(node->children[i], list) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int radix_tree_prefix(radix_tree *tree, const char *prefix, uint32_t **slots, size_t *slots_size)
+{
+    *slots = NULL;
+    *slots_size = 0;
+
+    // follow the prefix down to the first node whose names all start with it
+    radix_node *node = tree->root;
+    const char *p = prefix;
+    while (*p)
+    {
+        uint32_t pos;
+        radix_node *child = radix_find_child(node, (unsigned char)*p, &pos);
+        if (!child)
+            return STATUS_SUCCESS;
+
+        uint32_t common = common_prefix_len(child->label, child->label_len, p);
+        if (p[common] != '\0' && common < child->label_len)
+            return STATUS_SUCCESS;
+
+        node = child;
+        p += common;
+    }
+
+    slot_list list = { 0 };
+    if (radix_collect(node, &list) == STATUS_ERROR)
+    {
+        free(list.slots);
+        return STATUS_ERROR;
+    }
+
+    *slots = list.slots;
+    *slots_size = list.size;
+    return STATUS_SUCCESS;
+}
+
+static void radix_remap(radix_node *node, const uint32_t *slot_map, size_t *count)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < node->slot_count; i++)
+    {
+        if (slot_map[node->slots[i]] != UINT32_MAX)
+            node->slots[n++] = slot_map[node->slots[i]];
+    }
+    *count -= node->slot_count - n;
+    node->slot_count = n;
+
+    for (uint32_t i = 0; i < node->child_count; i++)
+        radix_remap(node->children[i], slot_map, count);
+}
+
+void radix_tree_remap(radix_tree *tree, const uint32_t *slot_map)
+{
+    radix_remap(tree->root, slot_map, &tree->count);
+}
+
+void free_radix_tree(radix_tree *tree)
+{
+    if (tree->root)
+        radix_node_free(tree->root);
+    tree->root = NULL;
+    tree->count = 0;
+}
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <endian.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "models.h"
+#include "proto.h"
+#include "changelog.h"
+#include "shard.h"
+#include "replication.h"
+#include "frame.h"
+
+
+// header of a message, its type and the length of its data
+#define REPLICATION_HEADER_SIZE (sizeof(proto_msg) + sizeof(uint32_t))
+
+
+// appends a REPLICATION_CHANGE message for c to the batch
+static int replication_encode_change(unsigned char **buf, unsigned char **cursor, size_t *capacity, change *c, uint64_t head_seq)
+{
+    const char *address = c->address ? c->address : "";
+    size_t name_len = strlen(c->name) + 1;
+    size_t address_len = strlen(address) + 1;
+    if (name_len > UINT16_MAX || address_len > UINT16_MAX)
+    {
+        fprintf(stderr, "%s:%s:%d change of '%s' is too long to replicate\n", __FILE__, __FUNCTION__, __LINE__, c->name);
+        return STATUS_ERROR;
+    }
+
+    size_t data_len = 3 * sizeof(uint64_t) + 1 + sizeof(uint32_t) + 2 * sizeof(uint16_t) + name_len + address_len;
+    if (resize_buffer(buf, cursor, capacity, REPLICATION_HEADER_SIZE + data_len) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    unsigned char *p = *cursor;
+    *(proto_msg *)p = REPLICATION_CHANGE;
+    p += sizeof(proto_msg);
+    *(uint32_t *)p = htonl(data_len);
+    p += sizeof(uint32_t);
+    *(uint64_t *)p = htobe64(c->seq);
+    p += sizeof(uint64_t);
+    *(uint64_t *)p = htobe64(head_seq);
+    p += sizeof(uint64_t);
+    *(uint64_t *)p = htobe64(c->time_us);
+    p += sizeof(uint64_t);
+    *p++ = c->type;
+    *(uint32_t *)p = htonl(c->hours);
+    p += sizeof(uint32_t);
+    *(uint16_t *)p = htons(name_len);
+    p += sizeof(uint16_t);
+    memcpy(p, c->name, name_len);
+    p += name_len;
+    *(uint16_t *)p = htons(address_len);
+    p += sizeof(uint16_t);
+    memcpy(p, address, address_len);
+    *cursor = p + address_len;
+    return STATUS_SUCCESS;
+}
+
+// the strings of the decoded change point into data
+int replication_decode_change(unsigned char *data, size_t data_len, change *c, uint64_t *head_seq)
+{
+    size_t fixed_len = 3 * sizeof(uint64_t) + 1 + sizeof(uint32_t) + sizeof(uint16_t);
+    if (data_len < fixed_len + sizeof(uint16_t))
+        return STATUS_ERROR;
+
+    unsigned char *end = data + data_len;
+    c->seq = be64toh(*(uint64_t *)data);
+    data += sizeof(uint64_t);
+    *head_seq = be64toh(*(uint64_t *)data);
+    data += sizeof(uint64_t);
+    c->time_us = be64toh(*(uint64_t *)data);
+    data += sizeof(uint64_t);
+    c->type = *data++;
+    c->hours = ntohl(*(uint32_t *)data);
+    data += sizeof(uint32_t);
+
+    size_t name_len = ntohs(*(uint16_t *)data);
+    data += sizeof(uint16_t);
+    if (name_len == 0 || (size_t)(end - data) < name_len + sizeof(uint16_t) || data[name_len - 1] != '\0')
+        return STATUS_ERROR;
+    c->name = (char *)data;
+    data += name_len;
+
+    size_t address_len = ntohs(*(uint16_t *)data);
+    data += sizeof(uint16_t);
+    if (address_len == 0 || (size_t)(end - data) != address_len || data[address_len - 1] != '\0')
+        return STATUS_ERROR;
+    c->address = c->type == CHANGE_ADD ? (char *)data : NULL;
+    return c->type == CHANGE_ADD || c->type == CHANGE_UPDATE || c->type == CHANGE_DELETE ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+// queues the batch behind whatever the connection has not sent yet
+static int replication_flush(client_connection *conn, unsigned char *buf, unsigned char **cursor)
+{
+    if (*cursor > buf && client_connection_queue(conn, buf, (size_t)(*cursor - buf)) == STATUS_ERROR)
+        return STATUS_ERROR;
+    *cursor = buf;
+    return STATUS_SUCCESS;
+}
+
+int replication_queue_copy(client_connection *conn, db_shards *s)
+{
+    employee *employees;
+    size_t employees_size;
+    if (db_shards_list(s, &employees, &employees_size) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < employees_size; i++)
+        count += employees[i].name != NULL;
+
+    size_t capacity = REPLICATION_BATCH_SIZE;
+    unsigned char *buf = malloc(capacity);
+    if (!buf)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate batch: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // the copy is as of the newest change, the follower is sent the changes after it
+    unsigned char *cursor = buf;
+    *(proto_msg *)cursor = REPLICATION_RESPONSE;
+    cursor += sizeof(proto_msg);
+    *(uint32_t *)cursor = htonl(REPLICATION_RESPONSE_SIZE);
+    cursor += sizeof(uint32_t);
+    *(uint64_t *)cursor = htobe64(s->changes.last_seq);
+    cursor += sizeof(uint64_t);
+    *(uint32_t *)cursor = htonl(count);
+    cursor += sizeof(uint32_t);
+
+    uint64_t now = changelog_now_us();
+    int status = STATUS_SUCCESS;
+    for (size_t i = 0; i < employees_size && status == STATUS_SUCCESS; i++)
+    {
+        if (!employees[i].name)
+            continue;
+        change c = { .seq=s->changes.last_seq, .time_us=now, .type=CHANGE_ADD, .hours=employees[i].hours,
+            .name=employees[i].name, .address=employees[i].address };
+        status = replication_encode_change(&buf, &cursor, &capacity, &c, s->changes.last_seq);
+        if (status == STATUS_SUCCESS && (size_t)(cursor - buf) >= REPLICATION_BATCH_SIZE)
+            status = replication_flush(conn, buf, &cursor);
+    }
+    if (status == STATUS_SUCCESS)
+        status = replication_flush(conn, buf, &cursor);
+
+    free(buf);
+    return status;
+}
+
+int replication_queue_subscribe(client_connection *conn, db_shards *s)
+{
+    unsigned char response[REPLICATION_HEADER_SIZE + SUBSCRIBE_RESPONSE_SIZE];
+    *(proto_msg *)response = SUBSCRIBE_RESPONSE;
+    *(uint32_t *)(response + sizeof(proto_msg)) = htonl(SUBSCRIBE_RESPONSE_SIZE);
+    *(uint64_t *)(response + REPLICATION_HEADER_SIZE) = htobe64(s->changes.last_seq);
+    return client_connection_queue(conn, response, sizeof(response));
+}
+
+int replication_queue_changes(client_connection *conn, db_shards *s)
+{
+    changelog *log = &s->changes;
+    if (conn->shipped_seq == log->last_seq)
+        return STATUS_SUCCESS;
+
+    // a follower further behind than the log reaches has to start over from a new copy
+    if (!changelog_covers(log, conn->shipped_seq))
+    {
+        fprintf(stderr, "%s:%s:%d connection at change %lu is behind the oldest change kept\n", __FILE__, __FUNCTION__, __LINE__, (unsigned long)conn->shipped_seq);
+        return STATUS_ERROR;
+    }
+
+    // the changes of a connection that has not taken what it was sent wait in the log instead of in memory
+    if (conn->out_len - conn->out_sent >= REPLICATION_MAX_BACKLOG)
+        return STATUS_SUCCESS;
+
+    size_t capacity = REPLICATION_BATCH_SIZE;
+    unsigned char *buf = malloc(capacity);
+    if (!buf)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate batch: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    unsigned char *cursor = buf;
+    int status = STATUS_SUCCESS;
+    for (size_t pos = changelog_find(log, conn->shipped_seq); pos < log->count && status == STATUS_SUCCESS; pos++)
+    {
+        status = replication_encode_change(&buf, &cursor, &capacity, changelog_get(log, pos), log->last_seq);
+        if (status == STATUS_SUCCESS && (size_t)(cursor - buf) >= REPLICATION_BATCH_SIZE)
+            status = replication_flush(conn, buf, &cursor);
+    }
+    if (status == STATUS_SUCCESS)
+        status = replication_flush(conn, buf, &cursor);
+    if (status == STATUS_SUCCESS)
+        conn->shipped_seq = log->last_seq;
+
+    free(buf);
+    return status;
+}
+
+// applies a change of the primary, the records of the copy are applied without being logged
+static int replica_apply(db_shards *s, change *c, uint64_t head_seq, bool copy)
+{
+    database *db = db_shard_for(s, c->name);
+    size_t idx;
+    if (c->type == CHANGE_ADD)
+    {
+        employee e = { .name=strdup(c->name), .address=strdup(c->address), .hours=c->hours };
+        if (!e.name || !e.address || db_add_employee(db, &e) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d unable to add '%s'\n", __FILE__, __FUNCTION__, __LINE__, c->name);
+            return STATUS_ERROR;
+        }
+    }
+    else if (db_find_employee(db, c->name, &idx) == STATUS_ERROR)
+    {
+        // the copy has diverged from the primary
+        fprintf(stderr, "%s:%s:%d change %lu of the primary names unknown employee '%s'\n", __FILE__, __FUNCTION__, __LINE__, (unsigned long)c->seq, c->name);
+        return STATUS_ERROR;
+    }
+    else if ((c->type == CHANGE_UPDATE && db_update_hours(db, idx, c->hours) == STATUS_ERROR) ||
+        (c->type == CHANGE_DELETE && db_delete_employee(db, idx) == STATUS_ERROR))
+    {
+        return STATUS_ERROR;
+    }
+
+    if (copy)
+        return STATUS_SUCCESS;
+    if (changelog_append(&s->changes, c->seq, c->time_us, c->type, c->name, c->address, c->hours) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // how far the primary is ahead, in changes and in time for the last one applied
+    uint64_t now = changelog_now_us();
+    s->replication.primary_seq = head_seq;
+    s->replication.lag_us = now > c->time_us ? now - c->time_us : 0;
+    return STATUS_SUCCESS;
+}
+
+// reads and applies one whole message of the given type
+static int replica_receive_message(replica *r, db_shards *s, proto_msg type, bool copy)
+{
+    unsigned char header[REPLICATION_HEADER_SIZE];
+    if (receive_all(r->fd, header, REPLICATION_HEADER_SIZE, 0) != REPLICATION_HEADER_SIZE)
+    {
+        fprintf(stderr, "%s:%s:%d unable to receive message from primary\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    uint32_t data_len = ntohl(*(uint32_t *)(header + sizeof(proto_msg)));
+    if (*(proto_msg *)header != type || data_len > REPLICATION_MAX_MESSAGE)
+    {
+        fprintf(stderr, "%s:%s:%d unexpected message from primary\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    if (data_len > r->buf_capacity)
+    {
+        unsigned char *buf = realloc(r->buf, data_len);
+        if (!buf)
+        {
+            fprintf(stderr, "%s:%s:%d unable to grow receive buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        r->buf = buf;
+        r->buf_capacity = data_len;
+    }
+    if (receive_all(r->fd, r->buf, data_len, 0) != (int)data_len)
+    {
+        fprintf(stderr, "%s:%s:%d unable to receive message from primary\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (type == REPLICATION_RESPONSE)
+        return data_len == REPLICATION_RESPONSE_SIZE ? STATUS_SUCCESS : STATUS_ERROR;
+
+    change c;
+    uint64_t head_seq;
+    if (replication_decode_change(r->buf, data_len, &c, &head_seq) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d invalid change from primary\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    return replica_apply(s, &c, head_seq, copy);
+}
+
+int replica_connect(replica *r, char *host, char *port, uint16_t protocol_version, db_shards *s)
+{
+    *r = (replica) { .fd=-1, .host=host, .port=port, .protocol_version=protocol_version };
+    if ((r->fd = get_socket(host, port)) == STATUS_ERROR || send_handshake(r->fd, protocol_version) == STATUS_ERROR ||
+        receive_handshake(r->fd) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to connect to primary %s:%s\n", __FILE__, __FUNCTION__, __LINE__, host, port);
+        free_replica(r);
+        return STATUS_ERROR;
+    }
+
+    // only the request is framed as negotiated, the copy and the changes keep their own framing
+    if (send_request(r->fd, protocol_version, REPLICATION_REQUEST, 1, NULL, 0, MSG_NOSIGNAL) == STATUS_ERROR ||
+        replica_receive_message(r, s, REPLICATION_RESPONSE, true) == STATUS_ERROR)
+    {
+        free_replica(r);
+        return STATUS_ERROR;
+    }
+
+    // the copy is received in full before any request is served, the changes after it as they arrive
+    uint64_t seq = be64toh(*(uint64_t *)r->buf);
+    uint32_t count = ntohl(*(uint32_t *)(r->buf + sizeof(uint64_t)));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (replica_receive_message(r, s, REPLICATION_CHANGE, true) == STATUS_ERROR)
+        {
+            free_replica(r);
+            return STATUS_ERROR;
+        }
+    }
+
+    changelog_reset(&s->changes, seq);
+    s->replication.primary_seq = seq;
+    s->replication.lag_us = 0;
+    r->buf_len = 0;
+    return STATUS_SUCCESS;
+}
+
+// drops the records and the connection after a change went missing, and starts over from a new copy
+static int replica_resync(replica *r, db_shards *s)
+{
+    char *host = r->host;
+    char *port = r->port;
+    uint16_t protocol_version = r->protocol_version;
+    free_replica(r);
+    if (db_shards_clear(s) == STATUS_ERROR)
+        return STATUS_ERROR;
+    return replica_connect(r, host, port, protocol_version, s);
+}
+
+int replica_receive(replica *r, db_shards *s)
+{
+    if (r->buf_len == r->buf_capacity)
+    {
+        size_t capacity = r->buf_capacity ? 2 * r->buf_capacity : REPLICATION_BATCH_SIZE;
+        unsigned char *buf = realloc(r->buf, capacity);
+        if (!buf)
+        {
+            fprintf(stderr, "%s:%s:%d unable to grow receive buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        r->buf = buf;
+        r->buf_capacity = capacity;
+    }
+
+    ssize_t nbytes_read = recv(r->fd, r->buf + r->buf_len, r->buf_capacity - r->buf_len, 0);
+    if (nbytes_read == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to receive from primary: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    if (nbytes_read == 0)
+        return 0;
+    r->buf_len += nbytes_read;
+
+    // apply every whole message, a partial one waits for the rest of its bytes
+    size_t pos = 0;
+    while (r->buf_len - pos >= REPLICATION_HEADER_SIZE)
+    {
+        unsigned char *header = r->buf + pos;
+        uint32_t data_len = ntohl(*(uint32_t *)(header + sizeof(proto_msg)));
+        if (*(proto_msg *)header != REPLICATION_CHANGE || data_len > REPLICATION_MAX_MESSAGE)
+        {
+            fprintf(stderr, "%s:%s:%d unexpected message from primary\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+        if (r->buf_len - pos < REPLICATION_HEADER_SIZE + data_len)
+            break;
+
+        change c;
+        uint64_t head_seq;
+        if (replication_decode_change(header + REPLICATION_HEADER_SIZE, data_len, &c, &head_seq) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d invalid change from primary\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+
+        // applying across a gap would leave the copy diverged from the primary without either noticing, the
+        // rest of the buffer belongs to the connection being replaced
+        if (c.seq != s->changes.last_seq + 1)
+        {
+            fprintf(stderr, "%s:%s:%d change %lu of the primary does not follow change %lu, starting over\n", __FILE__, __FUNCTION__, __LINE__,
+                (unsigned long)c.seq, (unsigned long)s->changes.last_seq);
+            return replica_resync(r, s) == STATUS_ERROR ? STATUS_ERROR : (int)nbytes_read;
+        }
+        if (replica_apply(s, &c, head_seq, false) == STATUS_ERROR)
+            return STATUS_ERROR;
+        pos += REPLICATION_HEADER_SIZE + data_len;
+    }
+
+    memmove(r->buf, r->buf + pos, r->buf_len - pos);
+    r->buf_len -= pos;
+    return (int)nbytes_read;
+}
+
+void free_replica(replica *r)
+{
+    if (r->fd != -1)
+        close(r->fd);
+    free(r->buf);
+    *r = (replica) { .fd=-1 };
+}
@@ -7,11 +7,17 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 
 #include "common.h"
 #include "serialize.h"
+#include "name_index.h"
+#include "string_pool.h"
+#include "lz.h"
+#include "checksums.h"
 
 int write_all(int fd, void *buf, size_t buf_size)
 {
@@ -160,6 +166,13 @@ int fserialize_employee(int fd, employee *e)
 
 
 int fdeserialize_employee(int fd, employee *e)
+{
+    // records that reference an address dictionary cannot be read without it
+    return fdeserialize_record(fd, e, NULL);
+}
+
+
+int fdeserialize_record(int fd, employee *e, db_dictionary *dictionary)
 {
     // deserialize name
     uint16_t name_len;
@@ -192,13 +205,35 @@ int fdeserialize_employee(int fd, employee *e)
     // convert back to host endianess
     address_len = ntohs(address_len);
 
-    // read address from file
-    char *address = malloc(address_len); 
-    if (read(fd, address, address_len) != address_len)
+    char *address;
+    if (address_len == 0)
     {
-        fprintf(stderr, "%s:%s:%d - error reading address from database file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
-        return STATUS_ERROR;
+        // copy the address from the dictionary
+        uint32_t address_ref;
+        if (read(fd, &address_ref, sizeof(uint32_t)) != sizeof(uint32_t))
+        {
+            fprintf(stderr, "%s:%s:%d - error reading address reference from database file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+
+        address_ref = ntohl(address_ref);
+        if (!dictionary || address_ref >= dictionary->count)
+        {
+            fprintf(stderr, "%s:%s:%d - corrupted data, address reference %u without a dictionary entry\n", __FILE__, __FUNCTION__, __LINE__, address_ref);
+            return STATUS_ERROR;
+        }
+        address = strdup(dictionary->addresses[address_ref]);
+    }
+    else
+    {
+        // read address from file
+        address = malloc(address_len); 
+        if (read(fd, address, address_len) != address_len)
+        {
+            fprintf(stderr, "%s:%s:%d - error reading address from database file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
 
+        }
     }
     
     // deserialize hours
@@ -233,49 +268,714 @@ int write_new_file_hdr(int fd)
 
 int write_db(int fd, db_header *dbhdr, employee *employees)
 {
-	// change file cursor byte right after file header
-	if (lseek(fd, sizeof(db_header), SEEK_SET) == -1)
-	{
-		fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
-		return STATUS_ERROR;
-	}
-
-	// write employees to file
-	int nbytes_written = write_employees(fd, employees, dbhdr->employee_count);
-	if (nbytes_written == -1)
-	{
-		fprintf(stderr, "%s:%s:%d write_employees faile()\n", __FILE__, __FUNCTION__, __LINE__);
-		return STATUS_ERROR;
-	}
-
-	// record size of file
-	dbhdr->fsize = sizeof(db_header) + nbytes_written;
-	
-	// Convert to network byte order
-	dbhdr->fsize = htonl(dbhdr->fsize);
-	dbhdr->employee_count = htonl(dbhdr->employee_count);
-
-	// change file cursor to beginning of file
-	if (lseek(fd, 0, SEEK_SET) == -1)
-	{
-		fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
-		return STATUS_ERROR;
-	}
-
-	// now write header to file
-	if (write(fd, dbhdr, sizeof(db_header)) == -1)
-	{
-		fprintf(stderr, "%s:%s:%d unable to write header to file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
-		return STATUS_ERROR;
-	}
-
-    // conver back to host byte order
-	dbhdr->fsize = ntohl(dbhdr->fsize);
-	dbhdr->employee_count = ntohl(dbhdr->employee_count);
-
-	return STATUS_SUCCESS;
+    // plain database file without any optional sections
+    return checkpoint_db(fd, dbhdr, employees, 0);
+}
+
+// writes the address dictionary, returns its length and the dictionary index of every record in refs
+static int checkpoint_db_dictionary(int fd, employee *employees, size_t employees_size, uint32_t **refs)
+{
+    // number the distinct addresses in order of first use
+    string_pool pool;
+    if (string_pool_init(&pool) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    *refs = malloc((employees_size ? employees_size : 1) * sizeof(uint32_t));
+    char **addresses = malloc((employees_size ? employees_size : 1) * sizeof(char *));
+    uint32_t count = 0;
+    int status = STATUS_ERROR;
+    if (!*refs || !addresses)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate address dictionary: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        goto out;
+    }
+
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        string_pool_entry *entry = string_pool_find(&pool, employees[i].address);
+        if (!entry)
+        {
+            char *address = strdup(employees[i].address);
+            if (!address || !string_pool_intern(&pool, address) || !(entry = string_pool_find(&pool, address)))
+                goto out;
+            entry->index = count;
+            addresses[count++] = entry->str;
+        }
+        (*refs)[i] = entry->index;
+    }
+
+    status = write_db_dictionary(fd, addresses, count);
+
+out:
+    if (status == STATUS_ERROR)
+    {
+        free(*refs);
+        *refs = NULL;
+    }
+    free(addresses);
+    free_string_pool(&pool);
+    return status;
+}
+
+static size_t encoded_record_size(employee *e, uint32_t address_ref)
+{
+    size_t size = 2 * sizeof(uint16_t) + strlen(e->name) + 1 + sizeof(uint32_t);
+    return size + (address_ref == DB_ADDRESS_INLINE ? strlen(e->address) + 1 : sizeof(uint32_t));
+}
+
+// compresses the records of a block, returns the length of the block and points block at its bytes, which are the
+// records themselves when they do not shrink
+int compress_db_block(const unsigned char *raw, size_t raw_len, unsigned char *compressed, size_t compressed_cap, const unsigned char **block)
+{
+    int length = lz_compress(raw, raw_len, compressed, compressed_cap);
+    if (length == STATUS_ERROR)
+        return STATUS_ERROR;
+    if ((size_t)length >= raw_len)
+    {
+        *block = raw;
+        return (int)raw_len;
+    }
+    *block = compressed;
+    return length;
+}
+
+// writes the block index at the file cursor, then the tombstones of the records in the blocks and the blocks
+// themselves, returns the length of the blocks
+static int write_db_blocks(int fd, employee *employees, size_t employees_size, uint32_t *refs, db_section *index, db_section *tombstones)
+{
+    // split the records into blocks first, so that the index can be written ahead of them
+    size_t block_count = 0;
+    size_t raw_len = 0;
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        raw_len += encoded_record_size(employees + i, refs ? refs[i] : DB_ADDRESS_INLINE);
+        if (raw_len >= DB_BLOCK_SIZE || i == employees_size - 1)
+        {
+            block_count++;
+            raw_len = 0;
+        }
+    }
+
+    off_t index_offset = lseek(fd, 0, SEEK_CUR);
+    size_t index_len = sizeof(uint32_t) + block_count * sizeof(db_block);
+    size_t tombstones_len = (employees_size + 7) / 8;
+    uint32_t *entries = malloc(index_len);
+    unsigned char *raw = malloc(DB_BLOCK_RAW_CAPACITY);
+    size_t compressed_cap = lz_compress_bound(DB_BLOCK_RAW_CAPACITY);
+    unsigned char *compressed = malloc(compressed_cap);
+    unsigned char *bits = calloc(tombstones_len ? tombstones_len : 1, 1);
+    int status = STATUS_ERROR;
+    if (index_offset == -1 || !entries || !raw || !compressed || !bits)
+    {
+        fprintf(stderr, "%s:%s:%d unable to set up block index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        goto out;
+    }
+
+    // no record is deleted yet
+    uint32_t offset = (uint32_t)(index_offset + index_len);
+    if (pwrite(fd, bits, tombstones_len, offset) != (ssize_t)tombstones_len)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write block tombstones: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        goto out;
+    }
+    *tombstones = (db_section) { .type=DB_SECTION_BLOCK_TOMBSTONES, .offset=offset, .length=(uint32_t)tombstones_len };
+    offset += tombstones_len;
+    if (lseek(fd, offset, SEEK_SET) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        goto out;
+    }
+    uint32_t blocks_start = offset;
+
+    uint32_t *entry = entries;
+    *entry++ = htonl((uint32_t)block_count);
+    raw_len = 0;
+    uint32_t record_count = 0;
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        raw_len += encode_employee_record(employees + i, refs ? refs[i] : DB_ADDRESS_INLINE, raw + raw_len);
+        record_count++;
+        if (raw_len < DB_BLOCK_SIZE && i != employees_size - 1)
+            continue;
+
+        const unsigned char *block;
+        int length = compress_db_block(raw, raw_len, compressed, compressed_cap, &block);
+        if (length == STATUS_ERROR)
+            goto out;
+        if (write_all(fd, (void *)block, length) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d unable to write block\n", __FILE__, __FUNCTION__, __LINE__);
+            goto out;
+        }
+
+        *entry++ = htonl(offset);
+        *entry++ = htonl((uint32_t)length);
+        *entry++ = htonl((uint32_t)raw_len);
+        *entry++ = htonl(record_count);
+        offset += length;
+        raw_len = 0;
+        record_count = 0;
+    }
+
+    if (pwrite(fd, entries, index_len, index_offset) != (ssize_t)index_len)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write block index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        goto out;
+    }
+
+    *index = (db_section) { .type=DB_SECTION_BLOCKS, .offset=(uint32_t)index_offset, .length=(uint32_t)index_len };
+    status = (int)(offset - blocks_start);
+
+out:
+    free(entries);
+    free(raw);
+    free(compressed);
+    free(bits);
+    return status;
+}
+
+int checkpoint_db(int fd, db_header *dbhdr, employee *employees, int flags)
+{
+    // change file cursor byte right after file header
+    if (lseek(fd, sizeof(db_header), SEEK_SET) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // record offsets are needed by the offset directory and the name index, records inside compressed blocks have none
+    uint32_t *offsets = NULL;
+    if ((flags & (DB_CHECKPOINT_OFFSETS | DB_CHECKPOINT_NAME_INDEX)) && dbhdr->employee_count > 0)
+    {
+        offsets = calloc(dbhdr->employee_count, sizeof(uint32_t));
+        if (!offsets)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate offset directory: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+    }
+
+    // the address dictionary and the block index precede the records so that appended records never overwrite them
+    uint32_t fsize = sizeof(db_header);
+    uint32_t *refs = NULL;
+    db_section dictionary = { .type=DB_SECTION_ADDRESSES, .offset=fsize, .length=0 };
+    if (flags & DB_CHECKPOINT_ADDRESS_DICTIONARY)
+    {
+        int nbytes = checkpoint_db_dictionary(fd, employees, dbhdr->employee_count, &refs);
+        if (nbytes == STATUS_ERROR)
+        {
+            free(offsets);
+            return STATUS_ERROR;
+        }
+        dictionary.length = nbytes;
+        fsize += nbytes;
+    }
+
+    db_section blocks = { 0 };
+    db_section tombstones = { 0 };
+    uint32_t records_start = fsize;
+    if (flags & DB_CHECKPOINT_COMPRESSED)
+    {
+        int nbytes = write_db_blocks(fd, employees, dbhdr->employee_count, refs, &blocks, &tombstones);
+        if (nbytes == STATUS_ERROR)
+        {
+            free(refs);
+            free(offsets);
+            return STATUS_ERROR;
+        }
+        records_start = tombstones.offset + tombstones.length;
+        fsize = records_start + nbytes;
+    }
+    else
+    {
+        // write employees to file, recording the offset of each record
+        unsigned char *record = NULL;
+        for (size_t i = 0; i < dbhdr->employee_count; i++)
+        {
+            if (offsets)
+                offsets[i] = fsize;
+
+            int nbytes;
+            if (refs)
+            {
+                unsigned char *p = realloc(record, encoded_record_size(employees + i, refs[i]));
+                if (!p)
+                {
+                    fprintf(stderr, "%s:%s:%d unable to allocate record: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+                    nbytes = STATUS_ERROR;
+                }
+                else
+                {
+                    record = p;
+                    nbytes = encode_employee_record(employees + i, refs[i], record);
+                    if (write_all(fd, record, nbytes) == STATUS_ERROR)
+                        nbytes = STATUS_ERROR;
+                }
+            }
+            else
+                nbytes = fserialize_employee(fd, employees + i);
+
+            if (nbytes == STATUS_ERROR)
+            {
+                fprintf(stderr, "%s:%s:%d unable to write employee record\n", __FILE__, __FUNCTION__, __LINE__);
+                free(record);
+                free(refs);
+                free(offsets);
+                return STATUS_ERROR;
+            }
+            fsize += nbytes;
+        }
+        free(record);
+    }
+    free(refs);
+
+    // write optional sections followed by the section table
+    if (flags)
+    {
+        db_section sections[DB_MAX_SECTIONS];
+        size_t section_count = 0;
+        if (flags & DB_CHECKPOINT_ADDRESS_DICTIONARY)
+            sections[section_count++] = dictionary;
+        if (flags & DB_CHECKPOINT_COMPRESSED)
+        {
+            sections[section_count++] = blocks;
+            sections[section_count++] = tombstones;
+        }
+        uint32_t records_end = fsize;
+        sections[section_count++] = (db_section) { .type=DB_SECTION_RECORDS, .offset=records_start, .length=records_end - records_start };
+
+        // the name index is built before the directory is converted to network byte order
+        name_index names = { 0 };
+        if ((flags & DB_CHECKPOINT_NAME_INDEX) && name_index_build(&names, employees, offsets, dbhdr->employee_count) == STATUS_ERROR)
+        {
+            free(offsets);
+            return STATUS_ERROR;
+        }
+
+        // the records of compressed blocks have no file offset to put in a directory
+        if ((flags & DB_CHECKPOINT_OFFSETS) && !(flags & DB_CHECKPOINT_COMPRESSED))
+        {
+            uint32_t directory_len = dbhdr->employee_count * sizeof(uint32_t);
+            for (size_t i = 0; i < dbhdr->employee_count; i++)
+                offsets[i] = htonl(offsets[i]);
+
+            if (offsets && write_all(fd, offsets, directory_len) == STATUS_ERROR)
+            {
+                fprintf(stderr, "%s:%s:%d unable to write offset directory\n", __FILE__, __FUNCTION__, __LINE__);
+                free_name_index(&names);
+                free(offsets);
+                return STATUS_ERROR;
+            }
+            sections[section_count++] = (db_section) { .type=DB_SECTION_OFFSETS, .offset=fsize, .length=directory_len };
+            fsize += directory_len;
+        }
+
+        if (flags & DB_CHECKPOINT_NAME_INDEX)
+        {
+            int nbytes = name_index_write(&names, fd, fsize, sections + section_count);
+            free_name_index(&names);
+            if (nbytes == STATUS_ERROR)
+            {
+                fprintf(stderr, "%s:%s:%d unable to write name index\n", __FILE__, __FUNCTION__, __LINE__);
+                free(offsets);
+                return STATUS_ERROR;
+            }
+            section_count++;
+            fsize += nbytes;
+        }
+
+        // checksums cover everything from the header to the end of the records, sections written after them are not covered
+        if (flags & DB_CHECKPOINT_CHECKSUMS)
+        {
+            db_checksums checksums;
+            if (db_checksums_compute(&checksums, fd, sizeof(db_header), records_end) == STATUS_ERROR)
+            {
+                free(offsets);
+                return STATUS_ERROR;
+            }
+            int nbytes = write_db_checksums(&checksums, fd, fsize, sections + section_count);
+            free_db_checksums(&checksums);
+            if (nbytes == STATUS_ERROR)
+            {
+                free(offsets);
+                return STATUS_ERROR;
+            }
+            section_count++;
+            fsize += nbytes;
+        }
+
+        int nbytes = write_db_footer(fd, sections, section_count);
+        if (nbytes == STATUS_ERROR)
+        {
+            free(offsets);
+            return STATUS_ERROR;
+        }
+        fsize += nbytes;
+    }
+    free(offsets);
+
+    // record size of file and convert to network byte order
+    dbhdr->fsize = fsize;
+    db_header hdr = { .fsize=htonl(dbhdr->fsize), .employee_count=htonl(dbhdr->employee_count | (flags ? DB_HEADER_SECTIONS : 0)) };
+
+    // now write header to beginning of file
+    if (pwrite(fd, &hdr, sizeof(db_header), 0) != sizeof(db_header))
+    {
+        fprintf(stderr, "%s:%s:%d unable to write header to file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // discard anything left over from a previously larger file
+    if (ftruncate(fd, fsize) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d ftruncate() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+int write_db_footer(int fd, db_section *sections, size_t section_count)
+{
+    // section table followed by the footer, all in network byte order
+    size_t table_len = section_count * sizeof(db_section) + sizeof(db_footer);
+    uint32_t *table = malloc(table_len);
+    if (!table)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate section table: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    uint32_t *p = table;
+    for (size_t i = 0; i < section_count; i++)
+    {
+        *p++ = htonl(sections[i].type);
+        *p++ = htonl(sections[i].offset);
+        *p++ = htonl(sections[i].length);
+    }
+    *p++ = htonl((uint32_t)section_count);
+    *p++ = htonl(DB_FOOTER_MAGIC);
+
+    if (write_all(fd, table, table_len) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write section table\n", __FILE__, __FUNCTION__, __LINE__);
+        free(table);
+        return STATUS_ERROR;
+    }
+
+    free(table);
+    return (int)table_len;
+}
+
+int read_db_sections(int fd, db_header *dbhdr, db_section *sections, size_t *section_count)
+{
+    *section_count = 0;
+
+    // only a header marked as having them is followed by a footer, the tail of any other file is its last record
+    db_header hdr;
+    if (pread(fd, &hdr, sizeof(db_header), 0) != sizeof(db_header))
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read header from file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    if (!(ntohl(hdr.employee_count) & DB_HEADER_SECTIONS))
+        return STATUS_SUCCESS;
+
+    db_footer footer;
+    if (dbhdr->fsize < sizeof(db_header) + sizeof(db_footer) ||
+        pread(fd, &footer, sizeof(db_footer), dbhdr->fsize - sizeof(db_footer)) != sizeof(db_footer))
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read footer from file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    if (ntohl(footer.magic) != DB_FOOTER_MAGIC)
+    {
+        fprintf(stderr, "%s:%s:%d - corrupted data, the header has sections but the file ends without a footer\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    uint32_t count = ntohl(footer.section_count);
+    size_t table_len = count * sizeof(db_section);
+    if (count > DB_MAX_SECTIONS || table_len + sizeof(db_footer) + sizeof(db_header) > dbhdr->fsize)
+    {
+        fprintf(stderr, "%s:%s:%d - corrupted data, invalid section count %u\n", __FILE__, __FUNCTION__, __LINE__, count);
+        return STATUS_ERROR;
+    }
+
+    uint32_t table_offset = dbhdr->fsize - sizeof(db_footer) - table_len;
+    if (pread(fd, sections, table_len, table_offset) != (ssize_t)table_len)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read section table from file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // convert to host byte order and validate every section lies before the table
+    for (size_t i = 0; i < count; i++)
+    {
+        sections[i].type = ntohl(sections[i].type);
+        sections[i].offset = ntohl(sections[i].offset);
+        sections[i].length = ntohl(sections[i].length);
+        if (sections[i].offset < sizeof(db_header) || sections[i].offset > table_offset || sections[i].length > table_offset - sections[i].offset)
+        {
+            fprintf(stderr, "%s:%s:%d - corrupted data, section %u out of bounds\n", __FILE__, __FUNCTION__, __LINE__, sections[i].type);
+            return STATUS_ERROR;
+        }
+    }
+
+    *section_count = count;
+    return STATUS_SUCCESS;
+}
+
+db_section *find_db_section(db_section *sections, size_t section_count, uint32_t type)
+{
+    for (size_t i = 0; i < section_count; i++)
+    {
+        if (sections[i].type == type)
+            return sections + i;
+    }
+    return NULL;
+}
+
+int read_offset_directory(int fd, db_section *directory, uint32_t **offsets, size_t employees_size)
+{
+    if (directory->length != employees_size * sizeof(uint32_t))
+    {
+        fprintf(stderr, "%s:%s:%d - corrupted data, offset directory has %zu entries for %zu employees\n", __FILE__, __FUNCTION__, __LINE__, directory->length / sizeof(uint32_t), employees_size);
+        return STATUS_ERROR;
+    }
+
+    *offsets = malloc(directory->length ? directory->length : 1);
+    if (!*offsets)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to allocate offset directory: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    if (pread(fd, *offsets, directory->length, directory->offset) != (ssize_t)directory->length)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read offset directory: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(*offsets);
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < employees_size; i++)
+        (*offsets)[i] = ntohl((*offsets)[i]);
+
+    return STATUS_SUCCESS;
+}
+
+int seek_employee(int fd, db_section *sections, size_t section_count, size_t idx)
+{
+    db_section *records = find_db_section(sections, section_count, DB_SECTION_RECORDS);
+    off_t offset = records ? records->offset : sizeof(db_header);
+    size_t start = 0;
+
+    // the offset directory covers every record written by the last checkpoint, records
+    // appended since then are reached by skipping forward from the last covered one
+    db_section *directory = find_db_section(sections, section_count, DB_SECTION_OFFSETS);
+    size_t covered = directory ? directory->length / sizeof(uint32_t) : 0;
+    if (covered > 0)
+    {
+        start = idx < covered ? idx : covered - 1;
+
+        uint32_t directory_offset;
+        if (pread(fd, &directory_offset, sizeof(uint32_t), directory->offset + start * sizeof(uint32_t)) != sizeof(uint32_t))
+        {
+            fprintf(stderr, "%s:%s:%d - unable to read offset directory: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        offset = ntohl(directory_offset);
+    }
+
+    // skip over the remaining preceding records using only their length fields
+    for (size_t i = start; i < idx; i++)
+    {
+        uint16_t len;
+        for (int field = 0; field < 2; field++)
+        {
+            if (pread(fd, &len, sizeof(uint16_t), offset) != sizeof(uint16_t))
+            {
+                fprintf(stderr, "%s:%s:%d - unable to read record length: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+                return STATUS_ERROR;
+            }
+            offset += sizeof(uint16_t) + ntohs(len);
+        }
+
+        // an address length of 0 is followed by a dictionary reference
+        offset += len ? sizeof(uint32_t) : 2 * sizeof(uint32_t);
+    }
+
+    if (lseek(fd, offset, SEEK_SET) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int write_db_dictionary(int fd, char **addresses, uint32_t count)
+{
+    // number of addresses followed by each length prefixed address, including its null terminator
+    size_t dictionary_len = sizeof(uint32_t);
+    for (uint32_t i = 0; i < count; i++)
+        dictionary_len += sizeof(uint16_t) + strlen(addresses[i]) + 1;
+
+    unsigned char *dictionary = malloc(dictionary_len);
+    if (!dictionary)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate address dictionary: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    unsigned char *p = dictionary;
+    *(uint32_t *)p = htonl(count);
+    p += sizeof(uint32_t);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint16_t address_len = strlen(addresses[i]) + 1;
+        *(uint16_t *)p = htons(address_len);
+        p += sizeof(uint16_t);
+        memcpy(p, addresses[i], address_len);
+        p += address_len;
+    }
+
+    int status = write_all(fd, dictionary, dictionary_len);
+    free(dictionary);
+    if (status == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write address dictionary\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    return (int)dictionary_len;
 }
 
+int read_db_dictionary(int fd, db_section *section, db_dictionary *dictionary)
+{
+    dictionary->addresses = NULL;
+    dictionary->count = 0;
+
+    // an empty section only records that a dictionary is wanted
+    if (section->length == 0)
+        return STATUS_SUCCESS;
+
+    unsigned char *buf = malloc(section->length);
+    if (!buf)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate address dictionary: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    if (section->length < sizeof(uint32_t) || pread(fd, buf, section->length, section->offset) != (ssize_t)section->length)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read address dictionary: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(buf);
+        return STATUS_ERROR;
+    }
+
+    // every entry needs at least its length and a null terminator
+    uint32_t count = ntohl(*(uint32_t *)buf);
+    if (count > (section->length - sizeof(uint32_t)) / (sizeof(uint16_t) + 1))
+    {
+        fprintf(stderr, "%s:%s:%d - corrupted data, invalid address dictionary size %u\n", __FILE__, __FUNCTION__, __LINE__, count);
+        free(buf);
+        return STATUS_ERROR;
+    }
+
+    dictionary->addresses = calloc(count ? count : 1, sizeof(char *));
+    if (!dictionary->addresses)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate address dictionary: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(buf);
+        return STATUS_ERROR;
+    }
+
+    const unsigned char *p = buf + sizeof(uint32_t), *end = buf + section->length;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint16_t address_len = end - p >= (ptrdiff_t)sizeof(uint16_t) ? ntohs(*(uint16_t *)p) : 0;
+        p += sizeof(uint16_t);
+        if (address_len == 0 || end - p < address_len || !(dictionary->addresses[i] = malloc(address_len)))
+        {
+            fprintf(stderr, "%s:%s:%d - corrupted data, unable to read address %u of the dictionary\n", __FILE__, __FUNCTION__, __LINE__, i);
+            free(buf);
+            free_db_dictionary(dictionary);
+            return STATUS_ERROR;
+        }
+
+        memcpy(dictionary->addresses[i], p, address_len);
+        dictionary->addresses[i][address_len - 1] = '\0';
+        dictionary->count++;
+        p += address_len;
+    }
+
+    free(buf);
+    return STATUS_SUCCESS;
+}
+
+void free_db_dictionary(db_dictionary *dictionary)
+{
+    for (uint32_t i = 0; i < dictionary->count; i++)
+        free(dictionary->addresses[i]);
+    free(dictionary->addresses);
+    dictionary->addresses = NULL;
+    dictionary->count = 0;
+}
+
+int read_db_blocks(int fd, db_section *section, db_block **blocks, size_t *block_count)
+{
+    // an empty section only records that blocks are wanted
+    *blocks = NULL;
+    *block_count = 0;
+    if (section->length == 0)
+        return STATUS_SUCCESS;
+
+    uint32_t count;
+    if (section->length < sizeof(uint32_t) || pread(fd, &count, sizeof(uint32_t), section->offset) != sizeof(uint32_t))
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read block index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    count = ntohl(count);
+    if (section->length != sizeof(uint32_t) + (uint64_t)count * sizeof(db_block))
+    {
+        fprintf(stderr, "%s:%s:%d - corrupted data, block index of %u bytes has %u blocks\n", __FILE__, __FUNCTION__, __LINE__, section->length, count);
+        return STATUS_ERROR;
+    }
+
+    *blocks = malloc(count ? count * sizeof(db_block) : 1);
+    if (!*blocks)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to allocate block index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    if (pread(fd, *blocks, count * sizeof(db_block), section->offset + sizeof(uint32_t)) != (ssize_t)(count * sizeof(db_block)))
+    {
+        fprintf(stderr, "%s:%s:%d - unable to read block index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(*blocks);
+        return STATUS_ERROR;
+    }
+
+    // a stored block has the same length compressed and raw, a compressed one has to shrink
+    for (uint32_t b = 0; b < count; b++)
+    {
+        db_block *block = *blocks + b;
+        block->offset = ntohl(block->offset);
+        block->length = ntohl(block->length);
+        block->raw_length = ntohl(block->raw_length);
+        block->record_count = ntohl(block->record_count);
+        if (block->length > block->raw_length)
+        {
+            fprintf(stderr, "%s:%s:%d - corrupted data, block %u grew when compressed\n", __FILE__, __FUNCTION__, __LINE__, b);
+            free(*blocks);
+            return STATUS_ERROR;
+        }
+    }
+
+    *block_count = count;
+    return STATUS_SUCCESS;
+}
 
 
 int write_employees(int fd, employee *employees, size_t employees_size)
@@ -295,16 +995,415 @@ int write_employees(int fd, employee *employees, size_t employees_size)
 }
 
 int read_employees(int fd, employee **employees, size_t employees_size)
+{
+    return read_records(fd, employees, employees_size, NULL);
+}
+
+int read_records(int fd, employee **employees, size_t employees_size, db_dictionary *dictionary)
 {
     for (size_t i = 0; i < employees_size; i++)
     {
-        if (fdeserialize_employee(fd, *employees + i) == STATUS_ERROR)  
+        if (fdeserialize_record(fd, *employees + i, dictionary) == STATUS_ERROR)  
             return STATUS_ERROR;
     }
     
     return STATUS_SUCCESS;
 }
 
+int encode_employee_record(employee *e, uint32_t address_ref, unsigned char *record)
+{
+    unsigned char *p = record;
+
+    // write name length and name, including its null terminator
+    uint16_t name_len = strlen(e->name) + 1;
+    *(uint16_t *)p = htons(name_len);
+    p += sizeof(uint16_t);
+    memcpy(p, e->name, name_len);
+    p += name_len;
+
+    // write address length and address, including its null terminator, or a zero length and the dictionary index
+    if (address_ref == DB_ADDRESS_INLINE)
+    {
+        uint16_t address_len = strlen(e->address) + 1;
+        *(uint16_t *)p = htons(address_len);
+        p += sizeof(uint16_t);
+        memcpy(p, e->address, address_len);
+        p += address_len;
+    }
+    else
+    {
+        *(uint16_t *)p = 0;
+        p += sizeof(uint16_t);
+        *(uint32_t *)p = htonl(address_ref);
+        p += sizeof(uint32_t);
+    }
+
+    // write hours
+    *(uint32_t *)p = htonl(e->hours);
+    p += sizeof(uint32_t);
+
+    return (int)(p - record);
+}
+
+int decode_employee_record(const unsigned char *record, const unsigned char *end, db_dictionary *dictionary, employee *e)
+{
+    const unsigned char *p = record;
+
+    // unpack name length and copy name
+    if (end - p < (ptrdiff_t)sizeof(uint16_t))
+        return STATUS_ERROR;
+    uint16_t name_len = ntohs(*(uint16_t *)p);
+    p += sizeof(uint16_t);
+    if (name_len == 0 || end - p < name_len + (ptrdiff_t)sizeof(uint16_t))
+        return STATUS_ERROR;
+    const unsigned char *name = p;
+    p += name_len;
+
+    // unpack address length and copy address, a zero length is followed by a dictionary index
+    uint16_t address_len = ntohs(*(uint16_t *)p);
+    p += sizeof(uint16_t);
+    const unsigned char *address;
+    if (address_len == 0)
+    {
+        if (end - p < 2 * (ptrdiff_t)sizeof(uint32_t))
+            return STATUS_ERROR;
+        uint32_t address_ref = ntohl(*(uint32_t *)p);
+        p += sizeof(uint32_t);
+        if (!dictionary || address_ref >= dictionary->count)
+            return STATUS_ERROR;
+        address = (const unsigned char *)dictionary->addresses[address_ref];
+        address_len = strlen(dictionary->addresses[address_ref]) + 1;
+    }
+    else
+    {
+        if (end - p < address_len + (ptrdiff_t)sizeof(uint32_t))
+            return STATUS_ERROR;
+        address = p;
+        p += address_len;
+    }
+
+    e->name = malloc(name_len);
+    e->address = malloc(address_len);
+    if (!e->name || !e->address)
+    {
+        free(e->name);
+        free(e->address);
+        return STATUS_ERROR;
+    }
+
+    // lengths include the null terminator, make sure it is there
+    memcpy(e->name, name, name_len);
+    e->name[name_len - 1] = '\0';
+    memcpy(e->address, address, address_len);
+    e->address[address_len - 1] = '\0';
+
+    e->hours = ntohl(*(uint32_t *)p);
+    p += sizeof(uint32_t);
+
+    return (int)(p - record);
+}
+
+struct load_range {
+    const unsigned char *map;       /* mapping of the whole database file */
+    db_dictionary *dictionary;      /* addresses referenced by records, if the file has a dictionary */
+    const unsigned char *end;       /* end of the record region */
+    const uint32_t *offsets;        /* offset of every record in the file */
+    employee *employees;
+    size_t start;
+    size_t stop;
+    const db_block *blocks;         /* compressed blocks holding the first records of the file */
+    size_t block_start;
+    size_t block_stop;
+    size_t block_record;            /* index of the first record of the block at block_start */
+    int status;
+};
+
+static int load_block_range(struct load_range *range)
+{
+    size_t raw_len = 0;
+    for (size_t b = range->block_start; b < range->block_stop; b++)
+    {
+        if (range->blocks[b].raw_length > raw_len)
+            raw_len = range->blocks[b].raw_length;
+    }
+
+    unsigned char *raw = malloc(raw_len ? raw_len : 1);
+    if (!raw)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to allocate block buffer: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    size_t i = range->block_record;
+    for (size_t b = range->block_start; b < range->block_stop; b++)
+    {
+        const db_block *block = range->blocks + b;
+        const unsigned char *p = range->map + block->offset;
+        if (block->length != block->raw_length)
+        {
+            if (lz_decompress(p, block->length, raw, block->raw_length) == STATUS_ERROR)
+            {
+                fprintf(stderr, "%s:%s:%d - corrupted data, unable to decompress block %zu\n", __FILE__, __FUNCTION__, __LINE__, b);
+                free(raw);
+                return STATUS_ERROR;
+            }
+            p = raw;
+        }
+
+        const unsigned char *end = p + block->raw_length;
+        for (uint32_t k = 0; k < block->record_count; k++, i++)
+        {
+            int nbytes = decode_employee_record(p, end, range->dictionary, range->employees + i);
+            if (nbytes == STATUS_ERROR)
+            {
+                fprintf(stderr, "%s:%s:%d - corrupted data, unable to decode record %zu\n", __FILE__, __FUNCTION__, __LINE__, i);
+                free(raw);
+                return STATUS_ERROR;
+            }
+            p += nbytes;
+        }
+    }
+
+    free(raw);
+    return STATUS_SUCCESS;
+}
+
+static void *load_employee_range(void *arg)
+{
+    struct load_range *range = arg;
+    range->status = load_block_range(range);
+    if (range->status == STATUS_ERROR)
+        return NULL;
+
+    for (size_t i = range->start; i < range->stop; i++)
+    {
+        if (decode_employee_record(range->map + range->offsets[i], range->end, range->dictionary, range->employees + i) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d - corrupted data, unable to decode record %zu\n", __FILE__, __FUNCTION__, __LINE__, i);
+            range->status = STATUS_ERROR;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+int read_employees_parallel(int fd, db_header *dbhdr, db_section *sections, size_t section_count, employee *employees, uint32_t **offsets_out, size_t nthreads)
+{
+    size_t employees_size = dbhdr->employee_count;
+    if (nthreads == 0)
+    {
+        long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = nprocs > 0 ? (size_t)nprocs : 1;
+    }
+    if (nthreads > employees_size)
+        nthreads = employees_size ? employees_size : 1;
+
+    unsigned char *map = mmap(NULL, dbhdr->fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to map database file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    madvise(map, dbhdr->fsize, MADV_SEQUENTIAL);
+
+    // records region is bounded by the records section, or by the end of a legacy file
+    db_section *records = find_db_section(sections, section_count, DB_SECTION_RECORDS);
+    uint32_t records_start = records ? records->offset : sizeof(db_header);
+    uint32_t records_end = records ? records->offset + records->length : dbhdr->fsize;
+
+    // everything up to the end of the records is checked before any of it is decoded
+    db_section *checksums_section = find_db_section(sections, section_count, DB_SECTION_CHECKSUMS);
+    if (checksums_section && checksums_section->length > 0)
+    {
+        db_checksums checksums;
+        if (read_db_checksums(&checksums, fd, checksums_section) == STATUS_ERROR)
+        {
+            munmap(map, dbhdr->fsize);
+            return STATUS_ERROR;
+        }
+        if (checksums.start != sizeof(db_header) || checksums.end != records_end)
+        {
+            fprintf(stderr, "%s:%s:%d - corrupted data, checksums do not cover the records\n", __FILE__, __FUNCTION__, __LINE__);
+            free_db_checksums(&checksums);
+            munmap(map, dbhdr->fsize);
+            return STATUS_ERROR;
+        }
+        int verified = db_checksums_verify(&checksums, map);
+        free_db_checksums(&checksums);
+        if (verified == STATUS_ERROR)
+        {
+            munmap(map, dbhdr->fsize);
+            return STATUS_ERROR;
+        }
+    }
+
+    uint32_t *offsets = malloc((employees_size ? employees_size : 1) * sizeof(uint32_t));
+    if (!offsets)
+    {
+        fprintf(stderr, "%s:%s:%d - unable to allocate record offsets: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        munmap(map, dbhdr->fsize);
+        return STATUS_ERROR;
+    }
+
+    // the first records may be held by compressed blocks, those appended since follow them uncompressed
+    db_block *blocks = NULL;
+    size_t block_count = 0;
+    size_t compressed_count = 0;
+    db_section *block_index = find_db_section(sections, section_count, DB_SECTION_BLOCKS);
+    if (block_index && read_db_blocks(fd, block_index, &blocks, &block_count) == STATUS_ERROR)
+    {
+        free(offsets);
+        munmap(map, dbhdr->fsize);
+        return STATUS_ERROR;
+    }
+
+    for (size_t b = 0; b < block_count; b++)
+    {
+        if (blocks[b].offset != records_start || blocks[b].length > records_end - records_start ||
+            blocks[b].record_count > employees_size - compressed_count)
+        {
+            fprintf(stderr, "%s:%s:%d - corrupted data, block %zu out of bounds\n", __FILE__, __FUNCTION__, __LINE__, b);
+            free(blocks);
+            free(offsets);
+            munmap(map, dbhdr->fsize);
+            return STATUS_ERROR;
+        }
+        records_start += blocks[b].length;
+        compressed_count += blocks[b].record_count;
+    }
+    for (size_t i = 0; i < compressed_count; i++)
+        offsets[i] = 0;
+
+    // a record deleted inside a block is marked in the tombstones ahead of the blocks instead
+    db_section *tombstones = find_db_section(sections, section_count, DB_SECTION_BLOCK_TOMBSTONES);
+    if (tombstones && ((uint64_t)tombstones->length * 8 < compressed_count || (uint64_t)tombstones->offset + tombstones->length > records_end))
+    {
+        fprintf(stderr, "%s:%s:%d - corrupted data, block tombstones out of bounds\n", __FILE__, __FUNCTION__, __LINE__);
+        free(blocks);
+        free(offsets);
+        munmap(map, dbhdr->fsize);
+        return STATUS_ERROR;
+    }
+
+    // take record boundaries from the offset directory, or find them by skipping over length fields
+    db_section *directory = find_db_section(sections, section_count, DB_SECTION_OFFSETS);
+    if (!block_index && directory && directory->length == employees_size * sizeof(uint32_t))
+    {
+        const uint32_t *dir = (const uint32_t *)(map + directory->offset);
+        for (size_t i = 0; i < employees_size; i++)
+        {
+            offsets[i] = ntohl(dir[i]);
+            if (offsets[i] < records_start || offsets[i] >= records_end)
+            {
+                fprintf(stderr, "%s:%s:%d - corrupted data, offset of record %zu out of bounds\n", __FILE__, __FUNCTION__, __LINE__, i);
+                free(blocks);
+                free(offsets);
+                munmap(map, dbhdr->fsize);
+                return STATUS_ERROR;
+            }
+        }
+    }
+    else
+    {
+        uint64_t offset = records_start;
+        for (size_t i = compressed_count; i < employees_size; i++)
+        {
+            offsets[i] = (uint32_t)offset;
+            uint16_t len = 0;
+            for (int field = 0; field < 2; field++)
+            {
+                if (offset + sizeof(uint16_t) > records_end)
+                    break;
+                len = ntohs(*(uint16_t *)(map + offset));
+                offset += sizeof(uint16_t) + len;
+            }
+            offset += len ? sizeof(uint32_t) : 2 * sizeof(uint32_t);
+            if (offset > records_end)
+            {
+                fprintf(stderr, "%s:%s:%d - corrupted data, record %zu extends past end of file\n", __FILE__, __FUNCTION__, __LINE__, i);
+                free(blocks);
+                free(offsets);
+                munmap(map, dbhdr->fsize);
+                return STATUS_ERROR;
+            }
+        }
+    }
+
+    // records may reference a dictionary of shared addresses
+    db_dictionary dictionary = { 0 };
+    db_section *addresses = find_db_section(sections, section_count, DB_SECTION_ADDRESSES);
+    if (addresses && read_db_dictionary(fd, addresses, &dictionary) == STATUS_ERROR)
+    {
+        free(blocks);
+        free(offsets);
+        munmap(map, dbhdr->fsize);
+        return STATUS_ERROR;
+    }
+
+    // decode an equal share of the blocks and of the uncompressed records on each thread
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+    struct load_range *ranges = malloc(nthreads * sizeof(struct load_range));
+    size_t started = 0;
+    size_t block_record = 0;
+    size_t tail_count = employees_size - compressed_count;
+    int status = STATUS_SUCCESS;
+    for (size_t t = 0; t < nthreads; t++)
+    {
+        ranges[t] = (struct load_range) {
+            .map=map, .dictionary=&dictionary, .end=map + records_end, .offsets=offsets, .employees=employees,
+            .start=compressed_count + tail_count * t / nthreads, .stop=compressed_count + tail_count * (t + 1) / nthreads,
+            .blocks=blocks, .block_start=block_count * t / nthreads, .block_stop=block_count * (t + 1) / nthreads,
+            .block_record=block_record,
+        };
+        for (size_t b = ranges[t].block_start; b < ranges[t].block_stop; b++)
+            block_record += blocks[b].record_count;
+
+        // last range is decoded on the calling thread
+        if (t == nthreads - 1)
+        {
+            load_employee_range(ranges + t);
+            break;
+        }
+
+        if ((errno = pthread_create(threads + t, NULL, load_employee_range, ranges + t)))
+        {
+            fprintf(stderr, "%s:%s:%d - pthread_create() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            ranges[nthreads - 1].status = STATUS_ERROR;
+            break;
+        }
+        started++;
+    }
+
+    for (size_t t = 0; t < started; t++)
+    {
+        pthread_join(threads[t], NULL);
+        if (ranges[t].status == STATUS_ERROR)
+            status = STATUS_ERROR;
+    }
+    if (ranges[nthreads - 1].status == STATUS_ERROR)
+        status = STATUS_ERROR;
+
+    // records marked in the block tombstones are read with an empty name, like those deleted in place
+    for (size_t i = 0; status == STATUS_SUCCESS && tombstones && i < compressed_count; i++)
+    {
+        if (map[tombstones->offset + i / 8] & (1 << (i % 8)))
+            employees[i].name[0] = '\0';
+    }
+
+    free(threads);
+    free(ranges);
+    free(blocks);
+    free_db_dictionary(&dictionary);
+    munmap(map, dbhdr->fsize);
+
+    if (status == STATUS_ERROR || !offsets_out)
+        free(offsets);
+    else
+        *offsets_out = offsets;
+
+    return status;
+}
+
 int read_dbhdr(int fd, db_header *dbhdr)
 {
 
@@ -317,7 +1416,7 @@ int read_dbhdr(int fd, db_header *dbhdr)
 
     // Read stats from file, check file sizes in bytes match
     dbhdr->fsize = ntohl(dbhdr->fsize);
-    dbhdr->employee_count = ntohl(dbhdr->employee_count);
+    dbhdr->employee_count = ntohl(dbhdr->employee_count) & ~DB_HEADER_SECTIONS;
     struct stat s;
     if (fstat(fd, &s) == -1)
     {
@@ -0,0 +1,637 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "serialize.h"
+#include "name_index.h"
+#include "db.h"
+#include "shard.h"
+
+
+typedef struct {
+    database *db;
+    int fd;
+    const char *path;
+    char *snapshot_path;
+    db_shard_options *options;
+    size_t load_threads;
+    size_t budget;
+    int status;
+} db_shard_load;
+
+typedef int (*db_shards_cmp)(const employee *a, const employee *b);
+
+
+size_t db_shard_of(const char *name, size_t shard_count)
+{
+    // the high bits of the hash change too little with the last bytes of a name and the name index already takes its
+    // slots from the low bits, so the hash is mixed before the shard is taken from it
+    uint64_t hash = hash_name(name);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (size_t)((hash >> 32) % shard_count);
+}
+
+// path of a shard's file, or of its snapshot, the path itself when there is a single shard
+static char *db_shard_path(const char *path, size_t shard, size_t shard_count)
+{
+    if (shard_count == 1)
+        return strdup(path);
+
+    size_t len = strlen(path) + 32;
+    char *shard_path = malloc(len);
+    if (shard_path)
+        snprintf(shard_path, len, "%s.%zu", path, shard);
+    return shard_path;
+}
+
+// path of the file keeping the change log's sequence numbers increasing across restarts, see changelog_open()
+static char *db_shards_seq_path(const char *path)
+{
+    size_t len = strlen(path) + sizeof(".seq");
+    char *seq_path = malloc(len);
+    if (seq_path)
+        snprintf(seq_path, len, "%s.seq", path);
+    return seq_path;
+}
+
+static void *db_shard_load_thread(void *arg)
+{
+    db_shard_load *l = arg;
+    db_shard_options *o = l->options;
+
+    // a snapshot that is missing or no longer matches the file falls back to reading the file
+    if (l->snapshot_path && access(l->snapshot_path, F_OK) == 0 && db_load_snapshot(l->db, l->fd, o->checkpoint_flags, l->snapshot_path) == STATUS_SUCCESS)
+        l->status = STATUS_SUCCESS;
+    else if (l->snapshot_path && lseek(l->fd, 0, SEEK_SET) == -1)
+        l->status = STATUS_ERROR;
+    else if (o->budget)
+        l->status = db_load_paged(l->db, l->fd, o->checkpoint_flags, l->budget);
+    else if (o->lazy)
+        l->status = db_load_lazy(l->db, l->fd, o->checkpoint_flags, l->load_threads);
+    else
+        l->status = db_load(l->db, l->fd, o->checkpoint_flags, l->load_threads);
+    if (l->status == STATUS_ERROR)
+        return NULL;
+    l->db->path = l->path;
+
+    // substring searches scan every address unless the index is built
+    if (o->address_index && db_build_address_index(l->db) == STATUS_ERROR)
+    {
+        free_database(l->db);
+        l->status = STATUS_ERROR;
+    }
+    return NULL;
+}
+
+static void db_shards_close_files(db_shards *s)
+{
+    for (size_t i = 0; i < s->count; i++)
+    {
+        if (s->fds && s->fds[i] != -1)
+            close(s->fds[i]);
+        if (s->paths)
+            free(s->paths[i]);
+    }
+    free(s->dbs);
+    free(s->fds);
+    free(s->paths);
+    *s = (db_shards) { 0 };
+}
+
+static int db_shards_open_files(db_shards *s, const char *path, bool create)
+{
+    for (size_t i = 0; i < s->count; i++)
+    {
+        if (!(s->paths[i] = db_shard_path(path, i, s->count)))
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate shard path: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+
+        if (!create)
+        {
+            if ((s->fds[i] = open(s->paths[i], O_RDWR, 0666)) == -1)
+            {
+                fprintf(stderr, "%s:%s:%d unable to open file %s: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, s->paths[i], errno, strerror(errno));
+                return STATUS_ERROR;
+            }
+            continue;
+        }
+
+        if ((s->fds[i] = open(s->paths[i], O_RDWR | O_CREAT | O_EXCL, 0666)) == -1)
+        {
+            fprintf(stderr, "%s:%s:%d error creating new file '%s': (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, s->paths[i], errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        if (write_new_file_hdr(s->fds[i]) == STATUS_ERROR)
+            return STATUS_ERROR;
+        if (lseek(s->fds[i], 0, SEEK_SET) == -1)
+        {
+            fprintf(stderr, "%s:%s:%d unable to reset file cursor: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int db_shards_open(db_shards *s, const char *path, size_t shard_count, bool create, db_shard_options *options)
+{
+    *s = (db_shards) { 0 };
+    if (shard_count == 0 || shard_count > DB_SHARD_MAX)
+    {
+        fprintf(stderr, "%s:%s:%d invalid shard count %zu, between 1 and %d shards are supported\n", __FILE__, __FUNCTION__, __LINE__, shard_count, DB_SHARD_MAX);
+        return STATUS_ERROR;
+    }
+
+    // names are routed by the shard count, so files written with more shards than asked for cannot be opened,
+    // with fewer the file of the last shard is missing
+    char *next_path = db_shard_path(path, shard_count, shard_count + 1);
+    bool more_shards = next_path && !create && access(next_path, F_OK) == 0;
+    free(next_path);
+    if (more_shards)
+    {
+        fprintf(stderr, "%s:%s:%d '%s' has more than %zu shards\n", __FILE__, __FUNCTION__, __LINE__, path, shard_count);
+        return STATUS_ERROR;
+    }
+
+    s->count = shard_count;
+    s->dbs = calloc(shard_count, sizeof(database));
+    s->fds = malloc(shard_count * sizeof(int));
+    s->paths = calloc(shard_count, sizeof(char *));
+    if (!s->dbs || !s->fds || !s->paths)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate shards: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        db_shards_close_files(s);
+        return STATUS_ERROR;
+    }
+    for (size_t i = 0; i < shard_count; i++)
+        s->fds[i] = -1;
+
+    if (db_shards_open_files(s, path, create) == STATUS_ERROR)
+    {
+        db_shards_close_files(s);
+        return STATUS_ERROR;
+    }
+
+    // every shard is loaded by a thread of its own, sharing the loader threads between them
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t load_threads = options->load_threads ? options->load_threads : (nprocs > 0 ? (size_t)nprocs : 1);
+    db_shard_load loads[DB_SHARD_MAX];
+    pthread_t threads[DB_SHARD_MAX];
+    bool started[DB_SHARD_MAX] = { false };
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        loads[i] = (db_shard_load) {
+            .db=s->dbs + i,
+            .fd=s->fds[i],
+            .path=s->paths[i],
+            .snapshot_path=options->snapshot_path ? db_shard_path(options->snapshot_path, i, shard_count) : NULL,
+            .options=options,
+            .load_threads=load_threads > shard_count ? load_threads / shard_count : 1,
+            .budget=options->budget / shard_count,
+            .status=STATUS_ERROR,
+        };
+        if (options->snapshot_path && !loads[i].snapshot_path)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate snapshot path: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            continue;
+        }
+
+        if (shard_count == 1)
+            db_shard_load_thread(loads + i);
+        else if (pthread_create(threads + i, NULL, db_shard_load_thread, loads + i))
+            fprintf(stderr, "%s:%s:%d unable to start a loader thread for shard %zu\n", __FILE__, __FUNCTION__, __LINE__, i);
+        else
+            started[i] = true;
+    }
+
+    int status = STATUS_SUCCESS;
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        free(loads[i].snapshot_path);
+        if (loads[i].status == STATUS_ERROR)
+            status = STATUS_ERROR;
+    }
+
+    // changes are numbered after any number used before the shards were last closed, so they keep increasing
+    // across restarts even when the clock was set back in between
+    char *seq_path = db_shards_seq_path(path);
+    if (status == STATUS_SUCCESS && (!seq_path || changelog_open(&s->changes, CHANGELOG_CAPACITY, seq_path) == STATUS_ERROR))
+        status = STATUS_ERROR;
+    free(seq_path);
+
+    if (status == STATUS_ERROR)
+    {
+        for (size_t i = 0; i < shard_count; i++)
+        {
+            if (loads[i].status == STATUS_SUCCESS)
+                free_database(s->dbs + i);
+        }
+        db_shards_close_files(s);
+    }
+    return status;
+}
+
+// removes the file of every shard, and the one numbering their changes
+void db_shards_remove_files(const char *path, size_t shard_count)
+{
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        char *shard_path = db_shard_path(path, i, shard_count);
+        if (shard_path)
+            unlink(shard_path);
+        free(shard_path);
+    }
+    char *seq_path = db_shards_seq_path(path);
+    if (seq_path)
+        unlink(seq_path);
+    free(seq_path);
+}
+
+database *db_shard_for(db_shards *s, const char *name)
+{
+    return s->dbs + db_shard_of(name, s->count);
+}
+
+int db_shards_list(db_shards *s, employee **employees, size_t *employees_size)
+{
+    if (s->count == 1)
+        return db_list_employees(s->dbs, employees, employees_size);
+
+    // the tables of the shards, without their deleted slots
+    size_t size = 0;
+    for (size_t i = 0; i < s->count; i++)
+    {
+        employee *part;
+        size_t part_size;
+        if (db_list_employees(s->dbs + i, &part, &part_size) == STATUS_ERROR)
+            return STATUS_ERROR;
+
+        if (size + part_size > s->results_capacity)
+        {
+            size_t capacity = s->results_capacity ? s->results_capacity : 64;
+            while (capacity < size + part_size)
+                capacity *= 2;
+            employee *results = realloc(s->results, capacity * sizeof(employee));
+            if (!results)
+            {
+                fprintf(stderr, "%s:%s:%d unable to grow results: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+                return STATUS_ERROR;
+            }
+            s->results = results;
+            s->results_capacity = capacity;
+        }
+
+        for (size_t j = 0; j < part_size; j++)
+        {
+            if (part[j].name)
+                s->results[size++] = part[j];
+        }
+    }
+
+    *employees = s->results;
+    *employees_size = size;
+    return STATUS_SUCCESS;
+}
+
+static int db_shards_hours_cmp(const employee *a, const employee *b)
+{
+    return a->hours < b->hours ? -1 : a->hours > b->hours;
+}
+
+static int db_shards_hours_desc_cmp(const employee *a, const employee *b)
+{
+    return db_shards_hours_cmp(b, a);
+}
+
+static int db_shards_name_cmp(const employee *a, const employee *b)
+{
+    return strcmp(a->name, b->name);
+}
+
+// substring matches have no order, the results of the shards follow one another
+static int db_shards_unordered_cmp(const employee *a, const employee *b)
+{
+    (void)a;
+    (void)b;
+    return 0;
+}
+
+static void db_shards_free_parts(employee **parts, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        free(parts[i]);
+}
+
+// merges the ordered results of every shard into the first limit of them, the parts are freed
+static int db_shards_merge(employee **parts, size_t *sizes, size_t count, db_shards_cmp cmp, size_t limit, employee **employees, size_t *employees_size)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++)
+        total += sizes[i];
+    if (total > limit)
+        total = limit;
+
+    *employees = malloc((total ? total : 1) * sizeof(employee));
+    if (!*employees)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate results: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        db_shards_free_parts(parts, count);
+        return STATUS_ERROR;
+    }
+
+    // there are few shards, so the next result is found by comparing the head of each, ties go to the lower shard
+    size_t heads[DB_SHARD_MAX] = { 0 };
+    for (size_t n = 0; n < total; n++)
+    {
+        size_t best = count;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (heads[i] < sizes[i] && (best == count || cmp(parts[i] + heads[i], parts[best] + heads[best]) < 0))
+                best = i;
+        }
+        (*employees)[n] = parts[best][heads[best]++];
+    }
+
+    *employees_size = total;
+    db_shards_free_parts(parts, count);
+    return STATUS_SUCCESS;
+}
+
+int db_shards_hours_range(db_shards *s, uint32_t min_hours, uint32_t max_hours, employee **employees, size_t *employees_size)
+{
+    if (s->count == 1)
+        return db_hours_range(s->dbs, min_hours, max_hours, employees, employees_size);
+
+    employee *parts[DB_SHARD_MAX];
+    size_t sizes[DB_SHARD_MAX];
+    for (size_t i = 0; i < s->count; i++)
+    {
+        if (db_hours_range(s->dbs + i, min_hours, max_hours, parts + i, sizes + i) == STATUS_ERROR)
+        {
+            db_shards_free_parts(parts, i);
+            return STATUS_ERROR;
+        }
+    }
+    return db_shards_merge(parts, sizes, s->count, db_shards_hours_cmp, SIZE_MAX, employees, employees_size);
+}
+
+int db_shards_top_hours(db_shards *s, size_t k, employee **employees, size_t *employees_size)
+{
+    if (s->count == 1)
+        return db_top_hours(s->dbs, k, employees, employees_size);
+
+    // the top k overall are among the top k of each shard
+    employee *parts[DB_SHARD_MAX];
+    size_t sizes[DB_SHARD_MAX];
+    for (size_t i = 0; i < s->count; i++)
+    {
+        if (db_top_hours(s->dbs + i, k, parts + i, sizes + i) == STATUS_ERROR)
+        {
+            db_shards_free_parts(parts, i);
+            return STATUS_ERROR;
+        }
+    }
+    return db_shards_merge(parts, sizes, s->count, db_shards_hours_desc_cmp, k, employees, employees_size);
+}
+
+int db_shards_prefix_search(db_shards *s, const char *prefix, employee **employees, size_t *employees_size)
+{
+    if (s->count == 1)
+        return db_prefix_search(s->dbs, prefix, employees, employees_size);
+
+    employee *parts[DB_SHARD_MAX];
+    size_t sizes[DB_SHARD_MAX];
+    for (size_t i = 0; i < s->count; i++)
+    {
+        if (db_prefix_search(s->dbs + i, prefix, parts + i, sizes + i) == STATUS_ERROR)
+        {
+            db_shards_free_parts(parts, i);
+            return STATUS_ERROR;
+        }
+    }
+    return db_shards_merge(parts, sizes, s->count, db_shards_name_cmp, SIZE_MAX, employees, employees_size);
+}
+
+int db_shards_address_search(db_shards *s, const char *substring, employee **employees, size_t *employees_size)
+{
+    if (s->count == 1)
+        return db_address_search(s->dbs, substring, employees, employees_size);
+
+    employee *parts[DB_SHARD_MAX];
+    size_t sizes[DB_SHARD_MAX];
+    for (size_t i = 0; i < s->count; i++)
+    {
+        if (db_address_search(s->dbs + i, substring, parts + i, sizes + i) == STATUS_ERROR)
+        {
+            db_shards_free_parts(parts, i);
+            return STATUS_ERROR;
+        }
+    }
+    return db_shards_merge(parts, sizes, s->count, db_shards_unordered_cmp, SIZE_MAX, employees, employees_size);
+}
+
+// a name changed since some version and the shard owning it, the lookups are grouped by shard
+typedef struct {
+    size_t shard;
+    char *name;
+} db_shards_changed_name;
+
+static int db_shards_changed_name_cmp(const void *a, const void *b)
+{
+    const db_shards_changed_name *x = a, *y = b;
+    if (x->shard != y->shard)
+        return x->shard < y->shard ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+// The live records of the names changed since version and the names deleted since, each name once whatever number
+// of changes it had. resync is set instead when the changelog no longer reaches back to version. Both arrays are
+// shallow, the records stay owned by the shards and the deleted names by the changelog until the next change.
+int db_shards_changes_since(db_shards *s, uint64_t version, bool *resync, employee **changed, size_t *changed_size, char ***deleted, size_t *deleted_size)
+{
+    *resync = !changelog_covers(&s->changes, version);
+    size_t first = changelog_find(&s->changes, version);
+    size_t count = *resync ? 0 : s->changes.count - first;
+
+    db_shards_changed_name *names = malloc((count ? count : 1) * sizeof(db_shards_changed_name));
+    char **lookup = malloc((count ? count : 1) * sizeof(char *));
+    *changed = malloc((count ? count : 1) * sizeof(employee));
+    *deleted = malloc((count ? count : 1) * sizeof(char *));
+    if (!names || !lookup || !*changed || !*deleted)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate changes: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(names);
+        free(lookup);
+        free(*changed);
+        free(*deleted);
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        char *name = changelog_get(&s->changes, first + i)->name;
+        names[i] = (db_shards_changed_name) { .shard=db_shard_of(name, s->count), .name=name };
+    }
+    qsort(names, count, sizeof(db_shards_changed_name), db_shards_changed_name_cmp);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (unique && !db_shards_changed_name_cmp(names + unique - 1, names + i))
+            continue;
+        names[unique] = names[i];
+        lookup[unique++] = names[i].name;
+    }
+
+    // the names of one shard are looked up together, those it no longer has were deleted
+    *changed_size = 0;
+    *deleted_size = 0;
+    int status = STATUS_SUCCESS;
+    for (size_t start = 0, end; start < unique && status == STATUS_SUCCESS; start = end)
+    {
+        for (end = start + 1; end < unique && names[end].shard == names[start].shard; end++)
+            ;
+
+        employee *found;
+        size_t found_size;
+        if ((status = db_lookup_employees(s->dbs + names[start].shard, lookup + start, end - start, &found, &found_size)) == STATUS_ERROR)
+            break;
+        size_t j = 0;
+        for (size_t k = start; k < end; k++)
+        {
+            if (j < found_size && !strcmp(found[j].name, lookup[k]))
+                (*changed)[(*changed_size)++] = found[j++];
+            else
+                (*deleted)[(*deleted_size)++] = lookup[k];
+        }
+        free(found);
+    }
+
+    free(names);
+    free(lookup);
+    if (status == STATUS_ERROR)
+    {
+        free(*changed);
+        free(*deleted);
+    }
+    return status;
+}
+
+bool db_shards_compaction_pending(db_shards *s)
+{
+    for (size_t i = 0; i < s->count; i++)
+    {
+        if (db_compaction_pending(s->dbs + i))
+            return true;
+    }
+    return false;
+}
+
+int db_shards_compact_step(db_shards *s, size_t max_records)
+{
+    // each shard compacts on its own schedule, only the shards with enough deleted records do any work
+    for (size_t i = 0; i < s->count; i++)
+    {
+        if (db_compact_step(s->dbs + i, max_records) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// checkpoints each shard whose offset directory and name index miss min_appended or more appended records
+int db_shards_checkpoint(db_shards *s, size_t min_appended)
+{
+    for (size_t i = 0; i < s->count; i++)
+    {
+        if (db_checkpoint_pending(s->dbs + i, min_appended) && db_checkpoint(s->dbs + i) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// deletes every record of every shard, for a follower starting over from a new copy of its primary
+int db_shards_clear(db_shards *s)
+{
+    for (size_t i = 0; i < s->count; i++)
+    {
+        database *db = s->dbs + i;
+        employee *employees;
+        size_t employees_size;
+        if (db_list_employees(db, &employees, &employees_size) == STATUS_ERROR)
+            return STATUS_ERROR;
+
+        // the listed records are the table itself, or the results of a paged database, both change as records
+        // are deleted, so they are deleted by name
+        char **names = malloc((employees_size ? employees_size : 1) * sizeof(char *));
+        if (!names)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate names: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        size_t names_size = 0;
+        int status = STATUS_SUCCESS;
+        for (size_t j = 0; j < employees_size && status == STATUS_SUCCESS; j++)
+        {
+            if (employees[j].name && !(names[names_size++] = strdup(employees[j].name)))
+                status = STATUS_ERROR;
+        }
+
+        size_t idx;
+        for (size_t j = 0; j < names_size && status == STATUS_SUCCESS; j++)
+        {
+            if (names[j] && db_find_employee(db, names[j], &idx) == STATUS_SUCCESS)
+                status = db_delete_employee(db, idx);
+        }
+        for (size_t j = 0; j < names_size; j++)
+            free(names[j]);
+        free(names);
+        if (status == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d unable to clear shard %zu\n", __FILE__, __FUNCTION__, __LINE__, i);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int db_shards_write_snapshots(db_shards *s, const char *path)
+{
+    for (size_t i = 0; i < s->count; i++)
+    {
+        char *snapshot_path = db_shard_path(path, i, s->count);
+        if (!snapshot_path)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate snapshot path: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        int status = db_write_snapshot(s->dbs + i, snapshot_path);
+        free(snapshot_path);
+        if (status == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+void free_db_shards(db_shards *s)
+{
+    for (size_t i = 0; i < s->count; i++)
+    {
+        // a compaction or paged checkpoint replaces the file of a shard, closing the one it was opened with
+        s->fds[i] = s->dbs[i].fd;
+        free_database(s->dbs + i);
+    }
+    free(s->results);
+    free_changelog(&s->changes);
+    db_shards_close_files(s);
+}
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "serialize.h"
+#include "crc32c.h"
+#include "snapshot.h"
+
+
+int db_snapshot_source_of(int fd, db_header *hdr, db_section *sections, size_t section_count, db_snapshot_source *source)
+{
+    struct stat s;
+    if (fstat(fd, &s) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d fstat() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // appends change the header and the section table, in place writes change the checksums if the file
+    // has them and otherwise only the modification time
+    uint32_t crc = crc32c(0, hdr, sizeof(db_header));
+    crc = crc32c(crc, sections, section_count * sizeof(db_section));
+    db_section *checksums = find_db_section(sections, section_count, DB_SECTION_CHECKSUMS);
+    if (checksums && checksums->length > 0)
+    {
+        unsigned char *buf = malloc(checksums->length);
+        if (!buf || pread(fd, buf, checksums->length, checksums->offset) != (ssize_t)checksums->length)
+        {
+            fprintf(stderr, "%s:%s:%d unable to read checksums: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            free(buf);
+            return STATUS_ERROR;
+        }
+        crc = crc32c(crc, buf, checksums->length);
+        free(buf);
+    }
+
+    *source = (db_snapshot_source) {
+        .size=s.st_size,
+        .inode=s.st_ino,
+        .mtime_sec=s.st_mtim.tv_sec,
+        .mtime_nsec=s.st_mtim.tv_nsec,
+        .crc=crc,
+    };
+    return STATUS_SUCCESS;
+}
+
+int db_snapshot_create(db_snapshot_writer *w, const char *path)
+{
+    *w = (db_snapshot_writer) { .fd=-1 };
+    w->path = strdup(path);
+    w->tmp_path = malloc(strlen(path) + sizeof(".tmp"));
+    if (!w->path || !w->tmp_path)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate snapshot path: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        db_snapshot_abort(w);
+        return STATUS_ERROR;
+    }
+    sprintf(w->tmp_path, "%s.tmp", path);
+
+    if ((w->fd = open(w->tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0666)) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to create snapshot '%s': (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, w->tmp_path, errno, strerror(errno));
+        db_snapshot_abort(w);
+        return STATUS_ERROR;
+    }
+
+    // the header is written last, once the crc of everything after it is known
+    if (lseek(w->fd, sizeof(db_snapshot_header), SEEK_SET) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d lseek() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        db_snapshot_abort(w);
+        return STATUS_ERROR;
+    }
+    w->length = sizeof(db_snapshot_header);
+    return STATUS_SUCCESS;
+}
+
+// a section runs up to the last byte written before the next one begins or the snapshot is committed
+static void db_snapshot_end_section(db_snapshot_writer *w)
+{
+    if (w->hdr.section_count)
+        w->hdr.sections[w->hdr.section_count - 1].length = w->length - w->hdr.sections[w->hdr.section_count - 1].offset;
+}
+
+int db_snapshot_begin_section(db_snapshot_writer *w, uint32_t type)
+{
+    db_snapshot_end_section(w);
+    if (w->hdr.section_count == DB_SNAPSHOT_MAX_SECTIONS)
+    {
+        fprintf(stderr, "%s:%s:%d too many snapshot sections\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // every section starts aligned so its entries can be used straight from the mapping
+    static const unsigned char padding[DB_SECTION_ALIGN] = { 0 };
+    size_t padding_len = (DB_SECTION_ALIGN - w->length % DB_SECTION_ALIGN) % DB_SECTION_ALIGN;
+    if (padding_len && db_snapshot_write(w, padding, padding_len) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    w->hdr.sections[w->hdr.section_count++] = (db_snapshot_section) { .type=type, .offset=w->length, .length=0 };
+    return STATUS_SUCCESS;
+}
+
+int db_snapshot_write(db_snapshot_writer *w, const void *buf, size_t len)
+{
+    if (write_all(w->fd, (void *)buf, len) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    w->crc = crc32c(w->crc, buf, len);
+    w->length += len;
+    return STATUS_SUCCESS;
+}
+
+int db_snapshot_commit(db_snapshot_writer *w, db_snapshot_source *source)
+{
+    db_snapshot_end_section(w);
+    w->hdr.magic = DB_SNAPSHOT_MAGIC;
+    w->hdr.version = DB_SNAPSHOT_VERSION;
+    w->hdr.length = w->length;
+    w->hdr.crc = w->crc;
+    w->hdr.source = *source;
+
+    // the old snapshot is only replaced by a complete one
+    if (pwrite(w->fd, &w->hdr, sizeof(db_snapshot_header), 0) != sizeof(db_snapshot_header) || fsync(w->fd) == -1 ||
+        rename(w->tmp_path, w->path) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to write snapshot '%s': (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, w->path, errno, strerror(errno));
+        db_snapshot_abort(w);
+        return STATUS_ERROR;
+    }
+
+    close(w->fd);
+    free(w->path);
+    free(w->tmp_path);
+    *w = (db_snapshot_writer) { .fd=-1 };
+    return STATUS_SUCCESS;
+}
+
+void db_snapshot_abort(db_snapshot_writer *w)
+{
+    if (w->fd != -1)
+    {
+        close(w->fd);
+        unlink(w->tmp_path);
+    }
+    free(w->path);
+    free(w->tmp_path);
+    *w = (db_snapshot_writer) { .fd=-1 };
+}
+
+int db_snapshot_map(int fd, unsigned char **map, size_t *map_len)
+{
+    struct stat s;
+    if (fstat(fd, &s) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d fstat() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    if ((size_t)s.st_size < sizeof(db_snapshot_header))
+    {
+        fprintf(stderr, "%s:%s:%d corrupted data, snapshot is too short\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    unsigned char *m = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED)
+    {
+        fprintf(stderr, "%s:%s:%d unable to map snapshot: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // a snapshot from another version, machine or a write that did not finish is rejected as a whole
+    db_snapshot_header *hdr = (db_snapshot_header *)m;
+    bool valid = hdr->magic == DB_SNAPSHOT_MAGIC && hdr->version == DB_SNAPSHOT_VERSION && hdr->length == (uint64_t)s.st_size &&
+        hdr->section_count <= DB_SNAPSHOT_MAX_SECTIONS;
+    for (uint32_t i = 0; valid && i < hdr->section_count; i++)
+    {
+        db_snapshot_section *section = hdr->sections + i;
+        valid = section->offset >= sizeof(db_snapshot_header) && section->offset % DB_SECTION_ALIGN == 0 &&
+            section->offset <= hdr->length && section->length <= hdr->length - section->offset;
+    }
+    if (!valid || crc32c(0, m + sizeof(db_snapshot_header), s.st_size - sizeof(db_snapshot_header)) != hdr->crc)
+    {
+        fprintf(stderr, "%s:%s:%d corrupted data, invalid snapshot\n", __FILE__, __FUNCTION__, __LINE__);
+        munmap(m, s.st_size);
+        return STATUS_ERROR;
+    }
+
+    *map = m;
+    *map_len = s.st_size;
+    return STATUS_SUCCESS;
+}
+
+db_snapshot_section *find_db_snapshot_section(db_snapshot_header *hdr, uint32_t type)
+{
+    for (uint32_t i = 0; i < hdr->section_count; i++)
+    {
+        if (hdr->sections[i].type == type)
+            return hdr->sections + i;
+    }
+    return NULL;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+#include "models.h"
+#include "string_pool.h"
+
+
+static uint64_t hash_string(const char *s)
+{
+    uint64_t hash = FNV_OFFSET;
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++)
+    {
+        hash ^= (uint64_t)*p;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+int string_pool_init(string_pool *pool)
+{
+    pool->entries = calloc(STRING_POOL_INIT_CAPACITY, sizeof(string_pool_entry));
+    if (!pool->entries)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate string pool: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    pool->capacity = STRING_POOL_INIT_CAPACITY;
+    pool->count = 0;
+    return STATUS_SUCCESS;
+}
+
+static int string_pool_resize(string_pool *pool, size_t capacity)
+{
+    string_pool_entry *entries = calloc(capacity, sizeof(string_pool_entry));
+    if (!entries)
+    {
+        fprintf(stderr, "%s:%s:%d unable to resize string pool: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < pool->capacity; i++)
+    {
+        if (!pool->entries[i].str)
+            continue;
+
+        size_t j = pool->entries[i].hash & mask;
+        while (entries[j].str)
+            j = (j + 1) & mask;
+        entries[j] = pool->entries[i];
+    }
+
+    free(pool->entries);
+    pool->entries = entries;
+    pool->capacity = capacity;
+    return STATUS_SUCCESS;
+}
+
+static size_t string_pool_probe(string_pool *pool, const char *s, uint64_t hash)
+{
+    size_t mask = pool->capacity - 1;
+    size_t i = hash & mask;
+    while (pool->entries[i].str && (pool->entries[i].hash != hash || (pool->entries[i].str != s && strcmp(pool->entries[i].str, s))))
+        i = (i + 1) & mask;
+    return i;
+}
+
+char *string_pool_intern(string_pool *pool, char *s)
+{
+    // the pool takes ownership of s, a duplicate is freed in favour of the shared copy
+    uint64_t hash = hash_string(s);
+    size_t i = string_pool_probe(pool, s, hash);
+    if (pool->entries[i].str)
+    {
+        if (pool->entries[i].str != s)
+            free(s);
+        pool->entries[i].refs++;
+        return pool->entries[i].str;
+    }
+
+    if ((double)(pool->count + 1) > STRING_POOL_ALPHA * pool->capacity)
+    {
+        if (string_pool_resize(pool, 2 * pool->capacity) == STATUS_ERROR)
+            return NULL;
+        i = string_pool_probe(pool, s, hash);
+    }
+
+    pool->entries[i] = (string_pool_entry) { .str=s, .hash=hash, .refs=1, .index=UINT32_MAX };
+    pool->count++;
+    return s;
+}
+
+string_pool_entry *string_pool_find(string_pool *pool, const char *s)
+{
+    size_t i = string_pool_probe(pool, s, hash_string(s));
+    return pool->entries[i].str ? pool->entries + i : NULL;
+}
+
+void string_pool_release(string_pool *pool, const char *s)
+{
+    size_t mask = pool->capacity - 1;
+    size_t i = string_pool_probe(pool, s, hash_string(s));
+    if (!pool->entries[i].str || --pool->entries[i].refs > 0)
+        return;
+
+    free(pool->entries[i].str);
+    pool->count--;
+
+    // shift back later entries of the probe sequence so no tombstones are needed
+    for (size_t j = (i + 1) & mask; pool->entries[j].str; j = (j + 1) & mask)
+    {
+        size_t home = pool->entries[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            pool->entries[i] = pool->entries[j];
+            i = j;
+        }
+    }
+    pool->entries[i] = (string_pool_entry) { 0 };
+}
+
+void free_string_pool(string_pool *pool)
+{
+    for (size_t i = 0; i < pool->capacity; i++)
+        free(pool->entries[i].str);
+    free(pool->entries);
+    pool->entries = NULL;
+    pool->capacity = 0;
+    pool->count = 0;
+}
@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+#include "common.h"
+#include "trigram_index.h"
+
+
+static size_t intersect_sorted_u16_scalar(const uint16_t *a, size_t a_size, const uint16_t *b, size_t b_size, uint16_t *out)
+{
+    size_t i = 0, j = 0, k = 0;
+    while (i < a_size && j < b_size)
+    {
+        if (a[i] < b[j])
+            i++;
+        else if (a[i] > b[j])
+            j++;
+        else
+        {
+            out[k++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    return k;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// compares blocks of 8 values at once with an all pairs string compare, then merges the tails
+__attribute__((target("sse4.2")))
+static size_t intersect_sorted_u16_sse42(const uint16_t *a, size_t a_size, const uint16_t *b, size_t b_size, uint16_t *out)
+{
+    size_t i = 0, j = 0, k = 0;
+    size_t a_blocks = a_size & ~(size_t)7, b_blocks = b_size & ~(size_t)7;
+    while (i < a_blocks && j < b_blocks)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+
+        // explicit lengths so that a value of 0 is not taken as the end of the string
+        __m128i match = _mm_cmpestrm(vb, 8, va, 8, _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+        unsigned int mask = (unsigned int)_mm_cvtsi128_si32(match);
+        while (mask)
+        {
+            out[k++] = a[i + __builtin_ctz(mask)];
+            mask &= mask - 1;
+        }
+
+        uint16_t a_max = a[i + 7], b_max = b[j + 7];
+        if (a_max <= b_max)
+            i += 8;
+        if (b_max <= a_max)
+            j += 8;
+    }
+
+    return k + intersect_sorted_u16_scalar(a + i, a_size - i, b + j, b_size - j, out + k);
+}
+#endif
+
+size_t intersect_sorted_u16(const uint16_t *a, size_t a_size, const uint16_t *b, size_t b_size, uint16_t *out)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static int has_sse42 = -1;
+    if (has_sse42 == -1)
+        has_sse42 = __builtin_cpu_supports("sse4.2");
+    if (has_sse42)
+        return intersect_sorted_u16_sse42(a, a_size, b, b_size, out);
+#endif
+    return intersect_sorted_u16_scalar(a, a_size, b, b_size, out);
+}
+
+static uint32_t trigram_at(const char *s)
+{
+    return ((uint32_t)(unsigned char)s[0] << 16) | ((uint32_t)(unsigned char)s[1] << 8) | (unsigned char)s[2];
+}
+
+static size_t trigram_hash(uint32_t trigram, size_t mask)
+{
+    // murmur3 finalizer, trigrams of similar text only differ in a few bits
+    trigram ^= trigram >> 16;
+    trigram *= 0x85ebca6bU;
+    trigram ^= trigram >> 13;
+    trigram *= 0xc2b2ae35U;
+    trigram ^= trigram >> 16;
+    return trigram & mask;
+}
+
+static trigram_postings *trigram_lookup(trigram_index *idx, uint32_t trigram)
+{
+    size_t mask = idx->capacity - 1;
+    for (size_t i = trigram_hash(trigram, mask); idx->table[i].trigram; i = (i + 1) & mask)
+    {
+        if (idx->table[i].trigram == trigram)
+            return idx->table + i;
+    }
+    return NULL;
+}
+
+static int trigram_index_resize(trigram_index *idx, size_t capacity)
+{
+    trigram_postings *table = calloc(capacity, sizeof(trigram_postings));
+    if (!table)
+    {
+        fprintf(stderr, "%s:%s:%d unable to resize trigram index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < idx->capacity; i++)
+    {
+        if (!idx->table[i].trigram)
+            continue;
+
+        size_t j = trigram_hash(idx->table[i].trigram, mask);
+        while (table[j].trigram)
+            j = (j + 1) & mask;
+        table[j] = idx->table[i];
+    }
+
+    free(idx->table);
+    idx->table = table;
+    idx->capacity = capacity;
+    return STATUS_SUCCESS;
+}
+
+static trigram_postings *trigram_lookup_or_add(trigram_index *idx, uint32_t trigram)
+{
+    trigram_postings *postings = trigram_lookup(idx, trigram);
+    if (postings)
+        return postings;
+
+    if ((double)(idx->count + 1) > TRIGRAM_INDEX_ALPHA * idx->capacity && trigram_index_resize(idx, 2 * idx->capacity) == STATUS_ERROR)
+        return NULL;
+
+    size_t mask = idx->capacity - 1;
+    size_t i = trigram_hash(trigram, mask);
+    while (idx->table[i].trigram)
+        i = (i + 1) & mask;
+
+    idx->table[i].trigram = trigram;
+    idx->count++;
+    return idx->table + i;
+}
+
+// index of the chunk holding high, or of the position it would be inserted at
+static uint32_t chunk_pos(trigram_postings *postings, uint16_t high)
+{
+    uint32_t lo = 0, hi = postings->chunk_count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (postings->chunks[mid].high < high)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static uint32_t low_pos(trigram_chunk *chunk, uint16_t low)
+{
+    uint32_t lo = 0, hi = chunk->count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (chunk->lows[mid] < low)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int postings_add(trigram_postings *postings, uint32_t slot)
+{
+    uint16_t high = slot >> 16, low = slot & 0xffff;
+    uint32_t c = chunk_pos(postings, high);
+    if (c == postings->chunk_count || postings->chunks[c].high != high)
+    {
+        if (postings->chunk_count == postings->chunk_capacity)
+        {
+            uint32_t capacity = postings->chunk_capacity ? 2 * postings->chunk_capacity : 1;
+            trigram_chunk *chunks = realloc(postings->chunks, capacity * sizeof(trigram_chunk));
+            if (!chunks)
+            {
+                fprintf(stderr, "%s:%s:%d unable to grow posting list: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+                return STATUS_ERROR;
+            }
+            postings->chunks = chunks;
+            postings->chunk_capacity = capacity;
+        }
+        memmove(postings->chunks + c + 1, postings->chunks + c, (postings->chunk_count - c) * sizeof(trigram_chunk));
+        postings->chunks[c] = (trigram_chunk) { .high=high };
+        postings->chunk_count++;
+    }
+
+    trigram_chunk *chunk = postings->chunks + c;
+
+    // new records have the highest slot so this is usually an append, repeated trigrams of one address are stored once
+    uint32_t pos = chunk->count && chunk->lows[chunk->count - 1] < low ? chunk->count : low_pos(chunk, low);
+    if (pos < chunk->count && chunk->lows[pos] == low)
+        return STATUS_SUCCESS;
+
+    if (chunk->count == chunk->capacity)
+    {
+        uint32_t capacity = chunk->capacity ? 2 * chunk->capacity : 4;
+        uint16_t *lows = realloc(chunk->lows, capacity * sizeof(uint16_t));
+        if (!lows)
+        {
+            fprintf(stderr, "%s:%s:%d unable to grow posting list: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        chunk->lows = lows;
+        chunk->capacity = capacity;
+    }
+
+    memmove(chunk->lows + pos + 1, chunk->lows + pos, (chunk->count - pos) * sizeof(uint16_t));
+    chunk->lows[pos] = low;
+    chunk->count++;
+    return STATUS_SUCCESS;
+}
+
+static void postings_remove(trigram_postings *postings, uint32_t slot)
+{
+    uint16_t high = slot >> 16, low = slot & 0xffff;
+    uint32_t c = chunk_pos(postings, high);
+    if (c == postings->chunk_count || postings->chunks[c].high != high)
+        return;
+
+    trigram_chunk *chunk = postings->chunks + c;
+    uint32_t pos = low_pos(chunk, low);
+    if (pos == chunk->count || chunk->lows[pos] != low)
+        return;
+
+    memmove(chunk->lows + pos, chunk->lows + pos + 1, (chunk->count - pos - 1) * sizeof(uint16_t));
+    if (--chunk->count == 0)
+    {
+        free(chunk->lows);
+        memmove(postings->chunks + c, postings->chunks + c + 1, (postings->chunk_count - c - 1) * sizeof(trigram_chunk));
+        postings->chunk_count--;
+    }
+}
+
+static size_t postings_size(trigram_postings *postings)
+{
+    size_t size = 0;
+    for (uint32_t i = 0; i < postings->chunk_count; i++)
+        size += postings->chunks[i].count;
+    return size;
+}
+
+static void free_postings(trigram_postings *postings)
+{
+    for (uint32_t i = 0; i < postings->chunk_count; i++)
+        free(postings->chunks[i].lows);
+    free(postings->chunks);
+    postings->chunks = NULL;
+    postings->chunk_count = 0;
+    postings->chunk_capacity = 0;
+}
+
+int trigram_index_init(trigram_index *idx)
+{
+    idx->table = calloc(TRIGRAM_INDEX_INIT_CAPACITY, sizeof(trigram_postings));
+    if (!idx->table)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate trigram index: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    idx->capacity = TRIGRAM_INDEX_INIT_CAPACITY;
+    idx->count = 0;
+    return STATUS_SUCCESS;
+}
+
+int trigram_index_build(trigram_index *idx, employee *employees, size_t employees_size)
+{
+    if (trigram_index_init(idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        // deleted records have no address
+        if (employees[i].address && trigram_index_insert(idx, employees[i].address, i) == STATUS_ERROR)
+        {
+            free_trigram_index(idx);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int trigram_index_insert(trigram_index *idx, const char *address, uint32_t slot)
+{
+    size_t len = strlen(address);
+    for (size_t i = 0; i + 3 <= len; i++)
+    {
+        trigram_postings *postings = trigram_lookup_or_add(idx, trigram_at(address + i));
+        if (!postings || postings_add(postings, slot) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int trigram_index_remove(trigram_index *idx, const char *address, uint32_t slot)
+{
+    // emptied posting lists keep their table entry, addresses tend to reuse the same trigrams
+    size_t len = strlen(address);
+    for (size_t i = 0; i + 3 <= len; i++)
+    {
+        trigram_postings *postings = trigram_lookup(idx, trigram_at(address + i));
+        if (postings)
+            postings_remove(postings, slot);
+    }
+    return STATUS_SUCCESS;
+}
+
+int trigram_index_remap(trigram_index *idx, const uint32_t *slot_map)
+{
+    for (size_t i = 0; i < idx->capacity; i++)
+    {
+        trigram_postings *postings = idx->table + i;
+        if (!postings->trigram || !postings->chunk_count)
+            continue;
+
+        // decode the list and add the renumbered slots back, the map keeps them in order
+        size_t size = postings_size(postings);
+        uint32_t *slots = malloc(size * sizeof(uint32_t));
+        if (!slots)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate posting list: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+
+        size_t n = 0;
+        for (uint32_t c = 0; c < postings->chunk_count; c++)
+        {
+            for (uint32_t j = 0; j < postings->chunks[c].count; j++)
+            {
+                uint32_t slot = slot_map[((uint32_t)postings->chunks[c].high << 16) | postings->chunks[c].lows[j]];
+                if (slot != UINT32_MAX)
+                    slots[n++] = slot;
+            }
+        }
+
+        free_postings(postings);
+        for (size_t j = 0; j < n; j++)
+        {
+            if (postings_add(postings, slots[j]) == STATUS_ERROR)
+            {
+                free(slots);
+                return STATUS_ERROR;
+            }
+        }
+        free(slots);
+    }
+    return STATUS_SUCCESS;
+}
+
+static int postings_size_cmp(const void *a, const void *b)
+{
+    size_t x = postings_size(*(trigram_postings **)a), y = postings_size(*(trigram_postings **)b);
+    return x < y ? -1 : x > y;
+}
+
+// intersects the posting lists chunk by chunk, starting from the shortest one
+static int intersect_postings(trigram_postings **lists, size_t list_count, uint32_t **slots, size_t *slots_size)
+{
+    qsort(lists, list_count, sizeof(trigram_postings *), postings_size_cmp);
+
+    trigram_postings *first = lists[0];
+    *slots = malloc((postings_size(first) ? postings_size(first) : 1) * sizeof(uint32_t));
+    uint16_t *lows = malloc(65536 * sizeof(uint16_t));
+    if (!*slots || !lows)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate intersection: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        free(*slots);
+        free(lows);
+        return STATUS_ERROR;
+    }
+
+    size_t n = 0;
+    for (uint32_t c = 0; c < first->chunk_count; c++)
+    {
+        trigram_chunk *chunk = first->chunks + c;
+        memcpy(lows, chunk->lows, chunk->count * sizeof(uint16_t));
+        size_t count = chunk->count;
+
+        for (size_t l = 1; l < list_count && count > 0; l++)
+        {
+            uint32_t pos = chunk_pos(lists[l], chunk->high);
+            if (pos == lists[l]->chunk_count || lists[l]->chunks[pos].high != chunk->high)
+            {
+                count = 0;
+                break;
+            }
+
+            // the output never runs ahead of the input so the candidates are narrowed in place
+            trigram_chunk *other = lists[l]->chunks + pos;
+            count = intersect_sorted_u16(lows, count, other->lows, other->count, lows);
+        }
+
+        for (size_t i = 0; i < count; i++)
+            (*slots)[n++] = ((uint32_t)chunk->high << 16) | lows[i];
+    }
+
+    free(lows);
+    *slots_size = n;
+    return STATUS_SUCCESS;
+}
+
+int trigram_index_search(trigram_index *idx, employee *employees, size_t employees_size, const char *substring, uint32_t **slots, size_t *slots_size)
+{
+    size_t len = strlen(substring);
+    *slots = NULL;
+    *slots_size = 0;
+
+    // substrings shorter than a trigram can only be answered by a scan
+    if (len < 3)
+    {
+        *slots = malloc((employees_size ? employees_size : 1) * sizeof(uint32_t));
+        if (!*slots)
+        {
+            fprintf(stderr, "%s:%s:%d unable to allocate search result: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+            return STATUS_ERROR;
+        }
+        for (size_t i = 0; i < employees_size; i++)
+        {
+            if (employees[i].address && strstr(employees[i].address, substring))
+                (*slots)[(*slots_size)++] = i;
+        }
+        return STATUS_SUCCESS;
+    }
+
+    // every trigram of the substring must occur in a matching address
+    trigram_postings **lists = malloc((len - 2) * sizeof(trigram_postings *));
+    if (!lists)
+    {
+        fprintf(stderr, "%s:%s:%d unable to allocate posting lists: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    size_t list_count = 0;
+    for (size_t i = 0; i + 3 <= len; i++)
+    {
+        trigram_postings *postings = trigram_lookup(idx, trigram_at(substring + i));
+        if (!postings || !postings->chunk_count)
+        {
+            free(lists);
+            return STATUS_SUCCESS;
+        }
+
+        bool seen = false;
+        for (size_t j = 0; j < list_count && !seen; j++)
+            seen = lists[j] == postings;
+        if (!seen)
+            lists[list_count++] = postings;
+    }
+
+    int status = intersect_postings(lists, list_count, slots, slots_size);
+    free(lists);
+    if (status == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // trigrams can match out of order, confirm each candidate
+    size_t n = 0;
+    for (size_t i = 0; i < *slots_size; i++)
+    {
+        uint32_t slot = (*slots)[i];
+        if (slot < employees_size && employees[slot].address && strstr(employees[slot].address, substring))
+            (*slots)[n++] = slot;
+    }
+    *slots_size = n;
+    return STATUS_SUCCESS;
+}
+
+void free_trigram_index(trigram_index *idx)
+{
+    for (size_t i = 0; i < idx->capacity; i++)
+    {
+        if (idx->table[i].trigram)
+            free_postings(idx->table + i);
+    }
+    free(idx->table);
+    idx->table = NULL;
+    idx->capacity = 0;
+    idx->count = 0;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "common.h"
+#include "buffer_pool.h"
+
+
+// a file of page_count pages, every byte of page p holds p
+static int create_test_file(char *fname, uint32_t page_count)
+{
+    int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+        return STATUS_ERROR;
+
+    unsigned char page[BUFFER_POOL_PAGE_SIZE];
+    for (uint32_t p = 0; p < page_count; p++)
+    {
+        memset(page, p, sizeof(page));
+        if (write(fd, page, sizeof(page)) != sizeof(page))
+            return STATUS_ERROR;
+    }
+    return fd;
+}
+
+int test_clock_eviction(void)
+{
+    int fd = create_test_file("test/src/test_db.bin", 64);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    buffer_pool pool;
+    if (buffer_pool_init(&pool, fd, BUFFER_POOL_MIN_FRAMES * BUFFER_POOL_PAGE_SIZE) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // memory stays within the budget however many pages are read
+    for (uint32_t p = 0; p < 64; p++)
+    {
+        unsigned char byte;
+        if (buffer_pool_read(&pool, p * BUFFER_POOL_PAGE_SIZE + 7, &byte, 1, false) == STATUS_ERROR || byte != p)
+        {
+            fprintf(stderr, "%s:%s:%d page %u read back wrong\n", __FILE__, __FUNCTION__, __LINE__, p);
+            return STATUS_ERROR;
+        }
+    }
+    if (pool.frame_count != BUFFER_POOL_MIN_FRAMES || pool.misses != 64 || pool.evictions != 64 - BUFFER_POOL_MIN_FRAMES)
+    {
+        fprintf(stderr, "%s:%s:%d %zu misses and %zu evictions over %u frames\n", __FILE__, __FUNCTION__, __LINE__, pool.misses, pool.evictions, pool.frame_count);
+        return STATUS_ERROR;
+    }
+
+    // a page that keeps being used survives a scan of the whole file
+    unsigned char byte;
+    for (int round = 0; round < 4; round++)
+    {
+        if (buffer_pool_read(&pool, 5, &byte, 1, false) == STATUS_ERROR)
+            return STATUS_ERROR;
+        for (uint32_t p = 1; p < 64; p++)
+        {
+            if (buffer_pool_read(&pool, p * BUFFER_POOL_PAGE_SIZE, &byte, 1, true) == STATUS_ERROR || byte != p)
+                return STATUS_ERROR;
+        }
+    }
+    size_t misses = pool.misses;
+    if (buffer_pool_read(&pool, 5, &byte, 1, false) == STATUS_ERROR || byte != 0 || pool.misses != misses)
+    {
+        fprintf(stderr, "%s:%s:%d hot page was evicted by a scan\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_buffer_pool(&pool);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+int test_pins_and_writes(void)
+{
+    int fd = create_test_file("test/src/test_db.bin", 64);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    buffer_pool pool;
+    if (buffer_pool_init(&pool, fd, 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // pinned frames are never evicted, once every frame is pinned a new page cannot be read
+    const unsigned char *frames[BUFFER_POOL_MIN_FRAMES];
+    for (uint32_t p = 0; p < BUFFER_POOL_MIN_FRAMES; p++)
+    {
+        if (!(frames[p] = buffer_pool_pin(&pool, p, false)) || frames[p][0] != p)
+            return STATUS_ERROR;
+    }
+    if (buffer_pool_pin(&pool, BUFFER_POOL_MIN_FRAMES, false))
+    {
+        fprintf(stderr, "%s:%s:%d a pinned frame was evicted\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    for (uint32_t p = 0; p < BUFFER_POOL_MIN_FRAMES; p++)
+        buffer_pool_unpin(&pool, frames[p]);
+
+    // a write spanning two resident pages is seen by later reads
+    unsigned char buf[64], out[64];
+    memset(buf, 0xAB, sizeof(buf));
+    uint32_t offset = 3 * BUFFER_POOL_PAGE_SIZE - 32;
+    if (pwrite(fd, buf, sizeof(buf), offset) != sizeof(buf))
+        return STATUS_ERROR;
+    buffer_pool_write(&pool, offset, buf, sizeof(buf));
+    if (buffer_pool_read(&pool, offset, out, sizeof(out), false) == STATUS_ERROR || memcmp(buf, out, sizeof(buf)))
+    {
+        fprintf(stderr, "%s:%s:%d write not seen by the pool\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_buffer_pool(&pool);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+
+int main(void)
+{
+    printf("test_clock_eviction()...");
+    if (test_clock_eviction() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_pins_and_writes()...");
+    if (test_pins_and_writes() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
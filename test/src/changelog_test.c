@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <endian.h>
+
+#include "common.h"
+#include "changelog.h"
+
+#define TEST_SEQ_FILE "test/src/test_changelog.seq"
+
+
+int test_record_and_find(void)
+{
+    changelog log;
+    if (changelog_init(&log, 8, 100) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // changes are numbered after the sequence number the log starts from
+    if (changelog_record(&log, CHANGE_ADD, "Alice", "1 Main st.", 10) == STATUS_ERROR ||
+        changelog_record(&log, CHANGE_UPDATE, "Alice", NULL, 20) == STATUS_ERROR ||
+        changelog_record(&log, CHANGE_DELETE, "Alice", NULL, 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (log.count != 3 || log.last_seq != 103 || changelog_get(&log, 0)->seq != 101)
+        return STATUS_ERROR;
+    if (strcmp(changelog_get(&log, 0)->address, "1 Main st.") != 0 || changelog_get(&log, 1)->address != NULL ||
+        changelog_get(&log, 1)->hours != 20 || changelog_get(&log, 2)->type != CHANGE_DELETE)
+        return STATUS_ERROR;
+
+    // the changes after a sequence number start at the first one newer than it
+    if (changelog_find(&log, 100) != 0 || changelog_find(&log, 101) != 1 || changelog_find(&log, 103) != 3)
+        return STATUS_ERROR;
+    if (!changelog_covers(&log, 100) || !changelog_covers(&log, 103) || changelog_covers(&log, 99) || changelog_covers(&log, 104))
+        return STATUS_ERROR;
+
+    // changes applied elsewhere keep their numbers, which only move forward
+    if (changelog_append(&log, 103, 0, CHANGE_ADD, "Bob", "", 1) == STATUS_SUCCESS ||
+        changelog_append(&log, 200, 0, CHANGE_ADD, "Bob", "", 1) == STATUS_ERROR || log.last_seq != 200)
+        return STATUS_ERROR;
+    if (changelog_find(&log, 150) != 3 || !changelog_covers(&log, 150))
+        return STATUS_ERROR;
+
+    free_changelog(&log);
+    return STATUS_SUCCESS;
+}
+
+int test_ring_eviction(void)
+{
+    changelog log;
+    if (changelog_init(&log, 4, 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // the oldest changes make room for new ones once the ring is full
+    for (int i = 0; i < 10; i++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        if (changelog_record(&log, CHANGE_ADD, name, "", i) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (log.count != 4 || log.last_seq != 10)
+        return STATUS_ERROR;
+    for (size_t i = 0; i < log.count; i++)
+    {
+        if (changelog_get(&log, i)->seq != 7 + i || changelog_get(&log, i)->hours != 6 + i)
+            return STATUS_ERROR;
+    }
+
+    // a reader further behind than the log reaches can't catch up from it
+    if (changelog_covers(&log, 5) || !changelog_covers(&log, 6) || changelog_find(&log, 8) != 2)
+        return STATUS_ERROR;
+
+    changelog_reset(&log, 42);
+    if (log.count != 0 || !changelog_covers(&log, 42) || changelog_covers(&log, 41))
+        return STATUS_ERROR;
+
+    free_changelog(&log);
+    return STATUS_SUCCESS;
+}
+
+int test_persisted_sequence(void)
+{
+    unlink(TEST_SEQ_FILE);
+    changelog log;
+    if (changelog_open(&log, 4, TEST_SEQ_FILE) == STATUS_ERROR)
+        return STATUS_ERROR;
+    uint64_t first = log.last_seq;
+    if (changelog_record(&log, CHANGE_ADD, "Alice", "1 Main st.", 10) == STATUS_ERROR || log.last_seq != first + 1)
+        return STATUS_ERROR;
+    free_changelog(&log);
+
+    // a later start continues after every number the earlier one could have used
+    if (changelog_open(&log, 4, TEST_SEQ_FILE) == STATUS_ERROR || log.last_seq <= first + 1)
+        return STATUS_ERROR;
+    free_changelog(&log);
+
+    // even when the clock is behind the numbers used before, as after it was set back
+    uint64_t ahead = changelog_now_us() + 3600ULL * 1000000 * 24 * 365;
+    uint64_t stored = htobe64(ahead);
+    int fd = open(TEST_SEQ_FILE, O_WRONLY);
+    if (fd == -1 || pwrite(fd, &stored, sizeof(stored), 0) != sizeof(stored))
+        return STATUS_ERROR;
+    close(fd);
+    if (changelog_open(&log, 4, TEST_SEQ_FILE) == STATUS_ERROR || log.last_seq < ahead)
+        return STATUS_ERROR;
+
+    // numbers past the reservation are reserved again before they are used
+    uint64_t reserved = log.reserved_seq;
+    if (changelog_append(&log, reserved + 1, 0, CHANGE_ADD, "Bob", "", 1) == STATUS_ERROR || log.reserved_seq <= reserved + 1)
+        return STATUS_ERROR;
+    free_changelog(&log);
+    if (changelog_open(&log, 4, TEST_SEQ_FILE) == STATUS_ERROR || log.last_seq <= reserved + 1)
+        return STATUS_ERROR;
+    free_changelog(&log);
+    unlink(TEST_SEQ_FILE);
+    return STATUS_SUCCESS;
+}
+
+int main(void)
+{
+    printf("test_record_and_find()...");
+    if (test_record_and_find() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_ring_eviction()...");
+    if (test_ring_eviction() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_persisted_sequence()...");
+    if (test_persisted_sequence() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "crc32c.h"
+
+
+int test_check_value(void)
+{
+    // standard check value of CRC-32C
+    const char *text = "123456789";
+    if (crc32c(0, text, strlen(text)) != 0xE3069283 || crc32c_sw(0, text, strlen(text)) != 0xE3069283)
+    {
+        fprintf(stderr, "%s:%s:%d wrong check value %08x\n", __FILE__, __FUNCTION__, __LINE__, crc32c(0, text, strlen(text)));
+        return STATUS_ERROR;
+    }
+
+    // a crc can be continued over the next bytes
+    if (crc32c(crc32c(0, text, 4), text + 4, strlen(text) - 4) != 0xE3069283)
+    {
+        fprintf(stderr, "%s:%s:%d continued crc differs\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int test_matches_table(void)
+{
+    size_t len = 4 * 3 * CRC32C_STREAM_LEN + 123;
+    unsigned char *buf = malloc(len + 8);
+    srand(1);
+    for (size_t i = 0; i < len + 8; i++)
+        buf[i] = rand();
+
+    // lengths around the three stream split and unaligned starts take every path of the fast implementation
+    size_t lengths[] = { 0, 1, 7, 8, 9, 63, 64, 255, 3 * CRC32C_STREAM_LEN - 1, 3 * CRC32C_STREAM_LEN,
+        3 * CRC32C_STREAM_LEN + 1, 6 * CRC32C_STREAM_LEN + 17, len };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+    {
+        for (size_t misalign = 0; misalign < 8; misalign += 3)
+        {
+            if (crc32c(0x1234, buf + misalign, lengths[i]) != crc32c_sw(0x1234, buf + misalign, lengths[i]))
+            {
+                fprintf(stderr, "%s:%s:%d crc of %zu bytes at %zu differs from the table\n", __FILE__, __FUNCTION__, __LINE__, lengths[i], misalign);
+                free(buf);
+                return STATUS_ERROR;
+            }
+        }
+    }
+
+    free(buf);
+    return STATUS_SUCCESS;
+}
+
+int test_patch(void)
+{
+    size_t len = 64 * 1024;
+    unsigned char *buf = malloc(len);
+    unsigned char *old_bytes = malloc(16);
+    srand(2);
+    for (size_t i = 0; i < len; i++)
+        buf[i] = rand();
+
+    // overwrite a few bytes at the start, middle and end and patch the crc instead of recomputing it
+    size_t offsets[] = { 0, 1000, len - 16, len - 4 };
+    uint32_t crc = crc32c(0, buf, len);
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+    {
+        size_t n = len - offsets[i] < 16 ? len - offsets[i] : 16;
+        memcpy(old_bytes, buf + offsets[i], n);
+        for (size_t k = 0; k < n; k++)
+            buf[offsets[i] + k] ^= 0x5a + k;
+
+        crc = crc32c_patch(crc, old_bytes, buf + offsets[i], n, len - offsets[i] - n);
+        if (crc != crc32c(0, buf, len))
+        {
+            fprintf(stderr, "%s:%s:%d patch at %zu differs from a full crc\n", __FILE__, __FUNCTION__, __LINE__, offsets[i]);
+            free(buf);
+            free(old_bytes);
+            return STATUS_ERROR;
+        }
+    }
+
+    free(buf);
+    free(old_bytes);
+    return STATUS_SUCCESS;
+}
+
+
+int main(void)
+{
+    printf("test_check_value()...");
+    if (test_check_value() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_matches_table()...");
+    if (test_matches_table() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_patch()...");
+    if (test_patch() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "models.h"
+#include "proto.h"
+#include "frame.h"
+#include "db_async.h"
+#include "test_server.h"
+
+#define TEST_DB_FILE "test/src/test_db_async.bin"
+#define TEST_IN_FLIGHT 5000
+
+
+// what a request's callback saw
+typedef struct {
+    int calls;
+    int status;
+    size_t employees_size;
+    uint32_t hours;
+} completion;
+
+static void record_completion(int status, const unsigned char *data, uint32_t data_len, void *arg)
+{
+    completion *done = arg;
+    done->calls++;
+    done->status = status;
+    if (status != STATUS_SUCCESS || data_len == 0)
+        return;
+
+    employee *employees;
+    if (deserialize_list_employee_response((unsigned char *)data, data_len, &employees, &done->employees_size) == STATUS_ERROR)
+    {
+        done->status = STATUS_ERROR;
+        return;
+    }
+    done->hours = employees[0].hours;
+    for (size_t i = 0; i < done->employees_size; i++)
+    {
+        free(employees[i].name);
+        free(employees[i].address);
+    }
+    free(employees);
+}
+
+static int callbacks(uint16_t version)
+{
+    test_server s;
+    if (start_test_server(&s, TEST_DB_FILE, NULL) == STATUS_ERROR)
+        return STATUS_ERROR;
+    db_async_client c;
+    if (db_async_connect(&c, "127.0.0.1", s.port, version, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // nothing is sent until the client is polled, then every callback runs once with its own response
+    completion done[7] = { 0 };
+    db_client_request requests[7] = {
+        { .option='a', .text="Alice Smith", .address="1 Oak st.", .hours=10 },
+        { .option='a', .text="Bob Jones", .address="2 Elm st.", .hours=20 },
+        { .option='u', .text="Bob Jones", .hours=25 },
+        { .option='d', .text="Nobody" },
+        { .option='p', .text="Bob" },
+        { .option='r', .hours=0, .max_hours=100 },
+        { .option='l' },
+    };
+    for (int i = 0; i < 7; i++)
+    {
+        if (db_async_submit(&c, requests + i, record_completion, done + i) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (c.in_flight != 7 || db_async_wait(&c) == STATUS_ERROR || c.in_flight != 0)
+        return STATUS_ERROR;
+    for (int i = 0; i < 7; i++)
+    {
+        if (done[i].calls != 1)
+            return STATUS_ERROR;
+    }
+    if (done[0].status != STATUS_SUCCESS || done[2].status != STATUS_SUCCESS || done[3].status != DB_CLIENT_NOT_FOUND ||
+        done[4].employees_size != 1 || done[4].hours != 25 || done[5].employees_size != 2 || done[6].employees_size != 2)
+        return STATUS_ERROR;
+
+    free_db_async_client(&c);
+    return stop_test_server(&s);
+}
+
+int test_callbacks(void)
+{
+    if (callbacks(PROTOCOL_V1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    return callbacks(PROTOCOL_V2);
+}
+
+static void count_success(int status, const unsigned char *data, uint32_t data_len, void *arg)
+{
+    (void)data;
+    (void)data_len;
+    if (status == STATUS_SUCCESS)
+        (*(int *)arg)++;
+}
+
+int test_many_in_flight(void)
+{
+    test_server s;
+    if (start_test_server(&s, TEST_DB_FILE, NULL) == STATUS_ERROR)
+        return STATUS_ERROR;
+    db_async_client c;
+    if (db_async_connect(&c, "127.0.0.1", s.port, PROTOCOL_V2, 2) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // one thread has every request in flight at once, more than the socket buffers hold
+    int succeeded = 0;
+    if (db_async_submit(&c, &(db_client_request) { .option='a', .text="Carol White", .address="3 Ash st.", .hours=0 }, count_success, &succeeded) == STATUS_ERROR ||
+        db_async_wait(&c) == STATUS_ERROR || succeeded != 1)
+        return STATUS_ERROR;
+    for (uint32_t i = 1; i <= TEST_IN_FLIGHT; i++)
+    {
+        if (db_async_submit(&c, &(db_client_request) { .option='u', .text="Carol White", .hours=i }, count_success, &succeeded) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (c.in_flight != TEST_IN_FLIGHT || db_async_wait(&c) == STATUS_ERROR || succeeded != TEST_IN_FLIGHT + 1)
+        return STATUS_ERROR;
+
+    // requests on one connection are answered in order, the last one submitted on it wins
+    completion done = { 0 };
+    if (db_async_submit(&c, &(db_client_request) { .option='l' }, record_completion, &done) == STATUS_ERROR ||
+        db_async_wait(&c) == STATUS_ERROR || done.employees_size != 1 || (done.hours != TEST_IN_FLIGHT && done.hours != TEST_IN_FLIGHT - 1))
+        return STATUS_ERROR;
+
+    free_db_async_client(&c);
+    return stop_test_server(&s);
+}
+
+int test_connection_failure(void)
+{
+    test_server s;
+    if (start_test_server(&s, TEST_DB_FILE, NULL) == STATUS_ERROR)
+        return STATUS_ERROR;
+    db_async_client c;
+    if (db_async_connect(&c, "127.0.0.1", s.port, PROTOCOL_V2, 2) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // the requests on the broken connection fail, those on the other one are answered
+    completion done[4] = { 0 };
+    for (int i = 0; i < 4; i++)
+    {
+        if (db_async_submit(&c, &(db_client_request) { .option='l' }, record_completion, done + i) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    shutdown(c.conns[0].fd, SHUT_RDWR);
+    if (db_async_wait(&c) == STATUS_ERROR || c.conns[0].fd != -1)
+        return STATUS_ERROR;
+    if (done[0].status != STATUS_ERROR || done[2].status != STATUS_ERROR || done[1].status != STATUS_SUCCESS || done[3].status != STATUS_SUCCESS)
+        return STATUS_ERROR;
+
+    // later requests only go to the connection left
+    completion later = { 0 };
+    if (db_async_submit(&c, &(db_client_request) { .option='l' }, record_completion, &later) == STATUS_ERROR ||
+        db_async_wait(&c) == STATUS_ERROR || later.calls != 1 || later.status != STATUS_SUCCESS)
+        return STATUS_ERROR;
+
+    free_db_async_client(&c);
+    return stop_test_server(&s);
+}
+
+int main(void)
+{
+    printf("test_callbacks()...");
+    if (test_callbacks() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_many_in_flight()...");
+    if (test_many_in_flight() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_connection_failure()...");
+    if (test_connection_failure() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "models.h"
+#include "proto.h"
+#include "frame.h"
+#include "shard.h"
+#include "db_client.h"
+#include "test_server.h"
+
+#define TEST_DB_FILE "test/src/test_db_client.bin"
+#define TEST_SHARDS 2
+#define TEST_MAX_CONNECTIONS 16
+#define TEST_THREADS 8
+#define TEST_ADDS_PER_THREAD 8
+#define TEST_SERVER_DB_FILE "test/src/test_db_client_server.bin"
+#define TEST_UNIX_PATH "test/src/test_db_client.sock"
+
+
+// a server answering requests the way bin/server does, one thread per connection, which counts the connections
+// a client opens
+typedef struct {
+    int listener;
+    char port[8];
+    db_shards shards;
+    pthread_mutex_t lock;
+    pthread_t accepter;
+    pthread_t workers[TEST_MAX_CONNECTIONS];
+    size_t worker_count;
+} fake_server;
+
+typedef struct {
+    fake_server *server;
+    int fd;
+} test_worker;
+
+static int serve_request(fake_server *s, int fd, uint16_t version, unsigned char **payload, size_t *capacity)
+{
+    client_connection conn = { 0 };
+    uint32_t request_id = 0;
+    if (version >= PROTOCOL_V2)
+    {
+        frame_header h;
+        if (receive_frame(fd, &h, payload, capacity) <= 0)
+            return STATUS_ERROR;
+        request_id = h.request_id;
+        conn.buf_size = h.payload_len;
+    }
+    else
+    {
+        unsigned char header[sizeof(proto_msg) + sizeof(uint32_t)];
+        if (receive_all(fd, header, sizeof(header), 0) <= 0)
+            return STATUS_ERROR;
+        conn.buf_size = ntohl(*(uint32_t *)(header + sizeof(proto_msg)));
+        unsigned char *cursor = *payload;
+        if (resize_buffer(payload, &cursor, capacity, conn.buf_size) == STATUS_ERROR ||
+            (conn.buf_size > 0 && receive_all(fd, *payload, conn.buf_size, 0) <= 0))
+            return STATUS_ERROR;
+    }
+    conn.buf = *payload;
+
+    size_t response_size = sizeof(proto_msg) + 1 + sizeof(uint32_t);
+    unsigned char *response = calloc(1, response_size);
+    *(proto_msg *)response = DB_ACCESS_RESPONSE;
+    pthread_mutex_lock(&s->lock);
+    int status = deserialize_request_options(&s->shards, &response, &response_size, &conn);
+    pthread_mutex_unlock(&s->lock);
+    if (status == STATUS_SUCCESS)
+    {
+        if (version >= PROTOCOL_V2)
+        {
+            size_t header_size = sizeof(proto_msg) + 1 + sizeof(uint32_t);
+            frame_header h = { .opcode=DB_ACCESS_RESPONSE, .flags=response[sizeof(proto_msg)], .request_id=request_id, .payload_len=(uint32_t)(response_size - header_size) };
+            status = send_frame(fd, &h, response + header_size, MSG_NOSIGNAL);
+        }
+        else if (send_all(fd, response, response_size, MSG_NOSIGNAL) == STATUS_ERROR)
+        {
+            status = STATUS_ERROR;
+        }
+    }
+    free(response);
+    return status;
+}
+
+static void *serve_connection(void *arg)
+{
+    test_worker *w = arg;
+    unsigned char handshake[HANDSHAKE_REQ_SIZE];
+    unsigned char response[sizeof(proto_msg) + 1];
+    if (receive_all(w->fd, handshake, HANDSHAKE_REQ_SIZE, 0) == HANDSHAKE_REQ_SIZE && *(proto_msg *)handshake == HANDSHAKE_REQUEST)
+    {
+        uint16_t version = ntohs(*(uint16_t *)(handshake + sizeof(proto_msg)));
+        *(proto_msg *)response = HANDSHAKE_RESPONSE;
+        response[sizeof(proto_msg)] = 0;
+        unsigned char *payload = NULL;
+        size_t capacity = 0;
+        if (send_all(w->fd, response, sizeof(response), 0) != STATUS_ERROR)
+        {
+            // served until the client closes the connection
+            while (serve_request(w->server, w->fd, version, &payload, &capacity) == STATUS_SUCCESS)
+                ;
+        }
+        free(payload);
+    }
+    close(w->fd);
+    free(w);
+    return NULL;
+}
+
+static void *accept_connections(void *arg)
+{
+    fake_server *s = arg;
+    int fd;
+    while ((fd = accept(s->listener, NULL, NULL)) != -1)
+    {
+        if (s->worker_count == TEST_MAX_CONNECTIONS)
+        {
+            close(fd);
+            break;
+        }
+        test_worker *w = malloc(sizeof(test_worker));
+        *w = (test_worker) { .server=s, .fd=fd };
+        pthread_create(s->workers + s->worker_count++, NULL, serve_connection, w);
+    }
+    return NULL;
+}
+
+static int start_server(fake_server *s)
+{
+    db_shards_remove_files(TEST_DB_FILE, TEST_SHARDS);
+    db_shard_options options = { 0 };
+    *s = (fake_server) { .worker_count=0 };
+    if (db_shards_open(&s->shards, TEST_DB_FILE, TEST_SHARDS, true, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+    pthread_mutex_init(&s->lock, NULL);
+
+    struct sockaddr_in addr = { .sin_family=AF_INET, .sin_addr.s_addr=htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    s->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->listener == -1 || bind(s->listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(s->listener, TEST_MAX_CONNECTIONS) == -1 ||
+        getsockname(s->listener, (struct sockaddr *)&addr, &addr_len) == -1)
+        return STATUS_ERROR;
+    snprintf(s->port, sizeof(s->port), "%u", ntohs(addr.sin_port));
+    return pthread_create(&s->accepter, NULL, accept_connections, s) == 0 ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+// the clients must have closed their connections for the workers to finish
+static void stop_server(fake_server *s)
+{
+    shutdown(s->listener, SHUT_RDWR);
+    pthread_join(s->accepter, NULL);
+    close(s->listener);
+    for (size_t i = 0; i < s->worker_count; i++)
+        pthread_join(s->workers[i], NULL);
+    pthread_mutex_destroy(&s->lock);
+    free_db_shards(&s->shards);
+    db_shards_remove_files(TEST_DB_FILE, TEST_SHARDS);
+}
+
+static int find_hours(employee *employees, size_t employees_size, const char *name, uint32_t *hours)
+{
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        if (strcmp(employees[i].name, name) == 0)
+        {
+            *hours = employees[i].hours;
+            return STATUS_SUCCESS;
+        }
+    }
+    return STATUS_ERROR;
+}
+
+static int count_view(const employee_view *e, void *arg)
+{
+    (*(size_t *)arg)++;
+    return e->hours == 25 || e->hours == 10 ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+static int round_trips(uint16_t version, const char *unix_path)
+{
+    test_server s;
+    if (start_test_server(&s, TEST_SERVER_DB_FILE, unix_path) == STATUS_ERROR)
+        return STATUS_ERROR;
+    db_client c;
+    if ((unix_path ? db_client_connect(&c, unix_path, NULL, version, 2) : db_client_connect(&c, "127.0.0.1", s.port, version, 2)) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    if (db_client_add(&c, "Alice Smith", "1 Oak st.", 10) != STATUS_SUCCESS ||
+        db_client_add(&c, "Bob Jones", "2 Elm st.", 20) != STATUS_SUCCESS ||
+        db_client_add(&c, "Alan Turing", "3 Oak st.", 30) != STATUS_SUCCESS ||
+        db_client_update(&c, "Bob Jones", 25) != STATUS_SUCCESS ||
+        db_client_delete(&c, "Alan Turing") != STATUS_SUCCESS)
+        return STATUS_ERROR;
+
+    // the server's error code comes back on its own, the connection stays usable
+    if (db_client_update(&c, "Nobody", 1) != DB_CLIENT_NOT_FOUND || db_client_delete(&c, "Alan Turing") != DB_CLIENT_NOT_FOUND)
+        return STATUS_ERROR;
+
+    employee *employees;
+    size_t employees_size;
+    uint32_t hours;
+    if (db_client_list(&c, &employees, &employees_size) != STATUS_SUCCESS || employees_size != 2 ||
+        find_hours(employees, employees_size, "Bob Jones", &hours) == STATUS_ERROR || hours != 25 ||
+        find_hours(employees, employees_size, "Alice Smith", &hours) == STATUS_ERROR || hours != 10)
+        return STATUS_ERROR;
+    db_client_free_employees(employees, employees_size);
+
+    if (db_client_range(&c, 15, 30, &employees, &employees_size) != STATUS_SUCCESS || employees_size != 1 ||
+        strcmp(employees[0].name, "Bob Jones") != 0)
+        return STATUS_ERROR;
+    db_client_free_employees(employees, employees_size);
+
+    if (db_client_top(&c, 1, &employees, &employees_size) != STATUS_SUCCESS || employees_size != 1 || employees[0].hours != 25)
+        return STATUS_ERROR;
+    db_client_free_employees(employees, employees_size);
+
+    if (db_client_prefix(&c, "Ali", &employees, &employees_size) != STATUS_SUCCESS || employees_size != 1 ||
+        strcmp(employees[0].name, "Alice Smith") != 0)
+        return STATUS_ERROR;
+    db_client_free_employees(employees, employees_size);
+
+    if (db_client_search_address(&c, "Elm", &employees, &employees_size) != STATUS_SUCCESS || employees_size != 1 ||
+        strcmp(employees[0].address, "2 Elm st.") != 0)
+        return STATUS_ERROR;
+    db_client_free_employees(employees, employees_size);
+
+    // employees are passed on as they are received, without being copied
+    size_t count = 0;
+    if (db_client_each(&c, &(db_client_request) { .option='l' }, count_view, &count) != STATUS_SUCCESS || count != 2)
+        return STATUS_ERROR;
+
+    // a query matching nothing answers with no employees
+    if (db_client_prefix(&c, "Zed", &employees, &employees_size) != STATUS_SUCCESS || employees_size != 0)
+        return STATUS_ERROR;
+    db_client_free_employees(employees, employees_size);
+
+    free_db_client(&c);
+    return stop_test_server(&s);
+}
+
+// the calls answered by bin/server itself
+int test_round_trips(void)
+{
+    if (round_trips(PROTOCOL_V1, NULL) == STATUS_ERROR || round_trips(PROTOCOL_V2, NULL) == STATUS_ERROR)
+        return STATUS_ERROR;
+    // the same calls through a unix domain socket, as a client on the server's host makes them
+    return round_trips(PROTOCOL_V2, TEST_UNIX_PATH);
+}
+
+typedef struct {
+    db_client *c;
+    int thread;
+    int status;
+} caller_args;
+
+static void *call_concurrently(void *arg)
+{
+    caller_args *args = arg;
+    args->status = STATUS_ERROR;
+    for (int i = 0; i < TEST_ADDS_PER_THREAD; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d-%d", args->thread, i);
+        if (db_client_add(args->c, name, "4 Pine st.", 0) != STATUS_SUCCESS)
+            return NULL;
+        for (uint32_t hours = 1; hours <= 10; hours++)
+        {
+            if (db_client_update(args->c, name, hours) != STATUS_SUCCESS)
+                return NULL;
+        }
+    }
+    args->status = STATUS_SUCCESS;
+    return NULL;
+}
+
+int test_concurrent_calls(void)
+{
+    fake_server s;
+    if (start_server(&s) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // more threads than connections, the calls wait their turn for one
+    db_client c;
+    if (db_client_connect(&c, "127.0.0.1", s.port, PROTOCOL_V2, 3) == STATUS_ERROR)
+        return STATUS_ERROR;
+    pthread_t threads[TEST_THREADS];
+    caller_args args[TEST_THREADS];
+    for (int i = 0; i < TEST_THREADS; i++)
+    {
+        args[i] = (caller_args) { .c=&c, .thread=i };
+        if (pthread_create(threads + i, NULL, call_concurrently, args + i) != 0)
+            return STATUS_ERROR;
+    }
+    for (int i = 0; i < TEST_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        if (args[i].status == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (s.worker_count != 3 || c.idle_count != 3)
+        return STATUS_ERROR;
+
+    employee *employees;
+    size_t employees_size;
+    if (db_client_list(&c, &employees, &employees_size) != STATUS_SUCCESS || employees_size != TEST_THREADS * TEST_ADDS_PER_THREAD)
+        return STATUS_ERROR;
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        if (employees[i].hours != 10)
+            return STATUS_ERROR;
+    }
+    db_client_free_employees(employees, employees_size);
+
+    free_db_client(&c);
+    stop_server(&s);
+    return STATUS_SUCCESS;
+}
+
+int test_reconnect(void)
+{
+    fake_server s;
+    if (start_server(&s) == STATUS_ERROR)
+        return STATUS_ERROR;
+    db_client c;
+    if (db_client_connect(&c, "127.0.0.1", s.port, PROTOCOL_V2, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // the call on a broken connection fails without being retried, the next one connects again
+    shutdown(c.conns[0].fd, SHUT_RDWR);
+    if (db_client_add(&c, "Carol White", "5 Ash st.", 8) != STATUS_ERROR || c.conns[0].fd != -1)
+        return STATUS_ERROR;
+    if (db_client_add(&c, "Carol White", "5 Ash st.", 8) != STATUS_SUCCESS || s.worker_count != 2)
+        return STATUS_ERROR;
+    free_db_client(&c);
+
+    // a pool without connections is refused, and what is left of it can still be freed
+    if (db_client_connect(&c, "127.0.0.1", s.port, PROTOCOL_V2, 0) != STATUS_ERROR)
+        return STATUS_ERROR;
+    free_db_client(&c);
+    stop_server(&s);
+    return STATUS_SUCCESS;
+}
+
+int main(void)
+{
+    printf("test_round_trips()...");
+    if (test_round_trips() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_concurrent_calls()...");
+    if (test_concurrent_calls() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_reconnect()...");
+    if (test_reconnect() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
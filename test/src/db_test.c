@@ -0,0 +1,1371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "serialize.h"
+#include "db.h"
+
+
+int create_test_db(char *fname, int checkpoint_flags)
+{
+    int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to open file: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    employee employees[3] = {
+        { .name="John Doe", .address="123 Wallaby Way, Sydney", .hours=120 },
+        { .name="Sally Sample", .address="123 easy st, Sydney", .hours=180 },
+        { .name="Suzy Mediocare", .address="666 Sunny Ln, New York", .hours=220 },
+    };
+
+    db_header dbhdr = { .fsize=sizeof(db_header), .employee_count=3 };
+    if (checkpoint_db(fd, &dbhdr, employees, checkpoint_flags) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d checkpoint_db() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+int test_update_hours_in_place(void)
+{
+    int fd = create_test_db("test/src/test_db.bin", DB_CHECKPOINT_OFFSETS);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    if (db_load(&db, fd, 0, 2) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    struct stat before;
+    fstat(fd, &before);
+
+    size_t idx;
+    if (db_find_employee(&db, "Sally Sample", &idx) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_find_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (db_update_hours(&db, idx, 40) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_update_hours() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // the file keeps its size and its optional sections
+    struct stat after;
+    fstat(fd, &after);
+    if (after.st_size != before.st_size)
+    {
+        fprintf(stderr, "%s:%s:%d file size changed: %zu should be %zu\n", __FILE__, __FUNCTION__, __LINE__, (size_t)after.st_size, (size_t)before.st_size);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+
+    // reload and check the update was persisted
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (!(db.checkpoint_flags & DB_CHECKPOINT_OFFSETS))
+    {
+        fprintf(stderr, "%s:%s:%d offset directory lost by update\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (db.employees[1].hours != 40 || db.employees[0].hours != 120 || db.employees[2].hours != 220)
+    {
+        fprintf(stderr, "%s:%s:%d hours not updated correctly: %u should be 40\n", __FILE__, __FUNCTION__, __LINE__, db.employees[1].hours);
+        return STATUS_ERROR;
+    }
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+int test_update_after_add(void)
+{
+    int fd = create_test_db("test/src/test_db.bin", 0);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    employee e = { .name=strdup("Joe Sample"), .address=strdup("456 easy st. Mobile"), .hours=10 };
+    if (db_add_employee(&db, &e) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_add_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // offsets of the added record must be known for the in place write
+    if (db_update_hours(&db, 3, 99) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_update_hours() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (db.hdr.employee_count != 4 || strcmp(db.employees[3].name, "Joe Sample") || db.employees[3].hours != 99)
+    {
+        fprintf(stderr, "%s:%s:%d added employee not updated correctly\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+int test_delete_tombstone(void)
+{
+    int fd = create_test_db("test/src/test_db.bin", DB_CHECKPOINT_OFFSETS);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    struct stat before;
+    fstat(fd, &before);
+
+    size_t idx;
+    if (db_find_employee(&db, "John Doe", &idx) == STATUS_ERROR || db_delete_employee(&db, idx) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d deleting employee failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (db_find_employee(&db, "John Doe", &idx) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d deleted employee still found\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // deleting only marks the record, the file keeps its size
+    struct stat after;
+    fstat(fd, &after);
+    if (after.st_size != before.st_size)
+    {
+        fprintf(stderr, "%s:%s:%d file size changed: %zu should be %zu\n", __FILE__, __FUNCTION__, __LINE__, (size_t)after.st_size, (size_t)before.st_size);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // order of the remaining records is preserved
+    if (db.dead_count != 1 || db.employees[0].name || strcmp(db.employees[1].name, "Sally Sample") || strcmp(db.employees[2].name, "Suzy Mediocare"))
+    {
+        fprintf(stderr, "%s:%s:%d tombstone not loaded correctly\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+int test_incremental_compaction(void)
+{
+    char *fname = "test/src/test_db.bin";
+    int fd = create_test_db(fname, DB_CHECKPOINT_OFFSETS);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    db.path = fname;
+    db.compact_min_dead = 1;
+    db.compact_ratio = 0.0;
+
+    // grow the table so compaction takes several steps
+    for (int i = 0; i < 20; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        employee e = { .name=strdup(name), .address=strdup("1 Main st."), .hours=i };
+        if (db_add_employee(&db, &e) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d db_add_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+
+    for (size_t i = 3; i < 23; i += 2)
+    {
+        if (db_delete_employee(&db, i) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d db_delete_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+
+    if (!db_compaction_pending(&db) || db_compact_step(&db, 4) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d compaction did not start\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // mutate records on both sides of the compaction cursor while it is running
+    size_t idx;
+    if (db_find_employee(&db, "Sally Sample", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 7) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (db_find_employee(&db, "Suzy Mediocare", &idx) == STATUS_ERROR || db_delete_employee(&db, idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (db_find_employee(&db, "Employee 17", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 180) == STATUS_ERROR)
+        return STATUS_ERROR;
+    employee e = { .name=strdup("Late Addition"), .address=strdup("2 Main st."), .hours=5 };
+    if (db_add_employee(&db, &e) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    for (int steps = 0; db.compaction.fd != -1 || steps == 0; steps++)
+    {
+        if (steps > 10 || db_compact_step(&db, 4) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d compaction did not finish\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+
+    // the server keeps using the switched file descriptor
+    fd = db.fd;
+    if (db_find_employee(&db, "Employee 1", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 1000) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_database(&db);
+
+    // reload from the path to see what was switched in
+    close(fd);
+    fd = open(fname, O_RDWR);
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // 3 original + 20 added + 1 late, minus 10 deleted before compaction and one deleted while running
+    size_t live = 0;
+    for (size_t i = 0; i < db.hdr.employee_count; i++)
+        live += db.employees[i].name != NULL;
+
+    if (live != 13 || db.hdr.employee_count > 14)
+    {
+        fprintf(stderr, "%s:%s:%d wrong number of records after compaction: %zu live of %u\n", __FILE__, __FUNCTION__, __LINE__, live, db.hdr.employee_count);
+        return STATUS_ERROR;
+    }
+
+    if (!(db.checkpoint_flags & DB_CHECKPOINT_OFFSETS))
+    {
+        fprintf(stderr, "%s:%s:%d offset directory not kept by compaction\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    struct { char *name; uint32_t hours; } expected[] = {
+        { "John Doe", 120 }, { "Sally Sample", 7 }, { "Employee 1", 1000 }, { "Employee 17", 180 }, { "Late Addition", 5 },
+    };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        if (db_find_employee(&db, expected[i].name, &idx) == STATUS_ERROR || db.employees[idx].hours != expected[i].hours)
+        {
+            fprintf(stderr, "%s:%s:%d employee '%s' not compacted correctly\n", __FILE__, __FUNCTION__, __LINE__, expected[i].name);
+            return STATUS_ERROR;
+        }
+    }
+
+    if (db_find_employee(&db, "Suzy Mediocare", &idx) == STATUS_SUCCESS || db_find_employee(&db, "Employee 0", &idx) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d deleted employee survived compaction\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // the hours index follows the renumbered slots
+    employee *by_hours;
+    size_t by_hours_size;
+    if (db_hours_range(&db, 0, UINT32_MAX, &by_hours, &by_hours_size) == STATUS_ERROR || by_hours_size != db.hdr.employee_count - db.dead_count)
+    {
+        fprintf(stderr, "%s:%s:%d hours index out of sync after compaction\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    for (size_t i = 0; i < by_hours_size; i++)
+    {
+        if (!by_hours[i].name || (i > 0 && by_hours[i - 1].hours > by_hours[i].hours))
+        {
+            fprintf(stderr, "%s:%s:%d hours index not ordered after compaction\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+    free(by_hours);
+
+    if (db_top_hours(&db, 1, &by_hours, &by_hours_size) == STATUS_ERROR || by_hours_size != 1 || strcmp(by_hours[0].name, "Employee 1"))
+    {
+        fprintf(stderr, "%s:%s:%d wrong employee with the most hours\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free(by_hours);
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+int test_name_index_mapped(void)
+{
+    int fd = create_test_db("test/src/test_db.bin", DB_CHECKPOINT_NAME_INDEX);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // the index written by the checkpoint is used as is
+    if (!db.names.map)
+    {
+        fprintf(stderr, "%s:%s:%d name index was not mapped\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    size_t idx;
+    if (db_find_employee(&db, "Suzy Mediocare", &idx) == STATUS_ERROR || idx != 2)
+    {
+        fprintf(stderr, "%s:%s:%d mapped name index lookup failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (db_delete_employee(&db, 0) == STATUS_ERROR || db_find_employee(&db, "John Doe", &idx) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d deleted employee still indexed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // appending detaches the index from the file it overwrites
+    employee e = { .name=strdup("Joe Sample"), .address=strdup("456 easy st. Mobile"), .hours=10 };
+    if (db_add_employee(&db, &e) == STATUS_ERROR || db.names.map)
+    {
+        fprintf(stderr, "%s:%s:%d db_add_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (db_find_employee(&db, "Joe Sample", &idx) == STATUS_ERROR || idx != 3 ||
+        db_find_employee(&db, "Sally Sample", &idx) == STATUS_ERROR || idx != 1)
+    {
+        fprintf(stderr, "%s:%s:%d detached name index lookup failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+
+    // the append left an empty index section, the index is rebuilt and written again by a checkpoint
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR || db.names.map || !(db.checkpoint_flags & DB_CHECKPOINT_NAME_INDEX))
+    {
+        fprintf(stderr, "%s:%s:%d name index should be rebuilt after append\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (db_checkpoint(&db) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_checkpoint() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR || !db.names.map)
+    {
+        fprintf(stderr, "%s:%s:%d name index not mapped after checkpoint\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    const char *expected[] = { "Sally Sample", "Suzy Mediocare", "Joe Sample" };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        if (db_find_employee(&db, expected[i], &idx) == STATUS_ERROR || idx != i)
+        {
+            fprintf(stderr, "%s:%s:%d employee '%s' not found at %zu\n", __FILE__, __FUNCTION__, __LINE__, expected[i], i);
+            return STATUS_ERROR;
+        }
+    }
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+
+int test_address_dictionary(void)
+{
+    char *fname = "test/src/test_db.bin";
+    int fd = create_test_db(fname, DB_CHECKPOINT_ADDRESS_DICTIONARY);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    if (db_load(&db, fd, 0, 2) == STATUS_ERROR || !(db.checkpoint_flags & DB_CHECKPOINT_ADDRESS_DICTIONARY) || db.records_start == sizeof(db_header))
+    {
+        fprintf(stderr, "%s:%s:%d db_load() did not find the address dictionary\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    db.path = fname;
+    db.compact_min_dead = 1;
+    db.compact_ratio = 0.0;
+
+    // appended records share one copy of an address
+    for (int i = 0; i < 8; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        employee e = { .name=strdup(name), .address=strdup(i % 2 ? "1 Main st." : "123 easy st, Sydney"), .hours=i };
+        if (db_add_employee(&db, &e) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d db_add_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+
+    if (db.employees[3].address != db.employees[5].address || db.employees[1].address != db.employees[7].address || db.address_pool.count != 4)
+    {
+        fprintf(stderr, "%s:%s:%d equal addresses are not shared\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // in place writes to both dictionary and inline records
+    size_t idx;
+    if (db_find_employee(&db, "Sally Sample", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 7) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 4", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 44) == STATUS_ERROR ||
+        db_find_employee(&db, "John Doe", &idx) == STATUS_ERROR || db_delete_employee(&db, idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // compaction writes the pool as the dictionary of the new file
+    for (int steps = 0; db.compaction.fd != -1 || steps == 0; steps++)
+    {
+        if (steps > 10 || db_compact_step(&db, 4) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d compaction did not finish\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+    fd = db.fd;
+    if (db_find_employee(&db, "Employee 1", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 1000) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_database(&db);
+
+    struct { char *name; char *address; uint32_t hours; } expected[] = {
+        { "Sally Sample", "123 easy st, Sydney", 7 }, { "Suzy Mediocare", "666 Sunny Ln, New York", 220 },
+        { "Employee 1", "1 Main st.", 1000 }, { "Employee 4", "123 easy st, Sydney", 44 },
+    };
+    for (int round = 0; round < 2; round++)
+    {
+        lseek(fd, 0, SEEK_SET);
+        if (db_load(&db, fd, 0, 2) == STATUS_ERROR || !(db.checkpoint_flags & DB_CHECKPOINT_ADDRESS_DICTIONARY))
+        {
+            fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+
+        for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+        {
+            if (db_find_employee(&db, expected[i].name, &idx) == STATUS_ERROR ||
+                strcmp(db.employees[idx].address, expected[i].address) || db.employees[idx].hours != expected[i].hours)
+            {
+                fprintf(stderr, "%s:%s:%d employee '%s' not read back correctly\n", __FILE__, __FUNCTION__, __LINE__, expected[i].name);
+                return STATUS_ERROR;
+            }
+        }
+        if (db_find_employee(&db, "John Doe", &idx) == STATUS_SUCCESS || db.address_pool.count != 3)
+        {
+            fprintf(stderr, "%s:%s:%d wrong records after reload\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+
+        // the second round reads back a full checkpoint, where every record references the dictionary
+        if (round == 0 && db_checkpoint(&db) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d db_checkpoint() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+        if (round == 0 && (db_find_employee(&db, "Employee 4", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 44) == STATUS_ERROR))
+            return STATUS_ERROR;
+        free_database(&db);
+    }
+
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+
+// writes employees_size records in compressed blocks, the size the file has uncompressed is returned too
+int create_compressed_db(char *fname, size_t employees_size, uint32_t *plain_size)
+{
+    int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+        return STATUS_ERROR;
+
+    employee *employees = malloc(employees_size * sizeof(employee));
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        char name[32], address[64];
+        snprintf(name, sizeof(name), "Employee %zu", i);
+        snprintf(address, sizeof(address), "%zu Wallaby Way, Sydney", i % 100);
+        employees[i] = (employee) { .name=strdup(name), .address=strdup(address), .hours=i };
+    }
+
+    db_header dbhdr = { .fsize=sizeof(db_header), .employee_count=employees_size };
+    if (checkpoint_db(fd, &dbhdr, employees, 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+    *plain_size = dbhdr.fsize;
+    if (checkpoint_db(fd, &dbhdr, employees, DB_CHECKPOINT_COMPRESSED) == STATUS_ERROR)
+        return STATUS_ERROR;
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        free(employees[i].name);
+        free(employees[i].address);
+    }
+    free(employees);
+    return fd;
+}
+
+int test_compressed_blocks(void)
+{
+    // enough records for several blocks
+    char *fname = "test/src/test_db.bin";
+    size_t employees_size = 5000;
+    uint32_t plain_size;
+    int fd = create_compressed_db(fname, employees_size, &plain_size);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    db_header dbhdr;
+    lseek(fd, 0, SEEK_SET);
+    if (read_dbhdr(fd, &dbhdr) == STATUS_ERROR || dbhdr.fsize >= plain_size / 2)
+    {
+        fprintf(stderr, "%s:%s:%d compressed file has %u bytes, plain file %u\n", __FILE__, __FUNCTION__, __LINE__, dbhdr.fsize, plain_size);
+        return STATUS_ERROR;
+    }
+
+    database db;
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 3) == STATUS_ERROR || !(db.checkpoint_flags & DB_CHECKPOINT_COMPRESSED) || db.hdr.employee_count != employees_size)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %zu", i);
+        if (strcmp(db.employees[i].name, name) || db.employees[i].hours != i || db.offsets[i] != 0)
+        {
+            fprintf(stderr, "%s:%s:%d record %zu not decoded from its block\n", __FILE__, __FUNCTION__, __LINE__, i);
+            return STATUS_ERROR;
+        }
+    }
+
+    // appended records follow the blocks uncompressed and are updated in place
+    employee e = { .name=strdup("Late Addition"), .address=strdup("2 Main st."), .hours=5 };
+    size_t idx;
+    struct stat before, after;
+    if (db_add_employee(&db, &e) == STATUS_ERROR || db.offsets[employees_size] == 0 ||
+        fstat(fd, &before) == -1 || db_update_hours(&db, employees_size, 6) == STATUS_ERROR || fstat(fd, &after) == -1 ||
+        before.st_size != after.st_size || db.offsets[employees_size] == 0)
+    {
+        fprintf(stderr, "%s:%s:%d appended record not written in place\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+
+    // the appended record is read back from the uncompressed tail
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 2) == STATUS_ERROR || db_find_employee(&db, "Late Addition", &idx) == STATUS_ERROR || db.employees[idx].hours != 6)
+    {
+        fprintf(stderr, "%s:%s:%d appended record not read back\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // a record inside a block is replaced by an uncompressed copy, the blocks themselves are not rewritten
+    size_t record_size = 0;
+    if (db_find_employee(&db, "Employee 42", &idx) == STATUS_ERROR || (record_size = employee_record_size(db.employees + idx)) == 0 ||
+        fstat(fd, &before) == -1 || db_update_hours(&db, idx, 4242) == STATUS_ERROR || fstat(fd, &after) == -1 ||
+        after.st_size != before.st_size + (off_t)record_size || db.hdr.employee_count != employees_size + 2 ||
+        db.offsets[employees_size + 1] == 0 || db.employees[idx].name)
+    {
+        fprintf(stderr, "%s:%s:%d update inside a block failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // and deleted by setting its tombstone bit ahead of the blocks
+    if (db_find_employee(&db, "Employee 7", &idx) == STATUS_ERROR || fstat(fd, &before) == -1 ||
+        db_delete_employee(&db, idx) == STATUS_ERROR || fstat(fd, &after) == -1 || after.st_size != before.st_size)
+    {
+        fprintf(stderr, "%s:%s:%d delete inside a block failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 4) == STATUS_ERROR || db.dead_count != 2 ||
+        db_find_employee(&db, "Employee 42", &idx) == STATUS_ERROR || db.employees[idx].hours != 4242 ||
+        db_find_employee(&db, "Employee 7", &idx) == STATUS_SUCCESS ||
+        db_find_employee(&db, "Late Addition", &idx) == STATUS_ERROR || db.employees[idx].hours != 6)
+    {
+        fprintf(stderr, "%s:%s:%d changes inside blocks not read back\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+
+// the checksums kept in memory and those in the file both match the file contents
+static int checksums_match(database *db)
+{
+    db_checksums computed, stored;
+    if (db_checksums_compute(&computed, db->fd, sizeof(db_header), db->records_end) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (read_db_checksums(&stored, db->fd, &db->checksums_section) == STATUS_ERROR)
+    {
+        free_db_checksums(&computed);
+        return STATUS_ERROR;
+    }
+
+    int status = STATUS_SUCCESS;
+    if (computed.count != db->checksums.count || computed.end != db->checksums.end || stored.count != computed.count ||
+        memcmp(computed.crcs, db->checksums.crcs, computed.count * sizeof(uint32_t)) ||
+        memcmp(computed.crcs, stored.crcs, computed.count * sizeof(uint32_t)))
+    {
+        fprintf(stderr, "%s:%s:%d checksums do not match the file\n", __FILE__, __FUNCTION__, __LINE__);
+        status = STATUS_ERROR;
+    }
+    free_db_checksums(&computed);
+    free_db_checksums(&stored);
+    return status;
+}
+
+int test_compressed_compaction(void)
+{
+    char *fname = "test/src/test_db.bin";
+    size_t employees_size = 5000;
+    uint32_t plain_size;
+    int fd = create_compressed_db(fname, employees_size, &plain_size);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 2) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    db.path = fname;
+    db.compact_min_dead = 1;
+    db.compact_ratio = 0.0;
+
+    for (size_t i = 0; i < employees_size; i += 3)
+    {
+        if (db_delete_employee(&db, i) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d db_delete_employee() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+    uint32_t fsize = db.hdr.fsize;
+
+    if (!db_compaction_pending(&db) || db_compact_step(&db, 500) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d compaction did not start\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // mutate records already copied into a block of the new file and records still only in the old one, then
+    // add more records than the tombstones reserved for the blocks have room for
+    size_t idx;
+    if (db_find_employee(&db, "Employee 1", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 101) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 2", &idx) == STATUS_ERROR || db_delete_employee(&db, idx) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 4999", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 1) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 4997", &idx) == STATUS_ERROR || db_delete_employee(&db, idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+    for (int i = 0; i < 20; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Late Addition %d", i);
+        employee e = { .name=strdup(name), .address=strdup("2 Main st."), .hours=i };
+        if (db_add_employee(&db, &e) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+
+    for (int steps = 0; db.compaction.fd != -1; steps++)
+    {
+        if (steps > 20 || db_compact_step(&db, 500) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d compaction did not finish\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+
+    // the first records are back in blocks, the ones past the reserved room follow them uncompressed
+    if (db.hdr.fsize >= fsize || db.offsets[0] != 0 || db.offsets[db.hdr.employee_count - 1] == 0)
+    {
+        fprintf(stderr, "%s:%s:%d records not compacted into blocks\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // the switched file takes changes inside its blocks too
+    fd = db.fd;
+    if (db_find_employee(&db, "Employee 5", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 55) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_database(&db);
+
+    close(fd);
+    fd = open(fname, O_RDWR);
+    if (db_load(&db, fd, 0, 2) == STATUS_ERROR || !(db.checkpoint_flags & DB_CHECKPOINT_COMPRESSED))
+    {
+        fprintf(stderr, "%s:%s:%d db_load() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // every third record and two more deleted, 20 added
+    size_t live = db.hdr.employee_count - db.dead_count;
+    if (live != employees_size - (employees_size + 2) / 3 - 2 + 20)
+    {
+        fprintf(stderr, "%s:%s:%d wrong number of records after compaction: %zu live\n", __FILE__, __FUNCTION__, __LINE__, live);
+        return STATUS_ERROR;
+    }
+
+    struct { char *name; uint32_t hours; } expected[] = {
+        { "Employee 1", 101 }, { "Employee 4999", 1 }, { "Employee 5", 55 }, { "Employee 4", 4 }, { "Late Addition 19", 19 },
+    };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        if (db_find_employee(&db, expected[i].name, &idx) == STATUS_ERROR || db.employees[idx].hours != expected[i].hours)
+        {
+            fprintf(stderr, "%s:%s:%d employee '%s' not compacted correctly\n", __FILE__, __FUNCTION__, __LINE__, expected[i].name);
+            return STATUS_ERROR;
+        }
+    }
+
+    if (db_find_employee(&db, "Employee 2", &idx) == STATUS_SUCCESS || db_find_employee(&db, "Employee 4997", &idx) == STATUS_SUCCESS ||
+        db_find_employee(&db, "Employee 3", &idx) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d deleted employee survived compaction\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+int test_checksums(void)
+{
+    char *fname = "test/src/test_db.bin";
+    int fd = create_test_db(fname, DB_CHECKPOINT_CHECKSUMS | DB_CHECKPOINT_ADDRESS_DICTIONARY);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR || !(db.checkpoint_flags & DB_CHECKPOINT_CHECKSUMS) || checksums_match(&db) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d checksums not loaded\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    db.path = fname;
+    db.compact_min_dead = 1;
+    db.compact_ratio = 0.0;
+
+    // appended records extend the last checksum and spill into new chunks
+    for (int i = 0; i < 3000; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        employee e = { .name=strdup(name), .address=strdup("1 Main st."), .hours=i };
+        if (db_add_employee(&db, &e) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (db.checksums.count < 2 || checksums_match(&db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // in place writes patch the checksums of the chunks they touch
+    size_t idx;
+    for (int i = 0; i < 3000; i += 7)
+    {
+        if (db_update_hours(&db, 3 + i, 100000 + i) == STATUS_ERROR || (i % 2 && db_delete_employee(&db, 3 + i) == STATUS_ERROR))
+            return STATUS_ERROR;
+    }
+    if (checksums_match(&db) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // records copied by a compaction are checksummed as they are written, including writes mirrored while it runs
+    if (db_compact_step(&db, 1000) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 10", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 11) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 2000", &idx) == STATUS_ERROR || db_delete_employee(&db, idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+    while (db.compaction.fd != -1)
+    {
+        if (db_compact_step(&db, 1000) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (checksums_match(&db) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d compacted file checksums differ\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    fd = db.fd;
+
+    if (db_checkpoint(&db) == STATUS_ERROR || checksums_match(&db) == STATUS_ERROR)
+        return STATUS_ERROR;
+    uint32_t records_end = db.records_end;
+    free_database(&db);
+
+    // a single flipped byte anywhere in the records fails the load
+    unsigned char byte;
+    if (pread(fd, &byte, 1, records_end - 10) != 1)
+        return STATUS_ERROR;
+    byte ^= 0x20;
+    if (pwrite(fd, &byte, 1, records_end - 10) != 1)
+        return STATUS_ERROR;
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 2) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d corrupted file was loaded\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    byte ^= 0x20;
+    lseek(fd, 0, SEEK_SET);
+    if (pwrite(fd, &byte, 1, records_end - 10) != 1 || db_load(&db, fd, 0, 2) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 10", &idx) == STATUS_ERROR || db.employees[idx].hours != 11 ||
+        db_find_employee(&db, "Employee 2000", &idx) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d restored file not read back\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+int test_paged(void)
+{
+    char *fname = "test/src/test_db.bin";
+    int fd = create_test_db(fname, DB_CHECKPOINT_CHECKSUMS | DB_CHECKPOINT_NAME_INDEX);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // the smallest pool, well under the size of the records added below
+    database db;
+    if (db_load_paged(&db, fd, 0, 0) == STATUS_ERROR || db.employees || db.pool.frame_count != BUFFER_POOL_MIN_FRAMES)
+    {
+        fprintf(stderr, "%s:%s:%d paged load failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    for (int i = 0; i < 3000; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        employee e = { .name=strdup(name), .address=strdup(i % 3 ? "1 Main st." : "2 Side st."), .hours=i };
+        if (db_add_employee(&db, &e) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+
+    size_t idx;
+    for (int i = 0; i < 3000; i += 10)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        if (db_find_employee(&db, name, &idx) == STATUS_ERROR || db_update_hours(&db, idx, 5000 + i) == STATUS_ERROR ||
+            (i % 20 == 0 && db_delete_employee(&db, idx) == STATUS_ERROR))
+            return STATUS_ERROR;
+    }
+    if (db_find_employee(&db, "Employee 20", &idx) == STATUS_SUCCESS || db_find_employee(&db, "Sally Sample", &idx) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d find after delete\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // every query reads the records it returns through the pool
+    employee *employees;
+    size_t employees_size;
+    if (db_list_employees(&db, &employees, &employees_size) == STATUS_ERROR || employees_size != 3 + 3000 - 150)
+    {
+        fprintf(stderr, "%s:%s:%d listed %zu employees\n", __FILE__, __FUNCTION__, __LINE__, employees_size);
+        return STATUS_ERROR;
+    }
+    if (db_hours_range(&db, 5000, 6000, &employees, &employees_size) == STATUS_ERROR || employees_size != 50 ||
+        employees[0].hours != 5010 || employees[49].hours != 5990)
+    {
+        fprintf(stderr, "%s:%s:%d hours range returned %zu employees\n", __FILE__, __FUNCTION__, __LINE__, employees_size);
+        return STATUS_ERROR;
+    }
+    free(employees);
+    if (db_top_hours(&db, 2, &employees, &employees_size) == STATUS_ERROR || employees_size != 2 ||
+        employees[0].hours != 7990 || strcmp(employees[1].name, "Employee 2970"))
+        return STATUS_ERROR;
+    free(employees);
+    if (db_prefix_search(&db, "Employee 299", &employees, &employees_size) == STATUS_ERROR || employees_size != 11 ||
+        strcmp(employees[0].name, "Employee 299") || strcmp(employees[10].name, "Employee 2999"))
+        return STATUS_ERROR;
+    free(employees);
+    if (db_address_search(&db, "Side", &employees, &employees_size) == STATUS_ERROR || employees_size != 1000 - 50)
+        return STATUS_ERROR;
+    free(employees);
+    if (db.pool.frame_count != BUFFER_POOL_MIN_FRAMES || !db.pool.evictions)
+    {
+        fprintf(stderr, "%s:%s:%d pool did not stay within its budget\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+
+    // the file written in paged mode loads the usual way, checksums included
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR || db.hdr.employee_count - db.dead_count != 3 + 3000 - 150 ||
+        db_find_employee(&db, "Employee 30", &idx) == STATUS_ERROR || db.employees[idx].hours != 5030 ||
+        db_find_employee(&db, "Employee 40", &idx) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d paged writes not read back\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+int test_paged_compaction(void)
+{
+    char *fname = "test/src/test_db.bin";
+    int flags = DB_CHECKPOINT_OFFSETS | DB_CHECKPOINT_NAME_INDEX | DB_CHECKPOINT_ADDRESS_DICTIONARY | DB_CHECKPOINT_CHECKSUMS;
+    int fd = create_test_db(fname, flags);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    if (db_load_paged(&db, fd, 0, 0) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d paged load failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    db.path = fname;
+
+    for (int i = 0; i < 3000; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        employee e = { .name=strdup(name), .address=strdup("1 Main st."), .hours=i };
+        if (db_add_employee(&db, &e) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    size_t idx;
+    for (int i = 0; i < 3000; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        if (i % 3 && (db_find_employee(&db, name, &idx) == STATUS_ERROR || db_delete_employee(&db, idx) == STATUS_ERROR))
+            return STATUS_ERROR;
+    }
+    uint32_t records_before = db.records_end - db.records_start;
+
+    // the dead records are dropped by one step, the pool keeps its budget
+    if (!db_compaction_pending(&db) || db_compact_step(&db, DB_COMPACT_BATCH) == STATUS_ERROR || db_compaction_pending(&db))
+    {
+        fprintf(stderr, "%s:%s:%d paged compaction failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    if (db.records_end - db.records_start >= records_before / 2 || db.hdr.employee_count != 3 + 1000 ||
+        db.dead_count != 0 || db.pool.frame_count != BUFFER_POOL_MIN_FRAMES)
+    {
+        fprintf(stderr, "%s:%s:%d %u records in %u bytes after compaction, %u before\n", __FILE__, __FUNCTION__, __LINE__,
+            db.hdr.employee_count, db.records_end - db.records_start, records_before);
+        return STATUS_ERROR;
+    }
+
+    // records referencing the dictionary were copied with it, the indexes follow the new slots
+    employee *employees;
+    size_t employees_size;
+    if (db_find_employee(&db, "Suzy Mediocare", &idx) == STATUS_ERROR || idx != 2 ||
+        db_find_employee(&db, "Employee 2997", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 9000) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 2998", &idx) == STATUS_SUCCESS)
+        return STATUS_ERROR;
+    if (db_top_hours(&db, 1, &employees, &employees_size) == STATUS_ERROR || employees_size != 1 || strcmp(employees[0].name, "Employee 2997"))
+        return STATUS_ERROR;
+    free(employees);
+    if (db_prefix_search(&db, "Suzy", &employees, &employees_size) == STATUS_ERROR || employees_size != 1 ||
+        strcmp(employees[0].address, "666 Sunny Ln, New York"))
+        return STATUS_ERROR;
+    free(employees);
+
+    // a checkpoint writes the index sections an append emptied
+    employee e = { .name=strdup("Late Addition"), .address=strdup("2 Main st."), .hours=5 };
+    if (db_add_employee(&db, &e) == STATUS_ERROR || !db_checkpoint_pending(&db, 1) ||
+        db_checkpoint(&db) == STATUS_ERROR || db_checkpoint_pending(&db, 1))
+    {
+        fprintf(stderr, "%s:%s:%d paged checkpoint failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    fd = db.fd;
+    free_database(&db);
+
+    // the new file maps its name index and matches its checksums
+    close(fd);
+    fd = open(fname, O_RDWR);
+    if (db_load_paged(&db, fd, 0, 0) == STATUS_ERROR || !db.names.map || db.hdr.employee_count != 3 + 1000 + 1 ||
+        db.checkpoint_flags != flags || db_find_employee(&db, "Late Addition", &idx) == STATUS_ERROR ||
+        db_find_employee(&db, "John Doe", &idx) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d rewritten file not read back\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+static size_t materialized_count(database *db)
+{
+    size_t count = 0;
+    for (size_t i = 0; db->materialized && i < db->hdr.employee_count; i++)
+        count += db->materialized[i];
+    return count;
+}
+
+int test_lazy(void)
+{
+    char *fname = "test/src/test_db.bin";
+    int flags = DB_CHECKPOINT_OFFSETS | DB_CHECKPOINT_NAME_INDEX | DB_CHECKPOINT_ADDRESS_DICTIONARY | DB_CHECKPOINT_CHECKSUMS;
+    int fd = create_test_db(fname, flags);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    for (int i = 0; i < 3000; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        employee e = { .name=strdup(name), .address=strdup(i % 2 ? "1 Main st." : "2 Side st."), .hours=i };
+        if (db_add_employee(&db, &e) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (db_checkpoint(&db) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_database(&db);
+
+    // nothing is decoded up front, a lookup decodes only the records it compares
+    lseek(fd, 0, SEEK_SET);
+    size_t idx;
+    if (db_load_lazy(&db, fd, 0, 1) == STATUS_ERROR || !db.materialized || materialized_count(&db) != 0 ||
+        db_find_employee(&db, "Employee 1500", &idx) == STATUS_ERROR || db.employees[idx].hours != 1500 ||
+        strcmp(db.employees[idx].address, "2 Side st.") || materialized_count(&db) > 2)
+    {
+        fprintf(stderr, "%s:%s:%d lazy lookup failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    employee e = { .name=strdup("Added Later"), .address=strdup("3 New st."), .hours=7 };
+    if (db_update_hours(&db, idx, 99999) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 20", &idx) == STATUS_ERROR || db_delete_employee(&db, idx) == STATUS_ERROR ||
+        db_add_employee(&db, &e) == STATUS_ERROR || db_find_employee(&db, "Added Later", &idx) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 20", &idx) == STATUS_SUCCESS || materialized_count(&db) > 6)
+    {
+        fprintf(stderr, "%s:%s:%d lazy writes failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // a query over every record materializes the rest, after which the database is as if loaded eagerly
+    employee *employees;
+    size_t employees_size;
+    if (db_top_hours(&db, 1, &employees, &employees_size) == STATUS_ERROR || db.materialized ||
+        employees_size != 1 || strcmp(employees[0].name, "Employee 1500") || db.dead_count != 1)
+    {
+        fprintf(stderr, "%s:%s:%d full materialization failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free(employees);
+    if (db_checkpoint(&db) == STATUS_ERROR)
+        return STATUS_ERROR;
+    uint32_t records_end = db.records_end;
+    free_database(&db);
+
+    // a flipped byte is only noticed by the lookups that read its chunk
+    unsigned char byte;
+    if (pread(fd, &byte, 1, records_end - 10) != 1)
+        return STATUS_ERROR;
+    byte ^= 0x20;
+    if (pwrite(fd, &byte, 1, records_end - 10) != 1)
+        return STATUS_ERROR;
+    lseek(fd, 0, SEEK_SET);
+    if (db_load_lazy(&db, fd, 0, 1) == STATUS_ERROR ||
+        db_find_employee(&db, "Employee 10", &idx) == STATUS_ERROR || db.employees[idx].hours != 10 ||
+        db_find_employee(&db, "Added Later", &idx) == STATUS_SUCCESS ||
+        db_list_employees(&db, &employees, &employees_size) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d corrupted chunk was read\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    free_database(&db);
+
+    // once records were appended after the checkpoint the file is loaded eagerly
+    byte ^= 0x20;
+    lseek(fd, 0, SEEK_SET);
+    e = (employee) { .name=strdup("Appended"), .address=strdup("4 Old st."), .hours=8 };
+    if (pwrite(fd, &byte, 1, records_end - 10) != 1 || db_load(&db, fd, 0, 1) == STATUS_ERROR || db_add_employee(&db, &e) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_database(&db);
+    lseek(fd, 0, SEEK_SET);
+    if (db_load_lazy(&db, fd, 0, 1) == STATUS_ERROR || db.materialized ||
+        db_find_employee(&db, "Appended", &idx) == STATUS_ERROR || db_find_employee(&db, "Added Later", &idx) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d appended file not loaded eagerly\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_database(&db);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+int test_snapshot(void)
+{
+    char *fname = "test/src/test_db.bin";
+    char *snapshot = "test/src/test_db.snap";
+    int fd = create_test_db(fname, DB_CHECKPOINT_NAME_INDEX | DB_CHECKPOINT_ADDRESS_DICTIONARY | DB_CHECKPOINT_CHECKSUMS);
+    if (fd == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    database db;
+    size_t idx;
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    for (int i = 0; i < 2000; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        employee e = { .name=strdup(name), .address=strdup(i % 2 ? "1 Main st." : "2 Side st."), .hours=i };
+        if (db_add_employee(&db, &e) == STATUS_ERROR || (i % 100 == 0 && db_delete_employee(&db, db.hdr.employee_count - 1) == STATUS_ERROR))
+            return STATUS_ERROR;
+    }
+    if (db_find_employee(&db, "Sally Sample", &idx) == STATUS_ERROR || db_update_hours(&db, idx, 5000) == STATUS_ERROR ||
+        db_write_snapshot(&db, snapshot) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_database(&db);
+
+    // the tables come back from the snapshot, the tree is built by the first prefix search
+    employee *employees;
+    size_t employees_size;
+    lseek(fd, 0, SEEK_SET);
+    if (db_load_snapshot(&db, fd, 0, snapshot) == STATUS_ERROR || db.hdr.employee_count != 2003 || db.dead_count != 20 || db.prefixes.root ||
+        db_find_employee(&db, "Employee 1999", &idx) == STATUS_ERROR || db.employees[idx].hours != 1999 ||
+        db_find_employee(&db, "Employee 1900", &idx) == STATUS_SUCCESS ||
+        db_find_employee(&db, "Employee 1", &idx) == STATUS_ERROR || db.employees[idx].address != db.employees[idx + 2].address)
+    {
+        fprintf(stderr, "%s:%s:%d snapshot not loaded\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    if (db_top_hours(&db, 1, &employees, &employees_size) == STATUS_ERROR || employees_size != 1 || strcmp(employees[0].name, "Sally Sample"))
+        return STATUS_ERROR;
+    free(employees);
+    if (db_prefix_search(&db, "Employee 199", &employees, &employees_size) == STATUS_ERROR || employees_size != 11 || !db.prefixes.root)
+        return STATUS_ERROR;
+    free(employees);
+
+    // names in the mapping are written over and deleted like any other
+    employee e = { .name=strdup("Added Later"), .address=strdup("1 Main st."), .hours=7 };
+    if (db_find_employee(&db, "Employee 3", &idx) == STATUS_ERROR || db_delete_employee(&db, idx) == STATUS_ERROR ||
+        db_add_employee(&db, &e) == STATUS_ERROR || db_checkpoint(&db) == STATUS_ERROR ||
+        db_find_employee(&db, "Added Later", &idx) == STATUS_ERROR || db_find_employee(&db, "Employee 5", &idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_database(&db);
+
+    // the file was written since, so the snapshot no longer stands in for it
+    lseek(fd, 0, SEEK_SET);
+    if (db_load_snapshot(&db, fd, 0, snapshot) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d stale snapshot was loaded\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // a snapshot with a flipped byte is rejected
+    lseek(fd, 0, SEEK_SET);
+    if (db_load(&db, fd, 0, 1) == STATUS_ERROR || db_write_snapshot(&db, snapshot) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_database(&db);
+    int snapshot_fd = open(snapshot, O_RDWR);
+    unsigned char byte;
+    off_t end = lseek(snapshot_fd, 0, SEEK_END);
+    if (pread(snapshot_fd, &byte, 1, end - 3) != 1)
+        return STATUS_ERROR;
+    byte ^= 0x01;
+    if (pwrite(snapshot_fd, &byte, 1, end - 3) != 1)
+        return STATUS_ERROR;
+    close(snapshot_fd);
+    lseek(fd, 0, SEEK_SET);
+    if (db_load_snapshot(&db, fd, 0, snapshot) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d corrupted snapshot was loaded\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    unlink(snapshot);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+
+int main(void)
+{
+    printf("test_update_hours_in_place()...");
+    if (test_update_hours_in_place() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_update_after_add()...");
+    if (test_update_after_add() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_delete_tombstone()...");
+    if (test_delete_tombstone() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_incremental_compaction()...");
+    if (test_incremental_compaction() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_name_index_mapped()...");
+    if (test_name_index_mapped() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_address_dictionary()...");
+    if (test_address_dictionary() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_compressed_blocks()...");
+    if (test_compressed_blocks() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_compressed_compaction()...");
+    if (test_compressed_compaction() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_checksums()...");
+    if (test_checksums() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_paged()...");
+    if (test_paged() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_paged_compaction()...");
+    if (test_paged_compaction() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_lazy()...");
+    if (test_lazy() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_snapshot()...");
+    if (test_snapshot() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
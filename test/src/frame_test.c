@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "models.h"
+#include "frame.h"
+
+
+int test_header_layout(void)
+{
+    frame_header h = { .opcode=DB_ACCESS_REQUEST, .flags=3, .request_id=0x01020304, .payload_len=0x0a0b0c0d };
+    unsigned char buf[FRAME_HEADER_SIZE];
+    encode_frame_header(buf, &h);
+
+    // every field is little endian at a fixed offset, whatever the host
+    unsigned char expected[FRAME_HEADER_SIZE] = { 0x02, 0xdb, DB_ACCESS_REQUEST, 3, 0x04, 0x03, 0x02, 0x01, 0x0d, 0x0c, 0x0b, 0x0a };
+    if (memcmp(buf, expected, FRAME_HEADER_SIZE) != 0)
+        return STATUS_ERROR;
+
+    frame_header decoded;
+    if (decode_frame_header(buf, &decoded) == STATUS_ERROR || decoded.opcode != h.opcode || decoded.flags != h.flags ||
+        decoded.request_id != h.request_id || decoded.payload_len != h.payload_len)
+        return STATUS_ERROR;
+
+    // a stream out of step with the framing is rejected
+    buf[0] ^= 0xff;
+    if (decode_frame_header(buf, &decoded) != STATUS_ERROR)
+        return STATUS_ERROR;
+    return STATUS_SUCCESS;
+}
+
+int test_send_receive(void)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+        return STATUS_ERROR;
+
+    // frames arrive whole and the payload buffer is reused as they grow
+    const char *payloads[] = { "short", "", "a somewhat longer payload" };
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        if (send_request(fds[0], PROTOCOL_V2, DB_ACCESS_REQUEST, i + 1, payloads[i], strlen(payloads[i]), 0) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    unsigned char *payload = NULL;
+    size_t capacity = 0;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        frame_header h;
+        size_t len = strlen(payloads[i]);
+        if (receive_frame(fds[1], &h, &payload, &capacity) != (int)(FRAME_HEADER_SIZE + len))
+            return STATUS_ERROR;
+        if (h.opcode != DB_ACCESS_REQUEST || h.request_id != i + 1 || h.payload_len != len || memcmp(payload, payloads[i], len) != 0)
+            return STATUS_ERROR;
+    }
+    if (capacity != strlen(payloads[2]))
+        return STATUS_ERROR;
+
+    // version 1 keeps its host sized message type and network order length
+    if (send_request(fds[0], PROTOCOL_V1, SUBSCRIBE_REQUEST, 7, "abc", 3, 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+    unsigned char v1[sizeof(proto_msg) + sizeof(uint32_t) + 3];
+    if (recv(fds[1], v1, sizeof(v1), MSG_WAITALL) != sizeof(v1) || *(proto_msg *)v1 != SUBSCRIBE_REQUEST ||
+        ntohl(*(uint32_t *)(v1 + sizeof(proto_msg))) != 3 || memcmp(v1 + sizeof(proto_msg) + sizeof(uint32_t), "abc", 3) != 0)
+        return STATUS_ERROR;
+
+    // a connection closed between frames is not an error
+    close(fds[0]);
+    frame_header h;
+    if (receive_frame(fds[1], &h, &payload, &capacity) != 0)
+        return STATUS_ERROR;
+
+    close(fds[1]);
+    free(payload);
+    return STATUS_SUCCESS;
+}
+
+int main(void)
+{
+    printf("test_header_layout()...");
+    if (test_header_layout() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_send_receive()...");
+    if (test_send_receive() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "hours_index.h"
+
+
+static int check_sorted(hours_index *idx, size_t expected_count)
+{
+    if (idx->count != expected_count)
+    {
+        fprintf(stderr, "%s:%s:%d count is %zu should be %zu\n", __FILE__, __FUNCTION__, __LINE__, idx->count, expected_count);
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 1; i < idx->count; i++)
+    {
+        hours_index_entry *a = idx->entries + i - 1, *b = idx->entries + i;
+        if (a->hours > b->hours || (a->hours == b->hours && a->slot >= b->slot))
+        {
+            fprintf(stderr, "%s:%s:%d entries %zu and %zu out of order\n", __FILE__, __FUNCTION__, __LINE__, i - 1, i);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int test_build_update_remove(void)
+{
+    employee employees[6] = {
+        { .name="A", .hours=50 }, { .name="B", .hours=10 }, { .name=NULL, .hours=30 },
+        { .name="D", .hours=50 }, { .name="E", .hours=70 }, { .name="F", .hours=20 },
+    };
+
+    // deleted slots are not indexed
+    hours_index idx;
+    if (hours_index_build(&idx, employees, 6) == STATUS_ERROR || check_sorted(&idx, 5) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // move entries both up and down
+    if (hours_index_update(&idx, 1, 10, 60) == STATUS_ERROR || hours_index_update(&idx, 4, 70, 0) == STATUS_ERROR ||
+        hours_index_update(&idx, 0, 50, 50) == STATUS_ERROR || check_sorted(&idx, 5) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d hours_index_update() failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (idx.entries[0].slot != 4 || idx.entries[4].slot != 1)
+    {
+        fprintf(stderr, "%s:%s:%d updated entries not moved\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    if (hours_index_remove(&idx, 50, 3) == STATUS_ERROR || hours_index_remove(&idx, 50, 3) == STATUS_SUCCESS ||
+        hours_index_insert(&idx, 25, 6) == STATUS_ERROR || check_sorted(&idx, 5) == STATUS_ERROR)
+    {
+        fprintf(stderr, "%s:%s:%d insert or remove failed\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_hours_index(&idx);
+    return STATUS_SUCCESS;
+}
+
+int test_range(void)
+{
+    hours_index idx = { 0 };
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        // two employees for each even number of hours
+        if (hours_index_insert(&idx, (i / 2) * 2, i) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+
+    struct { uint32_t min, max; size_t start, count; } cases[] = {
+        { 10, 20, 10, 12 }, { 11, 11, 12, 0 }, { 11, 12, 12, 2 }, { 0, UINT32_MAX, 0, 100 }, { 98, 1000, 98, 2 }, { 20, 10, 0, 0 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        size_t start;
+        size_t count = hours_index_range(&idx, cases[i].min, cases[i].max, &start);
+        if (count != cases[i].count || (count && start != cases[i].start))
+        {
+            fprintf(stderr, "%s:%s:%d range [%u, %u] gave %zu entries from %zu\n", __FILE__, __FUNCTION__, __LINE__, cases[i].min, cases[i].max, count, start);
+            return STATUS_ERROR;
+        }
+    }
+
+    // drop odd slots and renumber the rest as a compaction would
+    uint32_t slot_map[100];
+    for (uint32_t i = 0; i < 100; i++)
+        slot_map[i] = i % 2 ? UINT32_MAX : i / 2;
+    hours_index_remap(&idx, slot_map);
+    if (check_sorted(&idx, 50) == STATUS_ERROR || idx.entries[49].slot != 49)
+        return STATUS_ERROR;
+
+    free_hours_index(&idx);
+    return STATUS_SUCCESS;
+}
+
+
+int main(void)
+{
+    printf("test_build_update_remove()...");
+    if (test_build_update_remove() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_range()...");
+    if (test_range() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "lz.h"
+
+
+static int round_trip(const unsigned char *src, size_t src_len, size_t *compressed_len)
+{
+    size_t cap = lz_compress_bound(src_len);
+    unsigned char *compressed = malloc(cap);
+    unsigned char *out = malloc(src_len ? src_len : 1);
+    int length = lz_compress(src, src_len, compressed, cap);
+    if (length == STATUS_ERROR || (size_t)length > cap)
+    {
+        fprintf(stderr, "%s:%s:%d lz_compress() failed for %zu bytes\n", __FILE__, __FUNCTION__, __LINE__, src_len);
+        return STATUS_ERROR;
+    }
+
+    if (lz_decompress(compressed, length, out, src_len) == STATUS_ERROR || memcmp(src, out, src_len))
+    {
+        fprintf(stderr, "%s:%s:%d %zu bytes not restored\n", __FILE__, __FUNCTION__, __LINE__, src_len);
+        return STATUS_ERROR;
+    }
+
+    *compressed_len = length;
+    free(compressed);
+    free(out);
+    return STATUS_SUCCESS;
+}
+
+int test_round_trip(void)
+{
+    size_t len = 256 * 1024;
+    unsigned char *buf = malloc(len);
+    size_t compressed_len;
+
+    // records of the database file compress well
+    size_t n = 0;
+    for (int i = 0; n + 64 < len; i++)
+        n += snprintf((char *)buf + n, 64, "Employee %d%c%d Wallaby Way, Sydney%c", i, 0, i % 97, 0);
+    if (round_trip(buf, n, &compressed_len) == STATUS_ERROR || compressed_len >= n / 2)
+    {
+        fprintf(stderr, "%s:%s:%d records compressed to %zu of %zu bytes\n", __FILE__, __FUNCTION__, __LINE__, compressed_len, n);
+        return STATUS_ERROR;
+    }
+
+    // long runs need extended match lengths and overlapping copies
+    memset(buf, 'a', len);
+    if (round_trip(buf, len, &compressed_len) == STATUS_ERROR || compressed_len > len / 200)
+        return STATUS_ERROR;
+
+    // random input has long literal runs and must not grow past the bound
+    srand(1);
+    for (size_t i = 0; i < len; i++)
+        buf[i] = rand();
+    if (round_trip(buf, len, &compressed_len) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // inputs too short to hold a match
+    for (size_t i = 0; i < 8; i++)
+    {
+        if (round_trip(buf, i, &compressed_len) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+
+    free(buf);
+    return STATUS_SUCCESS;
+}
+
+int test_corrupted_input(void)
+{
+    const char *text = "123 Wallaby Way, Sydney 123 Wallaby Way, Sydney 123 Wallaby Way, Sydney";
+    size_t len = strlen(text);
+    unsigned char compressed[256], out[256];
+    int length = lz_compress((const unsigned char *)text, len, compressed, sizeof(compressed));
+    if (length == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // wrong expected length, truncated input and a match reaching before the output
+    if (lz_decompress(compressed, length, out, len - 1) == STATUS_SUCCESS ||
+        lz_decompress(compressed, length, out, len + 1) == STATUS_SUCCESS ||
+        lz_decompress(compressed, length - 1, out, len) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d corrupted input was accepted\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    unsigned char bad[] = { 0x10, 'a', 0x00, 0x05 };
+    if (lz_decompress(bad, sizeof(bad), out, 5) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d match offset past the output was accepted\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+
+int main(void)
+{
+    printf("test_round_trip()...");
+    if (test_round_trip() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_corrupted_input()...");
+    if (test_corrupted_input() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
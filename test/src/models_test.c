@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "models.h"
+
+
+static client_connection *new_connection(size_t conn_idx)
+{
+    client_connection *conn = malloc(sizeof(client_connection));
+    client_connection_init(conn, conn_idx);
+    return conn;
+}
+
+int test_connection_map_remove(void)
+{
+    connection_map m;
+    connection_map_init(&m, 0.5);
+
+    // enough keys to share buckets and grow the table
+    for (int fd = 0; fd < 300; fd++)
+        connection_map_insert(&m, fd, new_connection((size_t)fd));
+    if (m.entry_count != 300)
+        return STATUS_ERROR;
+
+    // removing from the head, middle and tail of a bucket leaves the other keys reachable
+    for (int fd = 0; fd < 300; fd += 2)
+    {
+        client_connection *conn = connection_map_get(&m, fd);
+        connection_map_remove(&m, fd);
+        free_client_connection(conn);
+    }
+    if (m.entry_count != 150)
+        return STATUS_ERROR;
+    for (int fd = 0; fd < 300; fd++)
+    {
+        if (connection_map_contains(&m, fd) != fd % 2)
+            return STATUS_ERROR;
+        if (fd % 2 && connection_map_get(&m, fd)->conn_idx != (size_t)fd)
+            return STATUS_ERROR;
+    }
+
+    // a descriptor is reused once it has been closed
+    connection_map_insert(&m, 4, new_connection(7));
+    if (!connection_map_contains(&m, 4) || connection_map_get(&m, 4)->conn_idx != 7 || m.entry_count != 151)
+        return STATUS_ERROR;
+
+    free_connection_map(&m);
+    return STATUS_SUCCESS;
+}
+
+int test_connection_queue(void)
+{
+    client_connection *conn = new_connection(0);
+
+    // responses queue up in order across growths of the buffer
+    char response[100];
+    for (int i = 0; i < 50; i++)
+    {
+        memset(response, 'a' + i % 26, sizeof(response));
+        if (client_connection_queue(conn, response, sizeof(response)) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (conn->out_len != 5000 || conn->out_capacity < conn->out_len)
+        return STATUS_ERROR;
+    for (int i = 0; i < 50; i++)
+    {
+        if (conn->out[i * 100] != 'a' + i % 26 || conn->out[i * 100 + 99] != 'a' + i % 26)
+            return STATUS_ERROR;
+    }
+
+    // the buffer is kept once sent
+    size_t capacity = conn->out_capacity;
+    conn->out_len = 0;
+    if (client_connection_queue(conn, "x", 1) == STATUS_ERROR || conn->out_capacity != capacity || conn->out[0] != 'x')
+        return STATUS_ERROR;
+
+    free_client_connection(conn);
+    return STATUS_SUCCESS;
+}
+
+int main(void)
+{
+    printf("test_connection_map_remove()...");
+    if (test_connection_map_remove() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_connection_queue()...");
+    if (test_connection_queue() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
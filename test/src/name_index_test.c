@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "name_index.h"
+
+#define TEST_EMPLOYEES 1000
+
+
+int test_insert_remove_find(void)
+{
+    employee *employees = calloc(TEST_EMPLOYEES, sizeof(employee));
+    char (*names)[32] = calloc(TEST_EMPLOYEES, sizeof(*names));
+    if (!employees || !names)
+        return STATUS_ERROR;
+
+    for (size_t i = 0; i < TEST_EMPLOYEES; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "Employee %zu", i);
+        employees[i].name = names[i];
+    }
+
+    // start small so the table is resized several times
+    name_index idx;
+    if (name_index_init(&idx, 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+    for (size_t i = 0; i < TEST_EMPLOYEES; i++)
+    {
+        if (name_index_insert(&idx, employees[i].name, i, 0) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d name_index_insert() failed\n", __FILE__, __FUNCTION__, __LINE__);
+            return STATUS_ERROR;
+        }
+    }
+
+    // removals shift entries back, every remaining name must still be reachable
+    for (size_t i = 1; i < TEST_EMPLOYEES; i += 2)
+    {
+        if (name_index_remove(&idx, employees[i].name, i) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d '%s' not removed\n", __FILE__, __FUNCTION__, __LINE__, employees[i].name);
+            return STATUS_ERROR;
+        }
+    }
+
+    for (size_t i = 0; i < TEST_EMPLOYEES; i++)
+    {
+        size_t slot;
+        int status = name_index_find(&idx, employees, TEST_EMPLOYEES, employees[i].name, &slot);
+        if ((i % 2 == 0) != (status == STATUS_SUCCESS) || (status == STATUS_SUCCESS && slot != i))
+        {
+            fprintf(stderr, "%s:%s:%d wrong lookup result for '%s'\n", __FILE__, __FUNCTION__, __LINE__, employees[i].name);
+            return STATUS_ERROR;
+        }
+    }
+
+    if (idx.count != TEST_EMPLOYEES / 2)
+    {
+        fprintf(stderr, "%s:%s:%d count is %zu should be %d\n", __FILE__, __FUNCTION__, __LINE__, idx.count, TEST_EMPLOYEES / 2);
+        return STATUS_ERROR;
+    }
+
+    free_name_index(&idx);
+    free(employees);
+    free(names);
+    return STATUS_SUCCESS;
+}
+
+
+int main(void)
+{
+    printf("test_insert_remove_find()...");
+    if (test_insert_remove_find() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
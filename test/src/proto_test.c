@@ -3,10 +3,14 @@
 #include <stdint.h>
 #include <arpa/inet.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
 
 #include "common.h"
 #include "proto.h"
 #include "models.h"
+#include "shard.h"
 //#include "parse.h"
 
 
@@ -418,6 +422,249 @@ int test_serialize_deserialize_list_employee_response(void)
 
 
 
+// runs a request of the given options against the shards the way the server does, returning the response data
+static unsigned char *run_request(db_shards *shards, unsigned char *options, size_t options_size, uint32_t *data_len)
+{
+    client_connection *conn = malloc(sizeof(client_connection));
+    client_connection_init(conn, 0);
+    conn->buf = malloc(options_size);
+    memcpy(conn->buf, options, options_size);
+    conn->buf_size = options_size;
+
+    size_t response_buf_size = sizeof(proto_msg) + sizeof(uint32_t) + 1;
+    unsigned char *response_buf = malloc(response_buf_size);
+    int status = deserialize_request_options(shards, &response_buf, &response_buf_size, conn);
+    free_client_connection(conn);
+    if (status == STATUS_ERROR || response_buf[sizeof(proto_msg)] != 0)
+    {
+        free(response_buf);
+        return NULL;
+    }
+
+    *data_len = ntohl(*(uint32_t *)(response_buf + sizeof(proto_msg) + 1));
+    memmove(response_buf, response_buf + sizeof(proto_msg) + sizeof(uint32_t) + 1, *data_len);
+    return response_buf;
+}
+
+static int run_write(db_shards *shards, const char *add, char *update_name, char *hours, char *delete_name)
+{
+    // the add option is parsed in place
+    char add_str[64];
+    snprintf(add_str, sizeof(add_str), "%s", add ? add : "");
+    size_t capacity = 1;
+    unsigned char *buf = malloc(capacity);
+    unsigned char *cursor = buf;
+    if ((add && serialize_add_employee_option(&buf, &cursor, &capacity, add_str) == STATUS_ERROR) ||
+        (update_name && serialize_update_employee_option(&buf, &cursor, &capacity, update_name, hours) == STATUS_ERROR) ||
+        (delete_name && serialize_delete_employee_option(&buf, &cursor, &capacity, delete_name) == STATUS_ERROR))
+        return STATUS_ERROR;
+
+    uint32_t data_len;
+    unsigned char *data = run_request(shards, buf, (size_t)(cursor - buf), &data_len);
+    free(buf);
+    free(data);
+    return data ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+static int run_changes_since(db_shards *shards, char *version_str, bool *resync, uint64_t *version, char ***deleted, size_t *deleted_size, employee **employees, size_t *employees_size)
+{
+    size_t capacity = 1;
+    unsigned char *buf = malloc(capacity);
+    unsigned char *cursor = buf;
+    if (serialize_changes_since_option(&buf, &cursor, &capacity, version_str) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    uint32_t data_len;
+    unsigned char *data = run_request(shards, buf, (size_t)(cursor - buf), &data_len);
+    free(buf);
+    if (!data)
+        return STATUS_ERROR;
+    int status = deserialize_changes_since_response(data, data_len, resync, version, deleted, deleted_size, employees, employees_size);
+    free(data);
+    return status;
+}
+
+static void free_changes(char **deleted, size_t deleted_size, employee *employees, size_t employees_size)
+{
+    for (size_t i = 0; i < deleted_size; i++)
+        free(deleted[i]);
+    free(deleted);
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        free(employees[i].name);
+        free(employees[i].address);
+    }
+    free(employees);
+}
+
+int test_changes_since(void)
+{
+    const char *path = "test/src/test_changes.bin";
+    db_shards_remove_files(path, 2);
+    db_shard_options options = { 0 };
+    db_shards shards;
+    if (db_shards_open(&shards, path, 2, true, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // a version older than the change history asks for a full list, and says which version to continue from
+    bool resync;
+    uint64_t version;
+    char **deleted;
+    size_t deleted_size;
+    employee *employees;
+    size_t employees_size;
+    if (run_changes_since(&shards, "0", &resync, &version, &deleted, &deleted_size, &employees, &employees_size) == STATUS_ERROR ||
+        !resync || version != shards.changes.last_seq || deleted_size != 0 || employees_size != 0)
+        return STATUS_ERROR;
+    free_changes(deleted, deleted_size, employees, employees_size);
+
+    if (run_write(&shards, "John Doe,1 Main st.,10", NULL, NULL, NULL) == STATUS_ERROR ||
+        run_write(&shards, "Sally Sample,2 Main st.,20", NULL, NULL, NULL) == STATUS_ERROR ||
+        run_write(&shards, "Suzy Mediocare,3 Main st.,30", NULL, NULL, NULL) == STATUS_ERROR)
+        return STATUS_ERROR;
+    uint64_t start = version;
+    if (run_changes_since(&shards, "1", &resync, &version, &deleted, &deleted_size, &employees, &employees_size) == STATUS_ERROR || !resync)
+        return STATUS_ERROR;
+    free_changes(deleted, deleted_size, employees, employees_size);
+
+    // only what changed after the version is sent, once per name however often it changed
+    char since[32];
+    snprintf(since, sizeof(since), "%lu", (unsigned long)(start + 3));
+    if (run_write(&shards, NULL, "Sally Sample", "21", NULL) == STATUS_ERROR ||
+        run_write(&shards, NULL, "Sally Sample", "22", NULL) == STATUS_ERROR ||
+        run_write(&shards, NULL, NULL, NULL, "Suzy Mediocare") == STATUS_ERROR ||
+        run_write(&shards, "Late Comer,4 Main st.,40", NULL, NULL, NULL) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (run_changes_since(&shards, since, &resync, &version, &deleted, &deleted_size, &employees, &employees_size) == STATUS_ERROR ||
+        resync || version != start + 7 || deleted_size != 1 || strcmp(deleted[0], "Suzy Mediocare") != 0 || employees_size != 2)
+        return STATUS_ERROR;
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        if (!strcmp(employees[i].name, "Sally Sample") ? employees[i].hours != 22 || strcmp(employees[i].address, "2 Main st.") != 0 :
+            strcmp(employees[i].name, "Late Comer") != 0 || employees[i].hours != 40)
+            return STATUS_ERROR;
+    }
+    free_changes(deleted, deleted_size, employees, employees_size);
+
+    // nothing changed since the newest version
+    snprintf(since, sizeof(since), "%lu", (unsigned long)version);
+    if (run_changes_since(&shards, since, &resync, &version, &deleted, &deleted_size, &employees, &employees_size) == STATUS_ERROR ||
+        resync || deleted_size != 0 || employees_size != 0)
+        return STATUS_ERROR;
+    free_changes(deleted, deleted_size, employees, employees_size);
+
+    free_db_shards(&shards);
+    db_shards_remove_files(path, 2);
+    return STATUS_SUCCESS;
+}
+
+#define TEST_LIST_EMPLOYEES 5000
+
+typedef struct {
+    int fd;
+    unsigned char *buf;
+    size_t len;
+} list_sender;
+
+// the list is sent in uneven pieces so records are cut at every offset
+static void *send_list(void *arg)
+{
+    list_sender *sender = arg;
+    for (size_t sent = 0, piece = 1; sent < sender->len; sent += piece, piece = piece * 7 % 4093 + 1)
+    {
+        if (piece > sender->len - sent)
+            piece = sender->len - sent;
+        if (send_all(sender->fd, sender->buf + sent, piece, 0) == STATUS_ERROR)
+            break;
+    }
+    return NULL;
+}
+
+typedef struct {
+    size_t count;
+    size_t mismatches;
+} list_check;
+
+static int check_employee_view(const employee_view *e, void *arg)
+{
+    list_check *check = arg;
+    char name[32];
+    snprintf(name, sizeof(name), "Employee %zu", check->count);
+    if (strcmp(e->name, name) != 0 || strcmp(e->address, "12 Long Road, Springfield") != 0 || e->hours != check->count % 100)
+        check->mismatches++;
+    check->count++;
+    return STATUS_SUCCESS;
+}
+
+int test_list_views(void)
+{
+    employee *employees = malloc(TEST_LIST_EMPLOYEES * sizeof(employee));
+    for (size_t i = 0; i < TEST_LIST_EMPLOYEES; i++)
+    {
+        employees[i].name = malloc(32);
+        snprintf(employees[i].name, 32, "Employee %zu", i);
+        employees[i].address = "12 Long Road, Springfield";
+        employees[i].hours = i % 100;
+    }
+    unsigned char *buf = NULL;
+    uint32_t buf_len = 0;
+    if (serialize_list_employee_response(&buf, buf, &buf_len, employees, TEST_LIST_EMPLOYEES) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // copying out keeps every employee past the first allocation
+    employee *copies;
+    size_t copies_size;
+    if (deserialize_list_employee_response(buf, buf_len, &copies, &copies_size) == STATUS_ERROR || copies_size != TEST_LIST_EMPLOYEES)
+        return STATUS_ERROR;
+    for (size_t i = 0; i < copies_size; i++)
+    {
+        if (strcmp(copies[i].name, employees[i].name) != 0 || copies[i].hours != employees[i].hours)
+            return STATUS_ERROR;
+        free(copies[i].name);
+        free(copies[i].address);
+    }
+    free(copies);
+
+    // views point into the bytes held in memory
+    list_check check = { 0 };
+    if (for_each_employee_view(buf, buf_len, check_employee_view, &check) == STATUS_ERROR || check.count != TEST_LIST_EMPLOYEES || check.mismatches)
+        return STATUS_ERROR;
+
+    // decoded off the socket in chunks, larger than one in total
+    int fds[2];
+    if (buf_len <= LIST_CHUNK_SIZE || socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+        return STATUS_ERROR;
+    list_sender sender = { .fd=fds[0], .buf=buf, .len=buf_len };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, send_list, &sender) != 0)
+        return STATUS_ERROR;
+    check = (list_check) { 0 };
+    int status = receive_list_response(fds[1], buf_len, check_employee_view, &check);
+    pthread_join(thread, NULL);
+    if (status == STATUS_ERROR || check.count != TEST_LIST_EMPLOYEES || check.mismatches)
+        return STATUS_ERROR;
+
+    // a list ending inside a record or with a string missing its terminator is refused
+    if (for_each_employee_view(buf, buf_len - 1, check_employee_view, &check) != STATUS_ERROR)
+        return STATUS_ERROR;
+    if (send_all(fds[0], buf, buf_len / 2, 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+    close(fds[0]);
+    if (receive_list_response(fds[1], buf_len, check_employee_view, &check) != STATUS_ERROR)
+        return STATUS_ERROR;
+    buf[sizeof(uint16_t) + strlen(employees[0].name)] = 'x';
+    employee_view e;
+    if (decode_employee_view(buf, buf_len, &e) != STATUS_ERROR)
+        return STATUS_ERROR;
+
+    close(fds[1]);
+    for (size_t i = 0; i < TEST_LIST_EMPLOYEES; i++)
+        free(employees[i].name);
+    free(employees);
+    free(buf);
+    return STATUS_SUCCESS;
+}
+
 int main(void)
 {
     printf("test_serialize_options()...\n");
@@ -452,6 +699,22 @@ int main(void)
     }
     printf("passed\n\n");
 
+    printf("test_list_views()...\n");
+    if (test_list_views() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n\n");
+
+    printf("test_changes_since()...\n");
+    if (test_changes_since() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n\n");
+
     return STATUS_SUCCESS;
 }
 
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "radix_tree.h"
+
+#define TEST_EMPLOYEES 500
+
+
+// compares the tree's answer for prefix against a scan of the live names
+static int check_prefix(radix_tree *tree, employee *employees, size_t employees_size, const char *prefix)
+{
+    uint32_t *slots;
+    size_t slots_size;
+    if (radix_tree_prefix(tree, prefix, &slots, &slots_size) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    size_t expected = 0;
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        if (employees[i].name && !strncmp(employees[i].name, prefix, strlen(prefix)))
+            expected++;
+    }
+
+    if (slots_size != expected)
+    {
+        fprintf(stderr, "%s:%s:%d prefix '%s' matched %zu names, expected %zu\n", __FILE__, __FUNCTION__, __LINE__, prefix, slots_size, expected);
+        free(slots);
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < slots_size; i++)
+    {
+        const char *name = employees[slots[i]].name;
+        if (!name || strncmp(name, prefix, strlen(prefix)) || (i > 0 && strcmp(employees[slots[i - 1]].name, name) > 0))
+        {
+            fprintf(stderr, "%s:%s:%d prefix '%s' result %zu is wrong or out of order\n", __FILE__, __FUNCTION__, __LINE__, prefix, i);
+            free(slots);
+            return STATUS_ERROR;
+        }
+    }
+
+    free(slots);
+    return STATUS_SUCCESS;
+}
+
+int test_prefix_search(void)
+{
+    employee *employees = calloc(TEST_EMPLOYEES, sizeof(employee));
+    char (*names)[32] = calloc(TEST_EMPLOYEES, sizeof(*names));
+    if (!employees || !names)
+        return STATUS_ERROR;
+
+    // names that are prefixes of each other, inserted out of order
+    const char *stems[] = { "Sam", "Sally", "Sal", "S", "John", "Jo", "Joanna" };
+    for (size_t i = 0; i < TEST_EMPLOYEES; i++)
+    {
+        size_t stem = (i * 7919) % (sizeof(stems) / sizeof(stems[0]));
+        if (i % 3)
+            snprintf(names[i], sizeof(names[i]), "%s %zu", stems[stem], (i * 31) % 97);
+        else
+            snprintf(names[i], sizeof(names[i]), "%s", stems[stem]);
+        employees[i].name = names[i];
+    }
+
+    radix_tree tree;
+    if (radix_tree_build(&tree, employees, TEST_EMPLOYEES) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    const char *prefixes[] = { "", "S", "Sa", "Sal", "Sally", "Sally 1", "J", "Joa", "John 9", "X", "Sallyx" };
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++)
+    {
+        if (check_prefix(&tree, employees, TEST_EMPLOYEES, prefixes[i]) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+
+    // removing names merges nodes back together
+    for (size_t i = 0; i < TEST_EMPLOYEES; i += 2)
+    {
+        if (radix_tree_remove(&tree, employees[i].name, i) == STATUS_ERROR)
+        {
+            fprintf(stderr, "%s:%s:%d '%s' not removed\n", __FILE__, __FUNCTION__, __LINE__, employees[i].name);
+            return STATUS_ERROR;
+        }
+        employees[i].name = NULL;
+    }
+
+    if (radix_tree_remove(&tree, "Sally", 0) == STATUS_SUCCESS || tree.count != TEST_EMPLOYEES / 2)
+    {
+        fprintf(stderr, "%s:%s:%d removed slot found again\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++)
+    {
+        if (check_prefix(&tree, employees, TEST_EMPLOYEES, prefixes[i]) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+
+    free_radix_tree(&tree);
+    free(employees);
+    free(names);
+    return STATUS_SUCCESS;
+}
+
+
+int main(void)
+{
+    printf("test_prefix_search()...");
+    if (test_prefix_search() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
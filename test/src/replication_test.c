@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <endian.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "models.h"
+#include "proto.h"
+#include "shard.h"
+#include "replication.h"
+
+#define TEST_PRIMARY_FILE "test/src/test_primary.bin"
+#define TEST_FOLLOWER_FILE "test/src/test_follower.bin"
+#define TEST_PRIMARY_SHARDS 4
+#define TEST_FOLLOWER_SHARDS 2
+#define TEST_EMPLOYEES 300
+
+
+// sends everything queued for a connection, the server sends it as the socket takes it instead
+static int send_queued_all(int fd, client_connection *conn)
+{
+    int status = send_all(fd, conn->out, conn->out_len, 0);
+    conn->out_len = 0;
+    return status;
+}
+
+// the primary's side of a follower connecting, answered the way the server does
+typedef struct {
+    int listener;
+    int fd;
+    db_shards *primary;
+    int status;
+} primary_args;
+
+static void *serve_follower(void *arg)
+{
+    primary_args *args = arg;
+    args->status = STATUS_ERROR;
+    if ((args->fd = accept(args->listener, NULL, NULL)) == -1)
+        return NULL;
+
+    unsigned char handshake[HANDSHAKE_REQ_SIZE];
+    unsigned char request[sizeof(proto_msg) + sizeof(uint32_t)];
+    if (receive_all(args->fd, handshake, HANDSHAKE_REQ_SIZE, 0) != HANDSHAKE_REQ_SIZE || *(proto_msg *)handshake != HANDSHAKE_REQUEST)
+        return NULL;
+    unsigned char response[sizeof(proto_msg) + 1];
+    *(proto_msg *)response = HANDSHAKE_RESPONSE;
+    response[sizeof(proto_msg)] = 0;
+    if (send_all(args->fd, response, sizeof(response), 0) == STATUS_ERROR)
+        return NULL;
+    if (receive_all(args->fd, request, sizeof(request), 0) != sizeof(request) || *(proto_msg *)request != REPLICATION_REQUEST)
+        return NULL;
+
+    client_connection conn = { 0 };
+    if (replication_queue_copy(&conn, args->primary) == STATUS_SUCCESS)
+        args->status = send_queued_all(args->fd, &conn);
+    free(conn.out);
+    return NULL;
+}
+
+// a listener on a free loopback port for the primary's side, the port is written to port
+static int listen_loopback(char *port, size_t port_size)
+{
+    struct sockaddr_in addr = { .sin_family=AF_INET, .sin_addr.s_addr=htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener == -1 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(listener, 1) == -1 ||
+        getsockname(listener, (struct sockaddr *)&addr, &addr_len) == -1)
+        return STATUS_ERROR;
+    snprintf(port, port_size, "%u", ntohs(addr.sin_port));
+    return listener;
+}
+
+static void remove_test_files(void)
+{
+    db_shards_remove_files(TEST_PRIMARY_FILE, TEST_PRIMARY_SHARDS);
+    db_shards_remove_files(TEST_FOLLOWER_FILE, TEST_FOLLOWER_SHARDS);
+    db_shards_remove_files(TEST_PRIMARY_FILE, 1);
+}
+
+// applies a write to the primary the way a request does, logging it first
+static int primary_write(db_shards *s, uint8_t type, const char *name, const char *address, uint32_t hours)
+{
+    if (changelog_record(&s->changes, type, name, address, hours) == STATUS_ERROR)
+        return STATUS_ERROR;
+    database *db = db_shard_for(s, name);
+    size_t idx;
+    if (type == CHANGE_ADD)
+    {
+        employee e = { .name=strdup(name), .address=strdup(address), .hours=hours };
+        return db_add_employee(db, &e);
+    }
+    if (db_find_employee(db, name, &idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+    return type == CHANGE_UPDATE ? db_update_hours(db, idx, hours) : db_delete_employee(db, idx);
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(((const employee *)a)->name, ((const employee *)b)->name);
+}
+
+// whether both hold the same records, whatever shards they are stored in
+static int same_records(db_shards *a, db_shards *b)
+{
+    employee *a_employees, *b_employees;
+    size_t a_size, b_size;
+    if (db_shards_list(a, &a_employees, &a_size) == STATUS_ERROR || db_shards_list(b, &b_employees, &b_size) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (a_size != b_size)
+    {
+        fprintf(stderr, "%s:%s:%d %zu records against %zu\n", __FILE__, __FUNCTION__, __LINE__, a_size, b_size);
+        return STATUS_ERROR;
+    }
+
+    qsort(a_employees, a_size, sizeof(employee), compare_names);
+    qsort(b_employees, b_size, sizeof(employee), compare_names);
+    for (size_t i = 0; i < a_size; i++)
+    {
+        if (strcmp(a_employees[i].name, b_employees[i].name) != 0 || strcmp(a_employees[i].address, b_employees[i].address) != 0 ||
+            a_employees[i].hours != b_employees[i].hours)
+        {
+            fprintf(stderr, "%s:%s:%d '%s' differs\n", __FILE__, __FUNCTION__, __LINE__, a_employees[i].name);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+int test_follow(void)
+{
+    remove_test_files();
+    db_shard_options options = { 0 };
+    db_shards primary, follower;
+    if (db_shards_open(&primary, TEST_PRIMARY_FILE, TEST_PRIMARY_SHARDS, true, &options) == STATUS_ERROR ||
+        db_shards_open(&follower, TEST_FOLLOWER_FILE, TEST_FOLLOWER_SHARDS, true, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+    for (int i = 0; i < TEST_EMPLOYEES; i++)
+    {
+        char name[32], address[32];
+        snprintf(name, sizeof(name), "Employee %03d", i);
+        snprintf(address, sizeof(address), "%d Main st.", i % 7);
+        if (primary_write(&primary, CHANGE_ADD, name, address, i % 50) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+
+    // the follower connects like a client and receives a copy as of the primary's newest change
+    primary_args args = { .fd=-1, .primary=&primary };
+    char port[8];
+    if ((args.listener = listen_loopback(port, sizeof(port))) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, serve_follower, &args) != 0)
+        return STATUS_ERROR;
+    replica r;
+    int status = replica_connect(&r, "127.0.0.1", port, 1, &follower);
+    pthread_join(thread, NULL);
+    close(args.listener);
+    if (status == STATUS_ERROR || args.status == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (follower.changes.last_seq != primary.changes.last_seq || follower.changes.count != 0 || same_records(&primary, &follower) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // changes after the copy are shipped in order and applied under the primary's sequence numbers
+    client_connection conn = { .shipped_seq=primary.changes.last_seq };
+    for (int i = 0; i < TEST_EMPLOYEES; i += 3)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %03d", i);
+        if (primary_write(&primary, i % 2 ? CHANGE_UPDATE : CHANGE_DELETE, name, NULL, 1000 + i) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (primary_write(&primary, CHANGE_ADD, "Newcomer", "9 Side st.", 7) == STATUS_ERROR ||
+        replication_queue_changes(&conn, &primary) == STATUS_ERROR || send_queued_all(args.fd, &conn) == STATUS_ERROR ||
+        conn.shipped_seq != primary.changes.last_seq)
+        return STATUS_ERROR;
+
+    // messages split across reads wait for the rest of their bytes
+    while (follower.changes.last_seq != primary.changes.last_seq)
+    {
+        if (replica_receive(&r, &follower) <= 0)
+            return STATUS_ERROR;
+    }
+    if (same_records(&primary, &follower) == STATUS_ERROR || follower.changes.count != primary.changes.count - TEST_EMPLOYEES)
+        return STATUS_ERROR;
+    if (follower.replication.primary_seq != primary.changes.last_seq || follower.replication.lag_us > 60 * 1000000ULL)
+        return STATUS_ERROR;
+
+    // nothing is sent while the follower is up to date, and it notices the primary going away
+    if (replication_queue_changes(&conn, &primary) == STATUS_ERROR || conn.out_len != 0)
+        return STATUS_ERROR;
+    free(conn.out);
+    close(args.fd);
+    if (replica_receive(&r, &follower) != 0)
+        return STATUS_ERROR;
+
+    free_replica(&r);
+    free_db_shards(&primary);
+    free_db_shards(&follower);
+    remove_test_files();
+    return STATUS_SUCCESS;
+}
+
+int test_follower_gap(void)
+{
+    remove_test_files();
+    db_shard_options options = { 0 };
+    db_shards primary, follower;
+    if (db_shards_open(&primary, TEST_PRIMARY_FILE, TEST_PRIMARY_SHARDS, true, &options) == STATUS_ERROR ||
+        db_shards_open(&follower, TEST_FOLLOWER_FILE, TEST_FOLLOWER_SHARDS, true, &options) == STATUS_ERROR ||
+        primary_write(&primary, CHANGE_ADD, "Employee 0", "1 Main st.", 1) == STATUS_ERROR ||
+        primary_write(&primary, CHANGE_ADD, "Employee 1", "2 Main st.", 2) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    primary_args args = { .fd=-1, .primary=&primary };
+    char port[8];
+    pthread_t thread;
+    if ((args.listener = listen_loopback(port, sizeof(port))) == STATUS_ERROR || pthread_create(&thread, NULL, serve_follower, &args) != 0)
+        return STATUS_ERROR;
+    replica r;
+    int status = replica_connect(&r, "127.0.0.1", port, 1, &follower);
+    pthread_join(thread, NULL);
+    if (status == STATUS_ERROR || args.status == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // the follower is sent the second of two changes only, as if the first had been lost on the way
+    client_connection conn = { 0 };
+    if (primary_write(&primary, CHANGE_UPDATE, "Employee 0", NULL, 10) == STATUS_ERROR ||
+        primary_write(&primary, CHANGE_DELETE, "Employee 1", NULL, 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+    conn.shipped_seq = primary.changes.last_seq - 1;
+    if (replication_queue_changes(&conn, &primary) == STATUS_ERROR || send_queued_all(args.fd, &conn) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // rather than applying it, the follower starts over from a new copy that has both
+    int old_fd = args.fd;
+    if (pthread_create(&thread, NULL, serve_follower, &args) != 0)
+        return STATUS_ERROR;
+    status = replica_receive(&r, &follower);
+    pthread_join(thread, NULL);
+    close(old_fd);
+    close(args.listener);
+    if (status <= 0 || args.status == STATUS_ERROR || r.fd == -1)
+        return STATUS_ERROR;
+    if (follower.changes.last_seq != primary.changes.last_seq || same_records(&primary, &follower) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    free(conn.out);
+    close(args.fd);
+    free_replica(&r);
+    free_db_shards(&primary);
+    free_db_shards(&follower);
+    remove_test_files();
+    return STATUS_SUCCESS;
+}
+
+int test_follower_too_far_behind(void)
+{
+    remove_test_files();
+    db_shard_options options = { 0 };
+    db_shards primary;
+    if (db_shards_open(&primary, TEST_PRIMARY_FILE, 1, true, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_changelog(&primary.changes);
+    if (changelog_init(&primary.changes, 4, 0) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // once the changes after a follower's last one are evicted it has to start over from a new copy
+    client_connection conn = { .shipped_seq=0 };
+    for (int i = 0; i < 6; i++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "Employee %d", i);
+        if (primary_write(&primary, CHANGE_ADD, name, "", i) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    int status = replication_queue_changes(&conn, &primary) == STATUS_ERROR ? STATUS_SUCCESS : STATUS_ERROR;
+
+    conn.shipped_seq = 2;
+    if (replication_queue_changes(&conn, &primary) == STATUS_ERROR || conn.shipped_seq != 6)
+        status = STATUS_ERROR;
+
+    free(conn.out);
+    free_db_shards(&primary);
+    remove_test_files();
+    return status;
+}
+
+int test_subscribe(void)
+{
+    remove_test_files();
+    db_shard_options options = { 0 };
+    db_shards primary;
+    if (db_shards_open(&primary, TEST_PRIMARY_FILE, TEST_PRIMARY_SHARDS, true, &options) == STATUS_ERROR ||
+        primary_write(&primary, CHANGE_ADD, "Before", "1 Main st.", 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+        return STATUS_ERROR;
+
+    // a subscriber is told where it starts and sent only the changes after it, without a copy
+    client_connection conn = { .shipped_seq=primary.changes.last_seq };
+    unsigned char message[4096];
+    size_t header_size = sizeof(proto_msg) + sizeof(uint32_t);
+    if (replication_queue_subscribe(&conn, &primary) == STATUS_ERROR || send_queued_all(fds[0], &conn) == STATUS_ERROR ||
+        receive_all(fds[1], message, header_size + SUBSCRIBE_RESPONSE_SIZE, 0) != (int)(header_size + SUBSCRIBE_RESPONSE_SIZE))
+        return STATUS_ERROR;
+    if (*(proto_msg *)message != SUBSCRIBE_RESPONSE || be64toh(*(uint64_t *)(message + header_size)) != conn.shipped_seq)
+        return STATUS_ERROR;
+
+    if (primary_write(&primary, CHANGE_ADD, "After", "2 Main st.", 2) == STATUS_ERROR ||
+        primary_write(&primary, CHANGE_UPDATE, "Before", NULL, 3) == STATUS_ERROR ||
+        primary_write(&primary, CHANGE_DELETE, "After", NULL, 0) == STATUS_ERROR ||
+        replication_queue_changes(&conn, &primary) == STATUS_ERROR || send_queued_all(fds[0], &conn) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    uint8_t expected_types[] = { CHANGE_ADD, CHANGE_UPDATE, CHANGE_DELETE };
+    const char *expected_names[] = { "After", "Before", "After" };
+    for (size_t i = 0; i < 3; i++)
+    {
+        if (receive_all(fds[1], message, header_size, 0) != (int)header_size || *(proto_msg *)message != REPLICATION_CHANGE)
+            return STATUS_ERROR;
+        uint32_t data_len = ntohl(*(uint32_t *)(message + sizeof(proto_msg)));
+        change c;
+        uint64_t head_seq;
+        if (data_len > sizeof(message) || receive_all(fds[1], message, data_len, 0) != (int)data_len ||
+            replication_decode_change(message, data_len, &c, &head_seq) == STATUS_ERROR)
+            return STATUS_ERROR;
+        if (c.seq != primary.changes.last_seq - 2 + i || head_seq != primary.changes.last_seq || c.type != expected_types[i] ||
+            strcmp(c.name, expected_names[i]) != 0 || (c.type == CHANGE_ADD && strcmp(c.address, "2 Main st.") != 0))
+            return STATUS_ERROR;
+    }
+
+    free(conn.out);
+    close(fds[0]);
+    close(fds[1]);
+    free_db_shards(&primary);
+    remove_test_files();
+    return STATUS_SUCCESS;
+}
+
+int test_slow_follower(void)
+{
+    remove_test_files();
+    db_shard_options options = { 0 };
+    db_shards primary;
+    if (db_shards_open(&primary, TEST_PRIMARY_FILE, 1, true, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // a follower that has not taken what it was sent is queued nothing more, its changes wait in the changelog
+    uint64_t seq = primary.changes.last_seq;
+    client_connection conn = { .shipped_seq=seq };
+    unsigned char *backlog = calloc(REPLICATION_MAX_BACKLOG, 1);
+    if (!backlog || client_connection_queue(&conn, backlog, REPLICATION_MAX_BACKLOG) == STATUS_ERROR ||
+        primary_write(&primary, CHANGE_ADD, "Employee 0", "1 Main st.", 1) == STATUS_ERROR ||
+        replication_queue_changes(&conn, &primary) == STATUS_ERROR || conn.out_len != REPLICATION_MAX_BACKLOG || conn.shipped_seq != seq)
+        return STATUS_ERROR;
+
+    // and are queued once it takes some of the backlog
+    conn.out_sent = REPLICATION_BATCH_SIZE;
+    int status = STATUS_SUCCESS;
+    if (replication_queue_changes(&conn, &primary) == STATUS_ERROR || conn.out_len <= REPLICATION_MAX_BACKLOG ||
+        conn.shipped_seq != primary.changes.last_seq)
+        status = STATUS_ERROR;
+
+    free(backlog);
+    free(conn.out);
+    free_db_shards(&primary);
+    remove_test_files();
+    return status;
+}
+
+int main(void)
+{
+    printf("test_follow()...");
+    if (test_follow() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_follower_gap()...");
+    if (test_follower_gap() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_follower_too_far_behind()...");
+    if (test_follower_too_far_behind() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_slow_follower()...");
+    if (test_slow_follower() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_subscribe()...");
+    if (test_subscribe() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
@@ -325,6 +325,276 @@ int test_read_write_file(void)
     return STATUS_SUCCESS;
 }
 
+int test_checkpoint_offset_directory(void)
+{
+    int fd = open("test/src/test_db.bin", O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+    {
+        fprintf(stderr, "unable to open file: (%d) %s\n", errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    employee employees[3] = {
+        { .name="John Doe", .address="123 abc st. Sydney Australia", .hours=120 },
+        { .name="Saly Sample", .address="456 easy st. Sydney Australia", .hours=140 },
+        { .name="Suzy Mediocare", .address="666 Sunny Ln, New York", .hours=220 },
+    };
+
+    db_header dbhdr = { .fsize=sizeof(db_header), .employee_count=3 };
+    if (checkpoint_db(fd, &dbhdr, employees, DB_CHECKPOINT_OFFSETS) == STATUS_ERROR)
+    {
+        fprintf(stderr, "checkpoint_db() failed\n");
+        return STATUS_ERROR;
+    }
+
+    // read the header and sections back in
+    lseek(fd, 0, SEEK_SET);
+    memset(&dbhdr, 0, sizeof(db_header));
+    if (read_dbhdr(fd, &dbhdr) == STATUS_ERROR)
+    {
+        fprintf(stderr, "read_dbhdr() failed\n");
+        return STATUS_ERROR;
+    }
+
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    if (read_db_sections(fd, &dbhdr, sections, &section_count) == STATUS_ERROR)
+    {
+        fprintf(stderr, "read_db_sections() failed\n");
+        return STATUS_ERROR;
+    }
+
+    db_section *directory = find_db_section(sections, section_count, DB_SECTION_OFFSETS);
+    if (!directory)
+    {
+        fprintf(stderr, "offset directory not present in file\n");
+        return STATUS_ERROR;
+    }
+
+    uint32_t *offsets;
+    if (read_offset_directory(fd, directory, &offsets, dbhdr.employee_count) == STATUS_ERROR)
+    {
+        fprintf(stderr, "read_offset_directory() failed\n");
+        return STATUS_ERROR;
+    }
+
+    if (offsets[0] != sizeof(db_header))
+    {
+        fprintf(stderr, "incorrect offset for first record: %u should be %zu\n", offsets[0], sizeof(db_header));
+        return STATUS_ERROR;
+    }
+
+    // records must still be readable sequentially right after the header
+    employee *read_employees_buf = malloc(3 * sizeof(employee));
+    if (read_employees(fd, &read_employees_buf, dbhdr.employee_count) == STATUS_ERROR)
+    {
+        fprintf(stderr, "read_employees() failed\n");
+        return STATUS_ERROR;
+    }
+
+    // seek directly to the last record
+    if (seek_employee(fd, sections, section_count, 2) == STATUS_ERROR)
+    {
+        fprintf(stderr, "seek_employee() failed\n");
+        return STATUS_ERROR;
+    }
+
+    if (lseek(fd, 0, SEEK_CUR) != offsets[2])
+    {
+        fprintf(stderr, "seek_employee() moved to the wrong offset\n");
+        return STATUS_ERROR;
+    }
+
+    employee e;
+    if (fdeserialize_employee(fd, &e) == STATUS_ERROR)
+    {
+        fprintf(stderr, "fdeserialize_employee() failed\n");
+        return STATUS_ERROR;
+    }
+
+    if (strcmp(e.name, employees[2].name) || e.hours != employees[2].hours)
+    {
+        fprintf(stderr, "employee read through offset directory does not match: '%s' should be '%s'\n", e.name, employees[2].name);
+        return STATUS_ERROR;
+    }
+
+    // a plain checkpoint drops the optional sections and shrinks the file
+    if (write_db(fd, &dbhdr, employees) == STATUS_ERROR)
+    {
+        fprintf(stderr, "write_db() failed\n");
+        return STATUS_ERROR;
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    if (read_dbhdr(fd, &dbhdr) == STATUS_ERROR || read_db_sections(fd, &dbhdr, sections, &section_count) == STATUS_ERROR)
+    {
+        fprintf(stderr, "reading rewritten file failed\n");
+        return STATUS_ERROR;
+    }
+
+    if (section_count != 0)
+    {
+        fprintf(stderr, "incorrect section count: %zu should be 0\n", section_count);
+        return STATUS_ERROR;
+    }
+
+    // without a directory records are located by skipping over the preceding ones
+    if (seek_employee(fd, sections, section_count, 2) == STATUS_ERROR || lseek(fd, 0, SEEK_CUR) != offsets[2])
+    {
+        fprintf(stderr, "seek_employee() without offset directory failed\n");
+        return STATUS_ERROR;
+    }
+
+    free(offsets);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+// a plain file whose last record ends in the bytes of the footer magic has no sections
+int test_plain_file_ending_in_magic(void)
+{
+    int fd = open("test/src/test_db.bin", O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+    {
+        fprintf(stderr, "unable to open file: (%d) %s\n", errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    employee employees[2] = {
+        { .name="John Doe", .address="123 abc st. Sydney Australia", .hours=120 },
+        { .name="Saly Sample", .address="456 easy st. Sydney Australia", .hours=DB_FOOTER_MAGIC },
+    };
+    db_header dbhdr = { .fsize=sizeof(db_header), .employee_count=2 };
+    if (write_db(fd, &dbhdr, employees) == STATUS_ERROR)
+    {
+        fprintf(stderr, "write_db() failed\n");
+        return STATUS_ERROR;
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    db_section sections[DB_MAX_SECTIONS];
+    size_t section_count;
+    if (read_dbhdr(fd, &dbhdr) == STATUS_ERROR || read_db_sections(fd, &dbhdr, sections, &section_count) == STATUS_ERROR)
+    {
+        fprintf(stderr, "reading plain file failed\n");
+        return STATUS_ERROR;
+    }
+    if (section_count != 0 || dbhdr.employee_count != 2)
+    {
+        fprintf(stderr, "plain file read with %zu sections and %u employees\n", section_count, dbhdr.employee_count);
+        return STATUS_ERROR;
+    }
+
+    employee *read_employees_buf = malloc(2 * sizeof(employee));
+    if (read_employees(fd, &read_employees_buf, dbhdr.employee_count) == STATUS_ERROR || read_employees_buf[1].hours != DB_FOOTER_MAGIC)
+    {
+        fprintf(stderr, "records of plain file not read back\n");
+        return STATUS_ERROR;
+    }
+
+    // the same records with a directory are marked as having sections in the header
+    if (checkpoint_db(fd, &dbhdr, employees, DB_CHECKPOINT_OFFSETS) == STATUS_ERROR)
+    {
+        fprintf(stderr, "checkpoint_db() failed\n");
+        return STATUS_ERROR;
+    }
+    lseek(fd, 0, SEEK_SET);
+    if (read_dbhdr(fd, &dbhdr) == STATUS_ERROR || read_db_sections(fd, &dbhdr, sections, &section_count) == STATUS_ERROR ||
+        dbhdr.employee_count != 2 || !find_db_section(sections, section_count, DB_SECTION_OFFSETS))
+    {
+        fprintf(stderr, "sections of checkpointed file not found\n");
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        free(read_employees_buf[i].name);
+        free(read_employees_buf[i].address);
+    }
+    free(read_employees_buf);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
+int test_read_employees_parallel(void)
+{
+    int fd = open("test/src/test_db.bin", O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+    {
+        fprintf(stderr, "unable to open file: (%d) %s\n", errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+
+    // enough employees to give every thread a few records
+    size_t employees_size = 100;
+    employee *employees = malloc(employees_size * sizeof(employee));
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        employees[i].name = malloc(32);
+        employees[i].address = malloc(32);
+        snprintf(employees[i].name, 32, "Employee %zu", i);
+        snprintf(employees[i].address, 32, "%zu easy st.", i * 7);
+        employees[i].hours = i;
+    }
+
+    // load the file both with and without an offset directory
+    int flags[2] = { 0, DB_CHECKPOINT_OFFSETS };
+    for (int f = 0; f < 2; f++)
+    {
+        db_header dbhdr = { .fsize=sizeof(db_header), .employee_count=employees_size };
+        if (checkpoint_db(fd, &dbhdr, employees, flags[f]) == STATUS_ERROR)
+        {
+            fprintf(stderr, "checkpoint_db() failed\n");
+            return STATUS_ERROR;
+        }
+
+        lseek(fd, 0, SEEK_SET);
+        db_section sections[DB_MAX_SECTIONS];
+        size_t section_count;
+        if (read_dbhdr(fd, &dbhdr) == STATUS_ERROR || read_db_sections(fd, &dbhdr, sections, &section_count) == STATUS_ERROR)
+        {
+            fprintf(stderr, "reading header failed\n");
+            return STATUS_ERROR;
+        }
+
+        employee *loaded = malloc(employees_size * sizeof(employee));
+        uint32_t *offsets;
+        if (read_employees_parallel(fd, &dbhdr, sections, section_count, loaded, &offsets, 3) == STATUS_ERROR)
+        {
+            fprintf(stderr, "read_employees_parallel() failed\n");
+            return STATUS_ERROR;
+        }
+
+        if (offsets[0] != sizeof(db_header))
+        {
+            fprintf(stderr, "incorrect offset for first record: %u should be %zu\n", offsets[0], sizeof(db_header));
+            return STATUS_ERROR;
+        }
+
+        for (size_t i = 0; i < employees_size; i++)
+        {
+            if (strcmp(loaded[i].name, employees[i].name) || strcmp(loaded[i].address, employees[i].address) || loaded[i].hours != employees[i].hours)
+            {
+                fprintf(stderr, "employee %zu does not match: '%s' should be '%s'\n", i, loaded[i].name, employees[i].name);
+                return STATUS_ERROR;
+            }
+            free(loaded[i].name);
+            free(loaded[i].address);
+        }
+        free(loaded);
+        free(offsets);
+    }
+
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        free(employees[i].name);
+        free(employees[i].address);
+    }
+    free(employees);
+    close(fd);
+    return STATUS_SUCCESS;
+}
+
 int main(void)
 {
     printf("test_serialize_deserialize_employee()...");
@@ -375,6 +645,30 @@ int main(void)
         return STATUS_ERROR;
     }
     printf("passed\n");
+
+    printf("test_checkpoint_offset_directory()...");
+    if (test_checkpoint_offset_directory() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_plain_file_ending_in_magic()...");
+    if (test_plain_file_ending_in_magic() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_read_employees_parallel()...");
+    if (test_read_employees_parallel() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
     
     return STATUS_SUCCESS;
 }
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "frame.h"
+#include "shard.h"
+#include "db_client.h"
+#include "test_server.h"
+
+#define TEST_DB_FILE "test/src/test_server.bin"
+#define TEST_SECOND_DB_FILE "test/src/test_server_second.bin"
+#define TEST_UNIX_PATH "test/src/test_server.sock"
+#define TEST_EXIT_TRIES 250
+#define TEST_PIPELINED_REQUESTS 2048
+#define TEST_PIPELINED_EMPLOYEES 256
+#define TEST_RECEIVE_TIMEOUT 5
+
+
+// a call through the server's unix domain socket, so the connection went through its AF_UNIX accept
+static int call_over_unix_socket(const char *name)
+{
+    db_client c;
+    if (db_client_connect(&c, TEST_UNIX_PATH, NULL, PROTOCOL_V2, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    employee *employees;
+    size_t employees_size;
+    int status = db_client_add(&c, name, "1 Oak st.", 10) == STATUS_SUCCESS &&
+        db_client_prefix(&c, name, &employees, &employees_size) == STATUS_SUCCESS ? STATUS_SUCCESS : STATUS_ERROR;
+    if (status == STATUS_SUCCESS)
+    {
+        status = employees_size == 1 && strcmp(employees[0].name, name) == 0 ? STATUS_SUCCESS : STATUS_ERROR;
+        db_client_free_employees(employees, employees_size);
+    }
+    free_db_client(&c);
+    return status;
+}
+
+// runs a server over the path, which is expected to refuse to start rather than come up
+static int refused_to_start(void)
+{
+    test_server s;
+    pid_t pid = spawn_test_server(&s, TEST_SECOND_DB_FILE, TEST_UNIX_PATH);
+    if (pid == -1)
+        return 0;
+    int status;
+    pid_t exited = 0;
+    for (int i = 0; i < TEST_EXIT_TRIES && (exited = waitpid(pid, &status, WNOHANG)) == 0; i++)
+        usleep(20000);
+    if (exited == 0)
+    {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    db_shards_remove_files(TEST_SECOND_DB_FILE, 1);
+    return exited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 1;
+}
+
+int test_unix_socket(void)
+{
+    unlink(TEST_UNIX_PATH);
+    test_server s;
+    if (start_test_server(&s, TEST_DB_FILE, TEST_UNIX_PATH) == STATUS_ERROR)
+        return STATUS_ERROR;
+    // a second server leaves the socket of the live one alone, which goes on serving through it
+    int status = call_over_unix_socket("Alice Smith") == STATUS_SUCCESS && refused_to_start() &&
+        call_over_unix_socket("Bob Jones") == STATUS_SUCCESS ? STATUS_SUCCESS : STATUS_ERROR;
+
+    // the socket is removed on shutdown
+    if (stop_test_server(&s) == STATUS_ERROR || access(TEST_UNIX_PATH, F_OK) == 0)
+        return STATUS_ERROR;
+    return status;
+}
+
+int test_stale_socket(void)
+{
+    // a socket left behind by a server that didn't shut down cleanly, nothing accepts on it
+    unlink(TEST_UNIX_PATH);
+    struct sockaddr_un addr = { .sun_family=AF_UNIX };
+    strcpy(addr.sun_path, TEST_UNIX_PATH);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        return STATUS_ERROR;
+    close(fd);
+
+    test_server s;
+    if (start_test_server(&s, TEST_DB_FILE, TEST_UNIX_PATH) == STATUS_ERROR || call_over_unix_socket("Carol White") == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (stop_test_server(&s) == STATUS_ERROR || access(TEST_UNIX_PATH, F_OK) == 0)
+        return STATUS_ERROR;
+
+    // any other file at the path is kept
+    FILE *f = fopen(TEST_UNIX_PATH, "w");
+    if (!f)
+        return STATUS_ERROR;
+    fclose(f);
+    if (!refused_to_start() || access(TEST_UNIX_PATH, F_OK) != 0)
+        return STATUS_ERROR;
+    unlink(TEST_UNIX_PATH);
+    return STATUS_SUCCESS;
+}
+
+static void on_alarm(int sig)
+{
+    (void)sig;
+}
+
+// a call left waiting on the server fails after TEST_RECEIVE_TIMEOUT seconds instead of hanging the test
+static int set_timeouts(int fd)
+{
+    struct timeval timeout = { .tv_sec=TEST_RECEIVE_TIMEOUT };
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1 ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+// the responses to the pipelined list requests arrive in order once the client reads them
+static int receive_pipelined(int fd, size_t count)
+{
+    unsigned char *payload = NULL;
+    int status = STATUS_SUCCESS;
+    for (size_t i = 1; i <= count && status == STATUS_SUCCESS; i++)
+    {
+        frame_header h;
+        if (receive_frame_header(fd, &h) <= 0 || h.request_id != i || h.opcode != DB_ACCESS_RESPONSE || h.flags != 0)
+        {
+            status = STATUS_ERROR;
+            break;
+        }
+        unsigned char *resized = realloc(payload, h.payload_len);
+        if (!resized)
+        {
+            status = STATUS_ERROR;
+            break;
+        }
+        payload = resized;
+        size_t employees_size = 0;
+        employee *employees = NULL;
+        status = receive_all(fd, payload, h.payload_len, 0) > 0 &&
+            deserialize_list_employee_response(payload, h.payload_len, &employees, &employees_size) == STATUS_SUCCESS &&
+            employees_size == TEST_PIPELINED_EMPLOYEES ? STATUS_SUCCESS : STATUS_ERROR;
+        db_client_free_employees(employees, employees_size);
+    }
+    free(payload);
+    return status;
+}
+
+int test_client_not_reading(void)
+{
+    test_server s;
+    db_client writer, idle, other;
+    if (start_test_server(&s, TEST_DB_FILE, NULL) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (db_client_connect(&writer, "127.0.0.1", s.port, PROTOCOL_V2, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    char name[64], address[256];
+    memset(address, 'x', sizeof(address) - 1);
+    address[sizeof(address) - 1] = '\0';
+    for (int i = 0; i < TEST_PIPELINED_EMPLOYEES; i++)
+    {
+        snprintf(name, sizeof(name), "Employee %d", i);
+        if (db_client_add(&writer, name, address, (uint32_t)i) != STATUS_SUCCESS)
+            return STATUS_ERROR;
+    }
+    free_db_client(&writer);
+
+    // one client sends far more list requests than the responses to fit in the socket buffers, and reads none
+    if (db_client_connect(&idle, "127.0.0.1", s.port, PROTOCOL_V2, 1) == STATUS_ERROR || set_timeouts(idle.conns[0].fd) == STATUS_ERROR)
+        return STATUS_ERROR;
+    unsigned char *requests = NULL, *cursor = NULL;
+    size_t capacity = 0;
+    db_client_request list = { .option='l' };
+    for (uint32_t i = 1; i <= TEST_PIPELINED_REQUESTS; i++)
+    {
+        if (encode_db_client_request(&requests, &cursor, &capacity, PROTOCOL_V2, i, &list) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    int status = send_all(idle.conns[0].fd, requests, (size_t)(cursor - requests), MSG_NOSIGNAL) == STATUS_ERROR ? STATUS_ERROR : STATUS_SUCCESS;
+    free(requests);
+
+    // another client is still served meanwhile, its handshake included, the alarm interrupts it otherwise
+    employee *employees = NULL;
+    size_t employees_size = 0;
+    struct sigaction sa = { .sa_handler=on_alarm };
+    if (status == STATUS_SUCCESS && sigaction(SIGALRM, &sa, NULL) == 0)
+    {
+        alarm(TEST_RECEIVE_TIMEOUT);
+        if (db_client_connect(&other, "127.0.0.1", s.port, PROTOCOL_V2, 1) == STATUS_ERROR)
+            status = STATUS_ERROR;
+        else
+        {
+            status = db_client_list(&other, &employees, &employees_size) != STATUS_SUCCESS || employees_size != TEST_PIPELINED_EMPLOYEES ? STATUS_ERROR : STATUS_SUCCESS;
+            db_client_free_employees(employees, employees_size);
+            free_db_client(&other);
+        }
+        alarm(0);
+    }
+
+    // and the first client is sent every response once it reads them
+    if (status == STATUS_SUCCESS)
+        status = receive_pipelined(idle.conns[0].fd, TEST_PIPELINED_REQUESTS);
+    free_db_client(&idle);
+    if (stop_test_server(&s) == STATUS_ERROR)
+        return STATUS_ERROR;
+    return status;
+}
+
+int main(void)
+{
+    printf("test_unix_socket()...");
+    if (test_unix_socket() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_stale_socket()...");
+    if (test_stale_socket() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_client_not_reading()...");
+    if (test_client_not_reading() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "db.h"
+#include "shard.h"
+
+#define TEST_SHARD_FILE "test/src/test_shard.bin"
+#define TEST_SHARDS 4
+#define TEST_EMPLOYEES 200
+
+
+static void remove_shard_files(size_t shard_count)
+{
+    char path[64];
+    for (size_t i = 0; i <= shard_count; i++)
+    {
+        snprintf(path, sizeof(path), "%s.%zu", TEST_SHARD_FILE, i);
+        unlink(path);
+    }
+    unlink(TEST_SHARD_FILE ".seq");
+}
+
+static int add_test_employees(db_shards *s)
+{
+    for (int i = 0; i < TEST_EMPLOYEES; i++)
+    {
+        char name[32], address[32];
+        snprintf(name, sizeof(name), "Employee %03d", i);
+        snprintf(address, sizeof(address), "%d Main st.", i % 7);
+        employee e = { .name=strdup(name), .address=strdup(address), .hours=(i * 37) % 101 };
+        if (db_add_employee(db_shard_for(s, e.name), &e) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+int test_routing(void)
+{
+    // the owner of a name never changes and every shard gets a share of the names
+    size_t counts[TEST_SHARDS] = { 0 };
+    for (int i = 0; i < TEST_EMPLOYEES; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Employee %03d", i);
+        size_t shard = db_shard_of(name, TEST_SHARDS);
+        if (shard >= TEST_SHARDS || shard != db_shard_of(name, TEST_SHARDS))
+            return STATUS_ERROR;
+        counts[shard]++;
+    }
+    for (size_t i = 0; i < TEST_SHARDS; i++)
+    {
+        if (counts[i] < TEST_EMPLOYEES / TEST_SHARDS / 2)
+        {
+            fprintf(stderr, "%s:%s:%d shard %zu owns only %zu of %d names\n", __FILE__, __FUNCTION__, __LINE__, i, counts[i], TEST_EMPLOYEES);
+            return STATUS_ERROR;
+        }
+    }
+    return db_shard_of("anyone", 1) == 0 ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+int test_fan_out(void)
+{
+    remove_shard_files(TEST_SHARDS);
+    db_shard_options options = { 0 };
+    db_shards s;
+    if (db_shards_open(&s, TEST_SHARD_FILE, TEST_SHARDS, true, &options) == STATUS_ERROR || add_test_employees(&s) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // each record is stored by its owner only
+    for (size_t i = 0; i < TEST_SHARDS; i++)
+    {
+        for (size_t j = 0; j < s.dbs[i].hdr.employee_count; j++)
+        {
+            if (db_shard_of(s.dbs[i].employees[j].name, TEST_SHARDS) != i)
+            {
+                fprintf(stderr, "%s:%s:%d '%s' stored in shard %zu\n", __FILE__, __FUNCTION__, __LINE__, s.dbs[i].employees[j].name, i);
+                return STATUS_ERROR;
+            }
+        }
+    }
+
+    employee *employees;
+    size_t employees_size;
+    if (db_shards_list(&s, &employees, &employees_size) == STATUS_ERROR || employees_size != TEST_EMPLOYEES)
+        return STATUS_ERROR;
+
+    // ordered results are merged across the shards
+    if (db_shards_hours_range(&s, 20, 60, &employees, &employees_size) == STATUS_ERROR)
+        return STATUS_ERROR;
+    size_t expected = 0;
+    for (int i = 0; i < TEST_EMPLOYEES; i++)
+        expected += (i * 37) % 101 >= 20 && (i * 37) % 101 <= 60;
+    for (size_t i = 0; i < employees_size; i++)
+    {
+        if (employees[i].hours < 20 || employees[i].hours > 60 || (i && employees[i - 1].hours > employees[i].hours))
+            return STATUS_ERROR;
+    }
+    free(employees);
+    if (employees_size != expected)
+    {
+        fprintf(stderr, "%s:%s:%d %zu of %zu employees in range\n", __FILE__, __FUNCTION__, __LINE__, employees_size, expected);
+        return STATUS_ERROR;
+    }
+
+    if (db_shards_top_hours(&s, 5, &employees, &employees_size) == STATUS_ERROR || employees_size != 5 || employees[0].hours != 100)
+        return STATUS_ERROR;
+    for (size_t i = 1; i < employees_size; i++)
+    {
+        if (employees[i - 1].hours < employees[i].hours)
+            return STATUS_ERROR;
+    }
+    free(employees);
+
+    if (db_shards_prefix_search(&s, "Employee 1", &employees, &employees_size) == STATUS_ERROR || employees_size != 100)
+        return STATUS_ERROR;
+    for (size_t i = 1; i < employees_size; i++)
+    {
+        if (strcmp(employees[i - 1].name, employees[i].name) >= 0)
+            return STATUS_ERROR;
+    }
+    free(employees);
+
+    if (db_shards_address_search(&s, "3 Main", &employees, &employees_size) == STATUS_ERROR || employees_size != TEST_EMPLOYEES / 7 + 1)
+        return STATUS_ERROR;
+    free(employees);
+
+    // writes reach the owning shard only and survive reopening
+    size_t idx;
+    database *db = db_shard_for(&s, "Employee 042");
+    if (db_find_employee(db, "Employee 042", &idx) == STATUS_ERROR || db_update_hours(db, idx, 999) == STATUS_ERROR)
+        return STATUS_ERROR;
+    db = db_shard_for(&s, "Employee 043");
+    if (db_find_employee(db, "Employee 043", &idx) == STATUS_ERROR || db_delete_employee(db, idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_db_shards(&s);
+
+    if (db_shards_open(&s, TEST_SHARD_FILE, TEST_SHARDS, false, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+    if (db_shards_top_hours(&s, 1, &employees, &employees_size) == STATUS_ERROR || employees_size != 1 ||
+        strcmp(employees[0].name, "Employee 042") != 0)
+        return STATUS_ERROR;
+    free(employees);
+    if (db_shards_list(&s, &employees, &employees_size) == STATUS_ERROR || employees_size != TEST_EMPLOYEES - 1)
+        return STATUS_ERROR;
+    free_db_shards(&s);
+
+    remove_shard_files(TEST_SHARDS);
+    return STATUS_SUCCESS;
+}
+
+int test_checkpoint_after_add(void)
+{
+    remove_shard_files(TEST_SHARDS);
+    db_shard_options options = { .checkpoint_flags=DB_CHECKPOINT_OFFSETS | DB_CHECKPOINT_NAME_INDEX };
+    db_shards s;
+    if (db_shards_open(&s, TEST_SHARD_FILE, TEST_SHARDS, true, &options) == STATUS_ERROR || add_test_employees(&s) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // no shard was appended enough records to be checkpointed before shutdown
+    if (db_shards_checkpoint(&s, TEST_EMPLOYEES) == STATUS_ERROR)
+        return STATUS_ERROR;
+    for (size_t i = 0; i < TEST_SHARDS; i++)
+    {
+        if (!db_checkpoint_pending(s.dbs + i, 1))
+        {
+            fprintf(stderr, "%s:%s:%d shard %zu checkpointed below the threshold\n", __FILE__, __FUNCTION__, __LINE__, i);
+            return STATUS_ERROR;
+        }
+    }
+
+    // what a server does on shutdown, the next start maps the index sections instead of reading every record
+    if (db_shards_checkpoint(&s, 1) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_db_shards(&s);
+
+    options.lazy = true;
+    if (db_shards_open(&s, TEST_SHARD_FILE, TEST_SHARDS, false, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+    for (size_t i = 0; i < TEST_SHARDS; i++)
+    {
+        if (!s.dbs[i].names.map || !s.dbs[i].materialized || db_checkpoint_pending(s.dbs + i, 1))
+        {
+            fprintf(stderr, "%s:%s:%d shard %zu was read in full after an add\n", __FILE__, __FUNCTION__, __LINE__, i);
+            return STATUS_ERROR;
+        }
+    }
+    size_t idx;
+    database *db = db_shard_for(&s, "Employee 042");
+    if (db_find_employee(db, "Employee 042", &idx) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_db_shards(&s);
+
+    // a file reopened before its shards were checkpointed still wants them to be
+    if (db_shards_open(&s, TEST_SHARD_FILE, TEST_SHARDS, false, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+    employee e = { .name=strdup("Employee 999"), .address=strdup("9 Main st."), .hours=9 };
+    db = db_shard_for(&s, e.name);
+    if (db_add_employee(db, &e) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_db_shards(&s);
+    if (db_shards_open(&s, TEST_SHARD_FILE, TEST_SHARDS, false, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+    db = db_shard_for(&s, "Employee 999");
+    int status = db_checkpoint_pending(db, 1) && !db->names.map ? STATUS_SUCCESS : STATUS_ERROR;
+    free_db_shards(&s);
+
+    remove_shard_files(TEST_SHARDS);
+    return status;
+}
+
+int test_shard_count_mismatch(void)
+{
+    remove_shard_files(TEST_SHARDS);
+    db_shard_options options = { 0 };
+    db_shards s;
+    if (db_shards_open(&s, TEST_SHARD_FILE, TEST_SHARDS, true, &options) == STATUS_ERROR)
+        return STATUS_ERROR;
+    free_db_shards(&s);
+
+    // names would be routed to the wrong files with any other shard count
+    int status = STATUS_SUCCESS;
+    if (db_shards_open(&s, TEST_SHARD_FILE, TEST_SHARDS / 2, false, &options) == STATUS_SUCCESS ||
+        db_shards_open(&s, TEST_SHARD_FILE, TEST_SHARDS * 2, false, &options) == STATUS_SUCCESS)
+    {
+        fprintf(stderr, "%s:%s:%d opened with a different shard count\n", __FILE__, __FUNCTION__, __LINE__);
+        status = STATUS_ERROR;
+    }
+
+    remove_shard_files(TEST_SHARDS);
+    return status;
+}
+
+int main(void)
+{
+    printf("test_routing()...");
+    if (test_routing() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_fan_out()...");
+    if (test_fan_out() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_checkpoint_after_add()...");
+    if (test_checkpoint_after_add() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_shard_count_mismatch()...");
+    if (test_shard_count_mismatch() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
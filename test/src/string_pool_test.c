@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "string_pool.h"
+
+
+int test_intern_release(void)
+{
+    string_pool pool;
+    if (string_pool_init(&pool) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // an equal string is freed in favour of the first copy
+    char *a = string_pool_intern(&pool, strdup("1 Main st."));
+    char *b = string_pool_intern(&pool, strdup("1 Main st."));
+    char *c = string_pool_intern(&pool, strdup("2 Main st."));
+    if (!a || a != b || a == c || pool.count != 2)
+    {
+        fprintf(stderr, "%s:%s:%d equal strings not shared\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    string_pool_entry *entry = string_pool_find(&pool, "1 Main st.");
+    if (!entry || entry->str != a || entry->refs != 2 || entry->index != UINT32_MAX)
+    {
+        fprintf(stderr, "%s:%s:%d string_pool_find() returned the wrong entry\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    // the string stays until its last holder releases it
+    string_pool_release(&pool, a);
+    if (!string_pool_find(&pool, "1 Main st.") || pool.count != 2)
+    {
+        fprintf(stderr, "%s:%s:%d string released too early\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+    string_pool_release(&pool, b);
+    if (string_pool_find(&pool, "1 Main st.") || !string_pool_find(&pool, "2 Main st.") || pool.count != 1)
+    {
+        fprintf(stderr, "%s:%s:%d string not released\n", __FILE__, __FUNCTION__, __LINE__);
+        return STATUS_ERROR;
+    }
+
+    free_string_pool(&pool);
+    return STATUS_SUCCESS;
+}
+
+int test_grow_and_shift(void)
+{
+    string_pool pool;
+    if (string_pool_init(&pool) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // enough strings to resize several times, each interned twice
+    char s[32];
+    for (int round = 0; round < 2; round++)
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            snprintf(s, sizeof(s), "%d Main st.", i);
+            if (!string_pool_intern(&pool, strdup(s)))
+                return STATUS_ERROR;
+        }
+    }
+    if (pool.count != 1000)
+    {
+        fprintf(stderr, "%s:%s:%d pool has %zu strings should be 1000\n", __FILE__, __FUNCTION__, __LINE__, pool.count);
+        return STATUS_ERROR;
+    }
+
+    // removing every other string must keep the rest reachable through their probe sequences
+    for (int i = 0; i < 1000; i += 2)
+    {
+        snprintf(s, sizeof(s), "%d Main st.", i);
+        string_pool_release(&pool, s);
+        string_pool_release(&pool, s);
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(s, sizeof(s), "%d Main st.", i);
+        string_pool_entry *entry = string_pool_find(&pool, s);
+        if ((i % 2 == 0) != (entry == NULL) || (entry && strcmp(entry->str, s)))
+        {
+            fprintf(stderr, "%s:%s:%d wrong lookup of '%s'\n", __FILE__, __FUNCTION__, __LINE__, s);
+            return STATUS_ERROR;
+        }
+    }
+
+    free_string_pool(&pool);
+    return STATUS_SUCCESS;
+}
+
+
+int main(void)
+{
+    printf("test_intern_release()...");
+    if (test_intern_release() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_grow_and_shift()...");
+    if (test_grow_and_shift() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "shard.h"
+#include "test_server.h"
+
+#define TEST_SERVER_TRIES 250
+
+
+// a port nothing is bound to, found by binding to port 0 and letting it go
+static int free_port(char *port, size_t port_size)
+{
+    struct sockaddr_in addr = { .sin_family=AF_INET, .sin_addr.s_addr=htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || getsockname(fd, (struct sockaddr *)&addr, &addr_len) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to find a free port: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return STATUS_ERROR;
+    }
+    close(fd);
+    snprintf(port, port_size, "%u", ntohs(addr.sin_port));
+    return STATUS_SUCCESS;
+}
+
+static int can_connect(int domain, struct sockaddr *addr, socklen_t addr_len)
+{
+    int fd = socket(domain, SOCK_STREAM, 0);
+    if (fd == -1)
+        return 0;
+    int status = connect(fd, addr, addr_len);
+    close(fd);
+    return status == 0;
+}
+
+pid_t spawn_test_server(test_server *s, const char *db_file, const char *unix_path)
+{
+    *s = (test_server) { .pid=-1, .db_file=db_file, .unix_path=unix_path };
+    if (free_port(s->port, sizeof(s->port)) == STATUS_ERROR)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        fprintf(stderr, "%s:%s:%d fork() failed: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return -1;
+    }
+    if (pid == 0)
+    {
+        // what it prints would be mixed into the test's own output, its errors are kept
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        if (unix_path)
+            execl("bin/server", "bin/server", "-n", "-f", db_file, "-a", "127.0.0.1", "-p", s->port, "-U", unix_path, "-v", "2", NULL);
+        else
+            execl("bin/server", "bin/server", "-n", "-f", db_file, "-a", "127.0.0.1", "-p", s->port, "-v", "2", NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+int start_test_server(test_server *s, const char *db_file, const char *unix_path)
+{
+    db_shards_remove_files(db_file, 1);
+    if ((s->pid = spawn_test_server(s, db_file, unix_path)) == -1)
+        return STATUS_ERROR;
+
+    // the unix domain socket is bound after the port, the server is up once both take connections
+    struct sockaddr_in addr = { .sin_family=AF_INET, .sin_port=htons(atoi(s->port)), .sin_addr.s_addr=htonl(INADDR_LOOPBACK) };
+    struct sockaddr_un unix_addr = { .sun_family=AF_UNIX };
+    if (unix_path)
+        strncpy(unix_addr.sun_path, unix_path, sizeof(unix_addr.sun_path) - 1);
+    for (int i = 0; i < TEST_SERVER_TRIES; i++)
+    {
+        if (waitpid(s->pid, NULL, WNOHANG) != 0)
+            break;
+        if (can_connect(AF_INET, (struct sockaddr *)&addr, sizeof(addr)) &&
+            (!unix_path || can_connect(AF_UNIX, (struct sockaddr *)&unix_addr, sizeof(unix_addr))))
+            return STATUS_SUCCESS;
+        usleep(20000);
+    }
+
+    fprintf(stderr, "%s:%s:%d unable to start bin/server, was it built with 'make build_server'?\n", __FILE__, __FUNCTION__, __LINE__);
+    kill(s->pid, SIGKILL);
+    waitpid(s->pid, NULL, 0);
+    db_shards_remove_files(db_file, 1);
+    return STATUS_ERROR;
+}
+
+int stop_test_server(test_server *s)
+{
+    int status;
+    if (kill(s->pid, SIGTERM) == -1 || waitpid(s->pid, &status, 0) == -1)
+    {
+        fprintf(stderr, "%s:%s:%d unable to stop bin/server: (%d) %s\n", __FILE__, __FUNCTION__, __LINE__, errno, strerror(errno));
+        return STATUS_ERROR;
+    }
+    db_shards_remove_files(s->db_file, 1);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? STATUS_SUCCESS : STATUS_ERROR;
+}
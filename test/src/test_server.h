@@ -0,0 +1,25 @@
+#ifndef TEST_SERVER_H
+#define TEST_SERVER_H
+
+#include <sys/types.h>
+
+// bin/server run in a process of its own, so that the client libraries are tested against the real thing
+// the tests run from the repository root after 'make build_server'
+
+typedef struct {
+    pid_t pid;
+    char port[8];
+    const char *db_file;
+    const char *unix_path;          /* also listening on a unix domain socket at this path when set */
+} test_server;
+
+// Starts bin/server on a free loopback port with a new database at db_file, returns once it accepts connections
+int start_test_server(test_server *s, const char *db_file, const char *unix_path);
+
+// Runs bin/server with the arguments start_test_server() would use, without waiting for it to come up
+pid_t spawn_test_server(test_server *s, const char *db_file, const char *unix_path);
+
+// Shuts the server down with SIGTERM and removes its database, fails unless it exited cleanly
+int stop_test_server(test_server *s);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "trigram_index.h"
+
+// enough employees for slots to span several chunks
+#define TEST_EMPLOYEES 140000
+
+
+int test_intersect_sorted_u16(void)
+{
+    uint16_t a[1000], b[700], out[700];
+    size_t a_size = 0, b_size = 0;
+
+    // a holds multiples of 3, b multiples of 5, including 0 which must not end a block
+    for (uint32_t v = 0; v < 3000; v += 3)
+        a[a_size++] = v;
+    for (uint32_t v = 0; v < 3500; v += 5)
+        b[b_size++] = v;
+
+    size_t count = intersect_sorted_u16(a, a_size, b, b_size, out);
+    if (count != 200)
+    {
+        fprintf(stderr, "%s:%s:%d intersection has %zu values should be 200\n", __FILE__, __FUNCTION__, __LINE__, count);
+        return STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (out[i] != 15 * i)
+        {
+            fprintf(stderr, "%s:%s:%d value %zu is %u should be %zu\n", __FILE__, __FUNCTION__, __LINE__, i, out[i], 15 * i);
+            return STATUS_ERROR;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+static int check_search(trigram_index *idx, employee *employees, const char *substring)
+{
+    uint32_t *slots;
+    size_t slots_size;
+    if (trigram_index_search(idx, employees, TEST_EMPLOYEES, substring, &slots, &slots_size) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // results are in slot order and equal to a scan
+    size_t n = 0;
+    for (size_t i = 0; i < TEST_EMPLOYEES; i++)
+    {
+        if (!employees[i].address || !strstr(employees[i].address, substring))
+            continue;
+        if (n == slots_size || slots[n] != i)
+        {
+            fprintf(stderr, "%s:%s:%d '%s' result %zu should be slot %zu\n", __FILE__, __FUNCTION__, __LINE__, substring, n, i);
+            free(slots);
+            return STATUS_ERROR;
+        }
+        n++;
+    }
+
+    if (n != slots_size)
+    {
+        fprintf(stderr, "%s:%s:%d '%s' has %zu results should be %zu\n", __FILE__, __FUNCTION__, __LINE__, substring, slots_size, n);
+        free(slots);
+        return STATUS_ERROR;
+    }
+
+    free(slots);
+    return STATUS_SUCCESS;
+}
+
+int test_search(void)
+{
+    const char *addresses[] = { "123 Wallaby Way, Sydney", "123 easy st, Sydney", "666 Sunny Ln, New York", "1 Way St, New Yorkshire", "aaaa" };
+    size_t address_count = sizeof(addresses) / sizeof(addresses[0]);
+
+    employee *employees = calloc(TEST_EMPLOYEES, sizeof(employee));
+    if (!employees)
+        return STATUS_ERROR;
+    for (size_t i = 0; i < TEST_EMPLOYEES; i++)
+        employees[i].address = (char *)addresses[(i * 7) % address_count];
+
+    trigram_index idx;
+    if (trigram_index_build(&idx, employees, TEST_EMPLOYEES) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    const char *queries[] = { "Sydney", "New York", "Way", "yW", "aaa", "Wallaby Way", "Yorkshire", "St", "Boston" };
+    size_t query_count = sizeof(queries) / sizeof(queries[0]);
+    for (size_t i = 0; i < query_count; i++)
+    {
+        if (check_search(&idx, employees, queries[i]) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+
+    // delete every third employee, then compact the slots the way the database does
+    uint32_t *slot_map = malloc(TEST_EMPLOYEES * sizeof(uint32_t));
+    if (!slot_map)
+        return STATUS_ERROR;
+    size_t n = 0;
+    for (size_t i = 0; i < TEST_EMPLOYEES; i++)
+    {
+        if (i % 3 == 0)
+        {
+            trigram_index_remove(&idx, employees[i].address, i);
+            slot_map[i] = UINT32_MAX;
+            continue;
+        }
+        slot_map[i] = n;
+        employees[n++] = employees[i];
+    }
+    for (size_t i = n; i < TEST_EMPLOYEES; i++)
+        employees[i].address = NULL;
+
+    if (trigram_index_remap(&idx, slot_map) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    // a new record is appended after the remaining ones
+    employees[n].address = "42 Wallaby Way, Perth";
+    if (trigram_index_insert(&idx, employees[n].address, n) == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    for (size_t i = 0; i < query_count; i++)
+    {
+        if (check_search(&idx, employees, queries[i]) == STATUS_ERROR)
+            return STATUS_ERROR;
+    }
+    if (check_search(&idx, employees, "Perth") == STATUS_ERROR)
+        return STATUS_ERROR;
+
+    free(slot_map);
+    free_trigram_index(&idx);
+    free(employees);
+    return STATUS_SUCCESS;
+}
+
+
+int main(void)
+{
+    printf("test_intersect_sorted_u16()...");
+    if (test_intersect_sorted_u16() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    printf("test_search()...");
+    if (test_search() == STATUS_ERROR)
+    {
+        printf("failed\n");
+        return STATUS_ERROR;
+    }
+    printf("passed\n");
+
+    return STATUS_SUCCESS;
+}